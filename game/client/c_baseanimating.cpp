@@ -695,6 +695,7 @@ C_BaseAnimating::C_BaseAnimating() :
 
 	m_iMostRecentModelBoneCounter = 0xFFFFFFFF;
 	m_iMostRecentBoneSetupRequest = g_iPreviousBoneCounter - 1;
+	m_nThreadedBoneSetupDepth = -1;
 	m_flLastBoneSetupTime = -FLT_MAX;
 
 	m_vecPreRagdollMins = vec3_origin;
@@ -2714,8 +2715,7 @@ ConVar cl_threaded_bone_setup("cl_threaded_bone_setup", "0", 0, "Enable parallel
 
 static void SetupBonesOnBaseAnimating( C_BaseAnimating *&pBaseAnimating )
 {
-	if ( !pBaseAnimating->GetMoveParent() )
-		pBaseAnimating->SetupBones( NULL, -1, -1, gpGlobals->curtime );
+	pBaseAnimating->SetupBones( NULL, -1, -1, gpGlobals->curtime );
 }
 
 static void PreThreadedBoneSetup()
@@ -2730,6 +2730,7 @@ static void PostThreadedBoneSetup()
 
 static bool g_bInThreadedBoneSetup;
 static bool g_bDoThreadedBoneSetup;
+static int g_nThreadedBoneSetupDepth;
 
 void C_BaseAnimating::InitBoneSetupThreadPool()
 {
@@ -2744,14 +2745,74 @@ void C_BaseAnimating::ThreadedBoneSetup()
 	g_bDoThreadedBoneSetup = cl_threaded_bone_setup.GetBool();
 	if ( g_bDoThreadedBoneSetup )
 	{
+		// Move children read their parent's bones (bone merge, attachments), so the animating
+		// parents of everything asked for last frame need to be set up this frame too.
+		for ( int i = 0; i < g_PreviousBoneSetups.Count(); i++ )
+		{
+			for ( C_BaseEntity *pParent = g_PreviousBoneSetups[i]->GetMoveParent(); pParent; pParent = pParent->GetMoveParent() )
+			{
+				C_BaseAnimating *pAnimating = pParent->GetBaseAnimating();
+				if ( pAnimating && pAnimating->m_iMostRecentBoneSetupRequest != g_iPreviousBoneCounter )
+				{
+					pAnimating->m_iMostRecentBoneSetupRequest = g_iPreviousBoneCounter;
+					g_PreviousBoneSetups.AddToTail( pAnimating );
+				}
+			}
+		}
+
 		int nCount = g_PreviousBoneSetups.Count();
 		if ( nCount > 1 )
 		{
+			// Order by depth in the move hierarchy. Entities at the same depth don't depend on
+			// each other, so each depth is set up in parallel once the one above it is done.
+			int nMaxDepth = 0;
+			for ( int i = 0; i < nCount; i++ )
+			{
+				C_BaseAnimating *pAnimating = g_PreviousBoneSetups[i];
+				pAnimating->m_nThreadedBoneSetupDepth = 0;
+				for ( C_BaseEntity *pParent = pAnimating->GetMoveParent(); pParent; pParent = pParent->GetMoveParent() )
+				{
+					pAnimating->m_nThreadedBoneSetupDepth++;
+				}
+				nMaxDepth = MAX( nMaxDepth, pAnimating->m_nThreadedBoneSetupDepth );
+			}
+
+			CUtlVector< C_BaseAnimating * > orderedSetups;
+			orderedSetups.EnsureCapacity( nCount );
+			CUtlVector< int > firstAtDepth;
+			firstAtDepth.EnsureCapacity( nMaxDepth + 2 );
+			for ( int nDepth = 0; nDepth <= nMaxDepth; nDepth++ )
+			{
+				firstAtDepth.AddToTail( orderedSetups.Count() );
+				for ( int i = 0; i < nCount; i++ )
+				{
+					if ( g_PreviousBoneSetups[i]->m_nThreadedBoneSetupDepth == nDepth )
+					{
+						orderedSetups.AddToTail( g_PreviousBoneSetups[i] );
+					}
+				}
+			}
+			firstAtDepth.AddToTail( nCount );
+
 			g_bInThreadedBoneSetup = true;
 
-			ParallelProcess( "C_BaseAnimating::ThreadedBoneSetup", g_PreviousBoneSetups.Base(), nCount, &SetupBonesOnBaseAnimating, &PreThreadedBoneSetup, &PostThreadedBoneSetup );
+			for ( int nDepth = 0; nDepth <= nMaxDepth; nDepth++ )
+			{
+				int nFirst = firstAtDepth[nDepth];
+				int nDepthCount = firstAtDepth[nDepth + 1] - nFirst;
+				if ( nDepthCount == 0 )
+					continue;
+
+				g_nThreadedBoneSetupDepth = nDepth;
+				ParallelProcess( "C_BaseAnimating::ThreadedBoneSetup", orderedSetups.Base() + nFirst, nDepthCount, &SetupBonesOnBaseAnimating, &PreThreadedBoneSetup, &PostThreadedBoneSetup );
+			}
 
 			g_bInThreadedBoneSetup = false;
+
+			for ( int i = 0; i < nCount; i++ )
+			{
+				g_PreviousBoneSetups[i]->m_nThreadedBoneSetupDepth = -1;
+			}
 		}
 	}
 	g_iPreviousBoneCounter++;
@@ -2807,7 +2868,11 @@ bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, i
 		boneMask |= BONE_USED_BY_ANYTHING;
 	}
 
-	if ( g_bInThreadedBoneSetup )
+	// Entities from a depth of the threaded pass that has already finished are only being read
+	// by their move children, which can safely wait on each other. Anything else gives up
+	// rather than risk waiting on a thread that is waiting on it.
+	bool bTryLock = g_bInThreadedBoneSetup && ( m_nThreadedBoneSetupDepth < 0 || m_nThreadedBoneSetupDepth >= g_nThreadedBoneSetupDepth );
+	if ( bTryLock )
 	{
 		if ( !m_BoneSetupLock.TryLock() )
 		{
@@ -2831,7 +2896,7 @@ bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, i
 
 	AUTO_LOCK( m_BoneSetupLock );
 
-	if ( g_bInThreadedBoneSetup )
+	if ( bTryLock )
 	{
 		m_BoneSetupLock.Unlock();
 	}
@@ -2859,7 +2924,7 @@ bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, i
 	}
 
 	int nBoneCount = m_CachedBoneData.Count();
-	if ( g_bDoThreadedBoneSetup && !g_bInThreadedBoneSetup && ( nBoneCount >= 16 ) && !GetMoveParent() && m_iMostRecentBoneSetupRequest != g_iPreviousBoneCounter )
+	if ( g_bDoThreadedBoneSetup && !g_bInThreadedBoneSetup && ( nBoneCount >= 16 ) && m_iMostRecentBoneSetupRequest != g_iPreviousBoneCounter )
 	{
 		m_iMostRecentBoneSetupRequest = g_iPreviousBoneCounter;
 		Assert( g_PreviousBoneSetups.Find( this ) == -1 );
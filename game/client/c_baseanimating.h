@@ -384,6 +384,10 @@ public:
 	bool							IsBoneCacheValid() const;	// Returns true if the bone cache is considered good for this frame.
 	void							GetCachedBoneMatrix( int boneIndex, matrix3x4_t &out );
 
+	// When the bones last changed, or FLT_MAX if this model doesn't track it. SetupBones needs
+	// to be called if this is later than the last setup.
+	virtual float					LastBoneChangedTime() { return FLT_MAX; }
+
 	// Wrappers for CBoneAccessor.
 	const matrix3x4_t&				GetBone( int iBone ) const;
 	matrix3x4_t&					GetBoneForWrite( int iBone );
@@ -466,9 +470,6 @@ protected:
 	virtual bool					CalcAttachments();
 
 private:
-	// This method should return true if the bones have changed + SetupBones needs to be called
-	virtual float					LastBoneChangedTime() { return FLT_MAX; }
-
 	CBoneList*						RecordBones( CStudioHdr *hdr, matrix3x4_t *pBoneState );
 
 	bool							PutAttachment( int number, const matrix3x4_t &attachmentToWorld );
@@ -512,6 +513,7 @@ protected:
 	// bone transformation matrix
 	unsigned long					m_iMostRecentModelBoneCounter;
 	unsigned long					m_iMostRecentBoneSetupRequest;
+	int								m_nThreadedBoneSetupDepth;	// move parent depth in the threaded bone setup pass, -1 if not in it
 	int								m_iPrevBoneMask;
 	int								m_iAccumulatedBoneMask;
 
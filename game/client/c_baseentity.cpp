@@ -855,6 +855,9 @@ void C_BaseEntity::Interp_HierarchyUpdateInterpolationAmounts()
 
 inline int C_BaseEntity::Interp_Interpolate( VarMapping_t *map, float currentTime )
 {
+	// The blends are written back when this goes out of scope
+	CInterpolatedVarBatchScope batchScope;
+
 	int bNoMoreChanges = 1;
 	if ( currentTime < map->m_lastInterpolationTime )
 	{
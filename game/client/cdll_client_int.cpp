@@ -58,6 +58,7 @@
 #include "igameevents.h"
 #include "datacache/idatacache.h"
 #include "datacache/imdlcache.h"
+#include "bone_setup.h"
 #include "kbutton.h"
 #include "tier0/icommandline.h"
 #include "gamerules_register.h"
@@ -1709,6 +1710,8 @@ void CHLClient::LevelShutdown( void )
 	// Now do the post-entity shutdown of all systems
 	IGameSystem::LevelShutdownPostEntityAllSystems();
 
+	Studio_FlushDecodedAnimCache();
+
 	view->LevelShutdown();
 	beams->ClearBeams();
 	ParticleMgr()->RemoveAllEffects();
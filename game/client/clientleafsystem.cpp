@@ -32,7 +32,7 @@ class VMatrix;  // forward decl
 static ConVar cl_drawleaf("cl_drawleaf", "-1", FCVAR_CHEAT );
 static ConVar r_PortalTestEnts( "r_PortalTestEnts", "1", FCVAR_CHEAT, "Clip entities against portal frustums." );
 static ConVar r_portalsopenall( "r_portalsopenall", "0", FCVAR_CHEAT, "Open all portals" );
-static ConVar cl_threaded_client_leaf_system("cl_threaded_client_leaf_system", "0"  );
+static ConVar cl_threaded_client_leaf_system("cl_threaded_client_leaf_system", "0", 0, "Frustum cull renderables on the thread pool when building render lists." );
 
 
 DEFINE_FIXEDSIZE_ALLOCATOR( CClientRenderablesList, 1, CUtlMemoryPool::GROW_SLOW );
@@ -112,6 +112,7 @@ public:
 	virtual void CollateViewModelRenderables( CUtlVector< IClientRenderable * >& opaque, CUtlVector< IClientRenderable * >& translucent );
 	virtual void BuildRenderablesList( const SetupRenderInfo_t &info );
 			void CollateRenderablesInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t &info );
+			void CollateDetailObjectsInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t &info );
 	virtual void DrawStaticProps( bool enable );
 	virtual void DrawSmallEntities( bool enable );
 	virtual void EnableAlternateSorting( ClientRenderHandle_t handle, bool bEnable );
@@ -156,6 +157,12 @@ private:
 
 	void SortEntities(  const Vector &vecRenderOrigin, const Vector &vecRenderForward, CClientRenderablesList::CEntry *pEntities, int nEntities );
 
+	// Staged version of BuildRenderablesList, which culls on the thread pool
+	void BuildRenderablesListThreaded( const SetupRenderInfo_t &info );
+
+	// Returns the world space render bounds, computing them at most once a frame
+	void GetRenderableWorldSpaceAABB( ClientRenderHandle_t handle, Vector &absMins, Vector &absMaxs );
+
 	// Returns -1 if the renderable spans more than one area. If it's totally in one area, then this returns the leaf.
 	short GetRenderableArea( ClientRenderHandle_t handle );
 
@@ -188,6 +195,16 @@ private:
 	// Adds a shadow to a leaf/removes shadow from leaf
 	void RemoveShadowFromLeaves( ClientLeafShadowHandle_t handle );
 
+	struct RenderableInfo_t;
+	struct RenderableCandidate_t;
+
+	// Steps of collating a renderable in a leaf, shared by the serial and threaded builds
+	bool ShouldCollateRenderable( int leaf, RenderableInfo_t &renderable, const SetupRenderInfo_t &info, unsigned char *pAlpha );
+	bool IsRenderableCulled( const RenderableInfo_t &renderable, const Vector &absMins, const Vector &absMaxs, bool portalTestEnts );
+	void CollateRenderable( RenderableInfo_t &renderable, ClientRenderHandle_t handle, int worldListLeafIndex, 
+		const Vector &absMins, const Vector &absMaxs, unsigned char nAlpha, const SetupRenderInfo_t &info );
+	void CullRenderableCandidate( RenderableCandidate_t &candidate );
+
 	// Methods associated with the various bi-directional sets
 	static unsigned int& FirstRenderableInLeaf( int leaf ) 
 	{ 
@@ -286,6 +303,30 @@ private:
 		EnumResult_t *pNext;
 	};
 
+	// A renderable that passed the leaf tests, waiting to be frustum culled
+	struct RenderableCandidate_t
+	{
+		Vector					m_AbsMins;
+		Vector					m_AbsMaxs;
+		ClientRenderHandle_t	m_Handle;
+		unsigned char			m_nAlpha;
+		bool					m_bCulled;
+	};
+
+	enum
+	{
+		AABB_FRAME_INVALID = -1,
+		THREADED_CULL_MIN_CANDIDATES = 64,
+	};
+
+	// What the cached bounds of a renderable were computed from
+	struct RenderableAABBKey_t
+	{
+		const model_t			*m_pModel;
+		Vector					m_vecOrigin;
+		QAngle					m_angAngles;
+	};
+
 	struct EnumResultList_t
 	{
 		EnumResult_t *pHead;
@@ -313,6 +354,19 @@ private:
 	// Dirty list of renderables
 	CUtlVector< ClientRenderHandle_t >	m_DirtyRenderables;
 
+	// World space render bounds of each renderable, indexed by handle. They're kept out of
+	// RenderableInfo_t so they can be reused by all the views rendered in a frame.
+	CUtlVector< Vector >	m_RenderableAbsMins;
+	CUtlVector< Vector >	m_RenderableAbsMaxs;
+	CUtlVector< int >		m_RenderableAABBFrame;		// AABB_FRAME_INVALID if the renderable moved
+	CUtlVector< RenderableAABBKey_t >	m_RenderableAABBKey;
+
+	// Scratch for BuildRenderablesListThreaded
+	CUtlVector< RenderableCandidate_t >	m_RenderableCandidates;
+	CUtlVector< int >					m_LeafFirstCandidate;
+	bool								m_bCullPortalTestEnts;
+	bool								m_bBuildingRenderablesList;
+
 	// List of renderables in view model render groups
 	CUtlVector< ClientRenderHandle_t >	m_ViewModels;
 
@@ -436,7 +490,7 @@ void CalcRenderableWorldSpaceAABB_Fast( IClientRenderable *pRenderable, Vector &
 //-----------------------------------------------------------------------------
 // constructor, destructor
 //-----------------------------------------------------------------------------
-CClientLeafSystem::CClientLeafSystem() : m_DrawStaticProps(true), m_DrawSmallObjects(true)
+CClientLeafSystem::CClientLeafSystem() : m_DrawStaticProps(true), m_DrawSmallObjects(true), m_bBuildingRenderablesList(false)
 {
 	// Set up the bi-directional lists...
 	m_RenderablesInLeaf.Init( FirstRenderableInLeaf, FirstLeafInRenderable );
@@ -474,6 +528,10 @@ void CClientLeafSystem::LevelInitPreEntity()
 	m_ShadowsInLeaf.EnsureCapacity( 256 );
 	m_ShadowsOnRenderable.EnsureCapacity( 256 );
 	m_DirtyRenderables.EnsureCapacity( 256 );
+	m_RenderableAbsMins.EnsureCapacity( 1024 );
+	m_RenderableAbsMaxs.EnsureCapacity( 1024 );
+	m_RenderableAABBFrame.EnsureCapacity( 1024 );
+	m_RenderableAABBKey.EnsureCapacity( 1024 );
 
 	// Add all the leaves we'll need
 	int leafCount = engine->LevelLeafCount();
@@ -519,6 +577,12 @@ void CClientLeafSystem::LevelShutdownPostEntity()
 	m_ShadowsInLeaf.Purge();
 	m_ShadowsOnRenderable.Purge();
 	m_DirtyRenderables.Purge();
+	m_RenderableAbsMins.Purge();
+	m_RenderableAbsMaxs.Purge();
+	m_RenderableAABBFrame.Purge();
+	m_RenderableAABBKey.Purge();
+	m_RenderableCandidates.Purge();
+	m_LeafFirstCandidate.Purge();
 }
 
 
@@ -636,6 +700,15 @@ void CClientLeafSystem::NewRenderable( IClientRenderable* pRenderable, RenderGro
 		AddToViewModelList( handle );
 	}
 
+	if ( m_RenderableAABBFrame.Count() <= handle )
+	{
+		m_RenderableAbsMins.SetCount( handle + 1 );
+		m_RenderableAbsMaxs.SetCount( handle + 1 );
+		m_RenderableAABBFrame.SetCount( handle + 1 );
+		m_RenderableAABBKey.SetCount( handle + 1 );
+	}
+	m_RenderableAABBFrame[handle] = AABB_FRAME_INVALID;
+
 	pRenderable->RenderHandle() = handle;
 }
 
@@ -1258,6 +1331,8 @@ void CClientLeafSystem::RenderableChanged( ClientRenderHandle_t handle )
 	if ( !m_Renderables.IsValidIndex( handle ) )
 		return;
 
+	m_RenderableAABBFrame[handle] = AABB_FRAME_INVALID;
+
 	if ( (m_Renderables[handle].m_Flags & RENDER_FLAGS_HASCHANGED ) == 0 )
 	{
 		m_Renderables[handle].m_Flags |= RENDER_FLAGS_HASCHANGED;
@@ -1551,82 +1626,201 @@ static RenderGroup_t DetectBucketedRenderGroup( RenderGroup_t group, float fDime
 	return bucketedGroup;
 }
 
-void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafIndex,	const SetupRenderInfo_t &info )
+//-----------------------------------------------------------------------------
+// World space render bounds. Everything rendered in a frame shares them; static props
+// keep theirs until they're moved. Not everything that moves or changes model in the
+// middle of a frame calls RenderableChanged(), so the model and transform have to match too.
+//-----------------------------------------------------------------------------
+inline void CClientLeafSystem::GetRenderableWorldSpaceAABB( ClientRenderHandle_t handle, Vector &absMins, Vector &absMaxs )
 {
-	bool portalTestEnts = r_PortalTestEnts.GetBool() && !r_portalsopenall.GetBool();
-	
-	// Place a fake entity for static/opaque ents in this leaf
-	AddRenderableToRenderList( *info.m_pRenderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_STATIC, NULL );
-	AddRenderableToRenderList( *info.m_pRenderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, NULL );
+	IClientRenderable *pRenderable = m_Renderables[handle].m_pRenderable;
+	RenderableAABBKey_t &key = m_RenderableAABBKey[handle];
+	int &nFrame = m_RenderableAABBFrame[handle];
 
-	// Collate everything.
-	unsigned int idx = m_RenderablesInLeaf.FirstElement(leaf);
-	for ( ;idx != m_RenderablesInLeaf.InvalidIndex(); idx = m_RenderablesInLeaf.NextElement(idx) )
+	bool bValid = ( nFrame == gpGlobals->framecount ) ||
+		( nFrame != AABB_FRAME_INVALID && ( m_Renderables[handle].m_Flags & RENDER_FLAGS_STATIC_PROP ) );
+	if ( bValid )
 	{
-		ClientRenderHandle_t handle = m_RenderablesInLeaf.Element(idx);
-		RenderableInfo_t& renderable = m_Renderables[handle];
+		bValid = ( key.m_pModel == pRenderable->GetModel() ) &&
+			( key.m_vecOrigin == pRenderable->GetRenderOrigin() ) &&
+			( key.m_angAngles == pRenderable->GetRenderAngles() );
+	}
 
-		// Early out on static props if we don't want to render them
-		if ((!m_DrawStaticProps) && (renderable.m_Flags & RENDER_FLAGS_STATIC_PROP))
-			continue;
+	if ( !bValid )
+	{
+		CalcRenderableWorldSpaceAABB( pRenderable, m_RenderableAbsMins[handle], m_RenderableAbsMaxs[handle] );
+		key.m_pModel = pRenderable->GetModel();
+		key.m_vecOrigin = pRenderable->GetRenderOrigin();
+		key.m_angAngles = pRenderable->GetRenderAngles();
+		nFrame = gpGlobals->framecount;
+	}
 
-		// Early out if we're told to not draw small objects (top view only,
-		/* that's why we don't check the z component).
-		if (!m_DrawSmallObjects)
-		{
-			CCachedRenderInfo& cachedInfo =  m_CachedRenderInfos[renderable.m_CachedRenderInfo];
-			float sizeX = cachedInfo.m_Maxs.x - cachedInfo.m_Mins.x;
-			float sizeY = cachedInfo.m_Maxs.y - cachedInfo.m_Mins.y;
-			if ((sizeX < 50.f) && (sizeY < 50.f))
-				continue;
-		}*/
+	absMins = m_RenderableAbsMins[handle];
+	absMaxs = m_RenderableAbsMaxs[handle];
+}
 
-		Assert( m_DrawSmallObjects ); // MOTODO
 
-		// Don't hit the same ent in multiple leaves twice.
-		if ( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
-		{
-			if ( renderable.m_RenderFrame2 == info.m_nRenderFrame )
-				continue;
+//-----------------------------------------------------------------------------
+// Leaf tests of CollateRenderablesInLeaf. Returns false if the renderable shouldn't be
+// added for this leaf. Not thread safe: this marks the renderable as seen this frame.
+//-----------------------------------------------------------------------------
+inline bool CClientLeafSystem::ShouldCollateRenderable( int leaf, RenderableInfo_t &renderable, const SetupRenderInfo_t &info, unsigned char *pAlpha )
+{
+	// Early out on static props if we don't want to render them
+	if ((!m_DrawStaticProps) && (renderable.m_Flags & RENDER_FLAGS_STATIC_PROP))
+		return false;
 
-			renderable.m_RenderFrame2 = info.m_nRenderFrame;
-		}
-		else // translucent
+	// Early out if we're told to not draw small objects (top view only,
+	/* that's why we don't check the z component).
+	if (!m_DrawSmallObjects)
+	{
+		CCachedRenderInfo& cachedInfo =  m_CachedRenderInfos[renderable.m_CachedRenderInfo];
+		float sizeX = cachedInfo.m_Maxs.x - cachedInfo.m_Mins.x;
+		float sizeY = cachedInfo.m_Maxs.y - cachedInfo.m_Mins.y;
+		if ((sizeX < 50.f) && (sizeY < 50.f))
+			return false;
+	}*/
+
+	Assert( m_DrawSmallObjects ); // MOTODO
+
+	// Don't hit the same ent in multiple leaves twice.
+	if ( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
+	{
+		if ( renderable.m_RenderFrame2 == info.m_nRenderFrame )
+			return false;
+
+		renderable.m_RenderFrame2 = info.m_nRenderFrame;
+	}
+	else // translucent
+	{
+		// Shadow depth skips ComputeTranslucentRenderLeaf!
+
+		// Translucent entities already have had ComputeTranslucentRenderLeaf called on them
+		// so m_RenderLeaf should be set to the nearest leaf, so that's what we want here.
+		if ( renderable.m_RenderLeaf != leaf )
+			return false;
+	}
+
+	*pAlpha = 255;
+	if ( info.m_bDrawTranslucentObjects ) 
+	{
+		// Prevent culling if the renderable is invisible
+		// NOTE: OPAQUE objects can have alpha == 0. 
+		// They are made to be opaque because they don't have to be sorted.
+		*pAlpha = renderable.m_pRenderable->GetFxBlend();
+		if ( *pAlpha == 0 )
+			return false;
+	}
+
+#ifdef INVASION_CLIENT_DLL
+	if (info.m_flRenderDistSq != 0.0f)
+	{
+		Vector mins, maxs;
+		renderable.m_pRenderable->GetRenderBounds( mins, maxs );
+
+		if ((maxs.z - mins.z) < 100)
 		{
-			// Shadow depth skips ComputeTranslucentRenderLeaf!
+			Vector vCenter;
+			VectorLerp( mins, maxs, 0.5f, vCenter );
+			vCenter += renderable.m_pRenderable->GetRenderOrigin();
 
-			// Translucent entities already have had ComputeTranslucentRenderLeaf called on them
-			// so m_RenderLeaf should be set to the nearest leaf, so that's what we want here.
-			if ( renderable.m_RenderLeaf != leaf )
-				continue;
+			float flDistSq = info.m_vecRenderOrigin.DistToSqr( vCenter );
+			if (info.m_flRenderDistSq <= flDistSq)
+				return false;
 		}
+	}
+#endif
 
-		unsigned char nAlpha = 255;
-		if ( info.m_bDrawTranslucentObjects ) 
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Frustum tests. Only reads the renderable, so this may run on any thread.
+//-----------------------------------------------------------------------------
+inline bool CClientLeafSystem::IsRenderableCulled( const RenderableInfo_t &renderable, const Vector &absMins, const Vector &absMaxs, bool portalTestEnts )
+{
+	// If the renderable is inside an area, cull it using the frustum for that area.
+	if ( portalTestEnts && renderable.m_Area != -1 )
+	{
+		return !engine->DoesBoxTouchAreaFrustum( absMins, absMaxs, renderable.m_Area );
+	}
+
+	// cull with main frustum
+	return engine->CullBox( absMins, absMaxs );
+}
+
+
+//-----------------------------------------------------------------------------
+// Adds a visible renderable to the render lists
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CollateRenderable( RenderableInfo_t &renderable, ClientRenderHandle_t handle, int worldListLeafIndex, 
+	const Vector &absMins, const Vector &absMaxs, unsigned char nAlpha, const SetupRenderInfo_t &info )
+{
+	if( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
+	{
+		RenderGroup_t group = (RenderGroup_t)renderable.m_RenderGroup;
+
+		// Determine object group offset
+		if ( RENDER_GROUP_CFG_NUM_OPAQUE_ENT_BUCKETS > 1 &&
+			 group >= RENDER_GROUP_OPAQUE_STATIC &&
+			 group <= RENDER_GROUP_OPAQUE_ENTITY )
 		{
-			// Prevent culling if the renderable is invisible
-			// NOTE: OPAQUE objects can have alpha == 0. 
-			// They are made to be opaque because they don't have to be sorted.
-			nAlpha = renderable.m_pRenderable->GetFxBlend();
-			if ( nAlpha == 0 )
-				continue;
+			Vector dims;
+			VectorSubtract( absMaxs, absMins, dims );
+
+			float const fDimension = MAX( MAX( fabs(dims.x), fabs(dims.y) ), fabs(dims.z) );
+			group = DetectBucketedRenderGroup( group, fDimension );
+			
+			Assert( group >= RENDER_GROUP_OPAQUE_STATIC_HUGE && group <= RENDER_GROUP_OPAQUE_ENTITY );
 		}
 
-		Vector absMins, absMaxs;
-		CalcRenderableWorldSpaceAABB( renderable.m_pRenderable, absMins, absMaxs );
-		// If the renderable is inside an area, cull it using the frustum for that area.
-		if ( portalTestEnts && renderable.m_Area != -1 )
+		AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
+			worldListLeafIndex, group, handle);
+	}
+	else
+	{
+		bool bTwoPass = ((renderable.m_Flags & RENDER_FLAGS_TWOPASS) != 0) && ( nAlpha == 255 );	// Two pass?
+
+		// Add to appropriate list if drawing translucent objects (shadow depth mapping will skip this)
+		if ( info.m_bDrawTranslucentObjects ) 
 		{
-			VPROF( "r_PortalTestEnts" );
-			if ( !engine->DoesBoxTouchAreaFrustum( absMins, absMaxs, renderable.m_Area ) )
-				continue;
+			AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
+				worldListLeafIndex, (RenderGroup_t)renderable.m_RenderGroup, handle, bTwoPass );
 		}
-		else
+		
+		if ( bTwoPass )	// Also add to opaque list if it's a two-pass model... 
 		{
-			// cull with main frustum
-			if ( engine->CullBox( absMins, absMaxs ) )
-				continue;
+			AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
+				worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, handle, bTwoPass );
 		}
+	}
+}
+
+
+void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafIndex,	const SetupRenderInfo_t &info )
+{
+	bool portalTestEnts = r_PortalTestEnts.GetBool() && !r_portalsopenall.GetBool();
+	
+	// Place a fake entity for static/opaque ents in this leaf
+	AddRenderableToRenderList( *info.m_pRenderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_STATIC, NULL );
+	AddRenderableToRenderList( *info.m_pRenderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, NULL );
+
+	// Collate everything.
+	unsigned int idx = m_RenderablesInLeaf.FirstElement(leaf);
+	for ( ;idx != m_RenderablesInLeaf.InvalidIndex(); idx = m_RenderablesInLeaf.NextElement(idx) )
+	{
+		ClientRenderHandle_t handle = m_RenderablesInLeaf.Element(idx);
+		RenderableInfo_t& renderable = m_Renderables[handle];
+
+		unsigned char nAlpha;
+		if ( !ShouldCollateRenderable( leaf, renderable, info, &nAlpha ) )
+			continue;
+
+		Vector absMins, absMaxs;
+		GetRenderableWorldSpaceAABB( handle, absMins, absMaxs );
+		if ( IsRenderableCulled( renderable, absMins, absMaxs, portalTestEnts ) )
+			continue;
 
 		// UNDONE: Investigate speed tradeoffs of occlusion culling brush models too?
 		if ( renderable.m_Flags & RENDER_FLAGS_STUDIO_MODEL )
@@ -1636,70 +1830,20 @@ void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafInd
 				continue;
 		}
 
-#ifdef INVASION_CLIENT_DLL
-		if (info.m_flRenderDistSq != 0.0f)
-		{
-			Vector mins, maxs;
-			renderable.m_pRenderable->GetRenderBounds( mins, maxs );
-
-			if ((maxs.z - mins.z) < 100)
-			{
-				Vector vCenter;
-				VectorLerp( mins, maxs, 0.5f, vCenter );
-				vCenter += renderable.m_pRenderable->GetRenderOrigin();
-
-				float flDistSq = info.m_vecRenderOrigin.DistToSqr( vCenter );
-				if (info.m_flRenderDistSq <= flDistSq)
-					continue;
-			}
-		}
-#endif
-
-		if( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
-		{
-			RenderGroup_t group = (RenderGroup_t)renderable.m_RenderGroup;
-
-			// Determine object group offset
-			if ( RENDER_GROUP_CFG_NUM_OPAQUE_ENT_BUCKETS > 1 &&
-				 group >= RENDER_GROUP_OPAQUE_STATIC &&
-				 group <= RENDER_GROUP_OPAQUE_ENTITY )
-			{
-				Vector dims;
-				VectorSubtract( absMaxs, absMins, dims );
+		CollateRenderable( renderable, handle, worldListLeafIndex, absMins, absMaxs, nAlpha, info );
+	}
 
-				float const fDimension = MAX( MAX( fabs(dims.x), fabs(dims.y) ), fabs(dims.z) );
-				group = DetectBucketedRenderGroup( group, fDimension );
-				
-				Assert( group >= RENDER_GROUP_OPAQUE_STATIC_HUGE && group <= RENDER_GROUP_OPAQUE_ENTITY );
-			}
+	CollateDetailObjectsInLeaf( leaf, worldListLeafIndex, info );
+}
 
-			AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
-				worldListLeafIndex, group, handle);
-		}
-		else
-		{
-			bool bTwoPass = ((renderable.m_Flags & RENDER_FLAGS_TWOPASS) != 0) && ( nAlpha == 255 );	// Two pass?
-
-			// Add to appropriate list if drawing translucent objects (shadow depth mapping will skip this)
-			if ( info.m_bDrawTranslucentObjects ) 
-			{
-				AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
-					worldListLeafIndex, (RenderGroup_t)renderable.m_RenderGroup, handle, bTwoPass );
-			}
-			
-			if ( bTwoPass )	// Also add to opaque list if it's a two-pass model... 
-			{
-				AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
-					worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, handle, bTwoPass );
-			}
-		}
-	}
 
+void CClientLeafSystem::CollateDetailObjectsInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t &info )
+{
 	// Do detail objects.
 	// These don't have render handles!
 	if ( info.m_bDrawDetailObjects && ShouldDrawDetailObjectsInLeaf( leaf, info.m_nDetailBuildFrame ) )
 	{
-		idx = m_Leaf[leaf].m_FirstDetailProp;
+		int idx = m_Leaf[leaf].m_FirstDetailProp;
 		int count = m_Leaf[leaf].m_DetailPropCount;
 		while( --count >= 0 )
 		{
@@ -1793,6 +1937,16 @@ void CClientLeafSystem::SortEntities( const Vector &vecRenderOrigin, const Vecto
 void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t &info )
 {
 	VPROF_BUDGET( "BuildRenderablesList", "BuildRenderablesList" );
+
+	// The scratch lists can't be shared if a view gets built while building another one
+	if ( cl_threaded_client_leaf_system.GetBool() && g_pThreadPool->NumThreads() && !m_bBuildingRenderablesList )
+	{
+		m_bBuildingRenderablesList = true;
+		BuildRenderablesListThreaded( info );
+		m_bBuildingRenderablesList = false;
+		return;
+	}
+
 	int leafCount = info.m_pWorldListInfo->m_LeafCount;
 	const Vector &vecRenderOrigin = info.m_vecRenderOrigin;
 	const Vector &vecRenderForward = info.m_vecRenderForward;
@@ -1814,3 +1968,117 @@ void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t &info )
 		}
 	}
 }
+
+
+//-----------------------------------------------------------------------------
+// Frustum culls a candidate. Called from the thread pool.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CullRenderableCandidate( RenderableCandidate_t &candidate )
+{
+	candidate.m_bCulled = IsRenderableCulled( m_Renderables[candidate.m_Handle], candidate.m_AbsMins, candidate.m_AbsMaxs, m_bCullPortalTestEnts );
+}
+
+
+//-----------------------------------------------------------------------------
+// Builds the same lists as the serial version, in three stages:
+// gather walks the leaves on this thread, doing the leaf tests and fetching bounds (which
+// may touch the entity hierarchy), cull runs the frustum tests on the thread pool, and
+// merge adds the survivors leaf by leaf, in the original order, so the result doesn't
+// depend on how the work was split up. Occlusion tests stay in the merge.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::BuildRenderablesListThreaded( const SetupRenderInfo_t &info )
+{
+	int leafCount = info.m_pWorldListInfo->m_LeafCount;
+	const Vector &vecRenderOrigin = info.m_vecRenderOrigin;
+	const Vector &vecRenderForward = info.m_vecRenderForward;
+	CClientRenderablesList::CEntry *pTranslucentEntries = info.m_pRenderList->m_RenderGroups[RENDER_GROUP_TRANSLUCENT_ENTITY];
+	int &nTranslucentEntries = info.m_pRenderList->m_RenderGroupCounts[RENDER_GROUP_TRANSLUCENT_ENTITY];
+
+	m_RenderableCandidates.RemoveAll();
+	m_LeafFirstCandidate.SetCount( leafCount + 1 );
+
+	{
+		VPROF( "BuildRenderablesList - gather" );
+		for( int i = 0; i < leafCount; i++ )
+		{
+			int leaf = info.m_pWorldListInfo->m_pLeafList[i];
+			m_LeafFirstCandidate[i] = m_RenderableCandidates.Count();
+
+			unsigned int idx = m_RenderablesInLeaf.FirstElement(leaf);
+			for ( ;idx != m_RenderablesInLeaf.InvalidIndex(); idx = m_RenderablesInLeaf.NextElement(idx) )
+			{
+				ClientRenderHandle_t handle = m_RenderablesInLeaf.Element(idx);
+				RenderableInfo_t& renderable = m_Renderables[handle];
+
+				unsigned char nAlpha;
+				if ( !ShouldCollateRenderable( leaf, renderable, info, &nAlpha ) )
+					continue;
+
+				RenderableCandidate_t &candidate = m_RenderableCandidates[ m_RenderableCandidates.AddToTail() ];
+				GetRenderableWorldSpaceAABB( handle, candidate.m_AbsMins, candidate.m_AbsMaxs );
+				candidate.m_Handle = handle;
+				candidate.m_nAlpha = nAlpha;
+				candidate.m_bCulled = false;
+			}
+		}
+		m_LeafFirstCandidate[leafCount] = m_RenderableCandidates.Count();
+	}
+
+	{
+		VPROF( "BuildRenderablesList - cull" );
+		m_bCullPortalTestEnts = r_PortalTestEnts.GetBool() && !r_portalsopenall.GetBool();
+
+		int nCandidates = m_RenderableCandidates.Count();
+		if ( nCandidates >= THREADED_CULL_MIN_CANDIDATES )
+		{
+			ParallelProcess( "CClientLeafSystem::BuildRenderablesList", m_RenderableCandidates.Base(), nCandidates, this, &CClientLeafSystem::CullRenderableCandidate );
+		}
+		else
+		{
+			for ( int i = 0; i < nCandidates; i++ )
+			{
+				CullRenderableCandidate( m_RenderableCandidates[i] );
+			}
+		}
+	}
+
+	{
+		VPROF( "BuildRenderablesList - merge" );
+		for( int i = 0; i < leafCount; i++ )
+		{
+			int nTranslucent = nTranslucentEntries;
+
+			// Place a fake entity for static/opaque ents in this leaf
+			AddRenderableToRenderList( *info.m_pRenderList, NULL, i, RENDER_GROUP_OPAQUE_STATIC, NULL );
+			AddRenderableToRenderList( *info.m_pRenderList, NULL, i, RENDER_GROUP_OPAQUE_ENTITY, NULL );
+
+			for ( int j = m_LeafFirstCandidate[i]; j < m_LeafFirstCandidate[i+1]; j++ )
+			{
+				const RenderableCandidate_t &candidate = m_RenderableCandidates[j];
+				if ( candidate.m_bCulled )
+					continue;
+
+				RenderableInfo_t& renderable = m_Renderables[candidate.m_Handle];
+
+				// UNDONE: Investigate speed tradeoffs of occlusion culling brush models too?
+				if ( renderable.m_Flags & RENDER_FLAGS_STUDIO_MODEL )
+				{
+					// test to see if this renderable is occluded by the engine's occlusion system
+					if ( engine->IsOccluded( candidate.m_AbsMins, candidate.m_AbsMaxs ) )
+						continue;
+				}
+
+				CollateRenderable( renderable, candidate.m_Handle, i, candidate.m_AbsMins, candidate.m_AbsMaxs, candidate.m_nAlpha, info );
+			}
+
+			CollateDetailObjectsInLeaf( info.m_pWorldListInfo->m_pLeafList[i], i, info );
+
+			int nNewTranslucent = nTranslucentEntries - nTranslucent;
+			if( (nNewTranslucent != 0 ) && info.m_bDrawTranslucentObjects )
+			{
+				// Sort the new translucent entities.
+				SortEntities( vecRenderOrigin, vecRenderForward, &pTranslucentEntries[nTranslucent], nNewTranslucent );
+			}
+		}
+	}
+}
@@ -683,6 +683,12 @@ void CTextureAllocator::GetTextureRect(TextureHandle_t handle, int& x, int& y, i
 
 static ConVar r_shadows( "r_shadows", "1" ); // hook into engine's cvars..
 static ConVar r_shadowmaxrendered("r_shadowmaxrendered", "32");
+static ConVar r_shadow_dirty_tracking( "r_shadow_dirty_tracking", "1", 0, "Only redraw animating render-to-texture shadows when the caster's bones or transform change" );
+static ConVar r_shadow_redraw_budget( "r_shadow_redraw_budget", "0", 0, "Max render-to-texture shadows to redraw per frame, largest on screen first (0 = no limit)" );
+static ConVar r_shadow_redraw_budget_ms( "r_shadow_redraw_budget_ms", "0", 0, "Max milliseconds to spend redrawing render-to-texture shadows per frame (0 = no limit)" );
+static ConVar r_shadow_amortize_area( "r_shadow_amortize_area", "0", 0, "Render-to-texture shadows smaller than this many pixels on screen are redrawn every r_shadow_amortize_frames frames (0 = off)" );
+static ConVar r_shadow_amortize_frames( "r_shadow_amortize_frames", "4" );
+static ConVar r_shadow_max_stale_frames( "r_shadow_max_stale_frames", "8", 0, "A dirty render-to-texture shadow is never left undrawn for longer than this many frames" );
 static ConVar r_shadows_gamecontrol( "r_shadows_gamecontrol", "-1", FCVAR_CHEAT );	 // hook into engine's cvars..
 
 //-----------------------------------------------------------------------------
@@ -817,6 +823,12 @@ private:
 		CTextureReference		m_ShadowDepthTexture;
 		int						m_nRenderFrame;
 		EHANDLE					m_hTargetEntity;
+
+		// State of the caster when the render-to-texture shadow was last drawn
+		int						m_nTextureDrawFrame;	// -1 if the texture has no valid contents
+		float					m_flTextureDrawTime;
+		matrix3x4_t				m_TextureRenderTransform;
+		VMatrix					m_TextureWorldToShadow;
 	};
 
 private:
@@ -891,6 +903,12 @@ private:
 	bool DrawRenderToTextureShadow( unsigned short clientShadowHandle, float flArea );
 	void DrawRenderToTextureShadowLOD( unsigned short clientShadowHandle );
 
+	// Dirty tracking and redraw budgeting for render-to-texture shadows
+	void CheckAnimatingSourceDirty( ClientShadowHandle_t handle );
+	bool HasAnimatingSourceChanged( ClientShadowHandle_t handle ) const;
+	bool ShouldDeferRenderToTextureShadow( ClientShadowHandle_t handle, float flArea ) const;
+	void InvalidateRenderToTextureShadows();
+
 	// Draws all children shadows into our own
 	bool DrawShadowHierarchy( IClientRenderable *pRenderable, const ClientShadow_t &shadow, bool bChild = false );
 
@@ -958,6 +976,8 @@ private:
 	bool m_bRenderTargetNeedsClear;
 	bool m_bUpdatingDirtyShadows;
 	bool m_bThreaded;
+	int m_nRenderToTextureRedraws;			// render-to-texture shadows redrawn so far this frame
+	double m_flRenderToTextureStartTime;
 	float m_flShadowCastDist;
 	float m_flMinShadowArea;
 	CUtlRBTree< ClientShadowHandle_t, unsigned short >	m_DirtyShadows;
@@ -1172,6 +1192,8 @@ CClientShadowMgr::CClientShadowMgr() :
 {
 	m_nDepthTextureResolution = r_flashlightdepthres.GetInt();
 	m_bThreaded = false;
+	m_nRenderToTextureRedraws = 0;
+	m_flRenderToTextureStartTime = 0.0;
 }
 
 
@@ -1423,6 +1445,7 @@ void CClientShadowMgr::InitRenderToTextureShadows()
 
 		m_ShadowAllocator.Reset();
 		m_bRenderTargetNeedsClear = true;
+		InvalidateRenderToTextureShadows();
 
 		float fr = (float)m_AmbientLightColor.r / 255.0f;
 		float fg = (float)m_AmbientLightColor.g / 255.0f;
@@ -1572,6 +1595,7 @@ void CClientShadowMgr::RestoreRenderState()
 	{
 		m_Shadows[h].m_Flags |= SHADOW_FLAGS_TEXTURE_DIRTY;
 	}
+	InvalidateRenderToTextureShadows();
 
 	SetShadowColor( m_AmbientLightColor.r, m_AmbientLightColor.g, m_AmbientLightColor.b );
 	m_bRenderTargetNeedsClear = true;
@@ -1818,6 +1842,8 @@ ClientShadowHandle_t CClientShadowMgr::CreateProjectedTexture( ClientEntityHandl
 	shadow.m_ClientLeafShadowHandle = ClientLeafSystem()->AddShadow( h, flags );
 	shadow.m_Flags = flags;
 	shadow.m_nRenderFrame = -1;
+	shadow.m_nTextureDrawFrame = -1;
+	shadow.m_flTextureDrawTime = -FLT_MAX;
 	shadow.m_LastOrigin.Init( FLT_MAX, FLT_MAX, FLT_MAX );
 	shadow.m_LastAngles.Init( FLT_MAX, FLT_MAX, FLT_MAX );
 	Assert( ( ( shadow.m_Flags & SHADOW_FLAGS_FLASHLIGHT ) == 0 ) != 
@@ -3703,6 +3729,8 @@ bool CClientShadowMgr::DrawShadowHierarchy( IClientRenderable *pRenderable, cons
 //-----------------------------------------------------------------------------
 bool CClientShadowMgr::BuildSetupListForRenderToTextureShadow( unsigned short clientShadowHandle, float flArea )
 {
+	CheckAnimatingSourceDirty( clientShadowHandle );
+
 	ClientShadow_t& shadow = m_Shadows[clientShadowHandle];
 	bool bDirtyTexture = (shadow.m_Flags & SHADOW_FLAGS_TEXTURE_DIRTY) != 0;
 	bool bNeedsRedraw = m_ShadowAllocator.UseTexture( shadow.m_ShadowTexture, bDirtyTexture, flArea );
@@ -3737,17 +3765,27 @@ bool CClientShadowMgr::DrawRenderToTextureShadow( unsigned short clientShadowHan
 		shadowmgr->SetShadowMaterial( shadow.m_ShadowHandle, m_RenderShadow, m_RenderModelShadow, (void*)(uintp)clientShadowHandle );
 	}
 
-	// Mark texture as being used...
+	CheckAnimatingSourceDirty( clientShadowHandle );
+
+	// A dirty shadow that's over budget keeps its current texture, if it still has one
 	bool bDirtyTexture = (shadow.m_Flags & SHADOW_FLAGS_TEXTURE_DIRTY) != 0;
+	bool bDeferRedraw = bDirtyTexture && !bPreviouslyUsingLODShadow && !m_bThreaded && ShouldDeferRenderToTextureShadow( clientShadowHandle, flArea );
+
+	// Mark texture as being used...
 	bool bDrewTexture = false;
-	bool bNeedsRedraw = ( !m_bThreaded && m_ShadowAllocator.UseTexture( shadow.m_ShadowTexture, bDirtyTexture, flArea ) );
+	bool bNeedsRedraw = ( !m_bThreaded && m_ShadowAllocator.UseTexture( shadow.m_ShadowTexture, bDirtyTexture && !bDeferRedraw, flArea ) );
 
 	if ( !m_ShadowAllocator.HasValidTexture( shadow.m_ShadowTexture ) )
 	{
+		shadow.m_nTextureDrawFrame = -1;
 		DrawRenderToTextureShadowLOD( clientShadowHandle );
 		return false;
 	}
 
+	// It stays dirty, and is picked up again on a later frame
+	if ( bDeferRedraw && !bNeedsRedraw )
+		return false;
+
 	if ( bNeedsRedraw || bDirtyTexture )
 	{
 		// shadow to be redrawn; for now, we'll always do it.
@@ -3784,12 +3822,19 @@ bool CClientShadowMgr::DrawRenderToTextureShadow( unsigned short clientShadowHan
 			DevMsg( "Didn't draw shadow hierarchy.. bad shadow texcoords probably going to happen..grab Brian!\n" );
 		}
 
-		// Only clear the dirty flag if the caster isn't animating
-		if ( (shadow.m_Flags & SHADOW_FLAGS_ANIMATING_SOURCE) == 0 )
+		// Only clear the dirty flag if the caster isn't animating, or if
+		// CheckAnimatingSourceDirty will tell us when it changes
+		if ( (shadow.m_Flags & SHADOW_FLAGS_ANIMATING_SOURCE) == 0 || r_shadow_dirty_tracking.GetBool() )
 		{
 			shadow.m_Flags &= ~SHADOW_FLAGS_TEXTURE_DIRTY;
 		}
 
+		shadow.m_nTextureDrawFrame = gpGlobals->framecount;
+		shadow.m_flTextureDrawTime = gpGlobals->curtime;
+		MatrixCopy( pRenderable->RenderableToWorldTransform(), shadow.m_TextureRenderTransform );
+		shadow.m_TextureWorldToShadow = shadowmgr->GetInfo( shadow.m_ShadowHandle ).m_WorldToShadow;
+		++m_nRenderToTextureRedraws;
+
 		SetRenderToTextureShadowTexCoords( shadow.m_ShadowHandle, x, y, w, h );
 	}
 	else if ( bPreviouslyUsingLODShadow )
@@ -3805,6 +3850,88 @@ bool CClientShadowMgr::DrawRenderToTextureShadow( unsigned short clientShadowHan
 }
 
 
+//-----------------------------------------------------------------------------
+// Animating casters keep their texture until their bones or transform change
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::CheckAnimatingSourceDirty( ClientShadowHandle_t handle )
+{
+	ClientShadow_t &shadow = m_Shadows[handle];
+	if ( ( shadow.m_Flags & ( SHADOW_FLAGS_ANIMATING_SOURCE | SHADOW_FLAGS_TEXTURE_DIRTY ) ) != SHADOW_FLAGS_ANIMATING_SOURCE )
+		return;
+
+	if ( HasAnimatingSourceChanged( handle ) )
+	{
+		shadow.m_Flags |= SHADOW_FLAGS_TEXTURE_DIRTY;
+	}
+}
+
+bool CClientShadowMgr::HasAnimatingSourceChanged( ClientShadowHandle_t handle ) const
+{
+	const ClientShadow_t &shadow = m_Shadows[handle];
+	if ( !r_shadow_dirty_tracking.GetBool() || shadow.m_nTextureDrawFrame < 0 )
+		return true;
+
+	// Children drawn into this shadow can change without us hearing about it
+	IClientRenderable *pRenderable = ClientEntityList().GetClientRenderableFromHandle( shadow.m_Entity );
+	if ( !pRenderable || pRenderable->FirstShadowChild() )
+		return true;
+
+	// Models that can't say when their bones last changed report FLT_MAX here
+	C_BaseEntity *pEntity = pRenderable->GetIClientUnknown()->GetBaseEntity();
+	C_BaseAnimating *pAnimating = pEntity ? pEntity->GetBaseAnimating() : NULL;
+	if ( !pAnimating || pAnimating->LastBoneChangedTime() >= shadow.m_flTextureDrawTime )
+		return true;
+
+	if ( memcmp( &pRenderable->RenderableToWorldTransform(), &shadow.m_TextureRenderTransform, sizeof( matrix3x4_t ) ) )
+		return true;
+
+	return memcmp( &shadowmgr->GetInfo( shadow.m_ShadowHandle ).m_WorldToShadow, &shadow.m_TextureWorldToShadow, sizeof( VMatrix ) ) != 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Can this dirty shadow keep showing its old texture this frame? Shadows are
+// drawn largest on screen first, so the redraw budget goes to those.
+//-----------------------------------------------------------------------------
+bool CClientShadowMgr::ShouldDeferRenderToTextureShadow( ClientShadowHandle_t handle, float flArea ) const
+{
+	const ClientShadow_t &shadow = m_Shadows[handle];
+	if ( shadow.m_nTextureDrawFrame < 0 )
+		return false;
+
+	int nStaleFrames = gpGlobals->framecount - shadow.m_nTextureDrawFrame;
+	if ( nStaleFrames >= r_shadow_max_stale_frames.GetInt() )
+		return false;
+
+	// Small shadows are redrawn every few frames. Each counts from its own last redraw, so they spread out.
+	int nAmortizeFrames = r_shadow_amortize_frames.GetInt();
+	if ( ( nAmortizeFrames > 1 ) && ( flArea < r_shadow_amortize_area.GetFloat() ) && ( nStaleFrames < nAmortizeFrames ) )
+		return true;
+
+	int nMaxRedraws = r_shadow_redraw_budget.GetInt();
+	if ( ( nMaxRedraws > 0 ) && ( m_nRenderToTextureRedraws >= nMaxRedraws ) )
+		return true;
+
+	float flMaxMs = r_shadow_redraw_budget_ms.GetFloat();
+	if ( ( flMaxMs > 0.0f ) && ( ( Plat_FloatTime() - m_flRenderToTextureStartTime ) * 1000.0f >= flMaxMs ) )
+		return true;
+
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// The render target was lost or reallocated, so no texture can be reused as is
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::InvalidateRenderToTextureShadows()
+{
+	for ( ClientShadowHandle_t i = m_Shadows.Head(); i != m_Shadows.InvalidIndex(); i = m_Shadows.Next(i) )
+	{
+		m_Shadows[i].m_nTextureDrawFrame = -1;
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // "Draws" the shadow LOD, which really means just set up the blobby shadow
 //-----------------------------------------------------------------------------
@@ -4046,6 +4173,9 @@ void CClientShadowMgr::ComputeShadowTextures( const CViewSetup &view, int leafCo
 	int nModelsRendered = 0;
 	int i;
 
+	m_nRenderToTextureRedraws = 0;
+	m_flRenderToTextureStartTime = Plat_FloatTime();
+
 	if ( m_bThreaded && g_pThreadPool->NumIdleThreads() )
 	{
 		s_NPCShadowBoneSetups.RemoveAll();
@@ -342,12 +342,30 @@ class CFastDetailLeafSpriteList : public CClientLeafSubSystemData
 	int m_nNumPendingSprites;
 	int m_nStartSpriteIndex;
 
+	// bounds of every quad in the leaf, for culling the leaf as a whole
+	Vector m_vecMins;
+	Vector m_vecMaxs;
+
 	CFastDetailLeafSpriteList( void )
 	{
 		m_nNumPendingSprites = 0;
 		m_nStartSpriteIndex = 0;
 	}
 
+	void ComputeBounds( void )
+	{
+		m_vecMins.Init( FLT_MAX, FLT_MAX, FLT_MAX );
+		m_vecMaxs.Init( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+		for( int i = 0; i < m_nNumSprites; i++ )
+		{
+			FastSpriteX4_t const &sprites = m_pSprites[i >> 2];
+			Vector vecPos( sprites.m_Pos.X( i & 3 ), sprites.m_Pos.Y( i & 3 ), sprites.m_Pos.Z( i & 3 ) );
+			float flRadius = fabs( SubFloat( sprites.m_HalfWidth, i & 3 ) ) + fabs( SubFloat( sprites.m_Height, i & 3 ) );
+			VectorMin( m_vecMins, vecPos - Vector( flRadius, flRadius, flRadius ), m_vecMins );
+			VectorMax( m_vecMaxs, vecPos + Vector( flRadius, flRadius, flRadius ), m_vecMaxs );
+		}
+	}
+
 };
 
 
@@ -414,6 +432,9 @@ public:
 	DetailPropLightstylesLump_t& DetailLighting( int i ) { return m_DetailLighting[i]; }
 	DetailPropSpriteDict_t& DetailSpriteDict( int i ) { return m_DetailSpriteDict[i]; }
 
+	// Reports how long the fast sprite build-out takes per leaf, by sprite count
+	void BenchmarkFastSprites( int nIterations );
+
 private:
 	struct DetailModelDict_t
 	{
@@ -438,6 +459,8 @@ private:
 							   Vector const &viewRight,
 							   Vector const &viewUp );
 
+	void DrawSortedFastSprites( CMeshBuilder &meshBuilder, SortInfo_t const *pDraw, int nCount ) const;
+
 	void RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList );
 
 	void UnserializeFastSprite( FastSpriteX4_t *pSpritex4, int nSubField, DetailObjectLump_t const &lump, bool bFlipped, Vector const &posOffset );
@@ -1643,6 +1666,7 @@ ConVar cl_detail_multiplier( "cl_detail_multiplier", "1", FCVAR_CHEAT, "extra de
 #define SPRITE_MULTIPLIER  ( cl_detail_multiplier.GetInt() )
 
 ConVar cl_fastdetailsprites( "cl_fastdetailsprites", "1", FCVAR_CHEAT, "whether to use new detail sprite system");
+ConVar cl_detail_frustum_cull( "cl_detail_frustum_cull", "1", FCVAR_CHEAT, "cull fast detail sprites against the sides of the view frustum" );
 
 static bool DetailObjectIsFastSprite( DetailObjectLump_t const & lump )
 {
@@ -1790,6 +1814,7 @@ void CDetailObjectSystem::UnserializeModels( CUtlBuffer& buf )
 					pNew->m_nNumSprites = nNumFastObjectsInCurLeaf;
 					pNew->m_nNumSIMDSprites = ( 3 + nNumFastObjectsInCurLeaf ) >> 2;
 					pNew->m_pSprites = pCurFastSpriteOut;
+					pNew->ComputeBounds();
 					pCurFastSpriteOut += pNew->m_nNumSIMDSprites;
 					ClientLeafSystem()->SetSubSystemDataInLeaf( 
 						detailObjectLeaf, CLSUBSYSTEM_DETAILOBJECTS, pNew );
@@ -1875,6 +1900,7 @@ void CDetailObjectSystem::UnserializeModels( CUtlBuffer& buf )
 			pNew->m_nNumSprites = nNumFastObjectsInCurLeaf;
 			pNew->m_nNumSIMDSprites = ( 3 + nNumFastObjectsInCurLeaf ) >> 2;
 			pNew->m_pSprites = pCurFastSpriteOut;
+			pNew->ComputeBounds();
 			pCurFastSpriteOut += pNew->m_nNumSIMDSprites;
 			ClientLeafSystem()->SetSubSystemDataInLeaf( 
 				detailObjectLeaf, CLSUBSYSTEM_DETAILOBJECTS, pNew );
@@ -2132,19 +2158,49 @@ static fltx4 Four_255s={ 255.0, 255.0, 255.0, 255.0 };
 static ALIGN16 int32 And255Mask[4] ALIGN16_POST = {0xff,0xff,0xff,0xff};
 #define PIXMASK ( * ( reinterpret_cast< fltx4 *>( &And255Mask ) ) )
 
+//-----------------------------------------------------------------------------
+// Is the box entirely outside one of the side planes of the view frustum?
+// The near and far planes are left to the facing and distance tests.
+//-----------------------------------------------------------------------------
+static bool CullBoxToFrustumSides( VPlane const *pFrustum, Vector const &vecMins, Vector const &vecMaxs )
+{
+	Vector vecCenter = ( vecMins + vecMaxs ) * 0.5f;
+	Vector vecExtents = vecMaxs - vecCenter;
+	for ( int i = FRUSTUM_RIGHT; i <= FRUSTUM_BOTTOM; i++ )
+	{
+		Vector const &vecNormal = pFrustum[i].m_Normal;
+		float flRadius = fabs( vecNormal.x ) * vecExtents.x + fabs( vecNormal.y ) * vecExtents.y + fabs( vecNormal.z ) * vecExtents.z;
+		if ( pFrustum[i].DistTo( vecCenter ) < -flRadius )
+			return true;
+	}
+	return false;
+}
+
 int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData,
 												Vector const &viewOrigin,
 												Vector const &viewForward,
 												Vector const &viewRight,
 												Vector const &viewUp )
 {
+	// part 0 - reject the whole leaf if none of its sprites can be in range or in view
+	if ( CalcSqrDistanceToAABB( pData->m_vecMins, pData->m_vecMaxs, viewOrigin ) > m_flCurMaxSqDist )
+		return 0;
+
+	VPlane const *pFrustum = cl_detail_frustum_cull.GetBool() ? view->GetFrustum() : NULL;
+	if ( pFrustum && CullBoxToFrustumSides( pFrustum, pData->m_vecMins, pData->m_vecMaxs ) )
+		return 0;
+
 	// part 1 - do all vertex math, fading, etc into a buffer, using as much simd as we can
 	int nSIMDSprites = pData->m_nNumSIMDSprites;
 	FastSpriteX4_t const *pSprites = pData->m_pSprites;
 	SortInfo_t *pOut = m_pFastSortInfo;
 	FastSpriteQuadBuildoutBufferX4_t *pQuadBufferOut = m_pBuildoutBuffer;
 	int curidx = 0;
-	int nLastBfMask = 0;
+
+	// the padding entries of the last block copy the first one, so they have to be masked off.
+	// a full last block has no padding.
+	int nTailSprites = pData->m_nNumSprites & 3;
+	int nTailMask = nTailSprites ? ( ( 0xf << nTailSprites ) & 0xf ) : 0;
 
 	FourVectors vecViewPos;
 	vecViewPos.DuplicateVector( viewOrigin );
@@ -2158,6 +2214,17 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 	FourVectors vecFwd;
 	vecFwd.DuplicateVector( viewForward );
 
+	FourVectors vecPlaneNormal[4];
+	fltx4 planeDist[4];
+	if ( pFrustum )
+	{
+		for ( int i = FRUSTUM_RIGHT; i <= FRUSTUM_BOTTOM; i++ )
+		{
+			vecPlaneNormal[i].DuplicateVector( pFrustum[i].m_Normal );
+			planeDist[i] = ReplicateX4( pFrustum[i].m_Dist );
+		}
+	}
+
 	do
 	{
 		// calculate alpha
@@ -2165,8 +2232,25 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 		ofs -= vecViewPos;
 		fltx4 ofsDotFwd = ofs * vecFwd;
 		fltx4 distanceSquared = ofs * ofs;
-		nLastBfMask = TestSignSIMD( OrSIMD( ofsDotFwd, CmpGtSIMD( distanceSquared, maxsqdist ) ) );		//  cull
-		if ( nLastBfMask != 0xf )
+		int nCullMask = TestSignSIMD( OrSIMD( ofsDotFwd, CmpGtSIMD( distanceSquared, maxsqdist ) ) );		//  cull
+		if ( nSIMDSprites == 1 )
+		{
+			nCullMask |= nTailMask;
+		}
+
+		if ( pFrustum && ( nCullMask != 0xf ) )
+		{
+			// test a sphere around each sprite's anchor that holds the whole quad
+			fltx4 radius = AddSIMD( MaxSIMD( pSprites->m_HalfWidth, NegSIMD( pSprites->m_HalfWidth ) ),
+									MaxSIMD( pSprites->m_Height, NegSIMD( pSprites->m_Height ) ) );
+			for ( int i = FRUSTUM_RIGHT; i <= FRUSTUM_BOTTOM; i++ )
+			{
+				fltx4 planeDistance = SubSIMD( pSprites->m_Pos * vecPlaneNormal[i], planeDist[i] );
+				nCullMask |= TestSignSIMD( AddSIMD( planeDistance, radius ) );
+			}
+		}
+
+		if ( nCullMask != 0xf )
 		{
 			FourVectors dx1;
 			dx1.x = fnegate( ofs.y );
@@ -2203,27 +2287,23 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 			fetch4 = *( ( fltx4 *) ( &pSprites->m_RGBColor[0][0] ) );
 			*( (fltx4 *) ( & ( pQuadBufferOut->m_RGBColor[0][0] ) ) ) = fetch4;
 
-			//!! bug!! store distance
-			// !! speed!! simd?
-			pOut[0].m_nIndex = curidx;
-			pOut[0].m_flDistance = SubFloat( distanceSquared, 0 );
-			pOut[1].m_nIndex = curidx+1;
-			pOut[1].m_flDistance = SubFloat( distanceSquared, 1 );
-			pOut[2].m_nIndex = curidx+2;
-			pOut[2].m_flDistance = SubFloat( distanceSquared, 2 );
-			pOut[3].m_nIndex = curidx+3;
-			pOut[3].m_flDistance = SubFloat( distanceSquared, 3 );
+			// only the sprites that survived culling get sorted and drawn
+			for ( int i = 0; i < 4; i++ )
+			{
+				if ( !( nCullMask & ( 1 << i ) ) )
+				{
+					pOut->m_nIndex = curidx + i;
+					pOut->m_flDistance = SubFloat( distanceSquared, i );
+					pOut++;
+				}
+			}
 			curidx += 4;
-			pOut += 4;
 			pQuadBufferOut++;
 		}
 		pSprites++;
 	} while( --nSIMDSprites );
 
-	// adjust count for tail
 	int nCount = pOut - m_pFastSortInfo;
-	if ( nLastBfMask != 0xf )						// if last not skipped
-		nCount -= ( 0 - pData->m_nNumSprites ) & 3;
 
 	// part 2 - sort
 	if ( nCount )
@@ -2236,6 +2316,62 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 }
 
 
+//-----------------------------------------------------------------------------
+// Writes the quads for a run of sorted sprites into the mesh
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::DrawSortedFastSprites( CMeshBuilder &meshBuilder, SortInfo_t const *pDraw, int nCount ) const
+{
+	FastSpriteQuadBuildoutBufferNonSIMDView_t const *pQuadBuffer =
+		( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) m_pBuildoutBuffer;
+
+	COMPILE_TIME_ASSERT( sizeof( FastSpriteQuadBuildoutBufferNonSIMDView_t ) ==
+						 sizeof( FastSpriteQuadBuildoutBufferX4_t ) );
+
+	while( nCount-- )
+	{
+		// draw the sucker
+		int nSIMDIdx = pDraw->m_nIndex >> 2;
+		int nSubIdx = pDraw->m_nIndex & 3;
+
+		FastSpriteQuadBuildoutBufferNonSIMDView_t const *pquad = pQuadBuffer+nSIMDIdx;
+
+		// voodoo - since everything is in 4s, offset structure pointer by a couple of floats to handle sub-index
+		pquad = (FastSpriteQuadBuildoutBufferNonSIMDView_t const *) ( ( (intp) ( pquad ) )+ ( nSubIdx << 2 ) );
+		uint8 const *pColorsCasted = reinterpret_cast<uint8 const *> ( pquad->m_Alpha );
+
+		uint8 color[4];
+		color[0] = pquad->m_RGBColor[0][0];
+		color[1] = pquad->m_RGBColor[0][1];
+		color[2] = pquad->m_RGBColor[0][2];
+		color[3] = pColorsCasted[MANTISSA_LSB_OFFSET];
+
+		DetailPropSpriteDict_t *pDict = pquad->m_pSpriteDefs[0];
+
+		// only position, color and the first texcoord are written, so only those need to advance
+		meshBuilder.Position3f( pquad->m_flX0[0], pquad->m_flY0[0], pquad->m_flZ0[0] );
+		meshBuilder.Color4ubv( color );
+		meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexLR.y );
+		meshBuilder.AdvanceVertexF<VTX_HAVEPOS | VTX_HAVECOLOR, 1>();
+
+		meshBuilder.Position3f( pquad->m_flX1[0], pquad->m_flY1[0], pquad->m_flZ1[0] );
+		meshBuilder.Color4ubv( color );
+		meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexUL.y );
+		meshBuilder.AdvanceVertexF<VTX_HAVEPOS | VTX_HAVECOLOR, 1>();
+
+		meshBuilder.Position3f( pquad->m_flX2[0], pquad->m_flY2[0], pquad->m_flZ2[0] );
+		meshBuilder.Color4ubv( color );
+		meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexUL.y );
+		meshBuilder.AdvanceVertexF<VTX_HAVEPOS | VTX_HAVECOLOR, 1>();
+
+		meshBuilder.Position3f( pquad->m_flX3[0], pquad->m_flY3[0], pquad->m_flZ3[0] );
+		meshBuilder.Color4ubv( color );
+		meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexLR.y );
+		meshBuilder.AdvanceVertexF<VTX_HAVEPOS | VTX_HAVECOLOR, 1>();
+		pDraw++;
+	}
+}
+
+
 void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList )
 {
 	// Here, we must draw all detail objects back-to-front
@@ -2299,11 +2435,6 @@ void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vec
 
 			// part 3 - stuff the sorted sprites into the vb
 			SortInfo_t const *pDraw = m_pFastSortInfo;
-			FastSpriteQuadBuildoutBufferNonSIMDView_t const *pQuadBuffer =
-				( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) m_pBuildoutBuffer;
-
-			COMPILE_TIME_ASSERT( sizeof( FastSpriteQuadBuildoutBufferNonSIMDView_t ) ==
-								 sizeof( FastSpriteQuadBuildoutBufferX4_t ) );
 
 			while( nCount )
 			{
@@ -2317,47 +2448,8 @@ void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vec
 				int nToDraw = MIN( nCount, nQuadsRemaining );
 				nCount -= nToDraw;
 				nQuadsRemaining -= nToDraw;
-				while( nToDraw-- )
-				{
-					// draw the sucker
-					int nSIMDIdx = pDraw->m_nIndex >> 2;
-					int nSubIdx = pDraw->m_nIndex & 3;
-
-					FastSpriteQuadBuildoutBufferNonSIMDView_t const *pquad = pQuadBuffer+nSIMDIdx;
-
-					// voodoo - since everything is in 4s, offset structure pointer by a couple of floats to handle sub-index
-					pquad = (FastSpriteQuadBuildoutBufferNonSIMDView_t const *) ( ( (int) ( pquad ) )+ ( nSubIdx << 2 ) );
-					uint8 const *pColorsCasted = reinterpret_cast<uint8 const *> ( pquad->m_Alpha );
-
-					uint8 color[4];
-					color[0] = pquad->m_RGBColor[0][0];
-					color[1] = pquad->m_RGBColor[0][1];
-					color[2] = pquad->m_RGBColor[0][2];
-					color[3] = pColorsCasted[MANTISSA_LSB_OFFSET];
-
-					DetailPropSpriteDict_t *pDict = pquad->m_pSpriteDefs[0];
-
-					meshBuilder.Position3f( pquad->m_flX0[0], pquad->m_flY0[0], pquad->m_flZ0[0] );
-					meshBuilder.Color4ubv( color );
-					meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexLR.y );
-					meshBuilder.AdvanceVertex();
-
-					meshBuilder.Position3f( pquad->m_flX1[0], pquad->m_flY1[0], pquad->m_flZ1[0] );
-					meshBuilder.Color4ubv( color );
-					meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexUL.y );
-					meshBuilder.AdvanceVertex();
-
-					meshBuilder.Position3f( pquad->m_flX2[0], pquad->m_flY2[0], pquad->m_flZ2[0] );
-					meshBuilder.Color4ubv( color );
-					meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexUL.y );
-					meshBuilder.AdvanceVertex();
-
-					meshBuilder.Position3f( pquad->m_flX3[0], pquad->m_flY3[0], pquad->m_flZ3[0] );
-					meshBuilder.Color4ubv( color );
-					meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexLR.y );
-					meshBuilder.AdvanceVertex();
-					pDraw++;
-				}
+				DrawSortedFastSprites( meshBuilder, pDraw, nToDraw );
+				pDraw += nToDraw;
 			}
 		}
 	}
@@ -2533,9 +2625,6 @@ void CDetailObjectSystem::RenderFastTranslucentDetailObjectsInLeaf( const Vector
 	meshBuilder.Begin( pMesh, MATERIAL_QUADS, nQuadsToDraw );
 
 	SortInfo_t const *pDraw = m_pFastSortInfo + pData->m_nStartSpriteIndex;
-
-	FastSpriteQuadBuildoutBufferNonSIMDView_t const *pQuadBuffer =
-		( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) m_pBuildoutBuffer;
 	
 	while( nCount && ( pDraw->m_flDistance >= flMinDistance ) )
 	{
@@ -2549,47 +2638,8 @@ void CDetailObjectSystem::RenderFastTranslucentDetailObjectsInLeaf( const Vector
 		int nToDraw = MIN( nCount, nQuadsRemaining );
 		nCount -= nToDraw;
 		nQuadsRemaining -= nToDraw;
-		while( nToDraw-- )
-		{
-			// draw the sucker
-			int nSIMDIdx = pDraw->m_nIndex >> 2;
-			int nSubIdx = pDraw->m_nIndex & 3;
-
-			FastSpriteQuadBuildoutBufferNonSIMDView_t const *pquad = pQuadBuffer+nSIMDIdx;
-
-			// voodoo - since everything is in 4s, offset structure pointer by a couple of floats to handle sub-index
-			pquad = (FastSpriteQuadBuildoutBufferNonSIMDView_t const *) ( ( (int) ( pquad ) )+ ( nSubIdx << 2 ) );
-			uint8 const *pColorsCasted = reinterpret_cast<uint8 const *> ( pquad->m_Alpha );
-
-			uint8 color[4];
-			color[0] = pquad->m_RGBColor[0][0];
-			color[1] = pquad->m_RGBColor[0][1];
-			color[2] = pquad->m_RGBColor[0][2];
-			color[3] = pColorsCasted[MANTISSA_LSB_OFFSET];
-
-			DetailPropSpriteDict_t *pDict = pquad->m_pSpriteDefs[0];
-
-			meshBuilder.Position3f( pquad->m_flX0[0], pquad->m_flY0[0], pquad->m_flZ0[0] );
-			meshBuilder.Color4ubv( color );
-			meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexLR.y );
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f( pquad->m_flX1[0], pquad->m_flY1[0], pquad->m_flZ1[0] );
-			meshBuilder.Color4ubv( color );
-			meshBuilder.TexCoord2f( 0, pDict->m_TexLR.x, pDict->m_TexUL.y );
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f( pquad->m_flX2[0], pquad->m_flY2[0], pquad->m_flZ2[0] );
-			meshBuilder.Color4ubv( color );
-			meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexUL.y );
-			meshBuilder.AdvanceVertex();
-
-			meshBuilder.Position3f( pquad->m_flX3[0], pquad->m_flY3[0], pquad->m_flZ3[0] );
-			meshBuilder.Color4ubv( color );
-			meshBuilder.TexCoord2f( 0, pDict->m_TexUL.x, pDict->m_TexLR.y );
-			meshBuilder.AdvanceVertex();
-			pDraw++;
-		}
+		DrawSortedFastSprites( meshBuilder, pDraw, nToDraw );
+		pDraw += nToDraw;
 	}
 	pData->m_nNumPendingSprites = nCount;
 	pData->m_nStartSpriteIndex = pDraw - m_pFastSortInfo;
@@ -2813,3 +2863,80 @@ void CDetailObjectSystem::BuildDetailObjectRenderLists( const Vector &vViewOrigi
 									 cl_detaildist.GetFloat(), this, (int)&ctx );
 }
 
+
+//-----------------------------------------------------------------------------
+// Times the fast sprite build-out of every leaf from the main view, and reports
+// the cost per sprite against the number of sprites in the leaf
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::BenchmarkFastSprites( int nIterations )
+{
+	if ( !m_pFastSpriteData )
+	{
+		Msg( "No fast detail sprites in this level.\n" );
+		return;
+	}
+
+	// leaves are grouped by sprite count: up to 4, 16, 64, 256, and more
+	const int NUM_BUCKETS = 5;
+	int nLeaves[NUM_BUCKETS] = { 0 };
+	int nSprites[NUM_BUCKETS] = { 0 };
+	int nVisible[NUM_BUCKETS] = { 0 };
+	float flTime[NUM_BUCKETS] = { 0 };
+
+	int nLeafCount = engine->LevelLeafCount();
+	for ( int nLeaf = 0; nLeaf < nLeafCount; ++nLeaf )
+	{
+		CFastDetailLeafSpriteList *pData = reinterpret_cast<CFastDetailLeafSpriteList *> (
+			ClientLeafSystem()->GetSubSystemDataInLeaf( nLeaf, CLSUBSYSTEM_DETAILOBJECTS ) );
+		if ( !pData )
+			continue;
+
+		int nBucket = 0;
+		while ( ( nBucket < NUM_BUCKETS - 1 ) && ( pData->m_nNumSprites > ( 4 << ( 2 * nBucket ) ) ) )
+		{
+			++nBucket;
+		}
+
+		int nCount = 0;
+		CFastTimer timer;
+		timer.Start();
+		for ( int i = 0; i < nIterations; i++ )
+		{
+			nCount = BuildOutSortedSprites( pData, MainViewOrigin(), MainViewForward(), MainViewRight(), MainViewUp() );
+		}
+		timer.End();
+
+		++nLeaves[nBucket];
+		nSprites[nBucket] += pData->m_nNumSprites;
+		nVisible[nBucket] += nCount;
+		flTime[nBucket] += timer.GetDuration().GetMillisecondsF() / nIterations;
+	}
+
+	// the sorted sprites of the current leaf were overwritten
+	m_nSortedFastLeaf = -1;
+
+	Msg( "leaf sprites  leaves   sprites   visible      ms/frame   ns/sprite\n" );
+	for ( int i = 0; i < NUM_BUCKETS; i++ )
+	{
+		if ( !nLeaves[i] )
+			continue;
+
+		char szRange[32];
+		if ( i == NUM_BUCKETS - 1 )
+		{
+			Q_snprintf( szRange, sizeof( szRange ), "%d+", ( 4 << ( 2 * ( i - 1 ) ) ) + 1 );
+		}
+		else
+		{
+			Q_snprintf( szRange, sizeof( szRange ), "%d-%d", i ? ( 4 << ( 2 * ( i - 1 ) ) ) + 1 : 1, 4 << ( 2 * i ) );
+		}
+		Msg( "%-12s %7d %9d %9d %13.4f %11.1f\n", szRange, nLeaves[i], nSprites[i], nVisible[i],
+			flTime[i], 1.0e6f * flTime[i] / nSprites[i] );
+	}
+}
+
+CON_COMMAND_F( cl_detail_benchmark, "Time the detail sprite build-out of every leaf from the current view. Arguments: [iterations]", FCVAR_CHEAT )
+{
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 100;
+	s_DetailObjectSystem.BenchmarkFastSprites( nIterations );
+}
@@ -6,6 +6,7 @@
 
 #include "cbase.h"
 #include "interpolatedvar.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -29,4 +30,255 @@ float g_flLastPacketTimestamp = 0;
 
 
 ConVar cl_extrapolate_amount( "cl_extrapolate_amount", "0.25", FCVAR_CHEAT, "Set how many seconds the client will extrapolate entities for." );
+ConVar cl_interp_batch( "cl_interp_batch", "1", 0, "Batch the float and Vector blends of each entity's interpolated vars and run them with SIMD." );
 
+
+// -------------------------------------------------------------------------------------------------------------- //
+// CInterpolatedVarBatch.
+// -------------------------------------------------------------------------------------------------------------- //
+
+CInterpolatedVarBatch *CInterpolatedVarBatch::s_pActive = NULL;
+
+// Only the main thread interpolates through a batch, so one is enough
+static CInterpolatedVarBatch g_InterpolatedVarBatch;
+
+
+void CInterpolatedVarBatch::AddLerp( float *pOut, const float *pFrom, const float *pTo, int nComponents, float frac )
+{
+	if ( m_nLerp + nComponents > BATCH_LANES )
+	{
+		Flush();
+	}
+
+	for ( int i = 0; i < nComponents; i++ )
+	{
+		int nLane = m_nLerp++;
+		m_LerpFrom[ nLane ] = pFrom[ i ];
+		m_LerpTo[ nLane ] = pTo[ i ];
+		m_LerpFrac[ nLane ] = frac;
+		m_pLerpOut[ nLane ] = &pOut[ i ];
+	}
+}
+
+
+void CInterpolatedVarBatch::AddHermite( float *pOut, const float *p0, const float *p1, const float *p2, int nComponents, float t )
+{
+	if ( m_nHermite + nComponents > BATCH_LANES )
+	{
+		Flush();
+	}
+
+	// Same coefficients as Lerp_Hermite()
+	float tSqr = t*t;
+	float tCube = t*tSqr;
+	float c1 = 2*tCube-3*tSqr+1;
+	float c2 = -2*tCube+3*tSqr;
+	float c3 = tCube-2*tSqr+t;
+	float c4 = tCube-tSqr;
+
+	for ( int i = 0; i < nComponents; i++ )
+	{
+		int nLane = m_nHermite++;
+		m_HermiteP0[ nLane ] = p0[ i ];
+		m_HermiteP1[ nLane ] = p1[ i ];
+		m_HermiteP2[ nLane ] = p2[ i ];
+		m_HermiteCoef[ 0 ][ nLane ] = c1;
+		m_HermiteCoef[ 1 ][ nLane ] = c2;
+		m_HermiteCoef[ 2 ][ nLane ] = c3;
+		m_HermiteCoef[ 3 ][ nLane ] = c4;
+		m_pHermiteOut[ nLane ] = &pOut[ i ];
+	}
+}
+
+
+void CInterpolatedVarBatch::Flush()
+{
+	// The results go back into the inputs, then get scattered to the vars.
+	// The operations are done in the same order as Lerp() and Lerp_Hermite(), so the results match the per-var code.
+	int nLerp4 = m_nLerp & ~3;
+	for ( int i = 0; i < nLerp4; i += 4 )
+	{
+		fltx4 a = LoadUnalignedSIMD( &m_LerpFrom[ i ] );
+		fltx4 b = LoadUnalignedSIMD( &m_LerpTo[ i ] );
+		fltx4 f = LoadUnalignedSIMD( &m_LerpFrac[ i ] );
+		StoreUnalignedSIMD( &m_LerpFrom[ i ], AddSIMD( a, MulSIMD( SubSIMD( b, a ), f ) ) );
+	}
+	for ( int i = nLerp4; i < m_nLerp; i++ )
+	{
+		m_LerpFrom[ i ] = m_LerpFrom[ i ] + ( m_LerpTo[ i ] - m_LerpFrom[ i ] ) * m_LerpFrac[ i ];
+	}
+	for ( int i = 0; i < m_nLerp; i++ )
+	{
+		*m_pLerpOut[ i ] = m_LerpFrom[ i ];
+	}
+	m_nLerp = 0;
+
+	int nHermite4 = m_nHermite & ~3;
+	for ( int i = 0; i < nHermite4; i += 4 )
+	{
+		fltx4 p0 = LoadUnalignedSIMD( &m_HermiteP0[ i ] );
+		fltx4 p1 = LoadUnalignedSIMD( &m_HermiteP1[ i ] );
+		fltx4 p2 = LoadUnalignedSIMD( &m_HermiteP2[ i ] );
+
+		fltx4 out = MulSIMD( p1, LoadUnalignedSIMD( &m_HermiteCoef[ 0 ][ i ] ) );
+		out = AddSIMD( out, MulSIMD( p2, LoadUnalignedSIMD( &m_HermiteCoef[ 1 ][ i ] ) ) );
+		out = AddSIMD( out, MulSIMD( SubSIMD( p1, p0 ), LoadUnalignedSIMD( &m_HermiteCoef[ 2 ][ i ] ) ) );
+		out = AddSIMD( out, MulSIMD( SubSIMD( p2, p1 ), LoadUnalignedSIMD( &m_HermiteCoef[ 3 ][ i ] ) ) );
+		StoreUnalignedSIMD( &m_HermiteP0[ i ], out );
+	}
+	for ( int i = nHermite4; i < m_nHermite; i++ )
+	{
+		float p0 = m_HermiteP0[ i ];
+		float p1 = m_HermiteP1[ i ];
+		float p2 = m_HermiteP2[ i ];
+
+		float out = p1 * m_HermiteCoef[ 0 ][ i ];
+		out += p2 * m_HermiteCoef[ 1 ][ i ];
+		out += ( p1 - p0 ) * m_HermiteCoef[ 2 ][ i ];
+		out += ( p2 - p1 ) * m_HermiteCoef[ 3 ][ i ];
+		m_HermiteP0[ i ] = out;
+	}
+	for ( int i = 0; i < m_nHermite; i++ )
+	{
+		*m_pHermiteOut[ i ] = m_HermiteP0[ i ];
+	}
+	m_nHermite = 0;
+}
+
+
+CInterpolatedVarBatchScope::CInterpolatedVarBatchScope()
+{
+	m_bActivated = false;
+
+#ifndef INTERPOLATEDVAR_PARANOID_MEASUREMENT
+	// The paranoid measurement compares each var's value right after it's interpolated
+	if ( !CInterpolatedVarBatch::s_pActive && cl_interp_batch.GetBool() && ThreadInMainThread() )
+	{
+		CInterpolatedVarBatch::s_pActive = &g_InterpolatedVarBatch;
+		m_bActivated = true;
+	}
+#endif
+}
+
+
+CInterpolatedVarBatchScope::~CInterpolatedVarBatchScope()
+{
+	if ( m_bActivated )
+	{
+		CInterpolatedVarBatch::s_pActive->Flush();
+		CInterpolatedVarBatch::s_pActive = NULL;
+	}
+}
+
+
+// -------------------------------------------------------------------------------------------------------------- //
+// Benchmark.
+// -------------------------------------------------------------------------------------------------------------- //
+
+template< class T >
+static float InterpolatedVarMaxError( const T &a, const T &b )
+{
+	float flMaxError = 0.0f;
+	for ( int i = 0; i < (int)( sizeof( T ) / sizeof( float ) ); i++ )
+	{
+		flMaxError = MAX( flMaxError, fabs( ((const float *)&a)[i] - ((const float *)&b)[i] ) );
+	}
+	return flMaxError;
+}
+
+template< class T >
+static void BenchmarkInterpolatedVars( const char *pTypeName, int nVars, int nIterations )
+{
+	T *pValues = new T[ nVars ];
+	T *pScalarValues = new T[ nVars ];
+	CInterpolatedVar< T > *pVars = new CInterpolatedVar< T >[ nVars ];
+
+	// Three samples, so hermite is used, and a current time past the newest one, so half of them extrapolate
+	RandomSeed( 1 );
+	for ( int i = 0; i < nVars; i++ )
+	{
+		pVars[i].Setup( &pValues[i], LATCH_SIMULATION_VAR | ( ( i & 2 ) ? INTERPOLATE_LINEAR_ONLY : 0 ) );
+		pVars[i].SetInterpolationAmount( 0.1f );
+		for ( int nSample = 0; nSample < 3; nSample++ )
+		{
+			for ( int j = 0; j < (int)( sizeof( T ) / sizeof( float ) ); j++ )
+			{
+				((float *)&pValues[i])[j] = RandomFloat( -1000.0f, 1000.0f );
+			}
+			pVars[i].NoteChanged( 0.1f * nSample, true );
+		}
+	}
+
+	CInterpolationContext context;
+	context.EnableExtrapolation( true );
+	context.SetLastTimeStamp( 0.2f );
+
+	float flScalarTime = 0.0f, flBatchTime = 0.0f;
+	for ( int nPass = 0; nPass < 2; nPass++ )
+	{
+		double flStart = Plat_FloatTime();
+		for ( int nIteration = 0; nIteration < nIterations; nIteration++ )
+		{
+			float flCurrentTime = 0.2f + 0.1f * ( nIteration & 1 ) + 0.001f * ( nIteration & 15 );
+
+			// Batch a few vars at a time, like entities do
+			for ( int i = 0; i < nVars; i += 8 )
+			{
+				if ( nPass == 0 )
+				{
+					for ( int j = i; j < MIN( i + 8, nVars ); j++ )
+					{
+						pVars[j].Interpolate( flCurrentTime );
+					}
+				}
+				else
+				{
+					CInterpolatedVarBatchScope batchScope;
+					for ( int j = i; j < MIN( i + 8, nVars ); j++ )
+					{
+						pVars[j].Interpolate( flCurrentTime );
+					}
+				}
+			}
+		}
+		float flElapsed = (float)( Plat_FloatTime() - flStart );
+
+		if ( nPass == 0 )
+		{
+			flScalarTime = flElapsed;
+			memcpy( pScalarValues, pValues, sizeof( T ) * nVars );
+		}
+		else
+		{
+			flBatchTime = flElapsed;
+		}
+	}
+
+	float flMaxError = 0.0f;
+	for ( int i = 0; i < nVars; i++ )
+	{
+		flMaxError = MAX( flMaxError, InterpolatedVarMaxError( pValues[i], pScalarValues[i] ) );
+	}
+
+	Msg( "%-8s %6d vars: per-var %.3f ms, batched %.3f ms, max difference %g\n",
+		pTypeName, nVars, flScalarTime * 1000.0f / nIterations, flBatchTime * 1000.0f / nIterations, flMaxError );
+
+	delete[] pVars;
+	delete[] pScalarValues;
+	delete[] pValues;
+}
+
+CON_COMMAND_F( cl_interp_batch_benchmark, "Time interpolating vars per-var and batched. Arguments: [var count]", FCVAR_CHEAT )
+{
+	int nVars = ( args.ArgC() >= 2 ) ? clamp( atoi( args[1] ), 1, 65536 ) : 4096;
+	int nIterations = 64;
+
+	if ( !cl_interp_batch.GetBool() )
+	{
+		Msg( "cl_interp_batch is 0, both runs will be per-var.\n" );
+	}
+
+	BenchmarkInterpolatedVars< float >( "float", nVars, nIterations );
+	BenchmarkInterpolatedVars< Vector >( "Vector", nVars, nIterations );
+	BenchmarkInterpolatedVars< QAngle >( "QAngle", nVars, nIterations );
+}
@@ -175,6 +175,70 @@ public:
 	virtual void SetDebug( bool bDebug ) = 0;
 };
 
+// -------------------------------------------------------------------------------------------------------------- //
+// CInterpolatedVarBatch - collects the float and Vector blends of the vars interpolated while it's active, and
+// runs them four lanes at a time when it's flushed. Results are the same as the per-var code.
+// -------------------------------------------------------------------------------------------------------------- //
+
+template< typename Type > struct InterpolatedVarBatchComponents	{ enum { COUNT = 0 }; };	// not batched
+template<> struct InterpolatedVarBatchComponents< float >		{ enum { COUNT = 1 }; };
+template<> struct InterpolatedVarBatchComponents< Vector >		{ enum { COUNT = 3 }; };
+// QAngle interpolates through quaternions, and stays on the per-var path
+
+class CInterpolatedVarBatch
+{
+public:
+	CInterpolatedVarBatch() : m_nLerp( 0 ), m_nHermite( 0 ) {}
+
+	// Returns the batch vars should add their blends to, NULL if they should blend right away.
+	static CInterpolatedVarBatch *GetActive()	{ return s_pActive; }
+
+	// Queue out = Lerp( frac, from, to ) for nComponents floats. 
+	void AddLerp( float *pOut, const float *pFrom, const float *pTo, int nComponents, float frac );
+
+	// Queue out = Lerp_Hermite( t, p0, p1, p2 ) for nComponents floats.
+	void AddHermite( float *pOut, const float *p0, const float *p1, const float *p2, int nComponents, float t );
+
+	// Blend everything queued, and write the results out.
+	void Flush();
+
+private:
+	friend class CInterpolatedVarBatchScope;
+
+	enum
+	{
+		BATCH_LANES = 256,
+	};
+
+	int		m_nLerp;
+	float	m_LerpFrom[ BATCH_LANES ];
+	float	m_LerpTo[ BATCH_LANES ];
+	float	m_LerpFrac[ BATCH_LANES ];
+	float	*m_pLerpOut[ BATCH_LANES ];
+
+	int		m_nHermite;
+	float	m_HermiteP0[ BATCH_LANES ];
+	float	m_HermiteP1[ BATCH_LANES ];
+	float	m_HermiteP2[ BATCH_LANES ];
+	float	m_HermiteCoef[ 4 ][ BATCH_LANES ];
+	float	*m_pHermiteOut[ BATCH_LANES ];
+
+	static CInterpolatedVarBatch *s_pActive;
+};
+
+// Makes the batch active for its lifetime on the main thread, and flushes it when it goes away.
+// Nested scopes share the outer batch.
+class CInterpolatedVarBatchScope
+{
+public:
+	CInterpolatedVarBatchScope();
+	~CInterpolatedVarBatchScope();
+
+private:
+	bool m_bActivated;
+};
+
+
 template< typename Type, bool IS_ARRAY >
 struct CInterpolatedVarEntryBase
 {
@@ -552,6 +616,12 @@ protected:
 
 	void _Interpolate( Type *out, float frac, CInterpolatedVarEntry *start, CInterpolatedVarEntry *end );
 	void _Interpolate_Hermite( Type *out, float frac, CInterpolatedVarEntry *pOriginalPrev, CInterpolatedVarEntry *start, CInterpolatedVarEntry *end, bool looping = false );
+
+	// Same as the above for m_pValue, but queue the blends on the active CInterpolatedVarBatch.
+	// Return false if there's no batch or the type isn't batched, and nothing was done.
+	bool _Extrapolate_Batch( CInterpolatedVarEntry *pOld, CInterpolatedVarEntry *pNew, float flDestinationTime, float flMaxExtrapolationAmount );
+	bool _Interpolate_Batch( float frac, CInterpolatedVarEntry *start, CInterpolatedVarEntry *end );
+	bool _Interpolate_Hermite_Batch( float frac, CInterpolatedVarEntry *pOriginalPrev, CInterpolatedVarEntry *start, CInterpolatedVarEntry *end );
 	
 	void _Derivative_Hermite( Type *out, float frac, CInterpolatedVarEntry *pOriginalPrev, CInterpolatedVarEntry *start, CInterpolatedVarEntry *end );
 	void _Derivative_Hermite_SmoothVelocity( Type *out, float frac, CInterpolatedVarEntry *b, CInterpolatedVarEntry *c, CInterpolatedVarEntry *d );
@@ -992,7 +1062,8 @@ inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::Interpolate( float current
 	if ( info.m_bHermite )
 	{
 		// base cast, we have 3 valid sample point
-		_Interpolate_Hermite( m_pValue, info.frac, &history[info.oldest], &history[info.older], &history[info.newer] );
+		if ( !_Interpolate_Hermite_Batch( info.frac, &history[info.oldest], &history[info.older], &history[info.newer] ) )
+			_Interpolate_Hermite( m_pValue, info.frac, &history[info.oldest], &history[info.older], &history[info.newer] );
 	}
 	else if ( info.newer == info.older  )
 	{
@@ -1021,16 +1092,19 @@ inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::Interpolate( float current
 			// The End
 
 			// Use the velocity here (extrapolate up to 1/4 of a second).
-			_Extrapolate( m_pValue, &history[realOlder], &history[info.newer], currentTime - interpolation_amount, cl_extrapolate_amount.GetFloat() );
+			if ( !_Extrapolate_Batch( &history[realOlder], &history[info.newer], currentTime - interpolation_amount, cl_extrapolate_amount.GetFloat() ) )
+				_Extrapolate( m_pValue, &history[realOlder], &history[info.newer], currentTime - interpolation_amount, cl_extrapolate_amount.GetFloat() );
 		}
 		else
 		{
-			_Interpolate( m_pValue, info.frac, &history[info.older], &history[info.newer] );
+			if ( !_Interpolate_Batch( info.frac, &history[info.older], &history[info.newer] ) )
+				_Interpolate( m_pValue, info.frac, &history[info.older], &history[info.newer] );
 		}
 	}
 	else
 	{
-		_Interpolate( m_pValue, info.frac, &history[info.older], &history[info.newer] );
+		if ( !_Interpolate_Batch( info.frac, &history[info.older], &history[info.newer] ) )
+			_Interpolate( m_pValue, info.frac, &history[info.older], &history[info.newer] );
 	}
 
 #ifdef INTERPOLATEDVAR_PARANOID_MEASUREMENT
@@ -1368,6 +1442,93 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Extrapolate(
 }
 
 
+template< typename Type, bool IS_ARRAY >
+inline bool CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Extrapolate_Batch( 
+	CInterpolatedVarEntry *pOld,
+	CInterpolatedVarEntry *pNew,
+	float flDestinationTime,
+	float flMaxExtrapolationAmount
+	)
+{
+	const int nComponents = InterpolatedVarBatchComponents<Type>::COUNT;
+	CInterpolatedVarBatch *pBatch = CInterpolatedVarBatch::GetActive();
+	if ( !nComponents || !pBatch )
+		return false;
+
+	// Holding the newest value is just a copy
+	if ( fabs( pOld->changetime - pNew->changetime ) < 0.001f || flDestinationTime <= pNew->changetime )
+		return false;
+
+	float flExtrapolationAmount = MIN( flDestinationTime - pNew->changetime, flMaxExtrapolationAmount );
+
+	// ExtrapolateInterpolatedVarType() for floats and vectors is a lerp past the newest value
+	float divisor = 1.0f / (pNew->changetime - pOld->changetime);
+	float frac = 1.0f + flExtrapolationAmount * divisor;
+	for ( int i=0; i < m_nMaxCount; i++ )
+	{
+		pBatch->AddLerp( (float *)&m_pValue[i], (const float *)&pOld->GetValue()[i], (const float *)&pNew->GetValue()[i], nComponents, frac );
+	}
+	return true;
+}
+
+
+template< typename Type, bool IS_ARRAY >
+inline bool CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Interpolate_Batch( float frac, CInterpolatedVarEntry *start, CInterpolatedVarEntry *end )
+{
+	const int nComponents = InterpolatedVarBatchComponents<Type>::COUNT;
+	CInterpolatedVarBatch *pBatch = CInterpolatedVarBatch::GetActive();
+	if ( !nComponents || !pBatch || start == end )
+		return false;
+
+	Assert( frac >= 0.0f && frac <= 1.0f );
+
+	for ( int i = 0; i < m_nMaxCount; i++ )
+	{
+		if ( m_bLooping[ i ] )
+		{
+			m_pValue[i] = LoopingLerp( frac, start->GetValue()[i], end->GetValue()[i] );
+		}
+		else
+		{
+			pBatch->AddLerp( (float *)&m_pValue[i], (const float *)&start->GetValue()[i], (const float *)&end->GetValue()[i], nComponents, frac );
+		}
+	}
+	return true;
+}
+
+
+template< typename Type, bool IS_ARRAY >
+inline bool CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Interpolate_Hermite_Batch( 
+	float frac, 
+	CInterpolatedVarEntry *prev, 
+	CInterpolatedVarEntry *start, 
+	CInterpolatedVarEntry *end )
+{
+	const int nComponents = InterpolatedVarBatchComponents<Type>::COUNT;
+	CInterpolatedVarBatch *pBatch = CInterpolatedVarBatch::GetActive();
+	if ( !nComponents || !pBatch )
+		return false;
+
+	// The batch copies the samples, so the fixup doesn't need to outlive this
+	CInterpolatedVarEntry fixup;
+	fixup.Init(m_nMaxCount);
+	TimeFixup_Hermite( fixup, prev, start, end );
+
+	for( int i = 0; i < m_nMaxCount; i++ )
+	{
+		if ( m_bLooping[ i ] )
+		{
+			m_pValue[ i ] = LoopingLerp_Hermite( frac, prev->GetValue()[i], start->GetValue()[i], end->GetValue()[i] );
+		}
+		else
+		{
+			pBatch->AddHermite( (float *)&m_pValue[i], (const float *)&prev->GetValue()[i], (const float *)&start->GetValue()[i], (const float *)&end->GetValue()[i], nComponents, frac );
+		}
+	}
+	return true;
+}
+
+
 template< typename Type, bool IS_ARRAY >
 inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::TimeFixup2_Hermite( 
 	typename CInterpolatedVarArrayBase<Type, IS_ARRAY>::CInterpolatedVarEntry &fixup,
@@ -121,6 +121,25 @@ void CLitSmokeEmitter::SimulateParticles( CParticleSimulateIterator *pIterator )
 {
 	// Make sure they've called Init().
 	Assert( m_bInitted );
+
+	if ( cl_particle_simd.GetBool() )
+	{
+		fltx4 fl4TimeDelta = ReplicateX4( pIterator->GetTimeDelta() );
+
+		CParticleBatchSIMD< LitSmokeParticle > batch;
+		LitSmokeParticle *pParticle = (LitSmokeParticle*)pIterator->GetFirst();
+		while ( pParticle )
+		{
+			batch.Add( pParticle );
+
+			pParticle = (LitSmokeParticle*)pIterator->GetNext();
+			if ( batch.IsFull() || !pParticle )
+			{
+				batch.Flush( pIterator, batch.Integrate( fl4TimeDelta ) );
+			}
+		}
+		return;
+	}
 	
 	LitSmokeParticle *pParticle = (LitSmokeParticle*)pIterator->GetFirst();
 	while ( pParticle )
@@ -665,49 +665,65 @@ void CParticleEffectBinding::SimulateParticles( float flTimeDelta )
 	}
 	else
 	{
-		Vector bbMin(0,0,0), bbMax(0,0,0);
-		bool bboxSet = false;
-
-		// slow the expensive update operation for particle systems that use auto-update-bbox
-		// auto update the bbox after N frames then randomly 1/N or after 2*N frames 
-		bool bFullBBoxUpdate = false;
-		++m_UpdateBBoxCounter;
-		if ( ( m_UpdateBBoxCounter >= BBOX_UPDATE_EVERY_N && random->RandomInt( 0, BBOX_UPDATE_EVERY_N ) == 0 ) ||
-			 ( m_UpdateBBoxCounter >= 2*BBOX_UPDATE_EVERY_N ) )
-		{
-			bFullBBoxUpdate = true;
+		SimulateMaterials( flTimeDelta, ShouldFullBBoxUpdate() );
+	}
+}
 
-			// reset watchdog
-			m_UpdateBBoxCounter = 0;
-		}
 
-		if ( bFullBBoxUpdate )
-		{
-			BBoxCalcStart( bbMin, bbMax );
-		}
-		FOR_EACH_LL( m_Materials, i )
-		{
-			CEffectMaterial *pMaterial = m_Materials[i];
+//-----------------------------------------------------------------------------
+// Should this frame's simulation recompute the bbox from the particles?
+//-----------------------------------------------------------------------------
+bool CParticleEffectBinding::ShouldFullBBoxUpdate()
+{
+	// slow the expensive update operation for particle systems that use auto-update-bbox
+	// auto update the bbox after N frames then randomly 1/N or after 2*N frames 
+	++m_UpdateBBoxCounter;
+	if ( ( m_UpdateBBoxCounter >= BBOX_UPDATE_EVERY_N && random->RandomInt( 0, BBOX_UPDATE_EVERY_N ) == 0 ) ||
+		 ( m_UpdateBBoxCounter >= 2*BBOX_UPDATE_EVERY_N ) )
+	{
+		// reset watchdog
+		m_UpdateBBoxCounter = 0;
+		return true;
+	}
 
-			CParticleSimulateIterator simulateIterator;
+	return false;
+}
 
-			simulateIterator.m_pEffectBinding = this;
-			simulateIterator.m_pMaterial = pMaterial;
-			simulateIterator.m_flTimeDelta = flTimeDelta;
 
-			m_pSim->SimulateParticles( &simulateIterator );
+//-----------------------------------------------------------------------------
+// Simulate the particles of each material, and optionally rebuild the bbox
+//-----------------------------------------------------------------------------
+void CParticleEffectBinding::SimulateMaterials( float flTimeDelta, bool bFullBBoxUpdate )
+{
+	Vector bbMin(0,0,0), bbMax(0,0,0);
+	bool bboxSet = false;
 
-			// Update the bbox.
-			if ( bFullBBoxUpdate )
-			{
-				GrowBBoxFromParticlePositions( pMaterial, bboxSet, bbMin, bbMax );
-			}
-		}
+	if ( bFullBBoxUpdate )
+	{
+		BBoxCalcStart( bbMin, bbMax );
+	}
+	FOR_EACH_LL( m_Materials, i )
+	{
+		CEffectMaterial *pMaterial = m_Materials[i];
+
+		CParticleSimulateIterator simulateIterator;
+
+		simulateIterator.m_pEffectBinding = this;
+		simulateIterator.m_pMaterial = pMaterial;
+		simulateIterator.m_flTimeDelta = flTimeDelta;
+
+		m_pSim->SimulateParticles( &simulateIterator );
+
+		// Update the bbox.
 		if ( bFullBBoxUpdate )
 		{
-			BBoxCalcEnd( bboxSet, bbMin, bbMax );
+			GrowBBoxFromParticlePositions( pMaterial, bboxSet, bbMin, bbMax );
 		}
 	}
+	if ( bFullBBoxUpdate )
+	{
+		BBoxCalcEnd( bboxSet, bbMin, bbMax );
+	}
 }
 
 
@@ -795,7 +811,7 @@ int CParticleEffectBinding::DrawMaterialParticles(
 
 	if( bBucketSort )
 	{
-		DoBucketSort( pMaterial, renderIterator.m_zCoords, renderIterator.m_nZCoords, renderIterator.m_MinZ, renderIterator.m_MaxZ );
+		DoRadixSort( pMaterial, renderIterator.m_zCoords, renderIterator.m_nZCoords );
 	}
 
 	// Flush out any remaining particles.
@@ -867,57 +883,83 @@ void CParticleEffectBinding::RenderEnd( VMatrix &tempModel, VMatrix &tempView )
 }
 
 
-void CParticleEffectBinding::DoBucketSort( CEffectMaterial *pMaterial, float *zCoords, int nZCoords, float minZ, float maxZ )
+//-----------------------------------------------------------------------------
+// Maps a float to an unsigned int that sorts in the same order
+//-----------------------------------------------------------------------------
+static inline uint32 FloatToRadixKey( float f )
+{
+	uint32 n = *(uint32*)&f;
+	uint32 nMask = ( n & 0x80000000 ) ? 0xFFFFFFFF : 0x80000000;
+	return n ^ nMask;
+}
+
+
+//-----------------------------------------------------------------------------
+// Sort the first nZCoords particles so the list starts with them in ascending z.
+// zCoords holds the z of each of those particles, in list order.
+//-----------------------------------------------------------------------------
+void CParticleEffectBinding::DoRadixSort( CEffectMaterial *pMaterial, const float *zCoords, int nZCoords )
 {
-	// Do an O(N) bucket sort. This helps the sort when there are lots of particles.
-	#define NUM_BUCKETS	32
-	Particle buckets[NUM_BUCKETS];
-	for( int iBucket=0; iBucket < NUM_BUCKETS; iBucket++ )
+	struct SortEntry_t
 	{
-		buckets[iBucket].m_pPrev = buckets[iBucket].m_pNext = &buckets[iBucket];
-	}
-	
-	// Sort into buckets.
-	int iCurParticle = 0;
+		uint32		m_nKey;
+		Particle	*m_pParticle;
+	};
+
+	if ( nZCoords <= 1 )
+		return;
+
+	Assert( nZCoords <= MAX_TOTAL_PARTICLES );
+	SortEntry_t *pEntries = (SortEntry_t*)stackalloc( 2 * nZCoords * sizeof( SortEntry_t ) );
+	SortEntry_t *pTemp = pEntries + nZCoords;
+
+	// Pull the particles out of the list, along with their keys.
+	int nEntries = 0;
 	Particle *pNext, *pCur;
-	for( pCur=pMaterial->m_Particles.m_pNext; pCur != &pMaterial->m_Particles; pCur=pNext )
+	for( pCur=pMaterial->m_Particles.m_pNext; pCur != &pMaterial->m_Particles && nEntries < nZCoords; pCur=pNext )
 	{
 		pNext = pCur->m_pNext;
-		if( iCurParticle >= nZCoords )
-			break;
-
-		// Remove it..
 		UnlinkParticle( pCur );
 
-		// Add it to the appropriate bucket.
-		float flPercent;
-		if (maxZ == minZ)
-			flPercent = 0;
-		else
-			flPercent = (zCoords[iCurParticle] - minZ) / (maxZ - minZ);
+		pEntries[nEntries].m_nKey = FloatToRadixKey( zCoords[nEntries] );
+		pEntries[nEntries].m_pParticle = pCur;
+		++nEntries;
+	}
 
-		int iAddBucket = (int)( flPercent * (NUM_BUCKETS - 0.0001f) );
-		iAddBucket = NUM_BUCKETS - iAddBucket - 1;
-		Assert( iAddBucket >= 0 && iAddBucket < NUM_BUCKETS );
+	// LSD radix sort, 8 bits per pass. Passes where every key has the same digit are skipped,
+	// which is common for the exponent byte since the particles of one effect are close together.
+	for ( int nShift = 0; nShift < 32; nShift += 8 )
+	{
+		int nCounts[256];
+		memset( nCounts, 0, sizeof( nCounts ) );
+		for ( int i = 0; i < nEntries; i++ )
+		{
+			++nCounts[ ( pEntries[i].m_nKey >> nShift ) & 0xFF ];
+		}
 
-		InsertParticleAfter( pCur, &buckets[iAddBucket] );
+		if ( nCounts[ ( pEntries[0].m_nKey >> nShift ) & 0xFF ] == nEntries )
+			continue;
 
-		++iCurParticle;
-	}
+		int nOffset = 0;
+		for ( int i = 0; i < 256; i++ )
+		{
+			int nCount = nCounts[i];
+			nCounts[i] = nOffset;
+			nOffset += nCount;
+		}
 
-	// Put the buckets back into the main list.
-	for( int iReAddBucket=0; iReAddBucket < NUM_BUCKETS; iReAddBucket++ )
-	{
-		Particle *pListHead = &buckets[iReAddBucket];
-		for( pCur=pListHead->m_pNext; pCur != pListHead; pCur=pNext )
+		for ( int i = 0; i < nEntries; i++ )
 		{
-			pNext = pCur->m_pNext;
-			InsertParticleAfter( pCur, &pMaterial->m_Particles );
-			--iCurParticle;
+			pTemp[ nCounts[ ( pEntries[i].m_nKey >> nShift ) & 0xFF ]++ ] = pEntries[i];
 		}
+		V_swap( pEntries, pTemp );
 	}
 
-	Assert(iCurParticle==0);
+	// Put them back at the front of the list, lowest z first.
+	for ( int i = nEntries; --i >= 0; )
+	{
+		InsertParticleAfter( pEntries[i].m_pParticle, &pMaterial->m_Particles );
+	}
 }
 
 
@@ -1931,6 +1973,19 @@ void CParticleMgr::UpdateNewEffects( float flTimeDelta )
 	}
 }
 
+struct ParticleEffectSimEntry_t
+{
+	CParticleEffectBinding *m_pEffect;
+	bool m_bFullBBoxUpdate;
+};
+
+static float s_flThreadedEffectTimeStep;
+
+static void ProcessParticleEffect( ParticleEffectSimEntry_t &entry )
+{
+	entry.m_pEffect->SimulateMaterials( s_flThreadedEffectTimeStep, entry.m_bFullBBoxUpdate );
+}
+
 void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 {
 	// These reflect the convars so we don't parse the strings every particle.
@@ -1943,6 +1998,10 @@ void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 	if( flTimeDelta > 0.1f )
 		flTimeDelta = 0.1f;
 
+	// Effects that only touch their own particles are simulated together on the job pool after this loop.
+	CUtlVectorFixedGrowable< ParticleEffectSimEntry_t, 64 > effectsToSimulate;
+	bool bThreaded = r_threaded_particles.GetBool();
+
 	FOR_EACH_LL( m_Effects, iEffect )
 	{
 		CParticleEffectBinding *pEffect = m_Effects[iEffect];
@@ -1971,14 +2030,40 @@ void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 		pEffect->m_pSim->Update( flTimeDelta );
 
 		if ( pEffect->GetFirstFrameFlag() )
+		{
 			pEffect->SetFirstFrameFlag( false );
+		}
+		else if ( bThreaded && !pEffect->GetFlag( CParticleEffectBinding::FLAGS_NEW_PARTICLE_SYSTEM ) && pEffect->m_pSim->IsSimulationThreadSafe() )
+		{
+			if ( pEffect->m_pSim->ShouldSimulate() )
+			{
+				ParticleEffectSimEntry_t &entry = effectsToSimulate[ effectsToSimulate.AddToTail() ];
+				entry.m_pEffect = pEffect;
+				entry.m_bFullBBoxUpdate = pEffect->ShouldFullBBoxUpdate();
+				continue;
+			}
+		}
 		else
+		{
 			pEffect->SimulateParticles( flTimeDelta );
+		}
 
 		// Update its position in the leaf system if its bbox changed.
 		pEffect->DetectChanges();
 	}
 
+	if ( effectsToSimulate.Count() )
+	{
+		s_flThreadedEffectTimeStep = flTimeDelta;
+		ParallelProcess( "CParticleMgr::UpdateAllEffects", effectsToSimulate.Base(), effectsToSimulate.Count(), ProcessParticleEffect );
+
+		// Update their positions in the leaf system.
+		FOR_EACH_VEC( effectsToSimulate, i )
+		{
+			effectsToSimulate[i].m_pEffect->DetectChanges();
+		}
+	}
+
 	if ( g_bMeasureParticlePerformance )					// use fixed time step
 	{
 		for( float dt=0.0f; dt <= flTimeDelta ; dt+= 0.01f )
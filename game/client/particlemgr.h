@@ -303,6 +303,10 @@ public:
 	virtual const Vector *GetParticlePosition( Particle *pParticle ) { return &pParticle->m_Pos; }
 
 	virtual const char *GetEffectName() { return "???"; } 
+
+	// Return true if SimulateParticles only touches this effect and its own particles,
+	// so it can run on the job pool at the same time as other effects.
+	virtual bool	IsSimulationThreadSafe() const { return false; }
 };
 
 #define REGISTER_EFFECT( effect )														\
@@ -354,6 +358,12 @@ public:
 	// Simulate all the particles.
 	void			SimulateParticles( float flTimeDelta );
 
+	// The two halves of SimulateParticles for effects that don't use the new particle system.
+	// ShouldFullBBoxUpdate must be called on the main thread. SimulateMaterials can run on the
+	// job pool if the effect's IsSimulationThreadSafe returns true.
+	bool			ShouldFullBBoxUpdate();
+	void			SimulateMaterials( float flTimeDelta, bool bFullBBoxUpdate );
+
 	// Use this to specify materials when adding particles. 
 	// Returns the index of the material it found or added.
 	// Returns INVALID_MATERIAL_HANDLE if it couldn't find or add a material.
@@ -492,12 +502,10 @@ private:
 	void			BBoxCalcStart( Vector &bbMin, Vector &bbMax );
 	void			BBoxCalcEnd( bool bboxSet, Vector &bbMin, Vector &bbMax );
 	
-	void			DoBucketSort( 
+	void			DoRadixSort( 
 						CEffectMaterial *pMaterial, 
-						float *zCoords, 
-						int nZCoords,
-						float minZ,
-						float maxZ );
+						const float *zCoords, 
+						int nZCoords );
 
 	int				GetRemovalInProgressFlag()					{ return GetFlag( FLAGS_REMOVALINPROGRESS ); }
 	void			SetRemovalInProgressFlag()					{ SetFlag( FLAGS_REMOVALINPROGRESS, 1 ); }
@@ -729,7 +737,7 @@ private:
 
 private:
 
-	int m_nCurrentParticlesAllocated;
+	CInterlockedInt m_nCurrentParticlesAllocated;		// particles are freed by effects simulating on the job pool
 
 	// Directional lighting info.
 	CParticleLightInfo m_DirectionalLight;
@@ -16,6 +16,8 @@
 #include "tier0/memdbgon.h"
 
 
+ConVar cl_particle_simd( "cl_particle_simd", "1", 0, "Simulate simple and lit smoke particles four at a time." );
+
 // Used for debugging to make sure all particle effects get freed when we exit.
 CUtlLinkedList<CParticleEffect*,int> g_ParticleEffects;
 class CEffectChecker
@@ -225,6 +227,7 @@ CSimpleEmitter::CSimpleEmitter( const char *pDebugName ) : CParticleEffect( pDeb
 {
 	m_flNearClipMin	= 16.0f;
 	m_flNearClipMax	= 64.0f;
+	m_bDefaultUpdates = false;
 }
 
 
@@ -236,6 +239,7 @@ CSmartPtr<CSimpleEmitter> CSimpleEmitter::Create( const char *pDebugName )
 {
 	CSimpleEmitter *pRet = new CSimpleEmitter( pDebugName );
 	pRet->SetDynamicallyAllocated( true );
+	pRet->m_bDefaultUpdates = true;
 	return pRet;
 }
 
@@ -364,6 +368,12 @@ Vector CSimpleEmitter::UpdateColor( const SimpleParticle *pParticle )
 
 void CSimpleEmitter::SimulateParticles( CParticleSimulateIterator *pIterator )
 {
+	if ( m_bDefaultUpdates && cl_particle_simd.GetBool() )
+	{
+		SimulateParticlesSIMD( pIterator );
+		return;
+	}
+
 	float timeDelta = pIterator->GetTimeDelta();
 
 	SimpleParticle *pParticle = (SimpleParticle*)pIterator->GetFirst();
@@ -384,6 +394,46 @@ void CSimpleEmitter::SimulateParticles( CParticleSimulateIterator *pIterator )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Same as SimulateParticles with the default Update* functions, but
+//			steps the particles four at a time.
+//-----------------------------------------------------------------------------
+void CSimpleEmitter::SimulateParticlesSIMD( CParticleSimulateIterator *pIterator )
+{
+	float timeDelta = pIterator->GetTimeDelta();
+	fltx4 fl4TimeDelta = ReplicateX4( timeDelta );
+
+	CParticleBatchSIMD< SimpleParticle > batch;
+	SimpleParticle *pParticle = (SimpleParticle*)pIterator->GetFirst();
+	while ( pParticle )
+	{
+		// Wind only touches the velocity of particles that asked for it.
+		CSimpleEmitter::UpdateVelocity( pParticle, timeDelta );
+		batch.Add( pParticle );
+
+		// Move the iterator past the batch before it removes anything.
+		pParticle = (SimpleParticle*)pIterator->GetNext();
+		if ( batch.IsFull() || !pParticle )
+		{
+			int nDeadMask = batch.Integrate( fl4TimeDelta );
+
+			fltx4 roll = Four_Zeros, rollDelta = Four_Zeros;
+			for ( int i = 0; i < batch.Count(); i++ )
+			{
+				SubFloat( roll, i ) = batch.Get( i )->m_flRoll;
+				SubFloat( rollDelta, i ) = batch.Get( i )->m_flRollDelta;
+			}
+			roll = MaddSIMD( rollDelta, fl4TimeDelta, roll );
+			for ( int i = 0; i < batch.Count(); i++ )
+			{
+				batch.Get( i )->m_flRoll = SubFloat( roll, i );
+			}
+
+			batch.Flush( pIterator, nDeadMask );
+		}
+	}
+}
+
 void CSimpleEmitter::RenderParticles( CParticleRenderIterator *pIterator )
 {
 	const SimpleParticle *pParticle = (const SimpleParticle *)pIterator->GetFirst();
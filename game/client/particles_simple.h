@@ -14,6 +14,10 @@
 #include "particlemgr.h"
 #include "particlesphererenderer.h"
 #include "smartptr.h"
+#include "mathlib/ssemath.h"
+
+
+extern ConVar cl_particle_simd;
 
 
 // ------------------------------------------------------------------------------------------------ //
@@ -152,6 +156,82 @@ public:
 };
 
 
+//-----------------------------------------------------------------------------
+// Gathers up to four particles so their motion and lifetime can be stepped
+// together in SIMD registers. T needs m_vecVelocity, m_flLifetime and m_flDieTime.
+//-----------------------------------------------------------------------------
+template< class T >
+class CParticleBatchSIMD
+{
+public:
+	CParticleBatchSIMD() : m_nCount( 0 ) {}
+
+	int		Count() const			{ return m_nCount; }
+	bool	IsFull() const			{ return m_nCount == 4; }
+	void	Add( T *pParticle )		{ Assert( m_nCount < 4 ); m_pParticles[m_nCount++] = pParticle; }
+	T*		Get( int i ) const		{ return m_pParticles[i]; }
+
+	// Moves the particles along their velocity and ages them. Returns a bit for each particle that should die.
+	int		Integrate( const fltx4 &fl4TimeDelta );
+
+	// Removes the particles in nDeadMask and empties the batch. The iterator must already be past them.
+	void	Flush( CParticleSimulateIterator *pIterator, int nDeadMask );
+
+private:
+	T		*m_pParticles[4];
+	int		m_nCount;
+};
+
+
+template< class T >
+inline int CParticleBatchSIMD<T>::Integrate( const fltx4 &fl4TimeDelta )
+{
+	fltx4 x = Four_Zeros, y = Four_Zeros, z = Four_Zeros;
+	fltx4 vx = Four_Zeros, vy = Four_Zeros, vz = Four_Zeros;
+	fltx4 life = Four_Zeros, die = Four_Zeros;
+	for ( int i = 0; i < m_nCount; i++ )
+	{
+		const T *pParticle = m_pParticles[i];
+		SubFloat( x, i ) = pParticle->m_Pos.x;
+		SubFloat( y, i ) = pParticle->m_Pos.y;
+		SubFloat( z, i ) = pParticle->m_Pos.z;
+		SubFloat( vx, i ) = pParticle->m_vecVelocity.x;
+		SubFloat( vy, i ) = pParticle->m_vecVelocity.y;
+		SubFloat( vz, i ) = pParticle->m_vecVelocity.z;
+		SubFloat( life, i ) = pParticle->m_flLifetime;
+		SubFloat( die, i ) = pParticle->m_flDieTime;
+	}
+
+	x = MaddSIMD( vx, fl4TimeDelta, x );
+	y = MaddSIMD( vy, fl4TimeDelta, y );
+	z = MaddSIMD( vz, fl4TimeDelta, z );
+	life = AddSIMD( life, fl4TimeDelta );
+
+	for ( int i = 0; i < m_nCount; i++ )
+	{
+		T *pParticle = m_pParticles[i];
+		pParticle->m_Pos.Init( SubFloat( x, i ), SubFloat( y, i ), SubFloat( z, i ) );
+		pParticle->m_flLifetime = SubFloat( life, i );
+	}
+
+	return TestSignSIMD( CmpGeSIMD( life, die ) ) & ( ( 1 << m_nCount ) - 1 );
+}
+
+
+template< class T >
+inline void CParticleBatchSIMD<T>::Flush( CParticleSimulateIterator *pIterator, int nDeadMask )
+{
+	for ( int i = 0; i < m_nCount; i++ )
+	{
+		if ( nDeadMask & ( 1 << i ) )
+		{
+			pIterator->RemoveParticle( m_pParticles[i] );
+		}
+	}
+	m_nCount = 0;
+}
+
+
 
 // CSimpleEmitter implements a common way to simulate and render particles.
 //
@@ -171,6 +251,7 @@ public:
 
 	virtual void	SimulateParticles( CParticleSimulateIterator *pIterator );
 	virtual void	RenderParticles( CParticleRenderIterator *pIterator );
+	virtual bool	IsSimulationThreadSafe() const	{ return m_bDefaultUpdates; }
 
 	void			SetNearClip( float nearClipMin, float nearClipMax );
 
@@ -194,6 +275,11 @@ protected:
 
 private:
 	CSimpleEmitter( const CSimpleEmitter & ); // not defined, not accessible
+
+	void			SimulateParticlesSIMD( CParticleSimulateIterator *pIterator );
+
+	// Set by Create(). This is a plain CSimpleEmitter, so none of the Update* functions are overridden.
+	bool			m_bDefaultUpdates;
 };
 
 //==================================================
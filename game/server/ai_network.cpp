@@ -117,6 +117,22 @@ CAI_Network::CAI_Network()
 		m_NearestCache[node].expiration	= FLT_MIN;
 	}
 
+	for (int i=0;i<NODEVIS_CACHE_SIZE;i++)
+	{
+		m_NodeVisCache[i].node			= NO_NODE;
+		m_NodeVisCache[i].expiration	= FLT_MIN;
+	}
+
+	m_vGridMins.Init();
+	m_flGridCellSize	= NODEGRID_CELL_SIZE;
+	m_nGridCellsX		= 0;
+	m_nGridCellsY		= 0;
+	m_nGridNodes		= 0;
+	for (int hull=0;hull<NUM_HULLS;hull++)
+	{
+		m_flGridHullShift[hull] = 0;
+	}
+
 #ifdef AI_NODE_TREE
 	m_pNodeTree = NULL;
 #endif
@@ -190,6 +206,136 @@ int	CAI_Network::FindBSSmallest(CVarBitVec *bitString, float *float_array, int a
 	return winIndex;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Sort the nodes into a uniform grid over their origins, so the 
+//			nearest node queries only look at the nodes around the query point.
+//			Also records, for each hull, how far the hull positions of the
+//			nodes can be from the node origins.
+//-----------------------------------------------------------------------------
+
+void CAI_Network::BuildNodeGrid()
+{
+	m_GridCellStart.RemoveAll();
+	m_GridNodes.RemoveAll();
+	m_GridNodeX.RemoveAll();
+	m_GridNodeY.RemoveAll();
+	m_GridNodeZ.RemoveAll();
+
+	m_nGridNodes	= m_iNumNodes;
+	m_nGridCellsX	= 0;
+	m_nGridCellsY	= 0;
+
+	for (int hull=0;hull<NUM_HULLS;hull++)
+	{
+		m_flGridHullShift[hull] = 0;
+	}
+
+	if ( !m_iNumNodes )
+		return;
+
+	Vector mins( FLT_MAX, FLT_MAX, FLT_MAX );
+	Vector maxs( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+	int node;
+	for ( node = 0; node < m_iNumNodes; node++ )
+	{
+		CAI_Node *pNode = m_pAInode[node];
+		const Vector &origin = pNode->GetOrigin();
+
+		VectorMin( mins, origin, mins );
+		VectorMax( maxs, origin, maxs );
+
+		for (int hull=0;hull<NUM_HULLS;hull++)
+		{
+			float flShift = (pNode->GetPosition(hull) - origin).Length2D();
+			m_flGridHullShift[hull] = MAX( m_flGridHullShift[hull], flShift );
+		}
+	}
+
+	float flExtent = MAX( maxs.x - mins.x, maxs.y - mins.y );
+
+	m_vGridMins			= mins;
+	m_flGridCellSize	= MAX( (float)NODEGRID_CELL_SIZE, flExtent / NODEGRID_MAX_CELLS + 1.0f );
+	m_nGridCellsX		= (int)( (maxs.x - mins.x) / m_flGridCellSize ) + 1;
+	m_nGridCellsY		= (int)( (maxs.y - mins.y) / m_flGridCellSize ) + 1;
+
+	int nCells = m_nGridCellsX * m_nGridCellsY;
+
+	// Count the nodes in each cell, then lay the cells out one after another
+	CUtlVector<int> nodeCell;
+	nodeCell.SetCount( m_iNumNodes );
+
+	m_GridCellStart.SetCount( nCells + 1 );
+	memset( m_GridCellStart.Base(), 0, m_GridCellStart.Count() * sizeof(int) );
+
+	for ( node = 0; node < m_iNumNodes; node++ )
+	{
+		const Vector &origin = m_pAInode[node]->GetOrigin();
+
+		int x, y;
+		GetNodeGridCell( origin.x, origin.y, &x, &y );
+
+		nodeCell[node] = y * m_nGridCellsX + x;
+		m_GridCellStart[nodeCell[node] + 1]++;
+	}
+
+	for ( int cell = 0; cell < nCells; cell++ )
+	{
+		m_GridCellStart[cell + 1] += m_GridCellStart[cell];
+	}
+
+	CUtlVector<int> cellNext;
+	cellNext.CopyArray( m_GridCellStart.Base(), nCells );
+
+	m_GridNodes.SetCount( m_iNumNodes );
+	m_GridNodeX.SetCount( m_iNumNodes );
+	m_GridNodeY.SetCount( m_iNumNodes );
+	m_GridNodeZ.SetCount( m_iNumNodes );
+
+	for ( node = 0; node < m_iNumNodes; node++ )
+	{
+		const Vector &origin = m_pAInode[node]->GetOrigin();
+		int i = cellNext[nodeCell[node]]++;
+
+		m_GridNodes[i] = node;
+		m_GridNodeX[i] = origin.x;
+		m_GridNodeY[i] = origin.y;
+		m_GridNodeZ[i] = origin.z;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Grid cell containing the given point, clamped to the grid
+//-----------------------------------------------------------------------------
+
+void CAI_Network::GetNodeGridCell( float x, float y, int *pX, int *pY ) const
+{
+	*pX = clamp( (int)floor( ( x - m_vGridMins.x ) / m_flGridCellSize ), 0, m_nGridCellsX - 1 );
+	*pY = clamp( (int)floor( ( y - m_vGridMins.y ) / m_flGridCellSize ), 0, m_nGridCellsY - 1 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Add a node to a distance list that keeps at most maxListCount
+//			nodes, farthest at the head. The grid visits nodes out of index
+//			order, so ties go to the lower index to keep the nodes a scan
+//			over every node would keep.
+//-----------------------------------------------------------------------------
+
+static void AddNearNode( CNodeList &result, int maxListCount, int node, float flDist )
+{
+	AI_NearNode_t nearNode( node, flDist );
+
+	if ( result.Count() == maxListCount )
+	{
+		if ( !CNodeList::IsLowerPriorityByIndex( result.ElementAtHead(), nearNode ) )
+			return;
+
+		result.RemoveAtHead();
+	}
+
+	result.Insert( nearNode );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Build a list of nearby nodes sorted by distance
 // Input  : &list - 
@@ -202,47 +348,145 @@ int CAI_Network::ListNodesInBox( CNodeList &list, int maxListCount, const Vector
 {
 	CNodeList result;
 	
-	result.SetLessFunc( CNodeList::RevIsLowerPriority );
+	result.SetLessFunc( CNodeList::RevIsLowerPriorityByIndex );
 	
 	// NOTE: maxListCount must be > 0 or this will crash
-	bool full = false;
-	float flClosest = 1000000.0 * 1000000;
-	int closest = 0;
+	if ( m_nGridNodes != m_iNumNodes )
+		BuildNodeGrid();
+
+	list.RemoveAll();
+	if ( !m_iNumNodes )
+		return 0;
 
-// UNDONE: Store the nodes in a tree and query the tree instead of the entire list!!!
-	for ( int node = 0; node < m_iNumNodes; node++ )
+	int x0, y0, x1, y1;
+	GetNodeGridCell( mins.x, mins.y, &x0, &y0 );
+	GetNodeGridCell( maxs.x, maxs.y, &x1, &y1 );
+
+	for ( int y = y0; y <= y1; y++ )
 	{
-		CAI_Node *pNode = m_pAInode[node];
-		const Vector &origin = pNode->GetOrigin();
-		// in box?
-		if ( origin.x < mins.x || origin.x > maxs.x ||
-			 origin.y < mins.y || origin.y > maxs.y ||
-			 origin.z < mins.z || origin.z > maxs.z )
-			continue;
+		for ( int x = x0; x <= x1; x++ )
+		{
+			int cell = y * m_nGridCellsX + x;
+			for ( int i = m_GridCellStart[cell]; i < m_GridCellStart[cell + 1]; i++ )
+			{
+				// in box?
+				if ( m_GridNodeX[i] < mins.x || m_GridNodeX[i] > maxs.x ||
+					 m_GridNodeY[i] < mins.y || m_GridNodeY[i] > maxs.y ||
+					 m_GridNodeZ[i] < mins.z || m_GridNodeZ[i] > maxs.z )
+					continue;
 
-		if ( !pFilter->NodeIsValid(*pNode) )
-			continue;
+				CAI_Node *pNode = m_pAInode[m_GridNodes[i]];
+				if ( !pFilter->NodeIsValid(*pNode) )
+					continue;
+
+				AddNearNode( result, maxListCount, m_GridNodes[i], pFilter->NodeDistanceSqr(*pNode) );
+			}
+		}
+	}
+	
+	while ( result.Count() )
+	{
+		list.Insert( result.ElementAtHead() );
+		result.RemoveAtHead();
+	}
+
+	return list.Count();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Same result as ListNodesInBox() on the box origin - ext to 
+//			origin + ext, for a filter that measures distance from origin
+//			to the node position of the given hull. Cells are visited in
+//			rings around origin, and the search stops once the list is full
+//			and no node in the remaining rings can be closer.
+//-----------------------------------------------------------------------------
+
+int CAI_Network::ListNearestNodes( CNodeList &list, int maxListCount, const Vector &origin, const Vector &ext, Hull_t hull, INodeListFilter *pFilter )
+{
+	CNodeList result;
+	
+	result.SetLessFunc( CNodeList::RevIsLowerPriorityByIndex );
+	
+	// NOTE: maxListCount must be > 0 or this will crash
+	if ( m_nGridNodes != m_iNumNodes )
+		BuildNodeGrid();
+
+	list.RemoveAll();
+	if ( !m_iNumNodes )
+		return 0;
+
+	Vector mins = origin - ext;
+	Vector maxs = origin + ext;
+
+	int x0, y0, x1, y1;
+	GetNodeGridCell( mins.x, mins.y, &x0, &y0 );
+	GetNodeGridCell( maxs.x, maxs.y, &x1, &y1 );
+
+	int cx, cy;
+	GetNodeGridCell( origin.x, origin.y, &cx, &cy );
 
-		float flDist = pFilter->NodeDistanceSqr(*pNode);
+	// Hull positions can be off the node origin, nodes can be this much closer than their cell
+	float flShift = ( hull >= 0 && hull < NUM_HULLS ) ? m_flGridHullShift[hull] : 0;
 
-		if ( flDist < flClosest )
+	for ( int ring = 0; ; ring++ )
+	{
+		if ( ring > 0 && result.Count() == maxListCount )
 		{
-			closest = node;
-			flClosest = flDist;
+			// Every node not visited yet is outside the square of the rings so far. Sides
+			// at the edge of the box or grid have nothing beyond them.
+			float flBound = FLT_MAX;
+			if ( cx - ring >= x0 )
+				flBound = MIN( flBound, origin.x - ( m_vGridMins.x + ( cx - ring + 1 ) * m_flGridCellSize ) );
+			if ( cx + ring <= x1 )
+				flBound = MIN( flBound, ( m_vGridMins.x + ( cx + ring ) * m_flGridCellSize ) - origin.x );
+			if ( cy - ring >= y0 )
+				flBound = MIN( flBound, origin.y - ( m_vGridMins.y + ( cy - ring + 1 ) * m_flGridCellSize ) );
+			if ( cy + ring <= y1 )
+				flBound = MIN( flBound, ( m_vGridMins.y + ( cy + ring ) * m_flGridCellSize ) - origin.y );
+
+			flBound -= flShift;
+			if ( flBound > 0 && Square( flBound ) > result.ElementAtHead().dist )
+				break;
 		}
 
-		if ( !full || (flDist < result.ElementAtHead().dist) )
+		int ry0 = MAX( cy - ring, y0 );
+		int ry1 = MIN( cy + ring, y1 );
+		int rx0 = MAX( cx - ring, x0 );
+		int rx1 = MIN( cx + ring, x1 );
+
+		for ( int y = ry0; y <= ry1; y++ )
 		{
-			if ( full )
-				result.RemoveAtHead();
+			bool bEdgeRow = ( y == cy - ring || y == cy + ring );
 
-			result.Insert( AI_NearNode_t(node, flDist) );
-	
-			full = (result.Count() == maxListCount);
+			for ( int x = rx0; x <= rx1; x++ )
+			{
+				// Only the cells on the ring, the inside was done already
+				if ( !bEdgeRow && x != cx - ring && x != cx + ring )
+					continue;
+
+				int cell = y * m_nGridCellsX + x;
+				for ( int i = m_GridCellStart[cell]; i < m_GridCellStart[cell + 1]; i++ )
+				{
+					// in box?
+					if ( m_GridNodeX[i] < mins.x || m_GridNodeX[i] > maxs.x ||
+						 m_GridNodeY[i] < mins.y || m_GridNodeY[i] > maxs.y ||
+						 m_GridNodeZ[i] < mins.z || m_GridNodeZ[i] > maxs.z )
+						continue;
+
+					CAI_Node *pNode = m_pAInode[m_GridNodes[i]];
+					if ( !pFilter->NodeIsValid(*pNode) )
+						continue;
+
+					AddNearNode( result, maxListCount, m_GridNodes[i], pFilter->NodeDistanceSqr(*pNode) );
+				}
+			}
 		}
+
+		// Whole box covered?
+		if ( cx - ring <= x0 && cx + ring >= x1 && cy - ring <= y0 && cy + ring >= y1 )
+			break;
 	}
 	
-	list.RemoveAll();
 	while ( result.Count() )
 	{
 		list.Insert( result.ElementAtHead() );
@@ -277,16 +521,11 @@ int	CAI_Network::NearestNodeToPoint( CAI_BaseNPC *pNPC, const Vector &vecOrigin,
 	{
 		if ( bCheckVisibility )
 		{
-			trace_t tr;
-
 			Vector vTestLoc = ( pNPC ) ? 
 								m_pAInode[cachedNode]->GetPosition(pNPC->GetHullType()) + pNPC->GetViewOffset() : 
 								m_pAInode[cachedNode]->GetOrigin();
 
-			CTraceFilterNav traceFilter( pNPC, true, pNPC, COLLISION_GROUP_NONE );
-			AI_TraceLine ( vecOrigin, vTestLoc, MASK_NPCSOLID_BRUSHONLY, &traceFilter, &tr );
-
-			if ( tr.fraction != 1.0 )
+			if ( !IsNodeVisible( pNPC, cachedNode, vecOrigin, vTestLoc ) )
 				cachedNode = NO_NODE;
 		}
 
@@ -318,7 +557,7 @@ int	CAI_Network::NearestNodeToPoint( CAI_BaseNPC *pNPC, const Vector &vecOrigin,
 		ext.Init( MAX_AIR_NODE_LINK_DIST, MAX_AIR_NODE_LINK_DIST, MAX_AIR_NODE_LINK_DIST );
 	}
 
-	ListNodesInBox( list, MAX_NEAR_NODES, vecOrigin - ext, vecOrigin + ext, &filter );
+	ListNearestNodes( list, MAX_NEAR_NODES, vecOrigin, ext, (pNPC) ? pNPC->GetHullType() : HULL_NONE, &filter );
 
 	// --------------------------------------------------------------
 	//  Now find a reachable node searching the close nodes first
@@ -339,18 +578,13 @@ int	CAI_Network::NearestNodeToPoint( CAI_BaseNPC *pNPC, const Vector &vecOrigin,
 
 		if ( bCheckVisibility )
 		{
-			trace_t tr;
-
 			Vector vTestLoc = ( pNPC ) ? 
 								m_pAInode[smallest]->GetPosition(pNPC->GetHullType()) + pNPC->GetNodeViewOffset() : 
 								m_pAInode[smallest]->GetOrigin();
 
 			Vector vecVisOrigin = vecOrigin + Vector(0,0,1);
 
-			CTraceFilterNav traceFilter( pNPC, true, pNPC, COLLISION_GROUP_NONE );
-			AI_TraceLine ( vecVisOrigin, vTestLoc, MASK_NPCSOLID_BRUSHONLY, &traceFilter, &tr );
-
-			if ( tr.fraction != 1.0 )
+			if ( !IsNodeVisible( pNPC, smallest, vecVisOrigin, vTestLoc ) )
 				continue;
 		}
 
@@ -386,6 +620,63 @@ int	CAI_Network::NearestNodeToPoint(const Vector &vPosition, bool bCheckVisibili
 	return NearestNodeToPoint( NULL, vPosition, bCheckVisibility );
 }
 	
+//-----------------------------------------------------------------------------
+// Purpose: Test if a node can be seen from a point, through the node 
+//			visibility cache. Trace starts within NODEVIS_CACHE_SNAP units 
+//			of each other share a result, trace ends must match. The trace
+//			filter depends on the NPC, so results are kept per NPC and hull.
+//-----------------------------------------------------------------------------
+
+bool CAI_Network::IsNodeVisible( CAI_BaseNPC *pNPC, int nodeID, const Vector &vecStart, const Vector &vecEnd )
+{
+	int start[3];
+	for ( int i = 0; i < 3; i++ )
+	{
+		start[i] = (int)floor( vecStart[i] * ( 1.0f / NODEVIS_CACHE_SNAP ) );
+	}
+
+	unsigned int npc = pNPC ? (unsigned int)pNPC->GetRefEHandle().ToInt() : 0;
+	int hull = pNPC ? pNPC->GetHullType() : HULL_NONE;
+
+	unsigned int hash = ( (unsigned int)nodeID * 73856093 ) ^ ( (unsigned int)start[0] * 19349663 ) ^ 
+						( (unsigned int)start[1] * 83492791 ) ^ ( (unsigned int)start[2] * 25165843 ) ^
+						( npc * 2654435761u ) ^ ( (unsigned int)hull * 40503 );
+	NodeVisCache_t &entry = m_NodeVisCache[ ( hash ^ ( hash >> 16 ) ) & ( NODEVIS_CACHE_SIZE - 1 ) ];
+
+	bool bUseCache = !ai_no_node_cache.GetBool();
+	if ( bUseCache &&
+		 entry.node == nodeID && 
+		 entry.npc == npc &&
+		 entry.hull == hull &&
+		 entry.expiration > gpGlobals->curtime &&
+		 entry.start[0] == start[0] && entry.start[1] == start[1] && entry.start[2] == start[2] &&
+		 entry.vEnd == vecEnd )
+	{
+		return entry.bVisible;
+	}
+
+	trace_t tr;
+	CTraceFilterNav traceFilter( pNPC, true, pNPC, COLLISION_GROUP_NONE );
+	AI_TraceLine ( vecStart, vecEnd, MASK_NPCSOLID_BRUSHONLY, &traceFilter, &tr );
+
+	bool bVisible = ( tr.fraction == 1.0 );
+
+	if ( bUseCache )
+	{
+		entry.node			= nodeID;
+		entry.npc			= npc;
+		entry.hull			= hull;
+		entry.start[0]		= start[0];
+		entry.start[1]		= start[1];
+		entry.start[2]		= start[2];
+		entry.vEnd			= vecEnd;
+		entry.expiration	= gpGlobals->curtime + NODEVIS_CACHE_LIFE;
+		entry.bVisible		= bVisible;
+	}
+
+	return bVisible;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Check nearest node cache for checkPos and return cached nearest
 //			node if it exists in the cache.  Doesn't care about reachability,
@@ -73,6 +73,17 @@ public:
 		// nodes with lower distance are lower priority
 		return node2.dist > node1.dist;
 	}
+	static bool IsLowerPriorityByIndex( const AI_NearNode_t &node1, const AI_NearNode_t &node2 )
+	{
+		// as IsLowerPriority, but ties go to the lower index
+		if ( node1.dist != node2.dist )
+			return node1.dist > node2.dist;
+		return node1.nodeIndex > node2.nodeIndex;
+	}
+	static bool RevIsLowerPriorityByIndex( const AI_NearNode_t &node1, const AI_NearNode_t &node2 )
+	{
+		return IsLowerPriorityByIndex( node2, node1 );
+	}
 
 	CNodeList( int growSize = 0, int initSize = 0 ) : CUtlPriorityQueue<AI_NearNode_t>( growSize, initSize, IsLowerPriority ) {}
 	CNodeList( AI_NearNode_t *pMemory, int count ) : CUtlPriorityQueue<AI_NearNode_t>( pMemory, count, IsLowerPriority ) {}
@@ -106,6 +117,8 @@ public:
 	int				NearestNodeToPoint( CAI_BaseNPC* pNPC, const Vector &vecOrigin, bool bCheckVisiblity = true ) { return NearestNodeToPoint( pNPC, vecOrigin, bCheckVisiblity, NULL ); }
 	int				NearestNodeToPoint(const Vector &vPosition, bool bCheckVisiblity = true );
 	
+	void			BuildNodeGrid();				// Index node positions for the nearest node queries, call when the graph is loaded or built
+
 	int				NumNodes() const 	{ return m_iNumNodes; }
 	CAI_Node*		GetNode( int id, bool bHandleError = true )
 	{ 
@@ -138,6 +151,11 @@ private:
 	int				GetCachedNode(const Vector &checkPos, Hull_t nHull, int *pCachePos);
 
 	int				ListNodesInBox( CNodeList &list, int maxListCount, const Vector &mins, const Vector &maxs, INodeListFilter *pFilter );
+	int				ListNearestNodes( CNodeList &list, int maxListCount, const Vector &origin, const Vector &ext, Hull_t hull, INodeListFilter *pFilter );
+
+	bool			IsNodeVisible( CAI_BaseNPC *pNPC, int nodeID, const Vector &vecStart, const Vector &vecEnd );
+
+	void			GetNodeGridCell( float x, float y, int *pX, int *pY ) const;
 
 	//---------------------------------
 
@@ -167,6 +185,51 @@ private:
 	NearNodeCache_T		m_NearestCache[NEARNODE_CACHE_SIZE];	// Cache of nearest nodes
 	int					m_iNearestCacheNext;					// Oldest record in the cache
 
+	//---------------------------------
+	// Uniform grid over the node origins, in the XY plane. The nodes of 
+	// cell i are m_GridNodes[ m_GridCellStart[i] ] to m_GridNodes[ m_GridCellStart[i+1] - 1 ]
+
+	enum
+	{
+		NODEGRID_CELL_SIZE	= 256,
+		NODEGRID_MAX_CELLS	= 128,		// per axis, cells grow to cover large maps
+	};
+
+	Vector				m_vGridMins;
+	float				m_flGridCellSize;
+	int					m_nGridCellsX;
+	int					m_nGridCellsY;
+	int					m_nGridNodes;							// Number of nodes when the grid was built
+	CUtlVector<int>		m_GridCellStart;
+	CUtlVector<int>		m_GridNodes;
+	CUtlVector<float>	m_GridNodeX;							// Node origins, in grid order
+	CUtlVector<float>	m_GridNodeY;
+	CUtlVector<float>	m_GridNodeZ;
+	float				m_flGridHullShift[NUM_HULLS];			// Furthest a hull position is from its node origin, in XY
+
+	//---------------------------------
+	// Results of the node visibility traces, indexed by a hash of the trace
+
+	enum
+	{
+		NODEVIS_CACHE_SIZE	= 256,		// must be a power of two
+		NODEVIS_CACHE_LIFE	= 1,
+		NODEVIS_CACHE_SNAP	= 4,		// trace starts closer than this share results
+	};
+
+	struct NodeVisCache_t
+	{
+		int		node;
+		unsigned int npc;				// EHANDLE of the NPC the trace was filtered for, 0 for none
+		int		hull;
+		int		start[3];				// Trace start, snapped
+		Vector	vEnd;
+		float	expiration;
+		bool	bVisible;
+	};
+
+	NodeVisCache_t		m_NodeVisCache[NODEVIS_CACHE_SIZE];
+
 #ifdef AI_NODE_TREE
 	ISpatialPartition * m_pNodeTree;
 	CUtlVector<int>		m_GatheredNodes;
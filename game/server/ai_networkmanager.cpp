@@ -710,6 +710,8 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 		DevMsg( "\n** Should run \"Check For Problems\" on the VMF then verify dynamic links\n" );
 #endif
 
+	m_pNetwork->BuildNodeGrid();
+
 	gm_fNetworksLoaded = true;
 	CAI_DynamicLink::gm_bInitialized = false;
 }
@@ -908,6 +910,7 @@ void CAI_NetworkManager::BuildNetworkGraph( void )
 
 	CAI_DynamicLink::gm_bInitialized = false;
 	g_AINetworkBuilder.Build( m_pNetwork );
+	m_pNetwork->BuildNodeGrid();
 
 	// If I'm loading for the first time save.  Otherwise I'm 
 	// doing a wc edit and I don't want to save
@@ -20,6 +20,10 @@ class CAI_Node;
 class CAI_Link;
 class CAI_TestHull;
 
+// A CVarBitVec of 32 bits or fewer points m_pInt at its own storage, so
+// m_NeighborsTable has to relocate them with the copy constructor
+DECLARE_NOT_TRIVIALLY_RELOCATABLE( CVarBitVec );
+
 //-----------------------------------------------------------------------------
 // CAI_NetworkManager
 //
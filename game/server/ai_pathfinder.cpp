@@ -310,13 +310,25 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 	nodeH[startID] = 0.1*(pAInode[startID]->GetPosition(GetHullType())-pAInode[endID]->GetPosition(GetHullType())).Length(); // Don't want to over estimate
 	nodeF[startID] = nodeG[startID] + nodeH[startID];
 
+	// Open nodes by F. A node is pushed again whenever its F changes, entries 
+	// for closed nodes or stale F are skipped when they come up. Ties go to
+	// the lowest node index, as with FindBSSmallest().
+	CNodeList openList( 0, 32 );
+	openList.SetLessFunc( CNodeList::IsLowerPriorityByIndex );
+
 	openBS.Set(startID);
 	closeBS.Set( startID );
+	openList.Insert( AI_NearNode_t( startID, nodeF[startID] ) );
 
 	// --------------- FIND BEST PATH ------------------
-	while (!openBS.IsAllClear()) 
+	while ( openList.Count() ) 
 	{
-		int smallestID = CAI_Network::FindBSSmallest(&openBS,nodeF,nNodes);
+		int smallestID = openList.ElementAtHead().nodeIndex;
+		float smallestF = openList.ElementAtHead().dist;
+		openList.RemoveAtHead();
+
+		if ( !openBS.IsBitSet(smallestID) || smallestF != nodeF[smallestID] )
+			continue;
 	
 		openBS.Clear(smallestID);
 
@@ -362,6 +374,7 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 
 				closeBS.Set( testID );
 				openBS.Set( testID );
+				openList.Insert( AI_NearNode_t( testID, nodeF[testID] ) );
 			}
 		}
 	}
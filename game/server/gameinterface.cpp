@@ -67,6 +67,7 @@
 #include "util.h"
 #include "tier0/icommandline.h"
 #include "datacache/imdlcache.h"
+#include "bone_setup.h"
 #include "engine/iserverplugin.h"
 #ifdef _WIN32
 #include "ienginevgui.h"
@@ -1388,6 +1389,8 @@ void CServerGameDLL::LevelShutdown( void )
 
 	IGameSystem::LevelShutdownPostEntityAllSystems();
 
+	Studio_FlushDecodedAnimCache();
+
 	// In case we quit out during initial load
 	CBaseEntity::SetAllowPrecache( false );
 
@@ -629,29 +629,14 @@ bool CHL2MP_Player::WantsLagCompensationOnEntity( const CBasePlayer *pPlayer, co
 	if ( pEntityTransmitBits && !pEntityTransmitBits->Get( pPlayer->entindex() ) )
 		return false;
 
-	const Vector &vMyOrigin = GetAbsOrigin();
 	const Vector &vHisOrigin = pPlayer->GetAbsOrigin();
+	return IsInLagCompensationCone( pPlayer, pCmd, vHisOrigin, vHisOrigin );
+}
 
-	// get max distance player could have moved within max lag compensation time, 
-	// multiply by 1.5 to to avoid "dead zones"  (sqrt(2) would be the exact value)
-	float maxDistance = 1.5 * pPlayer->MaxSpeed() * sv_maxunlag.GetFloat();
-
-	// If the player is within this distance, lag compensate them in case they're running past us.
-	if ( vHisOrigin.DistTo( vMyOrigin ) < maxDistance )
-		return true;
-
-	// If their origin is not within a 45 degree cone in front of us, no need to lag compensate.
-	Vector vForward;
-	AngleVectors( pCmd->viewangles, &vForward );
-	
-	Vector vDiff = vHisOrigin - vMyOrigin;
-	VectorNormalize( vDiff );
-
-	float flCosAngle = 0.707107f;	// 45 degree angle
-	if ( vForward.Dot( vDiff ) < flCosAngle )
-		return false;
-
-	return true;
+bool CHL2MP_Player::WantsLagCompensationOnHistory( const CBasePlayer *pPlayer, const CUserCmd *pCmd, const Vector &vecSweptMins, const Vector &vecSweptMaxs ) const
+{
+	// Same distance and view cone test as above, over the whole box
+	return IsInLagCompensationCone( pPlayer, pCmd, vecSweptMins, vecSweptMaxs );
 }
 
 Activity CHL2MP_Player::TranslateTeamActivity( Activity ActToTranslate )
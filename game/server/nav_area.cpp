@@ -558,6 +558,8 @@ CNavArea::~CNavArea()
  */
 void CNavArea::ConnectElevators( void )
 {
+	TheNavMesh->OnTopologyChanged();
+
 	m_elevator = NULL;
 	m_attributeFlags &= ~NAV_MESH_HAS_ELEVATOR;
 	m_elevatorAreas.RemoveAll();
@@ -758,6 +760,8 @@ bool CNavArea::HasNodes( void ) const
  */
 void CNavArea::OnDestroyNotify( CNavArea *dead )
 {
+	TheNavMesh->OnTopologyChanged();
+
 	NavConnect con;
 	con.area = dead;
 	for( int d=0; d<NUM_DIRECTIONS; ++d )
@@ -801,6 +805,8 @@ void CNavArea::ConnectTo( CNavArea *area, NavDirType dir )
 			return;
 	}
 
+	TheNavMesh->OnTopologyChanged();
+
 	NavConnect con;
 	con.area = area;
 	con.length = ( area->GetCenter() - GetCenter() ).Length();
@@ -845,6 +851,8 @@ void CNavArea::ConnectTo( CNavLadder *ladder )
  */
 void CNavArea::Disconnect( CNavArea *area )
 {
+	TheNavMesh->OnTopologyChanged();
+
 	NavConnect connect;
 	connect.area = area;
 
@@ -876,6 +884,8 @@ void CNavArea::Disconnect( CNavArea *area )
  */
 void CNavArea::Disconnect( CNavLadder *ladder )
 {
+	TheNavMesh->OnTopologyChanged();
+
 	NavLadderConnect con;
 	con.ladder = ladder;
 
@@ -4740,6 +4750,16 @@ void CNavArea::UpdateBlockedFromNavBlockers( void )
 		m_attributeFlags |= NAV_MESH_NAV_BLOCKER;
 	}
 
+	for ( int i=0; i<MAX_NAV_TEAMS; ++i )
+	{
+		if ( oldBlocked[i] != m_isBlocked[i] )
+		{
+			// a per-team change doesn't always change the overall blocked state below
+			TheNavMesh->OnBlockedChanged( this );
+			break;
+		}
+	}
+
 	// If we're unblocked, fire a nav_blocked event.
 	if ( wasBlocked != isBlocked )
 	{
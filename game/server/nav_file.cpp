@@ -11,6 +11,7 @@
 
 #include "cbase.h"
 #include "nav_mesh.h"
+#include "nav_hierarchy.h"
 #include "gamerules.h"
 #include "datacache/imdlcache.h"
 
@@ -1185,6 +1186,11 @@ bool CNavMesh::Save( void ) const
 	//
 	SaveCustomData( fileBuffer );
 
+	//
+	// Store path finding hierarchy, after any derived class data
+	//
+	TheNavHierarchy.Save( fileBuffer );
+
 	if ( !filesystem->WriteFile( filename, "MOD", fileBuffer ) )
 	{
 		Warning( "Unable to save %d bytes to %s\n", fileBuffer.Size(), filename );
@@ -1566,6 +1572,11 @@ NavErrorType CNavMesh::Load( void )
 	//
 	LoadCustomData( fileBuffer, subVersion );
 
+	//
+	// Load path finding hierarchy, if it was saved
+	//
+	TheNavHierarchy.Load( fileBuffer );
+
 	//
 	// Bind pointers, etc
 	//
@@ -1600,6 +1611,8 @@ struct OneWayLink_t
  */
 NavErrorType CNavMesh::PostLoad( unsigned int version )
 {
+	OnTopologyChanged();
+
 	// allow areas to connect to each other, etc
 	FOR_EACH_VEC( TheNavAreas, pit )
 	{
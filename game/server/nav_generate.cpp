@@ -17,6 +17,7 @@
 #include "viewport_panel_names.h"
 //#include "terror/TerrorShared.h"
 #include "fmtstr.h"
+#include "vstdlib/jobthread.h"
 
 #ifdef TERROR
 #include "func_simpleladder.h"
@@ -42,6 +43,8 @@ ConVar nav_generate_fixup_jump_areas( "nav_generate_fixup_jump_areas", "1", FCVA
 ConVar nav_generate_incremental_range( "nav_generate_incremental_range", "2000", FCVAR_CHEAT );
 ConVar nav_generate_incremental_tolerance( "nav_generate_incremental_tolerance", "0", FCVAR_CHEAT, "Z tolerance for adding new nav areas." );
 ConVar nav_area_max_size( "nav_area_max_size", "50", FCVAR_CHEAT, "Max area size created in nav generation" );
+ConVar nav_generate_parallel( "nav_generate_parallel", "0", FCVAR_CHEAT, "Sample walkable space in waves traced by the thread pool. The result does not depend on the number of threads, but differs from serial sampling." );
+ConVar nav_generate_threads( "nav_generate_threads", "0", FCVAR_CHEAT, "Maximum number of threads used by nav_generate_parallel. Zero uses the whole thread pool." );
 
 // Common bounding box for traces
 Vector NavTraceMins( -0.45, -0.45, 0 );
@@ -51,6 +54,26 @@ bool FindGroundForNode( Vector *pos, Vector *normal );	// find a ground Z for po
 const float MaxTraversableHeight = StepHeight;		// max internal obstacle height that can occur between nav nodes and safely disregarded
 const float MinObstacleAreaWidth = 10.0f;			// min width of a nav area we will generate on top of an obstacle
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * One step of walkable space sampling, from a node in a cardinal direction
+ */
+struct NavSampleStep
+{
+	CNavNode *node;							// the node we are stepping from
+	NavDirType dir;
+	Vector from;
+	Vector pos;								// grid position we are trying to reach
+
+	bool isWalkable;						// true if we can move there - the rest is only valid if so
+	Vector to;
+	Vector toNormal;
+	bool isOnDisplacement;
+	float obstacleHeight;
+	float obstacleStartDist;
+	float obstacleEndDist;
+};
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Shortest path cost, paying attention to "blocked" areas
@@ -3435,6 +3458,9 @@ void CNavMesh::BeginGeneration( bool incremental )
 
 	m_generationState = SAMPLE_WALKABLE_SPACE;
 	m_sampleTick = 0;
+	m_sampleStepCount = 0;
+	m_sampleFrontier.RemoveAll();
+	ResetGenerationTimes();
 	m_generationMode = (incremental) ? GENERATE_INCREMENTAL : GENERATE_FULL;
 	lastMsgTime = 0.0f;
 
@@ -3538,6 +3564,8 @@ void CNavMesh::BeginAnalysis( bool quitWhenFinished )
 	m_bQuitWhenFinished = quitWhenFinished;
 	lastMsgTime = 0.0f;
 	m_generationStartTime = Plat_FloatTime();
+	m_sampleStepCount = 0;
+	ResetGenerationTimes();
 }
 
 
@@ -3617,11 +3645,74 @@ static void HideAnalysisProgress( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::ResetGenerationTimes( void )
+{
+	for( int i=0; i<NUM_GENERATION_STATES; ++i )
+	{
+		m_generationStateTime[i] = 0.0f;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Report how long each step of the generation took
+ */
+void CNavMesh::PrintGenerationTimes( void ) const
+{
+	static const char *stateName[ NUM_GENERATION_STATES ] =
+	{
+		"Sampling walkable space",
+		"Creating areas from samples",
+		"Finding hiding spots",
+		"Finding encounter spots",
+		"Finding sniper spots",
+		"Finding earliest occupy times",
+		"Finding light intensity",
+		"Computing mesh visibility",
+		"Custom analysis",
+		"Saving",
+	};
+
+	for( int i=0; i<NUM_GENERATION_STATES; ++i )
+	{
+		if ( m_generationStateTime[i] > 0.0f )
+		{
+			Msg( "  %-32s %8.2f seconds\n", stateName[i], m_generationStateTime[i] );
+		}
+	}
+
+	if ( m_sampleStepCount )
+	{
+		Msg( "  %d nodes from %d sample steps, %s\n", CNavNode::GetListLength(), m_sampleStepCount,
+			nav_generate_parallel.GetBool() ? CFmtStr( "%d threads", g_pThreadPool ? g_pThreadPool->NumThreads() : 0 ).Access() : "serial" );
+	}
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Process the auto-generation for 'maxTime' seconds. return false if generation is complete.
  */
 bool CNavMesh::UpdateGeneration( float maxTime )
+{
+	GenerationStateType state = m_generationState;
+	double startTime = Plat_FloatTime();
+
+	bool isGenerating = UpdateGenerationState( maxTime );
+
+	m_generationStateTime[ state ] += Plat_FloatTime() - startTime;
+
+	return isGenerating;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Run the current step of the auto-generation for 'maxTime' seconds. return false if generation is complete.
+ */
+bool CNavMesh::UpdateGenerationState( float maxTime )
 {
 	double startTime = Plat_FloatTime();
 	static unsigned int s_movedPlayerToArea = 0;	// Last area we moved a player to for lighting calcs
@@ -3639,7 +3730,7 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 			AnalysisProgress( "Sampling walkable space...", 100, m_sampleTick / 10, false );
 			m_sampleTick = ( m_sampleTick + 1 ) % 1000;
 
-			while ( SampleStep() )
+			while ( nav_generate_parallel.GetBool() ? SampleWave() : SampleStep() )
 			{
 				if ( Plat_FloatTime() - startTime > maxTime )
 				{
@@ -3990,6 +4081,7 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 			// generation complete!
 			float generationTime = Plat_FloatTime() - m_generationStartTime;
 			Msg( "Generation complete!  %0.1f seconds elapsed.\n", generationTime );
+			PrintGenerationTimes();
 			bool restart = m_generationMode != GENERATE_INCREMENTAL;
 			m_generationMode = GENERATE_NONE;
 			m_isLoaded = true;
@@ -4075,22 +4167,44 @@ const char *CNavMesh::GetPlayerSpawnName( void ) const
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Add a nav node and connect it.
+ * Check a node for crouch areas and nearby cliffs.
+ * Only traces the world and writes to the node itself, so nodes can be checked in parallel.
+ */
+void CNavMesh::CheckNodeSurroundings( CNavNode *node )
+{
+	node->CheckCrouch();
+
+	// determine if there's a cliff nearby and set an attribute on this node
+	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
+	{
+		NavDirType dir = (NavDirType) i;
+		if ( CheckCliff( node->GetPosition(), dir ) )
+		{
+			node->SetAttributes( node->GetAttributes() | NAV_MESH_CLIFF );
+			break;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Connect the source node to the node at the given position, creating it if needed.
  * Node Z positions are ground level.
  */
-CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDirType dir, CNavNode *source, bool isOnDisplacement, 
-							float obstacleHeight, float obstacleStartDist, float obstacleEndDist )
+CNavNode *CNavMesh::ConnectNode( const Vector &destPos, const Vector &normal, NavDirType dir, CNavNode *source, bool isOnDisplacement,
+							float obstacleHeight, float obstacleStartDist, float obstacleEndDist, bool *isNew )
 {
 	// check if a node exists at this location
 	CNavNode *node = CNavNode::GetNode( destPos );
-	
+
 	// if no node exists, create one
-	bool useNew = false;
+	*isNew = false;
 	if (node == NULL)
 	{
 		node = new CNavNode( destPos, normal, source, isOnDisplacement );
 		OnNodeAdded( node );
-		useNew = true;
+		*isNew = true;
 	}
 
 	// connect source node to new node
@@ -4110,24 +4224,28 @@ CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDir
 		node->MarkAsVisited( OppositeDirection( dir ) );
 	}
 
+	return node;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add a nav node and connect it.
+ * Node Z positions are ground level.
+ */
+CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDirType dir, CNavNode *source, bool isOnDisplacement,
+							float obstacleHeight, float obstacleStartDist, float obstacleEndDist )
+{
+	bool useNew;
+	CNavNode *node = ConnectNode( destPos, normal, dir, source, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist, &useNew );
+
 	if (useNew)
 	{
 		// new node becomes current node
 		m_currentNode = node;
 	}
 
-	node->CheckCrouch();
-
-	// determine if there's a cliff nearby and set an attribute on this node
-	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
-	{
-		NavDirType dir = (NavDirType) i;
-		if ( CheckCliff( node->GetPosition(), dir ) )
-		{
-			node->SetAttributes( node->GetAttributes() | NAV_MESH_CLIFF );
-			break;
-		}
-	}
+	CheckNodeSurroundings( node );
 
 	return node;
 }
@@ -4341,280 +4459,337 @@ static bool IsNodeOverlapped( const Vector& pos, const Vector& offset )
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Search the world and build a map of possible movements.
- * The algorithm begins at the bot's current location, and does a recursive search
- * outwards, tracking all valid steps and generating a directed graph of CNavNodes.
- *
- * Sample the map one "step" in a cardinal direction to learn the map.
- *
- * Returns true if sampling needs to continue, or false if done.
+ * Return the node to continue sampling from once the current one is exhausted, or NULL if sampling is complete
  */
-bool CNavMesh::SampleStep( void )
+CNavNode *CNavMesh::GetNextSampleSeedNode( void )
 {
-	// take a step
-	while( true )
+	// sampling is complete from current seed, try next one
+	CNavNode *node = GetNextWalkableSeedNode();
+
+	if (node == NULL)
 	{
-		if (m_currentNode == NULL)
+		if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
 		{
-			// sampling is complete from current seed, try next one
-			m_currentNode = GetNextWalkableSeedNode();
+			return NULL;
+		}
 
-			if (m_currentNode == NULL)
-			{
-				if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
-				{
-					return false;
-				}
+		// search is exhausted - continue search from ends of ladders
+		for ( int i=0; i<m_ladders.Count(); ++i )
+		{
+			CNavLadder *ladder = m_ladders[i];
 
-				// search is exhausted - continue search from ends of ladders
-				for ( int i=0; i<m_ladders.Count(); ++i )
-				{
-					CNavLadder *ladder = m_ladders[i];
+			// check ladder bottom
+			if ((node = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != 0)
+				break;
 
-					// check ladder bottom
-					if ((m_currentNode = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != 0)
-						break;
+			// check ladder top
+			if ((node = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != 0)
+				break;
+		}
+	}
 
-					// check ladder top
-					if ((m_currentNode = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != 0)
-						break;
-				}
+	// if NULL, all seeds exhausted, sampling complete
+	return node;
+}
 
-				if (m_currentNode == NULL)
-				{
-					// all seeds exhausted, sampling complete
-					return false;
-				}
-			}
-		}
 
-		//
-		// Take a step from this node
-		//
-		for( int dir = NORTH; dir < NUM_DIRECTIONS; dir++ )
-		{
-			if (!m_currentNode->HasVisited( (NavDirType)dir ))
-			{
-				// have not searched in this direction yet
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Set up a sampling step from the given node, one grid step in the given direction
+ */
+static void InitSampleStep( NavSampleStep *step, CNavNode *node, NavDirType dir )
+{
+	// start at current node position
+	Vector pos = *node->GetPosition();
 
-				// start at current node position
-				Vector pos = *m_currentNode->GetPosition();
+	// snap to grid
+	int cx = TheNavMesh->SnapToGrid( pos.x );
+	int cy = TheNavMesh->SnapToGrid( pos.y );
 
-				// snap to grid
-				int cx = SnapToGrid( pos.x );
-				int cy = SnapToGrid( pos.y );
+	// attempt to move to adjacent node
+	switch( dir )
+	{
+		case NORTH:		cy -= GenerationStepSize; break;
+		case SOUTH:		cy += GenerationStepSize; break;
+		case EAST:		cx += GenerationStepSize; break;
+		case WEST:		cx -= GenerationStepSize; break;
+	}
 
-				// attempt to move to adjacent node
-				switch( dir )
-				{
-					case NORTH:		cy -= GenerationStepSize; break;
-					case SOUTH:		cy += GenerationStepSize; break;
-					case EAST:		cx += GenerationStepSize; break;
-					case WEST:		cx -= GenerationStepSize; break;
-				}
+	pos.x = cx;
+	pos.y = cy;
 
-				pos.x = cx;
-				pos.y = cy;
+	step->node = node;
+	step->dir = dir;
+	step->from = *node->GetPosition();
+	step->pos = pos;
+	step->isWalkable = false;
+}
 
-				m_generationDir = (NavDirType)dir;
 
-				// mark direction as visited
-				m_currentNode->MarkAsVisited( m_generationDir );
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Test if we can move from the step's node to its target position, and where we would end up.
+ * Only traces the world and reads the mesh, so any number of steps may be traced at the same time.
+ */
+bool CNavMesh::TraceSampleStep( NavSampleStep *step ) const
+{
+	const Vector &pos = step->pos;
 
-				// sanity check to not generate across the world for incremental generation
-				const float incrementalRange = nav_generate_incremental_range.GetFloat();
-				if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
-				{
-					bool inRange = false;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
-						{
-							inRange = true;
-							break;
-						}
-					}
+	// sanity check to not generate across the world for incremental generation
+	const float incrementalRange = nav_generate_incremental_range.GetFloat();
+	if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
+	{
+		bool inRange = false;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
+			{
+				inRange = true;
+				break;
+			}
+		}
 
-					if ( !inRange )
-					{
-						return true;
-					}
-				}
+		if ( !inRange )
+		{
+			return false;
+		}
+	}
+
+	if ( m_generationMode == GENERATE_SIMPLIFY )
+	{
+		if ( !m_simplifyGenerationExtent.Contains( pos ) )
+		{
+			return false;
+		}
+	}
 
-				if ( m_generationMode == GENERATE_SIMPLIFY )
+	// test if we can move to new position
+	trace_t result;
+	Vector from( step->from );
+	CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
+	Vector to, toNormal;
+	float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
+	if ( TraceAdjacentNode( 0, from, pos, &result ) )
+	{
+		to = result.endpos;
+		toNormal = result.plane.normal;
+	}
+	else
+	{
+		// test going up ClimbUpHeight
+		bool success = false;
+		for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
+		{						
+			trace_t tr;
+			Vector start( from );
+			Vector end( pos );
+			start.z += height;
+			end.z += height;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+			if ( !tr.startsolid && tr.fraction == 1.0f )
+			{
+				if ( !StayOnFloor( &tr ) )
 				{
-					if ( !m_simplifyGenerationExtent.Contains( pos ) )
-					{
-						return true;
-					}
+					break;
 				}
 
-				// test if we can move to new position
-				trace_t result;
-				Vector from( *m_currentNode->GetPosition() );
-				CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
-				Vector to, toNormal;
-				float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
-				if ( TraceAdjacentNode( 0, from, pos, &result ) )
+				to = tr.endpos;
+				toNormal = tr.plane.normal;
+
+				start = end = from;
+				end.z += height;
+				UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+				if ( tr.fraction < 1.0f )
 				{
-					to = result.endpos;
-					toNormal = result.plane.normal;
+					break;
 				}
-				else
+
+				// keep track of far up we had to go to find a path to the next node
+				obstacleHeight = height;
+				success = true;
+				break;
+			}
+			else
+			{
+				// Could not trace from node to node at this height, something is in the way.
+				// Trace in the other direction to see if we hit something
+				Vector vecToObstacleStart = tr.endpos - start;
+				Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
+				if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
 				{
-					// test going up ClimbUpHeight
-					bool success = false;
-					for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
-					{						
-						trace_t tr;
-						Vector start( from );
-						Vector end( pos );
-						start.z += height;
-						end.z += height;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-						if ( !tr.startsolid && tr.fraction == 1.0f )
+					UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+					if ( !tr.startsolid && tr.fraction < 1.0 )
+					{
+						// We hit something going the other direction.  There is some obstacle between the two nodes.
+						Vector vecToObstacleEnd = tr.endpos - start;
+						Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
+						if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
 						{
-							if ( !StayOnFloor( &tr ) )
+							// Remember the distances to start and end of the obstacle (with respect to the "from" node).
+							// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
+							// If we do eventually clear the obstacle, these values will be the start and end distance to the
+							// very tip of the obstacle.
+							obstacleStartDist = vecToObstacleStart.Length();
+							obstacleEndDist = vecToObstacleEnd.Length();
+							if ( obstacleEndDist == 0 )
 							{
-								break;
+								obstacleEndDist = GenerationStepSize;
 							}
+						}								
+					}
+				}
+			}
+		}
 
-							to = tr.endpos;
-							toNormal = tr.plane.normal;
+		if ( !success )
+		{
+			return false;
+		}
+	}
 
-							start = end = from;
-							end.z += height;
-							UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-							if ( tr.fraction < 1.0f )
-							{
-								break;
-							}
+	// Don't generate nodes if we spill off the end of the world onto skybox
+	if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
+	{
+		return false;
+	}
 
-							// keep track of far up we had to go to find a path to the next node
-							obstacleHeight = height;
-							success = true;
-							break;
-						}
-						else
-						{
-							// Could not trace from node to node at this height, something is in the way.
-							// Trace in the other direction to see if we hit something
-							Vector vecToObstacleStart = tr.endpos - start;
-							Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
-							if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
-							{
-								UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-								if ( !tr.startsolid && tr.fraction < 1.0 )
-								{
-									// We hit something going the other direction.  There is some obstacle between the two nodes.
-									Vector vecToObstacleEnd = tr.endpos - start;
-									Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
-									if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
-									{
-										// Remember the distances to start and end of the obstacle (with respect to the "from" node).
-										// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
-										// If we do eventually clear the obstacle, these values will be the start and end distance to the
-										// very tip of the obstacle.
-										obstacleStartDist = vecToObstacleStart.Length();
-										obstacleEndDist = vecToObstacleEnd.Length();
-										if ( obstacleEndDist == 0 )
-										{
-											obstacleEndDist = GenerationStepSize;
-										}
-									}								
-								}
-							}
-						}
-					}
+	// If we're incrementally generating, don't overlap existing nav areas.
+	Vector testPos( to );
+	bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
+	bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
+	bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
+	bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
+	if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+	{
+		return false;
+	}
 
-					if ( !success )
-					{
-						return true;
-					}
-				}
+	int nTolerance = nav_generate_incremental_tolerance.GetInt();
+	if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
+	{
+		bool bValid = false;
+		int zPos = to.z;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			int zMin = seedPos.z - nTolerance;
+			int zMax = seedPos.z + nTolerance;
 
-				// Don't generate nodes if we spill off the end of the world onto skybox
-				if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
-				{
-					return true;
-				}
+			if ( zPos >= zMin && zPos <= zMax )
+			{
+				bValid = true;
+				break;
+			}
+		}
 
-				// If we're incrementally generating, don't overlap existing nav areas.
-				Vector testPos( to );
-				bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
-				bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
-				bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
-				bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
-				if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+		if ( !bValid )
+			return false;
+	}
+
+
+	bool isOnDisplacement = result.IsDispSurface();
+
+	if ( nav_displacement_test.GetInt() > 0 )
+	{
+		// Test for nodes under displacement surfaces.
+		// This happens during development, and is a pain because the space underneath a displacement
+		// is not 'solid'.
+		Vector start = to + Vector( 0, 0, 0 );
+		Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
+		UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+
+		if ( result.fraction > 0 )
+		{
+			end = start;
+			start = result.endpos;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+			if ( result.fraction < 1 )
+			{
+				// if we made it down to within StepHeight, maybe we're on a static prop
+				if ( result.endpos.z > to.z + StepHeight )
 				{
-					return true;
+					return false;
 				}
+			}
+		}
+	}
 
-				int nTolerance = nav_generate_incremental_tolerance.GetInt();
-				if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
-				{
-					bool bValid = false;
-					int zPos = to.z;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						int zMin = seedPos.z - nTolerance;
-						int zMax = seedPos.z + nTolerance;
+	float deltaZ = to.z - from.z;
+	// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
+	// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
+	// and distances
+	if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
+	{
+		obstacleHeight = 0;
+		obstacleStartDist = 0;
+		obstacleEndDist = GenerationStepSize;
+	}
 
-						if ( zPos >= zMin && zPos <= zMax )
-						{
-							bValid = true;
-							break;
-						}
-					}
+	step->to = to;
+	step->toNormal = toNormal;
+	step->isOnDisplacement = isOnDisplacement;
+	step->obstacleHeight = obstacleHeight;
+	step->obstacleStartDist = obstacleStartDist;
+	step->obstacleEndDist = obstacleEndDist;
+	step->isWalkable = true;
 
-					if ( !bValid )
-						return true;
-				}
+	return true;
+}
 
 
-				bool isOnDisplacement = result.IsDispSurface();
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Search the world and build a map of possible movements.
+ * The algorithm begins at the bot's current location, and does a recursive search
+ * outwards, tracking all valid steps and generating a directed graph of CNavNodes.
+ *
+ * Sample the map one "step" in a cardinal direction to learn the map.
+ *
+ * Returns true if sampling needs to continue, or false if done.
+ */
+bool CNavMesh::SampleStep( void )
+{
+	// take a step
+	while( true )
+	{
+		if (m_currentNode == NULL)
+		{
+			m_currentNode = GetNextSampleSeedNode();
 
-				if ( nav_displacement_test.GetInt() > 0 )
-				{
-					// Test for nodes under displacement surfaces.
-					// This happens during development, and is a pain because the space underneath a displacement
-					// is not 'solid'.
-					Vector start = to + Vector( 0, 0, 0 );
-					Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
-					UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-
-					if ( result.fraction > 0 )
-					{
-						end = start;
-						start = result.endpos;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-						if ( result.fraction < 1 )
-						{
-							// if we made it down to within StepHeight, maybe we're on a static prop
-							if ( result.endpos.z > to.z + StepHeight )
-							{
-								return true;
-							}
-						}
-					}
-				}
+			if (m_currentNode == NULL)
+			{
+				// all seeds exhausted, sampling complete
+				return false;
+			}
+		}
 
-				float deltaZ = to.z - m_currentNode->GetPosition()->z;
-				// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
-				// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
-				// and distances
-				if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
+		//
+		// Take a step from this node
+		//
+		for( int dir = NORTH; dir < NUM_DIRECTIONS; dir++ )
+		{
+			if (!m_currentNode->HasVisited( (NavDirType)dir ))
+			{
+				// have not searched in this direction yet
+				NavSampleStep step;
+				InitSampleStep( &step, m_currentNode, (NavDirType)dir );
+
+				m_generationDir = (NavDirType)dir;
+
+				// mark direction as visited
+				m_currentNode->MarkAsVisited( m_generationDir );
+
+				++m_sampleStepCount;
+
+				if ( !TraceSampleStep( &step ) )
 				{
-					obstacleHeight = 0;
-					obstacleStartDist = 0;
-					obstacleEndDist = GenerationStepSize;
+					return true;
 				}
 
 				// we can move here
 				// create a new navigation node, and update current node pointer
-				AddNode( to, toNormal, m_generationDir, m_currentNode, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist );
+				AddNode( step.to, step.toNormal, m_generationDir, m_currentNode, step.isOnDisplacement, step.obstacleHeight, step.obstacleStartDist, step.obstacleEndDist );
 
 				return true;
 			}
@@ -4626,6 +4801,93 @@ bool CNavMesh::SampleStep( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::TraceSampleStepJob( NavSampleStep &step )
+{
+	TheNavMesh->TraceSampleStep( &step );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::CheckNodeSurroundingsJob( CNavNode *&node )
+{
+	CheckNodeSurroundings( node );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Parallel version of SampleStep(). Every node created in the previous wave steps in all of its
+ * unvisited directions at once, and the traces are spread across the thread pool. Results are
+ * applied in the order the steps were collected, so the nodes created don't depend on the number
+ * of threads - but they differ from the depth-first order of SampleStep().
+ *
+ * Returns true if sampling needs to continue, or false if done.
+ */
+bool CNavMesh::SampleWave( void )
+{
+	int maxParallel = ( nav_generate_threads.GetInt() > 0 ) ? nav_generate_threads.GetInt() : INT_MAX;
+
+	if ( m_sampleFrontier.Count() == 0 )
+	{
+		CNavNode *seed = GetNextSampleSeedNode();
+		if ( seed == NULL )
+		{
+			// all seeds exhausted, sampling complete
+			return false;
+		}
+
+		CheckNodeSurroundings( seed );
+		m_sampleFrontier.AddToTail( seed );
+	}
+
+	// collect the steps to take from every node of the wave
+	CUtlVector< NavSampleStep > steps;
+	steps.EnsureCapacity( NUM_DIRECTIONS * m_sampleFrontier.Count() );
+	FOR_EACH_VEC( m_sampleFrontier, it )
+	{
+		CNavNode *node = m_sampleFrontier[ it ];
+		for( int dir = NORTH; dir < NUM_DIRECTIONS; dir++ )
+		{
+			if ( node->HasVisited( (NavDirType)dir ) )
+				continue;
+
+			node->MarkAsVisited( (NavDirType)dir );
+			InitSampleStep( &steps[ steps.AddToTail() ], node, (NavDirType)dir );
+		}
+	}
+
+	m_sampleFrontier.RemoveAll();
+	m_sampleStepCount += steps.Count();
+
+	ParallelProcess( "CNavMesh::SampleWave", steps.Base(), steps.Count(), &CNavMesh::TraceSampleStepJob, NULL, NULL, maxParallel );
+
+	// connect the nodes, in order
+	FOR_EACH_VEC( steps, it )
+	{
+		const NavSampleStep &step = steps[ it ];
+		if ( !step.isWalkable )
+			continue;
+
+		// an earlier step of this wave already connected back to this node
+		if ( step.node->GetConnectedNode( step.dir ) )
+			continue;
+
+		bool isNew;
+		CNavNode *node = ConnectNode( step.to, step.toNormal, step.dir, step.node, step.isOnDisplacement, step.obstacleHeight, step.obstacleStartDist, step.obstacleEndDist, &isNew );
+		if ( isNew )
+		{
+			// new nodes are sampled from in the next wave
+			m_sampleFrontier.AddToTail( node );
+		}
+	}
+
+	ParallelProcess( "CNavMesh::SampleWave", m_sampleFrontier.Base(), m_sampleFrontier.Count(), &CNavMesh::CheckNodeSurroundingsJob, NULL, NULL, maxParallel );
+
+	return true;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Add given walkable position to list of seed positions for map sampling
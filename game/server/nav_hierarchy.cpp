@@ -0,0 +1,1149 @@
+// nav_hierarchy.cpp
+// Hierarchical path finding (HPA*) over the Navigation Mesh
+//========= Copyright Valve Corporation, All rights reserved. ============//
+
+#include "cbase.h"
+#include "tier0/vprof.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlpriorityqueue.h"
+
+#include "nav_mesh.h"
+#include "nav_hierarchy.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+ConVar nav_hierarchy_region_size( "nav_hierarchy_region_size", "1024", FCVAR_GAMEDLL | FCVAR_CHEAT, "Size of the grid cells the Navigation Mesh is cut into when building the path finding hierarchy." );
+
+CNavHierarchy TheNavHierarchy;
+
+#define NAV_HIERARCHY_MAGIC_NUMBER	0x4E415648		// "NAVH"
+#define NAV_HIERARCHY_VERSION		1
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Priority queue entry for searches over regions and portals
+ */
+struct NavHierarchyOpenEntry
+{
+	float cost;
+	int index;
+};
+
+static bool NavHierarchyOpenLessFunc( const NavHierarchyOpenEntry &lhs, const NavHierarchyOpenEntry &rhs )
+{
+	// cheapest entry at the head
+	return lhs.cost > rhs.cost;
+}
+
+typedef CUtlPriorityQueue< NavHierarchyOpenEntry > NavHierarchyOpenList;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Cost of crossing a single graph edge, as CNavShortestPathCost
+ */
+static float NavHierarchyEdgeCost( const CNavSearchGraph &graph, int sourceIndex, int edge )
+{
+	CNavShortestPathCost cost;
+	return cost.GetCost( graph.GetArea( graph.m_edgeTarget[ edge ] ), graph.GetArea( sourceIndex ), graph.m_edgeLadder[ edge ], graph.m_edgeElevator[ edge ], graph.m_edgeLength[ edge ], 0.0f );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Wraps a cost function, treating all areas outside of one region as dead ends
+ */
+class CNavRegionPathCost : public INavPathCost
+{
+public:
+	CNavRegionPathCost( const CNavHierarchy &hierarchy, int region, INavPathCost &costFunc ) : m_hierarchy( hierarchy ), m_costFunc( costFunc )
+	{
+		m_region = region;
+	}
+
+	virtual float GetCost( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder, const CFuncElevator *elevator, float length, float fromCostSoFar )
+	{
+		if ( m_hierarchy.GetRegion( area ) != m_region )
+			return -1.0f;
+
+		return m_costFunc.GetCost( area, fromArea, ladder, elevator, length, fromCostSoFar );
+	}
+
+	virtual int GetCacheID( void ) const	{ return 0; }
+
+private:
+	const CNavHierarchy &m_hierarchy;
+	INavPathCost &m_costFunc;
+	int m_region;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavHierarchy::Region::Region( void )
+{
+	isDirty = false;
+	blockedVersion = 1;
+
+	for( int i=0; i<ARRAYSIZE( dirtyCostVersion ); ++i )
+	{
+		dirtyCostVersion[i] = 0;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavHierarchy::CNavHierarchy( void )
+{
+	m_regionCount = 0;
+	m_isBound = false;
+	m_boundTopologyVersion = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavHierarchy::Reset( void )
+{
+	m_regionCount = 0;
+	m_region.Purge();
+
+	m_areaRegion.Purge();
+	m_areaLocalIndex.Purge();
+	m_areaPortal.Purge();
+
+	m_portalArea.Purge();
+	m_portalLocalIndex.Purge();
+	m_portalFirstLink.Purge();
+	m_linkEdge.Purge();
+	m_linkPortal.Purge();
+	m_linkCost.Purge();
+
+	m_savedAreaID.Purge();
+	m_savedAreaRegion.Purge();
+	m_savedPortalID.Purge();
+	m_savedRegionPortalCount.Purge();
+	m_savedPortalCost.Purge();
+
+	m_isBound = false;
+	m_boundTopologyVersion = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+int CNavHierarchy::GetRegion( const CNavArea *area ) const
+{
+	if ( !m_isBound )
+		return -1;
+
+	int index = TheNavPathEngine.GetGraph().GetAreaIndex( area );
+	if ( index < 0 || index >= m_areaRegion.Count() )
+		return -1;
+
+	return m_areaRegion[ index ];
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Cut the mesh into regions: areas whose centers are in the same grid cell, and that are connected
+ * to each other without leaving the cell.
+ */
+void CNavHierarchy::BuildRegions( void )
+{
+	const CNavSearchGraph &graph = TheNavPathEngine.GetGraph();
+	int areaCount = graph.GetAreaCount();
+
+	float cellSize = MAX( nav_hierarchy_region_size.GetFloat(), 100.0f );
+
+	CUtlVector< int > cellX, cellY;
+	cellX.SetCount( areaCount );
+	cellY.SetCount( areaCount );
+	for( int i=0; i<areaCount; ++i )
+	{
+		cellX[i] = (int)floor( graph.m_centerX[i] / cellSize );
+		cellY[i] = (int)floor( graph.m_centerY[i] / cellSize );
+	}
+
+	// union connected areas of the same cell
+	CUtlVector< int > parent;
+	parent.SetCount( areaCount );
+	for( int i=0; i<areaCount; ++i )
+	{
+		parent[i] = i;
+	}
+
+	for( int i=0; i<areaCount; ++i )
+	{
+		for( int edge = graph.m_firstEdge[i]; edge < graph.m_firstEdge[i+1]; ++edge )
+		{
+			int j = graph.m_edgeTarget[ edge ];
+			if ( cellX[i] != cellX[j] || cellY[i] != cellY[j] )
+				continue;
+
+			int rootI = i;
+			while( parent[ rootI ] != rootI )
+				rootI = parent[ rootI ] = parent[ parent[ rootI ] ];
+
+			int rootJ = j;
+			while( parent[ rootJ ] != rootJ )
+				rootJ = parent[ rootJ ] = parent[ parent[ rootJ ] ];
+
+			if ( rootI != rootJ )
+			{
+				parent[ MAX( rootI, rootJ ) ] = MIN( rootI, rootJ );
+			}
+		}
+	}
+
+	// number the regions in area order
+	m_areaRegion.SetCount( areaCount );
+	m_regionCount = 0;
+	for( int i=0; i<areaCount; ++i )
+	{
+		int root = i;
+		while( parent[ root ] != root )
+			root = parent[ root ];
+
+		// roots always have the lowest index of their set, so they are numbered first
+		m_areaRegion[i] = ( root == i ) ? m_regionCount++ : m_areaRegion[ root ];
+	}
+
+	m_region.SetCount( m_regionCount );
+
+	// portals are areas with a connection to or from another region
+	CUtlVector< bool > isPortal;
+	isPortal.SetCount( areaCount );
+	for( int i=0; i<areaCount; ++i )
+	{
+		isPortal[i] = false;
+	}
+
+	for( int i=0; i<areaCount; ++i )
+	{
+		for( int edge = graph.m_firstEdge[i]; edge < graph.m_firstEdge[i+1]; ++edge )
+		{
+			int j = graph.m_edgeTarget[ edge ];
+			if ( m_areaRegion[i] != m_areaRegion[j] )
+			{
+				isPortal[i] = true;
+				isPortal[j] = true;
+			}
+		}
+	}
+
+	for( int i=0; i<areaCount; ++i )
+	{
+		if ( isPortal[i] )
+		{
+			m_region[ m_areaRegion[i] ].portals.AddToTail( i );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Given the region of each area and the portals of each region, build the portal graph.
+ * Returns false if the regions don't fit the search graph.
+ */
+bool CNavHierarchy::BindPortals( void )
+{
+	const CNavSearchGraph &graph = TheNavPathEngine.GetGraph();
+	int areaCount = graph.GetAreaCount();
+
+	if ( m_areaRegion.Count() != areaCount )
+		return false;
+
+	m_areaLocalIndex.SetCount( areaCount );
+	m_areaPortal.SetCount( areaCount );
+	for( int i=0; i<areaCount; ++i )
+	{
+		int region = m_areaRegion[i];
+		if ( region < 0 || region >= m_regionCount )
+			return false;
+
+		m_areaLocalIndex[i] = m_region[ region ].areas.AddToTail( i );
+		m_areaPortal[i] = -1;
+	}
+
+	// number the portals
+	m_portalArea.RemoveAll();
+	m_portalLocalIndex.RemoveAll();
+	for( int r=0; r<m_regionCount; ++r )
+	{
+		const Region &region = m_region[r];
+		FOR_EACH_VEC( region.portals, p )
+		{
+			int index = region.portals[p];
+			if ( m_areaRegion[ index ] != r || m_areaPortal[ index ] >= 0 )
+				return false;
+
+			m_areaPortal[ index ] = m_portalArea.AddToTail( index );
+			m_portalLocalIndex.AddToTail( p );
+		}
+	}
+
+	// link portals across region boundaries
+	m_portalFirstLink.RemoveAll();
+	m_linkEdge.RemoveAll();
+	m_linkPortal.RemoveAll();
+	m_linkCost.RemoveAll();
+	FOR_EACH_VEC( m_portalArea, p )
+	{
+		int index = m_portalArea[p];
+
+		m_portalFirstLink.AddToTail( m_linkEdge.Count() );
+
+		for( int edge = graph.m_firstEdge[ index ]; edge < graph.m_firstEdge[ index+1 ]; ++edge )
+		{
+			int target = graph.m_edgeTarget[ edge ];
+			if ( m_areaRegion[ target ] == m_areaRegion[ index ] )
+				continue;
+
+			// stale hierarchy - this connection isn't between portals
+			if ( m_areaPortal[ target ] < 0 )
+				return false;
+
+			m_linkEdge.AddToTail( edge );
+			m_linkPortal.AddToTail( m_areaPortal[ target ] );
+			m_linkCost.AddToTail( NavHierarchyEdgeCost( graph, index, edge ) );
+		}
+	}
+	m_portalFirstLink.AddToTail( m_linkEdge.Count() );
+
+	// every connection leaving a region must leave from a portal
+	for( int i=0; i<areaCount; ++i )
+	{
+		if ( m_areaPortal[i] >= 0 )
+			continue;
+
+		for( int edge = graph.m_firstEdge[i]; edge < graph.m_firstEdge[i+1]; ++edge )
+		{
+			if ( m_areaRegion[ graph.m_edgeTarget[ edge ] ] != m_areaRegion[i] )
+				return false;
+		}
+	}
+
+	for( int r=0; r<m_regionCount; ++r )
+	{
+		BuildReverseEdges( r );
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavHierarchy::BuildReverseEdges( int r )
+{
+	const CNavSearchGraph &graph = TheNavPathEngine.GetGraph();
+	Region &region = m_region[r];
+
+	int localCount = region.areas.Count();
+
+	// count incoming edges of each area
+	region.firstReverseEdge.SetCount( localCount + 1 );
+	for( int i=0; i<=localCount; ++i )
+	{
+		region.firstReverseEdge[i] = 0;
+	}
+
+	FOR_EACH_VEC( region.areas, local )
+	{
+		int index = region.areas[ local ];
+		for( int edge = graph.m_firstEdge[ index ]; edge < graph.m_firstEdge[ index+1 ]; ++edge )
+		{
+			int target = graph.m_edgeTarget[ edge ];
+			if ( m_areaRegion[ target ] == r )
+			{
+				++region.firstReverseEdge[ m_areaLocalIndex[ target ] + 1 ];
+			}
+		}
+	}
+
+	for( int i=0; i<localCount; ++i )
+	{
+		region.firstReverseEdge[i+1] += region.firstReverseEdge[i];
+	}
+
+	// fill them in
+	int reverseCount = region.firstReverseEdge[ localCount ];
+	region.reverseEdge.SetCount( reverseCount );
+	region.reverseSource.SetCount( reverseCount );
+
+	CUtlVector< int > fill;
+	fill.CopyArray( region.firstReverseEdge.Base(), localCount );
+
+	FOR_EACH_VEC( region.areas, local )
+	{
+		int index = region.areas[ local ];
+		for( int edge = graph.m_firstEdge[ index ]; edge < graph.m_firstEdge[ index+1 ]; ++edge )
+		{
+			int target = graph.m_edgeTarget[ edge ];
+			if ( m_areaRegion[ target ] == r )
+			{
+				int slot = fill[ m_areaLocalIndex[ target ] ]++;
+				region.reverseEdge[ slot ] = edge;
+				region.reverseSource[ slot ] = local;
+			}
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Dijkstra search from (or, if 'isReverse', to) one area, without leaving its region.
+ * 'localCost' receives the cost for each area in the region, FLT_MAX if it can't be reached.
+ */
+void CNavHierarchy::SearchRegion( int r, int sourceIndex, bool isReverse, int teamID, bool ignoreNavBlockers, bool isBlockedHonored, CUtlVector< float > *localCost ) const
+{
+	const CNavSearchGraph &graph = TheNavPathEngine.GetGraph();
+	const Region &region = m_region[r];
+
+	localCost->SetCount( region.areas.Count() );
+	FOR_EACH_VEC( (*localCost), it )
+	{
+		localCost->Element( it ) = FLT_MAX;
+	}
+
+	if ( isBlockedHonored && graph.GetArea( sourceIndex )->IsBlocked( teamID, ignoreNavBlockers ) )
+		return;
+
+	NavHierarchyOpenList openList( 0, region.areas.Count(), NavHierarchyOpenLessFunc );
+
+	NavHierarchyOpenEntry entry;
+	entry.cost = 0.0f;
+	entry.index = m_areaLocalIndex[ sourceIndex ];
+	localCost->Element( entry.index ) = 0.0f;
+	openList.Insert( entry );
+
+	while( openList.Count() )
+	{
+		NavHierarchyOpenEntry current = openList.ElementAtHead();
+		openList.RemoveAtHead();
+
+		// skip stale entries
+		if ( current.cost > localCost->Element( current.index ) )
+			continue;
+
+		if ( isReverse )
+		{
+			for( int it = region.firstReverseEdge[ current.index ]; it < region.firstReverseEdge[ current.index+1 ]; ++it )
+			{
+				int local = region.reverseSource[ it ];
+				int index = region.areas[ local ];
+
+				if ( isBlockedHonored && graph.GetArea( index )->IsBlocked( teamID, ignoreNavBlockers ) )
+					continue;
+
+				float cost = current.cost + NavHierarchyEdgeCost( graph, index, region.reverseEdge[ it ] );
+				if ( cost < localCost->Element( local ) )
+				{
+					localCost->Element( local ) = cost;
+					entry.cost = cost;
+					entry.index = local;
+					openList.Insert( entry );
+				}
+			}
+		}
+		else
+		{
+			int index = region.areas[ current.index ];
+			for( int edge = graph.m_firstEdge[ index ]; edge < graph.m_firstEdge[ index+1 ]; ++edge )
+			{
+				int target = graph.m_edgeTarget[ edge ];
+				if ( m_areaRegion[ target ] != r )
+					continue;
+
+				if ( isBlockedHonored && graph.GetArea( target )->IsBlocked( teamID, ignoreNavBlockers ) )
+					continue;
+
+				int local = m_areaLocalIndex[ target ];
+				float cost = current.cost + NavHierarchyEdgeCost( graph, index, edge );
+				if ( cost < localCost->Element( local ) )
+				{
+					localCost->Element( local ) = cost;
+					entry.cost = cost;
+					entry.index = local;
+					openList.Insert( entry );
+				}
+			}
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compute the cost between every pair of portals of a region
+ */
+void CNavHierarchy::ComputePortalCosts( int r, CUtlVector< float > *portalCost, int teamID, bool ignoreNavBlockers, bool isBlockedHonored ) const
+{
+	const Region &region = m_region[r];
+	int portalCount = region.portals.Count();
+
+	portalCost->SetCount( portalCount * portalCount );
+
+	CUtlVector< float > localCost;
+	for( int from=0; from<portalCount; ++from )
+	{
+		SearchRegion( r, region.portals[ from ], false, teamID, ignoreNavBlockers, isBlockedHonored, &localCost );
+
+		for( int to=0; to<portalCount; ++to )
+		{
+			portalCost->Element( from * portalCount + to ) = localCost[ m_areaLocalIndex[ region.portals[ to ] ] ];
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Copy the costs from one portal of a region to each of its portals for the given team, recomputing
+ * them if the region is dirty. Query threads share the dirty costs, so they are only touched under the lock.
+ */
+void CNavHierarchy::GetPortalCosts( int r, int fromPortal, int teamID, bool ignoreNavBlockers, float *portalCost )
+{
+	Region &region = m_region[r];
+	int portalCount = region.portals.Count();
+
+	AUTO_LOCK_FM( m_dirtyMutex );
+
+	const CUtlVector< float > *regionCost = &region.portalCost;
+	if ( region.isDirty )
+	{
+		int teamSlot = ( teamID == TEAM_ANY ) ? MAX_NAV_TEAMS : ( teamID % MAX_NAV_TEAMS );
+		int slot = 2 * teamSlot + ( ignoreNavBlockers ? 1 : 0 );
+
+		if ( region.dirtyCostVersion[ slot ] != region.blockedVersion )
+		{
+			ComputePortalCosts( r, &region.dirtyCost[ slot ], teamID, ignoreNavBlockers, true );
+			region.dirtyCostVersion[ slot ] = region.blockedVersion;
+		}
+
+		regionCost = &region.dirtyCost[ slot ];
+	}
+
+	V_memcpy( portalCost, regionCost->Base() + fromPortal * portalCount, portalCount * sizeof( float ) );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Invoked on the main thread when the blocked state of an area changes
+ */
+void CNavHierarchy::OnAreaBlockedChanged( CNavArea *area )
+{
+	int r = GetRegion( area );
+	if ( r < 0 )
+		return;
+
+	Region &region = m_region[r];
+
+	const CNavSearchGraph &graph = TheNavPathEngine.GetGraph();
+
+	bool isDirty = false;
+	FOR_EACH_VEC( region.areas, it )
+	{
+		if ( graph.GetArea( region.areas[ it ] )->IsBlocked( TEAM_ANY ) )
+		{
+			isDirty = true;
+			break;
+		}
+	}
+
+	// queries on other threads read these in GetPortalCosts()
+	AUTO_LOCK_FM( m_dirtyMutex );
+	++region.blockedVersion;
+	region.isDirty = isDirty;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compute the hierarchy for the current mesh
+ */
+bool CNavHierarchy::Build( void )
+{
+	VPROF_BUDGET( "CNavHierarchy::Build", "NextBotSpiky" );
+
+	Reset();
+
+	if ( !TheNavPathEngine.UpdateGraph() )
+		return false;
+
+	const CNavSearchGraph &graph = TheNavPathEngine.GetGraph();
+	if ( graph.GetAreaCount() == 0 )
+		return false;
+
+	BuildRegions();
+
+	if ( !BindPortals() )
+	{
+		Assert( false );
+		Reset();
+		return false;
+	}
+
+	for( int r=0; r<m_regionCount; ++r )
+	{
+		ComputePortalCosts( r, &m_region[r].portalCost, TEAM_ANY, false, false );
+	}
+
+	// keep the file form, so it can be saved
+	m_savedAreaID.SetCount( graph.GetAreaCount() );
+	m_savedAreaRegion.SetCount( graph.GetAreaCount() );
+	for( int i=0; i<graph.GetAreaCount(); ++i )
+	{
+		m_savedAreaID[i] = graph.GetArea( i )->GetID();
+		m_savedAreaRegion[i] = m_areaRegion[i];
+	}
+
+	for( int r=0; r<m_regionCount; ++r )
+	{
+		const Region &region = m_region[r];
+
+		m_savedRegionPortalCount.AddToTail( region.portals.Count() );
+		FOR_EACH_VEC( region.portals, p )
+		{
+			m_savedPortalID.AddToTail( graph.GetArea( region.portals[p] )->GetID() );
+		}
+		m_savedPortalCost.AddMultipleToTail( region.portalCost.Count(), region.portalCost.Base() );
+	}
+
+	m_isBound = true;
+	m_boundTopologyVersion = graph.GetTopologyVersion();
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Make sure the hierarchy matches the search graph. A hierarchy loaded from a .nav file is bound
+ * to the graph the first time it is used. Returns false if there is no usable hierarchy.
+ */
+bool CNavHierarchy::UpdateBinding( void )
+{
+	if ( m_regionCount == 0 )
+		return false;
+
+	if ( !TheNavPathEngine.IsGraphCurrent() )
+	{
+		if ( !ThreadInMainThread() || TheNavMesh->IsGenerating() || !TheNavPathEngine.UpdateGraph() )
+			return false;
+	}
+
+	const CNavSearchGraph &graph = TheNavPathEngine.GetGraph();
+
+	if ( m_isBound )
+	{
+		if ( m_boundTopologyVersion == graph.GetTopologyVersion() )
+			return true;
+
+		// the mesh has been edited - the hierarchy must be rebuilt
+		if ( ThreadInMainThread() )
+		{
+			DevMsg( "Navigation Mesh has changed, discarding path finding hierarchy.\n" );
+			Reset();
+		}
+		return false;
+	}
+
+	if ( !ThreadInMainThread() )
+		return false;
+
+	// bind the loaded hierarchy
+	bool isValid = ( m_savedAreaID.Count() == graph.GetAreaCount() );
+
+	m_areaRegion.SetCount( graph.GetAreaCount() );
+	FOR_EACH_VEC( m_areaRegion, it )
+	{
+		m_areaRegion[ it ] = -1;
+	}
+
+	for( int i=0; isValid && i<m_savedAreaID.Count(); ++i )
+	{
+		int index = graph.GetAreaIndex( TheNavMesh->GetNavAreaByID( m_savedAreaID[i] ) );
+		if ( index < 0 || m_areaRegion[ index ] >= 0 )
+		{
+			isValid = false;
+			break;
+		}
+
+		m_areaRegion[ index ] = m_savedAreaRegion[i];
+	}
+
+	m_region.SetCount( m_regionCount );
+
+	int savedPortal = 0;
+	for( int r=0; isValid && r<m_regionCount; ++r )
+	{
+		Region &region = m_region[r];
+		for( int p=0; p<m_savedRegionPortalCount[r]; ++p )
+		{
+			int index = graph.GetAreaIndex( TheNavMesh->GetNavAreaByID( m_savedPortalID[ savedPortal++ ] ) );
+			if ( index < 0 )
+			{
+				isValid = false;
+				break;
+			}
+
+			region.portals.AddToTail( index );
+		}
+	}
+
+	if ( isValid )
+	{
+		isValid = BindPortals();
+	}
+
+	int savedCost = 0;
+	for( int r=0; isValid && r<m_regionCount; ++r )
+	{
+		Region &region = m_region[r];
+		int costCount = region.portals.Count() * region.portals.Count();
+		region.portalCost.CopyArray( &m_savedPortalCost[ savedCost ], costCount );
+		savedCost += costCount;
+	}
+
+	if ( !isValid )
+	{
+		DevMsg( "Path finding hierarchy does not match the Navigation Mesh, discarding it.\n" );
+		Reset();
+		return false;
+	}
+
+	m_isBound = true;
+	m_boundTopologyVersion = graph.GetTopologyVersion();
+
+	// pick up areas that were blocked before the hierarchy was bound
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		if ( TheNavAreas[ it ]->IsBlocked( TEAM_ANY ) )
+		{
+			OnAreaBlockedChanged( TheNavAreas[ it ] );
+		}
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Append the hierarchy to a .nav file. Only a hierarchy that was built with nav_build_hierarchy
+ * or loaded with the mesh is saved - saving never builds one.
+ */
+void CNavHierarchy::Save( CUtlBuffer &fileBuffer ) const
+{
+	if ( !IsBuilt() )
+		return;
+
+	// a hierarchy built before the mesh was edited no longer matches it
+	if ( m_isBound && m_boundTopologyVersion != TheNavMesh->GetTopologyVersion() )
+	{
+		Msg( "Navigation Mesh has changed, path finding hierarchy not saved. Use nav_build_hierarchy to rebuild it.\n" );
+		return;
+	}
+
+	fileBuffer.PutUnsignedInt( NAV_HIERARCHY_MAGIC_NUMBER );
+	fileBuffer.PutUnsignedInt( NAV_HIERARCHY_VERSION );
+
+	fileBuffer.PutInt( m_savedAreaID.Count() );
+	FOR_EACH_VEC( m_savedAreaID, it )
+	{
+		fileBuffer.PutUnsignedInt( m_savedAreaID[ it ] );
+		fileBuffer.PutInt( m_savedAreaRegion[ it ] );
+	}
+
+	fileBuffer.PutInt( m_regionCount );
+	int savedPortal = 0;
+	int savedCost = 0;
+	for( int r=0; r<m_regionCount; ++r )
+	{
+		int portalCount = m_savedRegionPortalCount[r];
+		fileBuffer.PutInt( portalCount );
+
+		for( int p=0; p<portalCount; ++p )
+		{
+			fileBuffer.PutUnsignedInt( m_savedPortalID[ savedPortal++ ] );
+		}
+
+		for( int c=0; c<portalCount * portalCount; ++c )
+		{
+			fileBuffer.PutFloat( m_savedPortalCost[ savedCost++ ] );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Read the hierarchy from a .nav file. Files saved before the hierarchy existed simply end here.
+ */
+void CNavHierarchy::Load( CUtlBuffer &fileBuffer )
+{
+	Reset();
+
+	if ( fileBuffer.GetBytesRemaining() < 2 * (int)sizeof( unsigned int ) )
+		return;
+
+	unsigned int magic = fileBuffer.GetUnsignedInt();
+	unsigned int version = fileBuffer.GetUnsignedInt();
+	if ( magic != NAV_HIERARCHY_MAGIC_NUMBER || version > NAV_HIERARCHY_VERSION )
+		return;
+
+	int areaCount = fileBuffer.GetInt();
+	if ( !fileBuffer.IsValid() || areaCount < 0 || (int64)areaCount * 2 * sizeof( int ) > fileBuffer.GetBytesRemaining() )
+		return;
+
+	m_savedAreaID.SetCount( areaCount );
+	m_savedAreaRegion.SetCount( areaCount );
+	for( int i=0; i<areaCount; ++i )
+	{
+		m_savedAreaID[i] = fileBuffer.GetUnsignedInt();
+		m_savedAreaRegion[i] = fileBuffer.GetInt();
+	}
+
+	int regionCount = fileBuffer.GetInt();
+	if ( !fileBuffer.IsValid() || regionCount <= 0 || regionCount > areaCount )
+	{
+		Reset();
+		return;
+	}
+
+	for( int r=0; r<regionCount; ++r )
+	{
+		int portalCount = fileBuffer.GetInt();
+		if ( !fileBuffer.IsValid() || portalCount < 0 || portalCount > areaCount )
+		{
+			Reset();
+			return;
+		}
+
+		// an ID and a row of costs per portal - don't trust a count the file can't hold
+		if ( (int64)portalCount * ( sizeof( unsigned int ) + portalCount * sizeof( float ) ) > fileBuffer.GetBytesRemaining() )
+		{
+			Reset();
+			return;
+		}
+
+		m_savedRegionPortalCount.AddToTail( portalCount );
+		for( int p=0; p<portalCount; ++p )
+		{
+			m_savedPortalID.AddToTail( fileBuffer.GetUnsignedInt() );
+		}
+
+		for( int c=0; c<portalCount * portalCount; ++c )
+		{
+			m_savedPortalCost.AddToTail( fileBuffer.GetFloat() );
+		}
+	}
+
+	if ( !fileBuffer.IsValid() )
+	{
+		Reset();
+		return;
+	}
+
+	m_regionCount = regionCount;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A* over the portal graph, from the start area to the goal area.
+ * 'portalPath' receives the portals crossed, and 'portalLink' the link used to enter each of them,
+ * or -1 if it was reached from within its own region.
+ */
+bool CNavHierarchy::SearchPortals( const NavPathQuery &query, int startIndex, int goalIndex, CUtlVector< int > *portalPath, CUtlVector< int > *portalLink )
+{
+	const CNavSearchGraph &graph = TheNavPathEngine.GetGraph();
+
+	int startRegion = m_areaRegion[ startIndex ];
+	int goalRegion = m_areaRegion[ goalIndex ];
+
+	// cost from the start to every area of its region, and from every area of the goal region to the goal
+	CUtlVector< float > startCost, goalCost;
+	SearchRegion( startRegion, startIndex, false, query.teamID, query.ignoreNavBlockers, true, &startCost );
+	SearchRegion( goalRegion, goalIndex, true, query.teamID, query.ignoreNavBlockers, true, &goalCost );
+
+	int portalCount = m_portalArea.Count();
+
+	CUtlVector< float > costSoFar;
+	CUtlVector< int > parent, parentLink;
+	costSoFar.SetCount( portalCount );
+	parent.SetCount( portalCount );
+	parentLink.SetCount( portalCount );
+	for( int p=0; p<portalCount; ++p )
+	{
+		costSoFar[p] = FLT_MAX;
+	}
+
+	Vector goalPos = graph.GetArea( goalIndex )->GetCenter();
+
+	NavHierarchyOpenList openList( 0, 64, NavHierarchyOpenLessFunc );
+	NavHierarchyOpenEntry entry;
+
+	const Region &region = m_region[ startRegion ];
+	FOR_EACH_VEC( region.portals, it )
+	{
+		int index = region.portals[ it ];
+		float cost = startCost[ m_areaLocalIndex[ index ] ];
+		if ( cost == FLT_MAX )
+			continue;
+
+		int p = m_areaPortal[ index ];
+		costSoFar[p] = cost;
+		parent[p] = -1;
+		parentLink[p] = -1;
+
+		entry.cost = cost + ( graph.GetArea( index )->GetCenter() - goalPos ).Length();
+		entry.index = p;
+		openList.Insert( entry );
+	}
+
+	float bestCost = FLT_MAX;
+	int bestPortal = -1;
+
+	CUtlVector< float > regionCost;
+
+	while( openList.Count() )
+	{
+		NavHierarchyOpenEntry current = openList.ElementAtHead();
+		openList.RemoveAtHead();
+
+		if ( current.cost >= bestCost )
+			break;
+
+		int p = current.index;
+		int index = m_portalArea[p];
+		float cost = costSoFar[p];
+
+		// skip stale entries
+		float estimate = ( graph.GetArea( index )->GetCenter() - goalPos ).Length();
+		if ( current.cost > cost + estimate )
+			continue;
+
+		int r = m_areaRegion[ index ];
+		if ( r == goalRegion )
+		{
+			float remaining = goalCost[ m_areaLocalIndex[ index ] ];
+			if ( remaining != FLT_MAX && cost + remaining < bestCost )
+			{
+				bestCost = cost + remaining;
+				bestPortal = p;
+			}
+		}
+
+		// to other portals of this region
+		const Region &portalRegion = m_region[r];
+		int regionPortalCount = portalRegion.portals.Count();
+		regionCost.SetCount( regionPortalCount );
+		GetPortalCosts( r, m_portalLocalIndex[p], query.teamID, query.ignoreNavBlockers, regionCost.Base() );
+		for( int to=0; to<regionPortalCount; ++to )
+		{
+			if ( regionCost[ to ] == FLT_MAX )
+				continue;
+
+			int toIndex = portalRegion.portals[ to ];
+			int toPortal = m_areaPortal[ toIndex ];
+			float newCost = cost + regionCost[ to ];
+			if ( newCost >= costSoFar[ toPortal ] )
+				continue;
+
+			costSoFar[ toPortal ] = newCost;
+			parent[ toPortal ] = p;
+			parentLink[ toPortal ] = -1;
+
+			entry.cost = newCost + ( graph.GetArea( toIndex )->GetCenter() - goalPos ).Length();
+			entry.index = toPortal;
+			openList.Insert( entry );
+		}
+
+		// across region boundaries
+		for( int link = m_portalFirstLink[p]; link < m_portalFirstLink[p+1]; ++link )
+		{
+			int toPortal = m_linkPortal[ link ];
+			int toIndex = m_portalArea[ toPortal ];
+
+			if ( graph.GetArea( toIndex )->IsBlocked( query.teamID, query.ignoreNavBlockers ) )
+				continue;
+
+			float newCost = cost + m_linkCost[ link ];
+			if ( newCost >= costSoFar[ toPortal ] )
+				continue;
+
+			costSoFar[ toPortal ] = newCost;
+			parent[ toPortal ] = p;
+			parentLink[ toPortal ] = link;
+
+			entry.cost = newCost + ( graph.GetArea( toIndex )->GetCenter() - goalPos ).Length();
+			entry.index = toPortal;
+			openList.Insert( entry );
+		}
+	}
+
+	if ( bestPortal < 0 )
+		return false;
+
+	// walk back to the start
+	portalPath->RemoveAll();
+	portalLink->RemoveAll();
+	for( int p = bestPortal; p >= 0; p = parent[p] )
+	{
+		portalPath->AddToHead( p );
+		portalLink->AddToHead( parentLink[p] );
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Turn a path over portals into a path over areas, searching within one region at a time
+ */
+bool CNavHierarchy::RefinePath( const NavPathQuery &query, INavPathCost &costFunc, int startIndex, int goalIndex, const CUtlVector< int > &portalPath, const CUtlVector< int > &portalLink, NavPathStepVector *path )
+{
+	const CNavSearchGraph &graph = TheNavPathEngine.GetGraph();
+
+	path->RemoveAll();
+
+	NavPathStep step;
+	step.area = graph.GetArea( startIndex );
+	step.how = NUM_TRAVERSE_TYPES;
+	path->AddToTail( step );
+
+	NavPathStepVector segment;
+	int currentIndex = startIndex;
+
+	for( int it=0; it<=portalPath.Count(); ++it )
+	{
+		int nextIndex = ( it < portalPath.Count() ) ? m_portalArea[ portalPath[ it ] ] : goalIndex;
+		int link = ( it < portalPath.Count() ) ? portalLink[ it ] : -1;
+
+		if ( link >= 0 )
+		{
+			// step across the region boundary
+			step.area = graph.GetArea( nextIndex );
+			step.how = (NavTraverseType)graph.m_edgeHow[ m_linkEdge[ link ] ];
+			path->AddToTail( step );
+		}
+		else if ( nextIndex != currentIndex )
+		{
+			// find our way through the region
+			NavPathQuery segmentQuery;
+			segmentQuery.startArea = graph.GetArea( currentIndex );
+			segmentQuery.goalArea = graph.GetArea( nextIndex );
+			segmentQuery.teamID = query.teamID;
+			segmentQuery.ignoreNavBlockers = query.ignoreNavBlockers;
+
+			CNavRegionPathCost regionCost( *this, m_areaRegion[ nextIndex ], costFunc );
+			if ( !TheNavPathEngine.BuildPath( segmentQuery, regionCost, &segment ) )
+				return false;
+
+			for( int s=1; s<segment.Count(); ++s )
+			{
+				path->AddToTail( segment[s] );
+			}
+		}
+
+		currentIndex = nextIndex;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavHierarchy::BuildPath( const NavPathQuery &query, INavPathCost &costFunc, NavPathStepVector *path, CNavArea **closestArea )
+{
+	VPROF_BUDGET( "CNavHierarchy::BuildPath", "NextBotSpiky" );
+
+	++m_queryCount;
+
+	// only area to area searches without a length limit go through the hierarchy
+	if ( query.startArea && query.goalArea && query.goalPos == NULL && query.maxPathLength <= 0.0f && UpdateBinding() )
+	{
+		const CNavSearchGraph &graph = TheNavPathEngine.GetGraph();
+		int startIndex = graph.GetAreaIndex( query.startArea );
+		int goalIndex = graph.GetAreaIndex( query.goalArea );
+
+		if ( startIndex >= 0 && goalIndex >= 0 && m_areaRegion[ startIndex ] != m_areaRegion[ goalIndex ] )
+		{
+			CUtlVector< int > portalPath, portalLink;
+			NavPathStepVector localPath;
+			NavPathStepVector *resultPath = ( path ) ? path : &localPath;
+
+			if ( SearchPortals( query, startIndex, goalIndex, &portalPath, &portalLink ) &&
+				 RefinePath( query, costFunc, startIndex, goalIndex, portalPath, portalLink, resultPath ) )
+			{
+				if ( closestArea )
+				{
+					*closestArea = query.goalArea;
+				}
+				return true;
+			}
+
+			// no path through the hierarchy - let a full search decide, and find the closest area
+			++m_fallbackCount;
+		}
+	}
+
+	return TheNavPathEngine.BuildPath( query, costFunc, path, closestArea );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavHierarchy::PrintStats( void ) const
+{
+	int queryCount = m_queryCount;
+	int fallbackCount = m_fallbackCount;
+
+	int dirtyCount = 0;
+	int costCount = 0;
+	FOR_EACH_VEC( m_region, it )
+	{
+		if ( m_region[ it ].isDirty )
+			++dirtyCount;
+		costCount += m_region[ it ].portalCost.Count();
+	}
+
+	Msg( "Nav hierarchy: %d regions (%d dirty), %d portals, %d links, %d portal costs%s\n",
+		m_regionCount, dirtyCount, m_portalArea.Count(), m_linkEdge.Count(), costCount, m_isBound ? "" : " (not bound)" );
+	Msg( "  %d queries, %d fell back to a full search\n", queryCount, fallbackCount );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nav_build_hierarchy, "Build the path finding hierarchy for the current Navigation Mesh. It is saved with the mesh.", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	double start = Plat_FloatTime();
+
+	if ( !TheNavHierarchy.Build() )
+	{
+		Msg( "Unable to build the path finding hierarchy.\n" );
+		return;
+	}
+
+	Msg( "Path finding hierarchy built in %.2f seconds.\n", Plat_FloatTime() - start );
+	TheNavHierarchy.PrintStats();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nav_hierarchy_stats, "Show path finding hierarchy statistics", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	TheNavHierarchy.PrintStats();
+}
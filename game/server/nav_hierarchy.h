@@ -0,0 +1,127 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_hierarchy.h
+// Hierarchical path finding (HPA*) over the Navigation Mesh
+
+#ifndef _NAV_HIERARCHY_H_
+#define _NAV_HIERARCHY_H_
+
+#include "tier0/threadtools.h"
+#include "nav_pathengine.h"
+
+class CUtlBuffer;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Abstract graph over the Navigation Mesh, used to answer long path queries without expanding
+ * every area in between.
+ *
+ * The mesh is cut into regions - the connected pieces of the areas whose centers fall in the same
+ * cell of a coarse grid. Areas with a connection into another region are "portals". For each region,
+ * the shortest path cost (as CNavShortestPathCost) between every pair of its portals is computed
+ * offline and stored in the .nav file.
+ *
+ * A query searches the portal graph, then refines each hop with CNavPathEngine, restricted to the
+ * region the hop is in. Regions that contain blocked areas are marked dirty, and their portal costs
+ * are recomputed for the blocked state of the querying team the next time a query crosses them.
+ */
+class CNavHierarchy
+{
+public:
+	CNavHierarchy( void );
+
+	/**
+	 * Same contract as CNavPathEngine::BuildPath(). Queries the hierarchy can't help with (no hierarchy,
+	 * goal is a position, length limit, start and goal in the same region) go straight to TheNavPathEngine.
+	 * The portal graph is searched using shortest path costs; 'costFunc' is used to refine each hop.
+	 */
+	bool BuildPath( const NavPathQuery &query, INavPathCost &costFunc, NavPathStepVector *path, CNavArea **closestArea = NULL );
+
+	bool Build( void );										// compute regions and portal costs for the current mesh - main thread only
+	void Reset( void );
+
+	bool IsBuilt( void ) const				{ return m_regionCount > 0; }
+	int GetRegionCount( void ) const		{ return m_regionCount; }
+	int GetRegion( const CNavArea *area ) const;			// returns -1 if the area is not in the hierarchy
+
+	void Save( CUtlBuffer &fileBuffer ) const;				// append hierarchy to a .nav file
+	void Load( CUtlBuffer &fileBuffer );					// read hierarchy from a .nav file, if present
+
+	void OnAreaBlockedChanged( CNavArea *area );			// invoked when the blocked state of an area changes, for any team
+
+	void PrintStats( void ) const;
+
+private:
+	bool UpdateBinding( void );								// make sure region data matches the search graph
+
+	struct Region
+	{
+		Region( void );
+
+		CUtlVector< int > areas;							// graph indices of the areas in this region
+		CUtlVector< int > portals;							// graph indices of the portal areas in this region
+		CUtlVector< float > portalCost;						// portals x portals, FLT_MAX if unreachable
+
+		// reverse edges inside this region, for searching backwards from a goal
+		CUtlVector< int > firstReverseEdge;					// indexed by local area index
+		CUtlVector< int > reverseEdge;						// graph edge index
+		CUtlVector< int > reverseSource;					// local index of the area the edge leaves from
+
+		bool isDirty;										// contains blocked areas
+		unsigned int blockedVersion;						// changes whenever the blocked state of an area in this region changes
+		unsigned int dirtyCostVersion[ 2 * ( MAX_NAV_TEAMS + 1 ) ];
+		CUtlVector< float > dirtyCost[ 2 * ( MAX_NAV_TEAMS + 1 ) ];		// portal costs honoring blocked areas, per team
+	};
+
+	void BuildRegions( void );
+	bool BindPortals( void );
+	void BuildReverseEdges( int region );
+	void ComputePortalCosts( int region, CUtlVector< float > *portalCost, int teamID, bool ignoreNavBlockers, bool isBlockedHonored ) const;
+	void GetPortalCosts( int region, int fromPortal, int teamID, bool ignoreNavBlockers, float *portalCost );
+
+	void SearchRegion( int region, int sourceIndex, bool isReverse, int teamID, bool ignoreNavBlockers, bool isBlockedHonored, CUtlVector< float > *localCost ) const;
+	bool SearchPortals( const NavPathQuery &query, int startIndex, int goalIndex, CUtlVector< int > *portalPath, CUtlVector< int > *portalLink );
+	bool RefinePath( const NavPathQuery &query, INavPathCost &costFunc, int startIndex, int goalIndex, const CUtlVector< int > &portalPath, const CUtlVector< int > &portalLink, NavPathStepVector *path );
+
+	int m_regionCount;
+	CUtlVector< Region > m_region;
+
+	// per graph area
+	CUtlVector< int > m_areaRegion;
+	CUtlVector< int > m_areaLocalIndex;						// index in Region::areas
+	CUtlVector< int > m_areaPortal;							// portal node index, or -1
+
+	// portal nodes
+	CUtlVector< int > m_portalArea;							// graph index
+	CUtlVector< int > m_portalLocalIndex;					// index in Region::portals
+	CUtlVector< int > m_portalFirstLink;					// links leaving region from portal i are [ m_portalFirstLink[i], m_portalFirstLink[i+1] )
+	CUtlVector< int > m_linkEdge;							// graph edge index
+	CUtlVector< int > m_linkPortal;							// portal node index the edge leads to
+	CUtlVector< float > m_linkCost;
+
+	// file form, by area ID - a loaded hierarchy is bound to the search graph when it is first used
+	CUtlVector< unsigned int > m_savedAreaID;
+	CUtlVector< int > m_savedAreaRegion;
+	CUtlVector< unsigned int > m_savedPortalID;				// grouped by region
+	CUtlVector< int > m_savedRegionPortalCount;
+	CUtlVector< float > m_savedPortalCost;
+
+	bool m_isBound;
+	unsigned int m_boundTopologyVersion;
+
+	CThreadFastMutex m_dirtyMutex;
+
+	CInterlockedInt m_queryCount;
+	CInterlockedInt m_fallbackCount;
+};
+
+extern CNavHierarchy TheNavHierarchy;
+
+
+#endif // _NAV_HIERARCHY_H_
@@ -13,6 +13,8 @@
 #include "filesystem.h"
 #include "nav_mesh.h"
 #include "nav_node.h"
+#include "nav_pathengine.h"
+#include "nav_hierarchy.h"
 #include "fmtstr.h"
 #include "utlbuffer.h"
 #include "tier0/vprof.h"
@@ -67,6 +69,8 @@ CNavMesh::CNavMesh( void )
 	m_hostThreadModeRestoreValue = 0;
 	m_placeCount = 0;
 	m_placeName = NULL;
+	m_topologyVersion = 0;
+	m_blockedVersion = 0;
 
 	LoadPlaceDatabase();
 
@@ -103,6 +107,8 @@ void CNavMesh::Reset( void )
 
 	m_generationMode = GENERATE_NONE;
 	m_currentNode = NULL;
+	m_sampleFrontier.RemoveAll();
+	m_sampleStepCount = 0;
 	ClearWalkableSeeds();
 
 	m_isAnalyzed = false;
@@ -158,6 +164,11 @@ CNavArea *CNavMesh::GetMarkedArea( void ) const
  */
 void CNavMesh::DestroyNavigationMesh( bool incremental )
 {
+	// the path engine holds pointers to areas that are about to go away
+	TheNavPathEngine.Reset();
+	TheNavHierarchy.Reset();
+	OnTopologyChanged();
+
 	m_blockedAreas.RemoveAll();
 	m_avoidanceObstacleAreas.RemoveAll();
 	m_transientAreas.RemoveAll();
@@ -268,6 +279,8 @@ void CNavMesh::Update( void )
 	UpdateBlockedAreas();
 	UpdateAvoidanceObstacleAreas();
 
+	TheNavPathEngine.Update();
+
 	if (nav_edit.GetBool())
 	{
 		if (m_isEditing == false)
@@ -466,6 +479,8 @@ void CNavMesh::AllocateGrid( float minX, float maxX, float minY, float maxY )
  */
 void CNavMesh::AddNavArea( CNavArea *area )
 {
+	OnTopologyChanged();
+
 	if ( !m_grid.Count() )
 	{
 		// If we somehow have no grid (manually creating a nav area without loading or generating a mesh), don't crash
@@ -519,6 +534,8 @@ void CNavMesh::AddNavArea( CNavArea *area )
  */
 void CNavMesh::RemoveNavArea( CNavArea *area )
 {
+	OnTopologyChanged();
+
 	// add to grid
 	int loX = WorldToGridX( area->GetCorner( NORTH_WEST ).x );
 	int loY = WorldToGridY( area->GetCorner( NORTH_WEST ).y );
@@ -3121,10 +3138,22 @@ HidingSpot *GetHidingSpotByID( unsigned int id )
 }
 
 
+//--------------------------------------------------------------------------------------------------------
+// invoked when the blocked state of an area changes, for any team
+void CNavMesh::OnBlockedChanged( CNavArea *area )
+{
+	++m_blockedVersion;
+
+	TheNavHierarchy.OnAreaBlockedChanged( area );
+}
+
+
 //--------------------------------------------------------------------------------------------------------
 // invoked when the area becomes blocked
 void CNavMesh::OnAreaBlocked( CNavArea *area )
 {
+	OnBlockedChanged( area );
+
 	if ( !m_blockedAreas.HasElement( area ) )
 	{
 		m_blockedAreas.AddToTail( area );
@@ -3136,6 +3165,8 @@ void CNavMesh::OnAreaBlocked( CNavArea *area )
 // invoked when the area becomes un-blocked
 void CNavMesh::OnAreaUnblocked( CNavArea *area )
 {
+	OnBlockedChanged( area );
+
 	m_blockedAreas.FindAndRemove( area );
 }
 
@@ -30,6 +30,7 @@
 
 class CNavArea;
 class CBaseEntity; 
+struct NavSampleStep;
 class CBreakable;
 
 extern ConVar nav_edit;
@@ -301,6 +302,11 @@ public:
 	virtual void OnBreakableBroken( CBaseEntity *broken ) { }			// invoked when a breakable is broken
 	virtual void OnAreaBlocked( CNavArea *area );						// invoked when the area becomes blocked
 	virtual void OnAreaUnblocked( CNavArea *area );						// invoked when the area becomes un-blocked
+
+	unsigned int GetTopologyVersion( void ) const	{ return m_topologyVersion; }	// changes whenever areas or their connections are added or removed
+	void OnTopologyChanged( void )					{ ++m_topologyVersion; }
+	unsigned int GetBlockedVersion( void ) const	{ return m_blockedVersion; }	// changes whenever the blocked state of any area changes, for any team
+	void OnBlockedChanged( CNavArea *area );											// invoked when the blocked state of an area changes, for any team
 	virtual void OnAvoidanceObstacleEnteredArea( CNavArea *area );					// invoked when the area becomes obstructed
 	virtual void OnAvoidanceObstacleLeftArea( CNavArea *area );					// invoked when the area becomes un-obstructed
 
@@ -1150,6 +1156,9 @@ private:
 	// Auto-generation
 	//
 	bool UpdateGeneration( float maxTime = 0.25f );				// process the auto-generation for 'maxTime' seconds. return false if generation is complete.
+	bool UpdateGenerationState( float maxTime );				// run the current generation step for 'maxTime' seconds
+	void ResetGenerationTimes( void );
+	void PrintGenerationTimes( void ) const;					// report how long each generation step took
 
 	virtual void BeginCustomAnalysis( bool bIncremental ) {}
 	virtual void EndCustomAnalysis() {}
@@ -1157,12 +1166,21 @@ private:
 	CNavNode *m_currentNode;									// the current node we are sampling from
 	NavDirType m_generationDir;
 	CNavNode *AddNode( const Vector &destPos, const Vector &destNormal, NavDirType dir, CNavNode *source, bool isOnDisplacement, float obstacleHeight, float flObstacleStartDist, float flObstacleEndDist );		// add a nav node and connect it, update current node
+	CNavNode *ConnectNode( const Vector &destPos, const Vector &destNormal, NavDirType dir, CNavNode *source, bool isOnDisplacement, float obstacleHeight, float flObstacleStartDist, float flObstacleEndDist, bool *isNew );	// connect to the node at destPos, creating it if needed
+	CUtlVector< CNavNode * > m_sampleFrontier;					// nodes to step from in the next wave of parallel sampling
+	int m_sampleStepCount;										// number of sample steps traced so far
 
 	NavLadderVector m_ladders;									// list of ladder navigation representations
 	void BuildLadders( void );
 	void DestroyLadders( void );
 
 	bool SampleStep( void );									// sample the walkable areas of the map
+	bool SampleWave( void );									// sample the walkable areas of the map, tracing a whole wave of steps in parallel
+	CNavNode *GetNextSampleSeedNode( void );					// return the next node to start sampling from, or NULL when done
+	bool TraceSampleStep( NavSampleStep *step ) const;			// test a single sampling step - thread-safe
+	static void TraceSampleStepJob( NavSampleStep &step );
+	static void CheckNodeSurroundings( CNavNode *node );		// check a node for crouch areas and nearby cliffs - thread-safe
+	static void CheckNodeSurroundingsJob( CNavNode *&node );
 	void CreateNavAreasFromNodes( void );						// cover all of the sampled nodes with nav areas
 
 	bool TestArea( CNavNode *node, int width, int height );		// check if an area of size (width, height) can fit, starting from node as upper left corner
@@ -1219,6 +1237,7 @@ private:
 	int m_sampleTick;											// counter for displaying pseudo-progress while sampling walkable space
 	bool m_bQuitWhenFinished;
 	float m_generationStartTime;
+	float m_generationStateTime[ NUM_GENERATION_STATES ];		// time spent in each generation state
 	Extent m_simplifyGenerationExtent;
 
 	char *m_spawnName;											// name of player spawn entity, used to initiate sampling
@@ -1244,6 +1263,9 @@ private:
 	void UpdateBlockedAreas( void );
 	CUtlVector< CNavArea * > m_blockedAreas;
 
+	unsigned int m_topologyVersion;
+	unsigned int m_blockedVersion;
+
 	CUtlVector< int > m_storedSelectedSet;						// "Stored" selected set, so we can do some editing and then restore the old selected set.  Done by ID, so we don't have to worry about split/delete/etc.
 
 	void BeginVisibilityComputations( void );
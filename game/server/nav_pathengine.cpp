@@ -0,0 +1,952 @@
+// nav_pathengine.cpp
+// Re-entrant A* over a compact snapshot of the Navigation Mesh, with a path cache
+//========= Copyright Valve Corporation, All rights reserved. ============//
+
+#include "cbase.h"
+#include "tier0/vprof.h"
+#include "mathlib/ssemath.h"
+#include "tier1/generichash.h"
+
+#include "nav_mesh.h"
+#include "nav_pathengine.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+ConVar nav_path_cache_size( "nav_path_cache_size", "512", FCVAR_GAMEDLL, "Maximum number of paths kept in the nav path engine cache. Zero disables the cache." );
+
+CNavPathEngine TheNavPathEngine;
+
+
+//--------------------------------------------------------------------------------------------------------------
+float CNavShortestPathCost::GetCost( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder, const CFuncElevator *elevator, float length, float fromCostSoFar )
+{
+	if ( fromArea == NULL )
+	{
+		// first area in path, no cost
+		return 0.0f;
+	}
+
+	// compute distance traveled along path so far
+	float dist;
+
+	if ( ladder )
+	{
+		dist = ladder->m_length;
+	}
+	else if ( length > 0.0 )
+	{
+		dist = length;
+	}
+	else
+	{
+		dist = ( area->GetCenter() - fromArea->GetCenter() ).Length();
+	}
+
+	float cost = dist + fromCostSoFar;
+
+	// if this is a "crouch" area, add penalty
+	if ( area->GetAttributes() & NAV_MESH_CROUCH )
+	{
+		const float crouchPenalty = 20.0f;		// 10
+		cost += crouchPenalty * dist;
+	}
+
+	// if this is a "jump" area, add penalty
+	if ( area->GetAttributes() & NAV_MESH_JUMP )
+	{
+		const float jumpPenalty = 5.0f;
+		cost += jumpPenalty * dist;
+	}
+
+	return cost;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSearchGraph::CNavSearchGraph( void )
+{
+	m_topologyVersion = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchGraph::Clear( void )
+{
+	m_area.Purge();
+	m_centerX.Purge();
+	m_centerY.Purge();
+	m_centerZ.Purge();
+	m_firstEdge.Purge();
+
+	m_edgeTarget.Purge();
+	m_edgeLength.Purge();
+	m_edgeHow.Purge();
+	m_edgeLadder.Purge();
+	m_edgeElevator.Purge();
+	m_edgeCenterX.Purge();
+	m_edgeCenterY.Purge();
+	m_edgeCenterZ.Purge();
+
+	m_idToIndex.Purge();
+	m_topologyVersion = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+int CNavSearchGraph::GetAreaIndex( const CNavArea *area ) const
+{
+	if ( area == NULL )
+		return -1;
+
+	unsigned int id = area->GetID();
+	if ( id >= (unsigned int)m_idToIndex.Count() )
+		return -1;
+
+	int index = m_idToIndex[ id ];
+	if ( index < 0 || m_area[ index ] != area )
+		return -1;
+
+	return index;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchGraph::AddEdge( int target, float length, NavTraverseType how, const CNavLadder *ladder, const CFuncElevator *elevator )
+{
+	if ( target < 0 )
+		return;
+
+	m_edgeTarget.AddToTail( target );
+	m_edgeLength.AddToTail( length );
+	m_edgeHow.AddToTail( (unsigned char)how );
+	m_edgeLadder.AddToTail( ladder );
+	m_edgeElevator.AddToTail( elevator );
+	m_edgeCenterX.AddToTail( m_centerX[ target ] );
+	m_edgeCenterY.AddToTail( m_centerY[ target ] );
+	m_edgeCenterZ.AddToTail( m_centerZ[ target ] );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Snapshot the connectivity of TheNavAreas
+ */
+void CNavSearchGraph::Build( void )
+{
+	VPROF_BUDGET( "CNavSearchGraph::Build", "NextBotSpiky" );
+
+	Clear();
+
+	int areaCount = TheNavAreas.Count();
+	m_area.EnsureCapacity( areaCount );
+	m_centerX.EnsureCapacity( areaCount );
+	m_centerY.EnsureCapacity( areaCount );
+	m_centerZ.EnsureCapacity( areaCount );
+	m_firstEdge.EnsureCapacity( areaCount + 1 );
+
+	unsigned int maxID = 0;
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+
+		m_area.AddToTail( area );
+		m_centerX.AddToTail( area->GetCenter().x );
+		m_centerY.AddToTail( area->GetCenter().y );
+		m_centerZ.AddToTail( area->GetCenter().z );
+
+		maxID = MAX( maxID, area->GetID() );
+	}
+
+	m_idToIndex.SetCount( maxID + 1 );
+	FOR_EACH_VEC( m_idToIndex, it )
+	{
+		m_idToIndex[ it ] = -1;
+	}
+
+	FOR_EACH_VEC( m_area, it )
+	{
+		m_idToIndex[ m_area[ it ]->GetID() ] = it;
+	}
+
+	// collect edges in the same order NavAreaBuildPath() visits them
+	FOR_EACH_VEC( m_area, it )
+	{
+		const CNavArea *area = m_area[ it ];
+
+		m_firstEdge.AddToTail( m_edgeTarget.Count() );
+
+		for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
+		{
+			const NavConnectVector *floorList = area->GetAdjacentAreas( (NavDirType)dir );
+			FOR_EACH_VEC( (*floorList), f )
+			{
+				const NavConnect &floorConnect = floorList->Element( f );
+				AddEdge( GetAreaIndex( floorConnect.area ), floorConnect.length, (NavTraverseType)dir, NULL, NULL );
+			}
+		}
+
+		// do not use BEHIND connection, as its very hard to get to when going up a ladder
+		const NavLadderConnectVector *ladderList = area->GetLadders( CNavLadder::LADDER_UP );
+		FOR_EACH_VEC( (*ladderList), l )
+		{
+			const CNavLadder *ladder = ladderList->Element( l ).ladder;
+			AddEdge( GetAreaIndex( ladder->m_topForwardArea ), -1.0f, GO_LADDER_UP, ladder, NULL );
+			AddEdge( GetAreaIndex( ladder->m_topLeftArea ), -1.0f, GO_LADDER_UP, ladder, NULL );
+			AddEdge( GetAreaIndex( ladder->m_topRightArea ), -1.0f, GO_LADDER_UP, ladder, NULL );
+		}
+
+		ladderList = area->GetLadders( CNavLadder::LADDER_DOWN );
+		FOR_EACH_VEC( (*ladderList), l )
+		{
+			const CNavLadder *ladder = ladderList->Element( l ).ladder;
+			AddEdge( GetAreaIndex( ladder->m_bottomArea ), -1.0f, GO_LADDER_DOWN, ladder, NULL );
+		}
+
+		const CFuncElevator *elevator = area->GetElevator();
+		if ( elevator )
+		{
+			const NavConnectVector &elevatorAreas = area->GetElevatorAreas();
+			FOR_EACH_VEC( elevatorAreas, e )
+			{
+				const CNavArea *elevatorArea = elevatorAreas[ e ].area;
+				NavTraverseType how = ( elevatorArea->GetCenter().z > area->GetCenter().z ) ? GO_ELEVATOR_UP : GO_ELEVATOR_DOWN;
+				AddEdge( GetAreaIndex( elevatorArea ), -1.0f, how, NULL, elevator );
+			}
+		}
+	}
+
+	m_firstEdge.AddToTail( m_edgeTarget.Count() );
+
+	// pad the edge centers so four-wide loads never run off the end
+	for( int i=0; i<3; ++i )
+	{
+		m_edgeCenterX.AddToTail( 0.0f );
+		m_edgeCenterY.AddToTail( 0.0f );
+		m_edgeCenterZ.AddToTail( 0.0f );
+	}
+
+	m_topologyVersion = TheNavMesh->GetTopologyVersion();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Per-query search state. Replaces the open/closed lists and cost fields stored in CNavArea,
+ * so that searches don't interfere with each other.
+ * The open list is an indexed 4-ary min-heap on total cost.
+ */
+class CNavSearchContext
+{
+public:
+	CNavSearchContext( void )
+	{
+		m_searchMarker = 0;
+	}
+
+	enum { HEAP_ARITY = 4 };
+
+	enum AreaState
+	{
+		AREA_UNVISITED,
+		AREA_OPEN,
+		AREA_CLOSED,
+	};
+
+	void Begin( int areaCount )
+	{
+		if ( m_marker.Count() != areaCount )
+		{
+			m_marker.SetCount( areaCount );
+			m_state.SetCount( areaCount );
+			m_heapIndex.SetCount( areaCount );
+			m_costSoFar.SetCount( areaCount );
+			m_totalCost.SetCount( areaCount );
+			m_pathLengthSoFar.SetCount( areaCount );
+			m_parent.SetCount( areaCount );
+			m_parentHow.SetCount( areaCount );
+
+			FOR_EACH_VEC( m_marker, it )
+			{
+				m_marker[ it ] = 0;
+			}
+			m_searchMarker = 0;
+		}
+
+		++m_searchMarker;
+		if ( m_searchMarker == 0 )
+		{
+			// wrapped around - stale markers could now look current
+			FOR_EACH_VEC( m_marker, it )
+			{
+				m_marker[ it ] = 0;
+			}
+			m_searchMarker = 1;
+		}
+
+		m_heap.RemoveAll();
+	}
+
+	// touch an area for this search, resetting it if this is its first visit
+	void Visit( int index )
+	{
+		if ( m_marker[ index ] != m_searchMarker )
+		{
+			m_marker[ index ] = m_searchMarker;
+			m_state[ index ] = AREA_UNVISITED;
+			m_parent[ index ] = -1;
+			m_parentHow[ index ] = NUM_TRAVERSE_TYPES;
+			m_pathLengthSoFar[ index ] = 0.0f;
+		}
+	}
+
+	bool IsVisited( int index ) const	{ return m_marker[ index ] == m_searchMarker; }
+	bool IsOpen( int index ) const		{ return IsVisited( index ) && m_state[ index ] == AREA_OPEN; }
+	bool IsClosed( int index ) const	{ return IsVisited( index ) && m_state[ index ] == AREA_CLOSED; }
+
+	bool IsOpenListEmpty( void ) const	{ return m_heap.Count() == 0; }
+
+	void AddToOpenList( int index )
+	{
+		Assert( IsVisited( index ) && m_state[ index ] != AREA_OPEN );
+		m_state[ index ] = AREA_OPEN;
+		m_heapIndex[ index ] = m_heap.AddToTail( index );
+		SiftUp( m_heapIndex[ index ] );
+	}
+
+	// a smaller total cost has been found for an area already on the open list
+	void UpdateOnOpenList( int index )
+	{
+		Assert( IsOpen( index ) );
+		SiftUp( m_heapIndex[ index ] );
+	}
+
+	int PopOpenList( void )
+	{
+		Assert( !IsOpenListEmpty() );
+		int index = m_heap[ 0 ];
+
+		int last = m_heap.Count() - 1;
+		if ( last > 0 )
+		{
+			m_heap[ 0 ] = m_heap[ last ];
+			m_heapIndex[ m_heap[ 0 ] ] = 0;
+		}
+		m_heap.RemoveMultipleFromTail( 1 );
+
+		if ( m_heap.Count() > 1 )
+		{
+			SiftDown( 0 );
+		}
+
+		m_state[ index ] = AREA_UNVISITED;
+		return index;
+	}
+
+	void AddToClosedList( int index )	{ m_state[ index ] = AREA_CLOSED; }
+	void RemoveFromClosedList( int index )	{ m_state[ index ] = AREA_UNVISITED; }
+
+	CUtlVector< float > m_costSoFar;
+	CUtlVector< float > m_totalCost;
+	CUtlVector< float > m_pathLengthSoFar;
+	CUtlVector< int > m_parent;
+	CUtlVector< unsigned char > m_parentHow;
+
+	// scratch space for per-edge values of the area being expanded
+	CUtlVector< float > m_edgeCostRemaining;
+	CUtlVector< float > m_edgeDeltaLength;
+
+private:
+	void SiftUp( int pos )
+	{
+		int index = m_heap[ pos ];
+		float cost = m_totalCost[ index ];
+
+		while( pos > 0 )
+		{
+			int parentPos = ( pos - 1 ) / HEAP_ARITY;
+			int parentIndex = m_heap[ parentPos ];
+			if ( m_totalCost[ parentIndex ] <= cost )
+				break;
+
+			m_heap[ pos ] = parentIndex;
+			m_heapIndex[ parentIndex ] = pos;
+			pos = parentPos;
+		}
+
+		m_heap[ pos ] = index;
+		m_heapIndex[ index ] = pos;
+	}
+
+	void SiftDown( int pos )
+	{
+		int count = m_heap.Count();
+		int index = m_heap[ pos ];
+		float cost = m_totalCost[ index ];
+
+		while( true )
+		{
+			int firstChild = pos * HEAP_ARITY + 1;
+			if ( firstChild >= count )
+				break;
+
+			// find the cheapest child
+			int bestPos = firstChild;
+			float bestCost = m_totalCost[ m_heap[ firstChild ] ];
+			int lastChild = MIN( firstChild + HEAP_ARITY, count );
+			for( int childPos = firstChild + 1; childPos < lastChild; ++childPos )
+			{
+				float childCost = m_totalCost[ m_heap[ childPos ] ];
+				if ( childCost < bestCost )
+				{
+					bestCost = childCost;
+					bestPos = childPos;
+				}
+			}
+
+			if ( bestCost >= cost )
+				break;
+
+			int bestIndex = m_heap[ bestPos ];
+			m_heap[ pos ] = bestIndex;
+			m_heapIndex[ bestIndex ] = pos;
+			pos = bestPos;
+		}
+
+		m_heap[ pos ] = index;
+		m_heapIndex[ index ] = pos;
+	}
+
+	unsigned int m_searchMarker;
+	CUtlVector< unsigned int > m_marker;			// area state is only valid if m_marker == m_searchMarker
+	CUtlVector< unsigned char > m_state;
+	CUtlVector< int > m_heapIndex;
+	CUtlVector< int > m_heap;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavPathEngine::CNavPathEngine( void )
+{
+	m_cacheBlockedVersion = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavPathEngine::~CNavPathEngine()
+{
+	m_freeContexts.PurgeAndDeleteElements();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathEngine::Reset( void )
+{
+	FlushCache();
+	m_graph.Clear();
+
+	AUTO_LOCK_FM( m_contextMutex );
+	m_freeContexts.PurgeAndDeleteElements();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavPathEngine::IsGraphCurrent( void ) const
+{
+	return m_graph.GetAreaCount() > 0 && m_graph.GetTopologyVersion() == TheNavMesh->GetTopologyVersion();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Make sure the search graph matches the mesh, rebuilding it if needed.
+ * Returns false if the graph is out of date and can't be rebuilt from this thread.
+ */
+bool CNavPathEngine::UpdateGraph( void )
+{
+	if ( IsGraphCurrent() )
+		return true;
+
+	// only the main thread may rebuild the graph
+	if ( !ThreadInMainThread() )
+		return false;
+
+	m_graph.Build();
+	FlushCache();
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Invoked each frame on the main thread, while no searches are running
+ */
+void CNavPathEngine::Update( void )
+{
+	if ( TheNavMesh->IsGenerating() )
+		return;
+
+	if ( m_graph.GetAreaCount() > 0 && !IsGraphCurrent() )
+	{
+		// the mesh has changed - rebuild on the next query
+		m_graph.Clear();
+		FlushCache();
+	}
+
+	if ( m_cacheBlockedVersion != TheNavMesh->GetBlockedVersion() )
+	{
+		FlushCache();
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSearchContext *CNavPathEngine::AcquireContext( void )
+{
+	AUTO_LOCK_FM( m_contextMutex );
+
+	if ( m_freeContexts.Count() )
+	{
+		CNavSearchContext *context = m_freeContexts.Tail();
+		m_freeContexts.RemoveMultipleFromTail( 1 );
+		return context;
+	}
+
+	return new CNavSearchContext;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathEngine::ReleaseContext( CNavSearchContext *context )
+{
+	AUTO_LOCK_FM( m_contextMutex );
+	m_freeContexts.AddToTail( context );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavPathEngine::BuildPath( const NavPathQuery &query, INavPathCost &costFunc, NavPathStepVector *path, CNavArea **closestArea )
+{
+	VPROF_BUDGET( "CNavPathEngine::BuildPath", "NextBotSpiky" );
+
+	if ( closestArea )
+	{
+		*closestArea = query.startArea;
+	}
+
+	if ( path )
+	{
+		path->RemoveAll();
+	}
+
+	if ( query.startArea == NULL )
+		return false;
+
+	// the mesh is in flux while it is being generated
+	if ( TheNavMesh->IsGenerating() && !IsGraphCurrent() )
+		return false;
+
+	if ( !UpdateGraph() )
+		return false;
+
+	++m_queryCount;
+
+	// only area to area searches without a length limit are cached
+	CacheKey key;
+	bool isCacheable = ( query.goalArea && query.goalPos == NULL && query.maxPathLength <= 0.0f && costFunc.GetCacheID() != 0 && nav_path_cache_size.GetInt() > 0 );
+	if ( isCacheable )
+	{
+		key.startIndex = m_graph.GetAreaIndex( query.startArea );
+		key.goalIndex = m_graph.GetAreaIndex( query.goalArea );
+		key.teamID = query.teamID;
+		key.costID = ( costFunc.GetCacheID() & 0x7FFFFFFF ) | ( query.ignoreNavBlockers ? 0x80000000 : 0 );
+
+		bool isPathFound;
+		if ( FindCachedPath( key, path, closestArea, &isPathFound ) )
+		{
+			++m_cacheHitCount;
+			return isPathFound;
+		}
+	}
+
+	CNavSearchContext *context = AcquireContext();
+
+	int reachedIndex = -1;
+	int closestIndex = -1;
+	bool isPathFound = Search( context, query, costFunc, &reachedIndex, &closestIndex );
+
+	NavPathStepVector localPath;
+	NavPathStepVector *resultPath = ( path ) ? path : &localPath;
+	if ( isPathFound && reachedIndex >= 0 )
+	{
+		BuildPathFromContext( context, reachedIndex, resultPath );
+	}
+
+	ReleaseContext( context );
+
+	if ( closestArea && closestIndex >= 0 )
+	{
+		*closestArea = m_graph.GetArea( closestIndex );
+	}
+
+	if ( isCacheable )
+	{
+		AddCachedPath( key, isPathFound, closestIndex, *resultPath );
+	}
+
+	return isPathFound;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A* search mirroring NavAreaBuildPath(), with all state kept in 'context'.
+ * Returns true if a path exists, with the index of the area the path ends in.
+ */
+bool CNavPathEngine::Search( CNavSearchContext *context, const NavPathQuery &query, INavPathCost &costFunc, int *reachedIndex, int *closestIndex )
+{
+	const CNavSearchGraph &graph = m_graph;
+
+	int startIndex = graph.GetAreaIndex( query.startArea );
+	if ( startIndex < 0 )
+		return false;
+
+	*closestIndex = startIndex;
+
+	CNavArea *goalArea = query.goalArea;
+	if ( goalArea != NULL && goalArea->IsBlocked( query.teamID, query.ignoreNavBlockers ) )
+		goalArea = NULL;
+
+	if ( goalArea == NULL && query.goalPos == NULL )
+		return false;
+
+	int goalIndex = graph.GetAreaIndex( goalArea );
+	if ( goalArea && goalIndex < 0 )
+		return false;
+
+	// if we are already in the goal area, build trivial path
+	if ( startIndex == goalIndex )
+	{
+		*reachedIndex = startIndex;
+		return true;
+	}
+
+	// determine actual goal position
+	Vector actualGoalPos = ( query.goalPos ) ? *query.goalPos : goalArea->GetCenter();
+	fltx4 goalX = ReplicateX4( actualGoalPos.x );
+	fltx4 goalY = ReplicateX4( actualGoalPos.y );
+	fltx4 goalZ = ReplicateX4( actualGoalPos.z );
+
+	// start search
+	context->Begin( graph.GetAreaCount() );
+	context->Visit( startIndex );
+
+	// compute estimate of path length
+	context->m_totalCost[ startIndex ] = ( query.startArea->GetCenter() - actualGoalPos ).Length();
+
+	float initCost = costFunc.GetCost( query.startArea, NULL, NULL, NULL, -1.0f, 0.0f );
+	if ( initCost < 0.0f )
+		return false;
+	context->m_costSoFar[ startIndex ] = initCost;
+	context->m_pathLengthSoFar[ startIndex ] = 0.0f;
+
+	context->AddToOpenList( startIndex );
+
+	// keep track of the area we visit that is closest to the goal
+	float closestAreaDist = context->m_totalCost[ startIndex ];
+
+	bool bHaveMaxPathLength = ( query.maxPathLength > 0.0f );
+
+	// do A* search
+	while( !context->IsOpenListEmpty() )
+	{
+		// get next area to check
+		int index = context->PopOpenList();
+		CNavArea *area = graph.GetArea( index );
+
+		// don't consider blocked areas
+		if ( area->IsBlocked( query.teamID, query.ignoreNavBlockers ) )
+			continue;
+
+		// check if we have found the goal area or position
+		if ( index == goalIndex || ( goalArea == NULL && query.goalPos && area->Contains( *query.goalPos ) ) )
+		{
+			*closestIndex = index;
+			*reachedIndex = index;
+			return true;
+		}
+
+		int firstEdge = graph.m_firstEdge[ index ];
+		int edgeCount = graph.m_firstEdge[ index + 1 ] - firstEdge;
+
+		// estimate the distance left to go from each neighbor, four at a time
+		context->m_edgeCostRemaining.SetCount( edgeCount + 3 );
+		context->m_edgeDeltaLength.SetCount( edgeCount + 3 );
+
+		fltx4 areaX = ReplicateX4( graph.m_centerX[ index ] );
+		fltx4 areaY = ReplicateX4( graph.m_centerY[ index ] );
+		fltx4 areaZ = ReplicateX4( graph.m_centerZ[ index ] );
+		for( int e=0; e<edgeCount; e+=4 )
+		{
+			fltx4 x = LoadUnalignedSIMD( &graph.m_edgeCenterX[ firstEdge + e ] );
+			fltx4 y = LoadUnalignedSIMD( &graph.m_edgeCenterY[ firstEdge + e ] );
+			fltx4 z = LoadUnalignedSIMD( &graph.m_edgeCenterZ[ firstEdge + e ] );
+
+			fltx4 dx = SubSIMD( x, goalX );
+			fltx4 dy = SubSIMD( y, goalY );
+			fltx4 dz = SubSIMD( z, goalZ );
+			fltx4 distSq = MaddSIMD( dx, dx, MaddSIMD( dy, dy, MulSIMD( dz, dz ) ) );
+			StoreUnalignedSIMD( &context->m_edgeCostRemaining[ e ], SqrtSIMD( distSq ) );
+
+			if ( bHaveMaxPathLength )
+			{
+				dx = SubSIMD( x, areaX );
+				dy = SubSIMD( y, areaY );
+				dz = SubSIMD( z, areaZ );
+				distSq = MaddSIMD( dx, dx, MaddSIMD( dy, dy, MulSIMD( dz, dz ) ) );
+				StoreUnalignedSIMD( &context->m_edgeDeltaLength[ e ], SqrtSIMD( distSq ) );
+			}
+		}
+
+		// search adjacent areas
+		int parentIndex = context->m_parent[ index ];
+		float costSoFar = context->m_costSoFar[ index ];
+
+		for( int e=0; e<edgeCount; ++e )
+		{
+			int edge = firstEdge + e;
+			int newIndex = graph.m_edgeTarget[ edge ];
+
+			// don't backtrack
+			if ( newIndex == parentIndex )
+				continue;
+			if ( newIndex == index ) // self neighbor?
+				continue;
+
+			CNavArea *newArea = graph.GetArea( newIndex );
+
+			// don't consider blocked areas
+			if ( newArea->IsBlocked( query.teamID, query.ignoreNavBlockers ) )
+				continue;
+
+			float newCostSoFar = costFunc.GetCost( newArea, area, graph.m_edgeLadder[ edge ], graph.m_edgeElevator[ edge ], graph.m_edgeLength[ edge ], costSoFar );
+
+			// NaNs really mess this function up causing tough to track down hangs. If
+			//  we get inf back, clamp it down to a really high number.
+			DebuggerBreakOnNaN_StagingOnly( newCostSoFar );
+			if ( IS_NAN( newCostSoFar ) )
+				newCostSoFar = 1e30f;
+
+			// check if cost functor says this area is a dead-end
+			if ( newCostSoFar < 0.0f )
+				continue;
+
+			// Safety check against a bogus functor.  The cost of the path
+			// A...B, C should always be at least as big as the path A...B.
+			Assert( newCostSoFar >= costSoFar );
+
+			// Make sure that any jump to a new area incurs some pathfinding cost
+			float minNewCostSoFar = costSoFar * 1.00001f + 0.00001f;
+			newCostSoFar = Max( newCostSoFar, minNewCostSoFar );
+
+			context->Visit( newIndex );
+
+			// stop if path length limit reached
+			if ( bHaveMaxPathLength )
+			{
+				// keep track of path length so far
+				float newLengthSoFar = context->m_pathLengthSoFar[ index ] + context->m_edgeDeltaLength[ e ];
+				if ( newLengthSoFar > query.maxPathLength )
+					continue;
+
+				context->m_pathLengthSoFar[ newIndex ] = newLengthSoFar;
+			}
+
+			bool isOpen = context->IsOpen( newIndex );
+			bool isClosed = context->IsClosed( newIndex );
+			if ( ( isOpen || isClosed ) && context->m_costSoFar[ newIndex ] <= newCostSoFar )
+			{
+				// this is a worse path - skip it
+				continue;
+			}
+
+			float newCostRemaining = context->m_edgeCostRemaining[ e ];
+
+			// track closest area to goal in case path fails
+			if ( newCostRemaining < closestAreaDist )
+			{
+				*closestIndex = newIndex;
+				closestAreaDist = newCostRemaining;
+			}
+
+			context->m_costSoFar[ newIndex ] = newCostSoFar;
+			context->m_totalCost[ newIndex ] = newCostSoFar + newCostRemaining;
+			context->m_parent[ newIndex ] = index;
+			context->m_parentHow[ newIndex ] = graph.m_edgeHow[ edge ];
+
+			if ( isClosed )
+			{
+				context->RemoveFromClosedList( newIndex );
+			}
+
+			if ( isOpen )
+			{
+				// area already on open list, update the heap to keep costs sorted
+				context->UpdateOnOpenList( newIndex );
+			}
+			else
+			{
+				context->AddToOpenList( newIndex );
+			}
+		}
+
+		// we have searched this area
+		context->AddToClosedList( index );
+	}
+
+	return false;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathEngine::BuildPathFromContext( const CNavSearchContext *context, int endIndex, NavPathStepVector *path ) const
+{
+	int count = 0;
+	for( int index = endIndex; index >= 0; index = context->m_parent[ index ] )
+	{
+		++count;
+	}
+
+	path->SetCount( count );
+
+	int i = count - 1;
+	for( int index = endIndex; index >= 0; index = context->m_parent[ index ] )
+	{
+		NavPathStep &step = path->Element( i-- );
+		step.area = m_graph.GetArea( index );
+		step.how = (NavTraverseType)context->m_parentHow[ index ];
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavPathEngine::FindCachedPath( const CacheKey &key, NavPathStepVector *path, CNavArea **closestArea, bool *isPathFound )
+{
+	AUTO_LOCK_FM( m_cacheMutex );
+
+	if ( m_cacheBlockedVersion != TheNavMesh->GetBlockedVersion() )
+	{
+		// blockers have changed since these paths were found
+		m_cacheLookup.RemoveAll();
+		m_cache.RemoveAll();
+		m_cacheBlockedVersion = TheNavMesh->GetBlockedVersion();
+		return false;
+	}
+
+	UtlHashHandle_t h = m_cacheLookup.Find( key );
+	if ( h == m_cacheLookup.InvalidHandle() )
+		return false;
+
+	int entryIndex = m_cacheLookup[ h ];
+	const CacheEntry &entry = m_cache[ entryIndex ];
+
+	if ( path )
+	{
+		path->SetCount( entry.areas.Count() );
+		FOR_EACH_VEC( entry.areas, it )
+		{
+			path->Element( it ).area = m_graph.GetArea( entry.areas[ it ] );
+			path->Element( it ).how = (NavTraverseType)entry.how[ it ];
+		}
+	}
+
+	if ( closestArea && entry.closestIndex >= 0 )
+	{
+		*closestArea = m_graph.GetArea( entry.closestIndex );
+	}
+
+	*isPathFound = entry.isPathFound;
+
+	// move to the head of the LRU list
+	m_cache.LinkToHead( entryIndex );
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathEngine::AddCachedPath( const CacheKey &key, bool isPathFound, int closestIndex, const NavPathStepVector &path )
+{
+	AUTO_LOCK_FM( m_cacheMutex );
+
+	if ( m_cacheBlockedVersion != TheNavMesh->GetBlockedVersion() )
+	{
+		m_cacheLookup.RemoveAll();
+		m_cache.RemoveAll();
+		m_cacheBlockedVersion = TheNavMesh->GetBlockedVersion();
+	}
+
+	if ( m_cacheLookup.HasElement( key ) )
+	{
+		// another thread got here first
+		return;
+	}
+
+	// evict least recently used paths
+	int maxCount = MAX( nav_path_cache_size.GetInt(), 1 );
+	while( m_cache.Count() >= maxCount )
+	{
+		int tail = m_cache.Tail();
+		m_cacheLookup.Remove( m_cache[ tail ].key );
+		m_cache.Remove( tail );
+	}
+
+	int entryIndex = m_cache.AddToHead();
+	CacheEntry &entry = m_cache[ entryIndex ];
+	entry.key = key;
+	entry.isPathFound = isPathFound;
+	entry.closestIndex = closestIndex;
+	entry.areas.SetCount( path.Count() );
+	entry.how.SetCount( path.Count() );
+	FOR_EACH_VEC( path, it )
+	{
+		entry.areas[ it ] = m_graph.GetAreaIndex( path[ it ].area );
+		entry.how[ it ] = (unsigned char)path[ it ].how;
+	}
+
+	m_cacheLookup.Insert( key, entryIndex );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathEngine::FlushCache( void )
+{
+	AUTO_LOCK_FM( m_cacheMutex );
+
+	m_cacheLookup.RemoveAll();
+	m_cache.RemoveAll();
+	m_cacheBlockedVersion = TheNavMesh ? TheNavMesh->GetBlockedVersion() : 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathEngine::PrintStats( void ) const
+{
+	int queryCount = m_queryCount;
+	int hitCount = m_cacheHitCount;
+
+	Msg( "Nav path engine: %d areas, %d edges in search graph\n", m_graph.GetAreaCount(), m_graph.m_edgeTarget.Count() );
+	Msg( "  %d queries, %d cache hits (%.1f%%), %d cached paths\n", queryCount, hitCount, queryCount ? 100.0f * hitCount / queryCount : 0.0f, m_cache.Count() );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nav_path_engine_stats, "Show nav path engine query and cache statistics", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	TheNavPathEngine.PrintStats();
+}
@@ -0,0 +1,230 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_pathengine.h
+// Re-entrant A* over a compact snapshot of the Navigation Mesh, with a path cache
+
+#ifndef _NAV_PATHENGINE_H_
+#define _NAV_PATHENGINE_H_
+
+#include "tier0/threadtools.h"
+#include "tier1/utlhashtable.h"
+#include "tier1/utllinkedlist.h"
+#include "nav_area.h"
+
+class CNavSearchContext;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Cost function used by CNavPathEngine.
+ * This is the same contract as the CostFunctor used with NavAreaBuildPath(), except that the cost
+ * so far of 'fromArea' is passed in instead of being read from the area, since the area's own
+ * search state is not touched by the engine.
+ */
+abstract_class INavPathCost
+{
+public:
+	/**
+	 * Return the total cost of reaching 'area' from 'fromArea', or -1 if 'area' is a dead end.
+	 * 'fromArea' is NULL for the first area in the path.
+	 */
+	virtual float GetCost( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder, const CFuncElevator *elevator, float length, float fromCostSoFar ) = 0;
+
+	/**
+	 * Return a number that uniquely identifies this cost function, so results can be shared between
+	 * queries. Return zero if the cost depends on anything other than the mesh and blocked state,
+	 * and the path will never be cached.
+	 */
+	virtual int GetCacheID( void ) const = 0;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * INavPathCost version of ShortestPathCost
+ */
+class CNavShortestPathCost : public INavPathCost
+{
+public:
+	enum { CACHE_ID = 1 };
+
+	virtual float GetCost( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder, const CFuncElevator *elevator, float length, float fromCostSoFar );
+	virtual int GetCacheID( void ) const	{ return CACHE_ID; }
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * One step of a path returned by CNavPathEngine
+ */
+struct NavPathStep
+{
+	CNavArea *area;
+	NavTraverseType how;					// how we got into this area - NUM_TRAVERSE_TYPES for the first step
+};
+
+typedef CUtlVector< NavPathStep > NavPathStepVector;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Read-only copy of the mesh connectivity, laid out for the search.
+ * Areas are referred to by their index in the graph. Edges for each area are stored contiguously,
+ * in the same order NavAreaBuildPath() visits them, with a copy of the target area's center
+ * so heuristics for all neighbors of an area can be computed four at a time.
+ */
+class CNavSearchGraph
+{
+public:
+	CNavSearchGraph( void );
+
+	void Build( void );										// snapshot TheNavAreas
+	void Clear( void );
+
+	int GetAreaCount( void ) const				{ return m_area.Count(); }
+	int GetAreaIndex( const CNavArea *area ) const;			// returns -1 if the area is not in the graph
+	CNavArea *GetArea( int index ) const		{ return m_area[ index ]; }
+
+	unsigned int GetTopologyVersion( void ) const	{ return m_topologyVersion; }
+
+	// area data
+	CUtlVector< CNavArea * > m_area;
+	CUtlVector< float > m_centerX, m_centerY, m_centerZ;
+	CUtlVector< int > m_firstEdge;							// edges for area i are [ m_firstEdge[i], m_firstEdge[i+1] )
+
+	// edge data
+	CUtlVector< int > m_edgeTarget;
+	CUtlVector< float > m_edgeLength;						// NavConnect length, -1 for ladders and elevators
+	CUtlVector< unsigned char > m_edgeHow;					// NavTraverseType
+	CUtlVector< const CNavLadder * > m_edgeLadder;
+	CUtlVector< const CFuncElevator * > m_edgeElevator;
+	CUtlVector< float > m_edgeCenterX, m_edgeCenterY, m_edgeCenterZ;	// center of the target area, padded for SIMD loads
+
+private:
+	void AddEdge( int target, float length, NavTraverseType how, const CNavLadder *ladder, const CFuncElevator *elevator );
+
+	CUtlVector< int > m_idToIndex;							// nav area ID -> index
+	unsigned int m_topologyVersion;							// TheNavMesh topology version this graph was built from
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Parameters of a path query
+ */
+struct NavPathQuery
+{
+	NavPathQuery( void )
+	{
+		startArea = NULL;
+		goalArea = NULL;
+		goalPos = NULL;
+		maxPathLength = 0.0f;
+		teamID = TEAM_ANY;
+		ignoreNavBlockers = false;
+	}
+
+	CNavArea *startArea;
+	CNavArea *goalArea;
+	const Vector *goalPos;
+	float maxPathLength;
+	int teamID;
+	bool ignoreNavBlockers;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Thread-safe path finding over the Navigation Mesh.
+ * Each query runs in its own CNavSearchContext, so any number of threads may search at the same
+ * time. The mesh must not be modified while searches are running; the search graph is rebuilt on
+ * the main thread when the mesh topology changes. Successful paths between two areas are cached,
+ * and the cache is flushed whenever the blocked state of any area changes.
+ */
+class CNavPathEngine
+{
+public:
+	CNavPathEngine( void );
+	~CNavPathEngine();
+
+	/**
+	 * Find a path with the same semantics as NavAreaBuildPath(). On success, 'path' holds the
+	 * areas from start to goal. If 'closestArea' is non-NULL, the area closest to the goal is
+	 * returned (useful if the path fails). Returns true if a path exists.
+	 */
+	bool BuildPath( const NavPathQuery &query, INavPathCost &costFunc, NavPathStepVector *path, CNavArea **closestArea = NULL );
+
+	void Update( void );									// invoked each frame on the main thread
+	void Reset( void );										// drop the graph, contexts and cache
+
+	void PrintStats( void ) const;
+
+	bool UpdateGraph( void );								// rebuild the graph if the mesh has changed - returns false if it is not usable
+	bool IsGraphCurrent( void ) const;
+	const CNavSearchGraph &GetGraph( void ) const	{ return m_graph; }
+
+private:
+
+	CNavSearchContext *AcquireContext( void );
+	void ReleaseContext( CNavSearchContext *context );
+
+	bool Search( CNavSearchContext *context, const NavPathQuery &query, INavPathCost &costFunc, int *reachedIndex, int *closestIndex );
+	void BuildPathFromContext( const CNavSearchContext *context, int endIndex, NavPathStepVector *path ) const;
+
+	CNavSearchGraph m_graph;
+
+	CUtlVector< CNavSearchContext * > m_freeContexts;
+	CThreadFastMutex m_contextMutex;
+
+	//----------------------------------------------------------------------------------
+	// Path cache
+	//
+	struct CacheKey
+	{
+		int startIndex;
+		int goalIndex;
+		int teamID;
+		int costID;											// cost functor ID, high bit set when ignoring nav blockers
+
+		bool operator==( const CacheKey &other ) const
+		{
+			return startIndex == other.startIndex && goalIndex == other.goalIndex && teamID == other.teamID && costID == other.costID;
+		}
+	};
+
+	struct CacheKeyHashFunctor
+	{
+		unsigned int operator()( const CacheKey &key ) const	{ return Hash16( &key ); }
+	};
+
+	struct CacheEntry
+	{
+		CacheKey key;
+		bool isPathFound;
+		int closestIndex;
+		CUtlVector< int > areas;							// area indices from start to goal
+		CUtlVector< unsigned char > how;
+	};
+
+	bool FindCachedPath( const CacheKey &key, NavPathStepVector *path, CNavArea **closestArea, bool *isPathFound );
+	void AddCachedPath( const CacheKey &key, bool isPathFound, int closestIndex, const NavPathStepVector &path );
+	void FlushCache( void );
+
+	CUtlHashtable< CacheKey, int, CacheKeyHashFunctor > m_cacheLookup;	// key -> index into m_cache
+	CUtlLinkedList< CacheEntry, int > m_cache;				// most recently used at the head
+	CThreadFastMutex m_cacheMutex;
+	unsigned int m_cacheBlockedVersion;						// TheNavMesh blocked version the cache contents are valid for
+
+	CInterlockedInt m_queryCount;
+	CInterlockedInt m_cacheHitCount;
+};
+
+extern CNavPathEngine TheNavPathEngine;
+
+
+#endif // _NAV_PATHENGINE_H_
@@ -739,29 +739,46 @@ bool CBasePlayer::WantsLagCompensationOnEntity( const CBasePlayer *pPlayer, cons
 	if ( pEntityTransmitBits && !pEntityTransmitBits->Get( pPlayer->entindex() ) )
 		return false;
 
-	const Vector &vMyOrigin = GetAbsOrigin();
 	const Vector &vHisOrigin = pPlayer->GetAbsOrigin();
+	return IsInLagCompensationCone( pPlayer, pCmd, vHisOrigin, vHisOrigin );
+}
+
+bool CBasePlayer::WantsLagCompensationOnHistory( const CBasePlayer *pPlayer, const CUserCmd *pCmd, const Vector &vecSweptMins, const Vector &vecSweptMaxs ) const
+{
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The distance and view cone test of WantsLagCompensationOnEntity. True if
+//			pPlayer could be anywhere in the box and need lag compensation.
+//-----------------------------------------------------------------------------
+bool CBasePlayer::IsInLagCompensationCone( const CBasePlayer *pPlayer, const CUserCmd *pCmd, const Vector &vecMins, const Vector &vecMaxs ) const
+{
+	// Test the sphere around the box, which is just a point for a single origin
+	Vector vHisCenter = ( vecMins + vecMaxs ) * 0.5f;
+	float flRadius = ( vecMaxs - vHisCenter ).Length();
+
+	Vector vDiff = vHisCenter - GetAbsOrigin();
+	float flDist = vDiff.Length();
 
 	// get max distance player could have moved within max lag compensation time, 
 	// multiply by 1.5 to to avoid "dead zones"  (sqrt(2) would be the exact value)
 	float maxDistance = 1.5 * pPlayer->MaxSpeed() * sv_maxunlag.GetFloat();
 
 	// If the player is within this distance, lag compensate them in case they're running past us.
-	if ( vHisOrigin.DistTo( vMyOrigin ) < maxDistance )
+	if ( flDist - flRadius < maxDistance )
 		return true;
 
 	// If their origin is not within a 45 degree cone in front of us, no need to lag compensate.
+	// The sphere center is at least ( perp * cos - along * sin ) from the surface of the cone,
+	// so the sphere misses it when that's more than the radius.
 	Vector vForward;
 	AngleVectors( pCmd->viewangles, &vForward );
-	
-	Vector vDiff = vHisOrigin - vMyOrigin;
-	VectorNormalize( vDiff );
 
 	float flCosAngle = 0.707107f;	// 45 degree angle
-	if ( vForward.Dot( vDiff ) < flCosAngle )
-		return false;
-
-	return true;
+	float flAlong = vForward.Dot( vDiff );
+	float flPerp = FastSqrt( MAX( flDist * flDist - flAlong * flAlong, 0.0f ) );
+	return ( flPerp - flAlong ) * flCosAngle <= flRadius;
 }
 
 void CBasePlayer::PauseBonusProgress( bool bPause )
@@ -284,6 +284,13 @@ public:
 	// (like team members, entities out of our PVS, etc).
 	virtual bool			WantsLagCompensationOnEntity( const CBasePlayer	*pPlayer, const CUserCmd *pCmd, const CBitVec<MAX_EDICTS> *pEntityTransmitBits ) const;
 
+	// Cheap early out asked before WantsLagCompensationOnEntity, with the box pPlayer swept over its lag
+	// compensation history. Only return false if WantsLagCompensationOnEntity would reject pPlayer anywhere
+	// in that box. The default never rejects, so override it together with WantsLagCompensationOnEntity.
+	virtual bool			WantsLagCompensationOnHistory( const CBasePlayer *pPlayer, const CUserCmd *pCmd, const Vector &vecSweptMins, const Vector &vecSweptMaxs ) const;
+	// Is any of the box within the cone in front of us that lag compensation cares about?
+	bool					IsInLagCompensationCone( const CBasePlayer *pPlayer, const CUserCmd *pCmd, const Vector &vecMins, const Vector &vecMaxs ) const;
+
 	virtual void			Spawn( void );
 	virtual void			Activate( void );
 	virtual void			SharedSpawn(); // Shared between client and server.
@@ -13,6 +13,7 @@
 #include "utllinkedlist.h"
 #include "BaseAnimatingOverlay.h"
 #include "tier0/vprof.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -36,6 +37,7 @@ ConVar sv_lagflushbonecache( "sv_lagflushbonecache", "1", FCVAR_DEVELOPMENTONLY,
 ConVar sv_showlagcompensation( "sv_showlagcompensation", "0", FCVAR_CHEAT, "Show lag compensated hitboxes whenever a player is lag compensated." );
 
 ConVar sv_unlag_fixstuck( "sv_unlag_fixstuck", "0", FCVAR_DEVELOPMENTONLY, "Disallow backtracking a player for lag compensation if it will cause them to become stuck" );
+ConVar sv_unlag_sweptcull( "sv_unlag_sweptcull", "1", FCVAR_DEVELOPMENTONLY, "Ask CBasePlayer::WantsLagCompensationOnHistory about the box each player swept over his history before anything else" );
 
 //-----------------------------------------------------------------------------
 // Purpose: 
@@ -114,6 +116,228 @@ public:
 	float					m_masterCycle;
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: Fixed-capacity history of lag records for a single player.
+//
+// Records live in a ring buffer addressed by a monotonically increasing serial
+// number (slot = serial & LAG_RECORD_HISTORY_MASK), with each field stored in
+// its own array so the time search and the bounds sweep only touch the data
+// they need. Serials increase with simulation time, which lets BacktrackPlayer
+// binary search instead of walking the whole history.
+//-----------------------------------------------------------------------------
+#define LAG_RECORD_HISTORY_BITS		8
+#define MAX_LAG_RECORDS				( 1 << LAG_RECORD_HISTORY_BITS )	// enough for sv_maxunlag 1.0 at 128 tick
+#define LAG_RECORD_HISTORY_MASK		( MAX_LAG_RECORDS - 1 )
+
+class CLagRecordTrack
+{
+public:
+	CLagRecordTrack()
+	{
+		Clear();
+	}
+
+	void Clear()
+	{
+		m_nHead = -1;
+		m_nCount = 0;
+		m_nLastBreak = -1;
+		m_bBoundsDirty = true;
+	}
+
+	int Count() const					{ return m_nCount; }
+	int Head() const					{ return m_nHead; }
+	int Tail() const					{ return m_nHead - m_nCount + 1; }
+	int Slot( int nSerial ) const		{ return nSerial & LAG_RECORD_HISTORY_MASK; }
+
+	// Newest serial that can't be backtracked through (player died or teleported)
+	int LastBreak() const				{ return m_nLastBreak; }
+
+	float SimulationTime( int nSerial ) const	{ return m_flSimulationTime[ Slot( nSerial ) ]; }
+	const Vector &Origin( int nSerial ) const	{ return m_vecOrigin[ Slot( nSerial ) ]; }
+
+	// Drop every record older than flDeadTime
+	void RemoveOlderThan( float flDeadTime )
+	{
+		while ( m_nCount > 0 && SimulationTime( Tail() ) < flDeadTime )
+		{
+			--m_nCount;
+			m_bBoundsDirty = true;
+		}
+
+		if ( m_nCount == 0 )
+		{
+			Clear();
+		}
+	}
+
+	void AddToHead( CBasePlayer *pPlayer, float flTeleportDistanceSqr );
+
+	// Returns the newest serial whose simulation time is <= flTargetTime, or the
+	// tail if every record is newer than that.
+	int FindRecord( float flTargetTime ) const
+	{
+		Assert( m_nCount > 0 );
+
+		int nLow = Tail();
+		int nHigh = m_nHead;
+		if ( SimulationTime( nLow ) > flTargetTime )
+			return nLow;
+
+		// invariant: SimulationTime( nLow ) <= flTargetTime
+		while ( nLow < nHigh )
+		{
+			int nMid = nLow + ( nHigh - nLow + 1 ) / 2;
+			if ( SimulationTime( nMid ) <= flTargetTime )
+			{
+				nLow = nMid;
+			}
+			else
+			{
+				nHigh = nMid - 1;
+			}
+		}
+
+		return nLow;
+	}
+
+	// World space box swept by the player's bbox over the whole history
+	void GetSweptBounds( Vector *pMins, Vector *pMaxs );
+
+	float		m_flSimulationTime[ MAX_LAG_RECORDS ];
+	int			m_fFlags[ MAX_LAG_RECORDS ];
+	Vector		m_vecOrigin[ MAX_LAG_RECORDS ];
+	QAngle		m_vecAngles[ MAX_LAG_RECORDS ];
+	Vector		m_vecMinsPreScaled[ MAX_LAG_RECORDS ];
+	Vector		m_vecMaxsPreScaled[ MAX_LAG_RECORDS ];
+	int			m_masterSequence[ MAX_LAG_RECORDS ];
+	float		m_masterCycle[ MAX_LAG_RECORDS ];
+	LayerRecord	m_layerRecords[ MAX_LAG_RECORDS ][ MAX_LAYER_RECORDS ];
+
+private:
+	int			m_nHead;
+	int			m_nCount;
+	int			m_nLastBreak;
+
+	bool		m_bBoundsDirty;
+	Vector		m_vecSweptMins;
+	Vector		m_vecSweptMaxs;
+};
+
+void CLagRecordTrack::AddToHead( CBasePlayer *pPlayer, float flTeleportDistanceSqr )
+{
+	Assert( m_nCount < MAX_LAG_RECORDS );
+	if ( m_nCount == MAX_LAG_RECORDS )
+	{
+		// Overwrite the oldest record rather than running off the end of the ring
+		--m_nCount;
+	}
+
+	++m_nHead;
+	++m_nCount;
+
+	int nSlot = Slot( m_nHead );
+
+	m_fFlags[nSlot] = 0;
+	if ( pPlayer->IsAlive() )
+	{
+		m_fFlags[nSlot] |= LC_ALIVE;
+	}
+
+	m_flSimulationTime[nSlot]	= pPlayer->GetSimulationTime();
+	m_vecAngles[nSlot]			= pPlayer->GetLocalAngles();
+	m_vecOrigin[nSlot]			= pPlayer->GetLocalOrigin();
+	m_vecMinsPreScaled[nSlot]	= pPlayer->CollisionProp()->OBBMinsPreScaled();
+	m_vecMaxsPreScaled[nSlot]	= pPlayer->CollisionProp()->OBBMaxsPreScaled();
+
+	LayerRecord *pLayers = m_layerRecords[nSlot];
+	int layerCount = pPlayer->GetNumAnimOverlays();
+	for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
+	{
+		CAnimationLayer *currentLayer = pPlayer->GetAnimOverlay(layerIndex);
+		if( currentLayer )
+		{
+			pLayers[layerIndex].m_cycle = currentLayer->m_flCycle;
+			pLayers[layerIndex].m_order = currentLayer->m_nOrder;
+			pLayers[layerIndex].m_sequence = currentLayer->m_nSequence;
+			pLayers[layerIndex].m_weight = currentLayer->m_flWeight;
+		}
+	}
+	m_masterSequence[nSlot] = pPlayer->GetSequence();
+	m_masterCycle[nSlot] = pPlayer->GetCycle();
+
+	// BacktrackPlayer can't go past a record where the player was dead, or one
+	// that is too far from its newer neighbour. Remember the newest such record
+	// so the search doesn't have to walk the history to find it.
+	if ( m_nCount > 1 )
+	{
+		Vector delta = m_vecOrigin[ Slot( m_nHead - 1 ) ] - m_vecOrigin[nSlot];
+		if ( delta.Length2DSqr() > flTeleportDistanceSqr )
+		{
+			m_nLastBreak = m_nHead - 1;
+		}
+	}
+
+	if ( !( m_fFlags[nSlot] & LC_ALIVE ) )
+	{
+		m_nLastBreak = m_nHead;
+	}
+
+	if ( !m_bBoundsDirty )
+	{
+		Vector vecMins = m_vecOrigin[nSlot] + m_vecMinsPreScaled[nSlot];
+		Vector vecMaxs = m_vecOrigin[nSlot] + m_vecMaxsPreScaled[nSlot];
+		VectorMin( m_vecSweptMins, vecMins, m_vecSweptMins );
+		VectorMax( m_vecSweptMaxs, vecMaxs, m_vecSweptMaxs );
+	}
+}
+
+void CLagRecordTrack::GetSweptBounds( Vector *pMins, Vector *pMaxs )
+{
+	Assert( m_nCount > 0 );
+
+	if ( m_bBoundsDirty )
+	{
+		fltx4 mins = Four_FLT_MAX;
+		fltx4 maxs = Four_Negative_FLT_MAX;
+		for ( int nSerial = Tail(); nSerial <= m_nHead; ++nSerial )
+		{
+			int nSlot = Slot( nSerial );
+			const Vector &vecOrigin = m_vecOrigin[nSlot];
+			const Vector &vecMins = m_vecMinsPreScaled[nSlot];
+			const Vector &vecMaxs = m_vecMaxsPreScaled[nSlot];
+
+			fltx4 origin = LoadUnaligned3SIMD( vecOrigin.Base() );
+			mins = MinSIMD( mins, AddSIMD( origin, LoadUnaligned3SIMD( vecMins.Base() ) ) );
+			maxs = MaxSIMD( maxs, AddSIMD( origin, LoadUnaligned3SIMD( vecMaxs.Base() ) ) );
+		}
+
+		m_vecSweptMins.Init( SubFloat( mins, 0 ), SubFloat( mins, 1 ), SubFloat( mins, 2 ) );
+		m_vecSweptMaxs.Init( SubFloat( maxs, 0 ), SubFloat( maxs, 1 ), SubFloat( maxs, 2 ) );
+		m_bBoundsDirty = false;
+	}
+
+	*pMins = m_vecSweptMins;
+	*pMaxs = m_vecSweptMaxs;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: A player we're about to move back in time, with the pair of records
+//          bracketing the target time and the interpolated transform.
+//-----------------------------------------------------------------------------
+struct LagBacktrackTarget
+{
+	CBasePlayer		*m_pPlayer;
+	int				m_nRecord;		// serial of the record at or before the target time
+	int				m_nPrevRecord;	// serial of the next newer record, or -1
+	float			m_flFrac;		// 0 when no interpolation is needed
+
+	Vector			m_vecOrigin;
+	QAngle			m_vecAngles;
+	Vector			m_vecMinsPreScaled;
+	Vector			m_vecMaxsPreScaled;
+};
+
 
 //
 // Try to take the player from his current origin to vWantedPos.
@@ -173,12 +397,17 @@ public:
 	CLagCompensationManager( char const *name ) : CAutoGameSystemPerFrame( name ), m_flTeleportDistanceSqr( 64 *64 )
 	{
 		m_isCurrentlyDoingCompensation = false;
+		Q_memset( m_pPlayerTrack, 0, sizeof( m_pPlayerTrack ) );
 	}
 
 	// IServerSystem stuff
 	virtual void Shutdown()
 	{
-		ClearHistory();
+		for ( int i=0; i<MAX_PLAYERS; i++ )
+		{
+			delete m_pPlayerTrack[i];
+			m_pPlayerTrack[i] = NULL;
+		}
 	}
 
 	virtual void LevelShutdownPostEntity()
@@ -200,14 +429,27 @@ public:
 private:
 	void			BacktrackPlayer( CBasePlayer *player, float flTargetTime );
 
+	bool			GetHistoryBounds( CBasePlayer *pPlayer, Vector *pMins, Vector *pMaxs );
+	bool			FindBacktrackTarget( CBasePlayer *pPlayer, float flTargetTime, LagBacktrackTarget *pTarget );
+	void			InterpolateBacktrackTargets( LagBacktrackTarget *pTargets, int nTargets );
+	void			ApplyBacktrackTarget( const LagBacktrackTarget &target, float flTargetTime );
+
 	void ClearHistory()
 	{
 		for ( int i=0; i<MAX_PLAYERS; i++ )
-			m_PlayerTrack[i].Purge();
+		{
+			if ( m_pPlayerTrack[i] )
+			{
+				m_pPlayerTrack[i]->Clear();
+			}
+		}
 	}
 
-	// keep a list of lag records for each player
-	CUtlFixedLinkedList< LagRecord >	m_PlayerTrack[ MAX_PLAYERS ];
+	// keep a ring buffer of lag records for each player, allocated the first time he's recorded
+	CLagRecordTrack			*m_pPlayerTrack[ MAX_PLAYERS ];
+
+	// Players being moved back by the current StartLagCompensation call
+	LagBacktrackTarget		m_BacktrackTargets[ MAX_PLAYERS ];
 
 	// Scratchpad for determining what needs to be restored
 	CBitVec<MAX_PLAYERS>	m_RestorePlayer;
@@ -243,81 +485,43 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 	VPROF_BUDGET( "FrameUpdatePostEntityThink", "CLagCompensationManager" );
 
 	// remove all records before that time:
-	int flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
+	float flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
 
 	// Iterate all active players
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
 	{
 		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
 
-		CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[i-1];
+		CLagRecordTrack *track = m_pPlayerTrack[i-1];
 
 		if ( !pPlayer )
 		{
-			if ( track->Count() > 0 )
+			if ( track )
 			{
-				track->RemoveAll();
+				track->Clear();
 			}
 
 			continue;
 		}
 
-		Assert( track->Count() < 1000 ); // insanity check
-
-		// remove tail records that are too old
-		int tailIndex = track->Tail();
-		while ( track->IsValidIndex( tailIndex ) )
+		if ( !track )
 		{
-			LagRecord &tail = track->Element( tailIndex );
-
-			// if tail is within limits, stop
-			if ( tail.m_flSimulationTime >= flDeadtime )
-				break;
-			
-			// remove tail, get new tail
-			track->Remove( tailIndex );
-			tailIndex = track->Tail();
+			track = m_pPlayerTrack[i-1] = new CLagRecordTrack;
 		}
 
+		// remove tail records that are too old
+		track->RemoveOlderThan( flDeadtime );
+
 		// check if head has same simulation time
 		if ( track->Count() > 0 )
 		{
-			LagRecord &head = track->Element( track->Head() );
-
 			// check if player changed simulation time since last time updated
-			if ( head.m_flSimulationTime >= pPlayer->GetSimulationTime() )
+			if ( track->SimulationTime( track->Head() ) >= pPlayer->GetSimulationTime() )
 				continue; // don't add new entry for same or older time
 		}
 
 		// add new record to player track
-		LagRecord &record = track->Element( track->AddToHead() );
-
-		record.m_fFlags = 0;
-		if ( pPlayer->IsAlive() )
-		{
-			record.m_fFlags |= LC_ALIVE;
-		}
-
-		record.m_flSimulationTime	= pPlayer->GetSimulationTime();
-		record.m_vecAngles			= pPlayer->GetLocalAngles();
-		record.m_vecOrigin			= pPlayer->GetLocalOrigin();
-		record.m_vecMinsPreScaled	= pPlayer->CollisionProp()->OBBMinsPreScaled();
-		record.m_vecMaxsPreScaled	= pPlayer->CollisionProp()->OBBMaxsPreScaled();
-
-		int layerCount = pPlayer->GetNumAnimOverlays();
-		for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
-		{
-			CAnimationLayer *currentLayer = pPlayer->GetAnimOverlay(layerIndex);
-			if( currentLayer )
-			{
-				record.m_layerRecords[layerIndex].m_cycle = currentLayer->m_flCycle;
-				record.m_layerRecords[layerIndex].m_order = currentLayer->m_nOrder;
-				record.m_layerRecords[layerIndex].m_sequence = currentLayer->m_nSequence;
-				record.m_layerRecords[layerIndex].m_weight = currentLayer->m_flWeight;
-			}
-		}
-		record.m_masterSequence = pPlayer->GetSequence();
-		record.m_masterCycle = pPlayer->GetCycle();
+		track->AddToHead( pPlayer, m_flTeleportDistanceSqr );
 	}
 
 	//Clear the current player.
@@ -393,8 +597,11 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		// DevMsg("StartLagCompensation: delta too big (%.3f)\n", deltaTime );
 		targettick = gpGlobals->tickcount - TIME_TO_TICKS( correct );
 	}
-	
-	// Iterate all active players
+
+	float flTargetTime = TICKS_TO_TIME( targettick );
+
+	// Find the history records for everyone we're going to move back
+	int nTargets = 0;
 	const CBitVec<MAX_EDICTS> *pEntityTransmitBits = engine->GetEntityTransmitBitsForClient( player->entindex() - 1 );
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
 	{
@@ -411,114 +618,204 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 			continue;
 		}
 
+		// Cheap reject for players whose entire history is out of reach
+		if ( sv_unlag_sweptcull.GetBool() )
+		{
+			Vector vecSweptMins, vecSweptMaxs;
+			if ( !GetHistoryBounds( pPlayer, &vecSweptMins, &vecSweptMaxs ) )
+				continue;
+
+			if ( !player->WantsLagCompensationOnHistory( pPlayer, cmd, vecSweptMins, vecSweptMaxs ) )
+				continue;
+		}
+
 		// Custom checks for if things should lag compensate (based on things like what team the player is on).
 		if ( !player->WantsLagCompensationOnEntity( pPlayer, cmd, pEntityTransmitBits ) )
 			continue;
 
-		// Move other player back in time
-		BacktrackPlayer( pPlayer, TICKS_TO_TIME( targettick ) );
+		if ( FindBacktrackTarget( pPlayer, flTargetTime, &m_BacktrackTargets[nTargets] ) )
+		{
+			++nTargets;
+		}
+	}
+
+	// Move other players back in time
+	InterpolateBacktrackTargets( m_BacktrackTargets, nTargets );
+	for ( int i = 0; i < nTargets; i++ )
+	{
+		ApplyBacktrackTarget( m_BacktrackTargets[i], flTargetTime );
 	}
 }
 
-void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
+//-----------------------------------------------------------------------------
+// Purpose: Gets the box swept by this player over his whole history, up to
+//          where he is now. Returns false if he has no history.
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::GetHistoryBounds( CBasePlayer *pPlayer, Vector *pMins, Vector *pMaxs )
 {
-	Vector org;
-	Vector minsPreScaled;
-	Vector maxsPreScaled;
-	QAngle ang;
+	CLagRecordTrack *track = m_pPlayerTrack[ pPlayer->entindex() - 1 ];
+	if ( !track || track->Count() <= 0 )
+		return false;
 
-	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
+	track->GetSweptBounds( pMins, pMaxs );
+
+	// The player may have moved since the last record was taken
+	const Vector &vecOrigin = pPlayer->GetAbsOrigin();
+	VectorMin( *pMins, vecOrigin, *pMins );
+	VectorMax( *pMaxs, vecOrigin, *pMaxs );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the records bracketing flTargetTime for this player. Returns
+//          false if the history can't be used to move him back.
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::FindBacktrackTarget( CBasePlayer *pPlayer, float flTargetTime, LagBacktrackTarget *pTarget )
+{
 	int pl_index = pPlayer->entindex() - 1;
 
 	// get track history of this player
-	CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[ pl_index ];
+	CLagRecordTrack *track = m_pPlayerTrack[ pl_index ];
 
 	// check if we have at leat one entry
-	if ( track->Count() <= 0 )
-		return;
+	if ( !track || track->Count() <= 0 )
+		return false;
 
-	int curr = track->Head();
+	// The newest record has to be close to where the player is now
+	Vector delta = track->Origin( track->Head() ) - pPlayer->GetLocalOrigin();
+	if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
+	{
+		// lost track, too much difference
+		return false;
+	}
 
-	LagRecord *prevRecord = NULL;
-	LagRecord *record = NULL;
+	// find the newest record at or before the target time
+	int nRecord = track->FindRecord( flTargetTime );
 
-	Vector prevOrg = pPlayer->GetLocalOrigin();
-	
-	// Walk context looking for any invalidating event
-	while( track->IsValidIndex(curr) )
+	// player most be alive and can't have teleported anywhere between now and then
+	if ( track->LastBreak() >= nRecord )
 	{
-		// remember last record
-		prevRecord = record;
+		// lost track
+		return false;
+	}
 
-		// get next record
-		record = &track->Element( curr );
+	pTarget->m_pPlayer = pPlayer;
+	pTarget->m_nRecord = nRecord;
+	pTarget->m_nPrevRecord = ( nRecord < track->Head() ) ? nRecord + 1 : -1;
+	pTarget->m_flFrac = 0.0f;
 
-		if ( !(record->m_fFlags & LC_ALIVE) )
+	if ( pTarget->m_nPrevRecord >= 0 )
+	{
+		float flRecordTime = track->SimulationTime( nRecord );
+		float flPrevRecordTime = track->SimulationTime( pTarget->m_nPrevRecord );
+		if ( ( flRecordTime < flTargetTime ) && ( flRecordTime < flPrevRecordTime ) )
 		{
-			// player most be alive, lost track
-			return;
-		}
+			// we didn't find the exact time but have a valid previous record
+			// so interpolate between these two records;
+			Assert( flTargetTime < flPrevRecordTime );
 
-		Vector delta = record->m_vecOrigin - prevOrg;
-		if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
-		{
-			// lost track, too much difference
-			return; 
+			// calc fraction between both records
+			pTarget->m_flFrac = ( flTargetTime - flRecordTime ) / ( flPrevRecordTime - flRecordTime );
+
+			Assert( pTarget->m_flFrac > 0 && pTarget->m_flFrac < 1 ); // should never extrapolate
 		}
+	}
 
-		// did we find a context smaller than target time ?
-		if ( record->m_flSimulationTime <= flTargetTime )
-			break; // hurra, stop
+	return true;
+}
 
-		prevOrg = record->m_vecOrigin;
+//-----------------------------------------------------------------------------
+// Purpose: Interpolates origin and bounds for four players at a time. Targets
+//          with a zero fraction come out as an exact copy of their record.
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::InterpolateBacktrackTargets( LagBacktrackTarget *pTargets, int nTargets )
+{
+	VPROF_BUDGET( "InterpolateBacktrackTargets", "CLagCompensationManager" );
 
-		// go one step back
-		curr = track->Next( curr );
-	}
+	for ( int i = 0; i < nTargets; i += 4 )
+	{
+		const Vector *pFrom[3][4];
+		const Vector *pTo[3][4];
+		fltx4 frac;
 
-	Assert( record );
+		// Pad a partial batch by repeating the last target
+		for ( int j = 0; j < 4; j++ )
+		{
+			const LagBacktrackTarget &target = pTargets[ MIN( i + j, nTargets - 1 ) ];
+			const CLagRecordTrack *track = m_pPlayerTrack[ target.m_pPlayer->entindex() - 1 ];
+			int nFrom = track->Slot( target.m_nRecord );
+			int nTo = ( target.m_nPrevRecord >= 0 ) ? track->Slot( target.m_nPrevRecord ) : nFrom;
+
+			pFrom[0][j] = &track->m_vecOrigin[nFrom];
+			pFrom[1][j] = &track->m_vecMinsPreScaled[nFrom];
+			pFrom[2][j] = &track->m_vecMaxsPreScaled[nFrom];
+			pTo[0][j] = &track->m_vecOrigin[nTo];
+			pTo[1][j] = &track->m_vecMinsPreScaled[nTo];
+			pTo[2][j] = &track->m_vecMaxsPreScaled[nTo];
+			SubFloat( frac, j ) = target.m_flFrac;
+		}
 
-	if ( !record )
-	{
-		if ( sv_unlag_debug.GetBool() )
+		FourVectors result[3];
+		for ( int k = 0; k < 3; k++ )
 		{
-			DevMsg( "No valid positions in history for BacktrackPlayer client ( %s )\n", pPlayer->GetPlayerName() );
+			FourVectors to;
+			result[k].LoadAndSwizzle( *pFrom[k][0], *pFrom[k][1], *pFrom[k][2], *pFrom[k][3] );
+			to.LoadAndSwizzle( *pTo[k][0], *pTo[k][1], *pTo[k][2], *pTo[k][3] );
+			to -= result[k];
+			to *= frac;
+			result[k] += to;
 		}
 
-		return; // that should never happen
+		int nCount = MIN( nTargets - i, 4 );
+		for ( int j = 0; j < nCount; j++ )
+		{
+			LagBacktrackTarget &target = pTargets[i + j];
+			target.m_vecOrigin = result[0].Vec( j );
+			target.m_vecMinsPreScaled = result[1].Vec( j );
+			target.m_vecMaxsPreScaled = result[2].Vec( j );
+
+			// Angles go through quaternions, so they stay scalar
+			const CLagRecordTrack *track = m_pPlayerTrack[ target.m_pPlayer->entindex() - 1 ];
+			const QAngle &angRecord = track->m_vecAngles[ track->Slot( target.m_nRecord ) ];
+			if ( target.m_flFrac > 0.0f )
+			{
+				target.m_vecAngles = Lerp( target.m_flFrac, angRecord, track->m_vecAngles[ track->Slot( target.m_nPrevRecord ) ] );
+			}
+			else
+			{
+				target.m_vecAngles = angRecord;
+			}
+		}
 	}
+}
 
-	float frac = 0.0f;
-	if ( prevRecord && 
-		 (record->m_flSimulationTime < flTargetTime) &&
-		 (record->m_flSimulationTime < prevRecord->m_flSimulationTime) )
-	{
-		// we didn't find the exact time but have a valid previous record
-		// so interpolate between these two records;
+void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
+{
+	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
 
-		Assert( prevRecord->m_flSimulationTime > record->m_flSimulationTime );
-		Assert( flTargetTime < prevRecord->m_flSimulationTime );
+	LagBacktrackTarget target;
+	if ( !FindBacktrackTarget( pPlayer, flTargetTime, &target ) )
+		return;
 
-		// calc fraction between both records
-		frac = ( flTargetTime - record->m_flSimulationTime ) / 
-			( prevRecord->m_flSimulationTime - record->m_flSimulationTime );
+	InterpolateBacktrackTargets( &target, 1 );
+	ApplyBacktrackTarget( target, flTargetTime );
+}
 
-		Assert( frac > 0 && frac < 1 ); // should never extrapolate
+void CLagCompensationManager::ApplyBacktrackTarget( const LagBacktrackTarget &target, float flTargetTime )
+{
+	CBasePlayer *pPlayer = target.m_pPlayer;
+	Vector org = target.m_vecOrigin;
+	Vector minsPreScaled = target.m_vecMinsPreScaled;
+	Vector maxsPreScaled = target.m_vecMaxsPreScaled;
+	QAngle ang = target.m_vecAngles;
+	float frac = target.m_flFrac;
+
+	VPROF_BUDGET( "ApplyBacktrackTarget", "CLagCompensationManager" );
+	int pl_index = pPlayer->entindex() - 1;
 
-		ang				= Lerp( frac, record->m_vecAngles, prevRecord->m_vecAngles );
-		org				= Lerp( frac, record->m_vecOrigin, prevRecord->m_vecOrigin );
-		minsPreScaled	= Lerp( frac, record->m_vecMinsPreScaled, prevRecord->m_vecMinsPreScaled );
-		maxsPreScaled	= Lerp( frac, record->m_vecMaxsPreScaled, prevRecord->m_vecMaxsPreScaled );
-	}
-	else
-	{
-		// we found the exact record or no other record to interpolate with
-		// just copy these values since they are the best we have
-		org				= record->m_vecOrigin;
-		ang				= record->m_vecAngles;
-		minsPreScaled	= record->m_vecMinsPreScaled;
-		maxsPreScaled	= record->m_vecMaxsPreScaled;
-	}
+	const CLagRecordTrack *track = m_pPlayerTrack[ pl_index ];
+	int nRecordSlot = track->Slot( target.m_nRecord );
+	int nPrevRecordSlot = ( target.m_nPrevRecord >= 0 ) ? track->Slot( target.m_nPrevRecord ) : -1;
 
 	// See if this is still a valid position for us to teleport to
 	if ( sv_unlag_fixstuck.GetBool() )
@@ -629,7 +926,7 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 	restore->m_masterCycle = pPlayer->GetCycle();
 
 	bool interpolationAllowed = false;
-	if( prevRecord && (record->m_masterSequence == prevRecord->m_masterSequence) )
+	if( nPrevRecordSlot >= 0 && (track->m_masterSequence[nRecordSlot] == track->m_masterSequence[nPrevRecordSlot]) )
 	{
 		// If the master state changes, all layers will be invalid too, so don't interp (ya know, interp barely ever happens anyway)
 		interpolationAllowed = true;
@@ -641,25 +938,25 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 	if( frac > 0.0f && interpolationAllowed )
 	{
 		interpolatedMasters = true;
-		pPlayer->SetSequence( Lerp( frac, record->m_masterSequence, prevRecord->m_masterSequence ) );
-		pPlayer->SetCycle( Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle ) );
+		pPlayer->SetSequence( Lerp( frac, track->m_masterSequence[nRecordSlot], track->m_masterSequence[nPrevRecordSlot] ) );
+		pPlayer->SetCycle( Lerp( frac, track->m_masterCycle[nRecordSlot], track->m_masterCycle[nPrevRecordSlot] ) );
 
-		if( record->m_masterCycle > prevRecord->m_masterCycle )
+		if( track->m_masterCycle[nRecordSlot] > track->m_masterCycle[nPrevRecordSlot] )
 		{
 			// the older record is higher in frame than the newer, it must have wrapped around from 1 back to 0
 			// add one to the newer so it is lerping from .9 to 1.1 instead of .9 to .1, for example.
-			float newCycle = Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle + 1 );
+			float newCycle = Lerp( frac, track->m_masterCycle[nRecordSlot], track->m_masterCycle[nPrevRecordSlot] + 1 );
 			pPlayer->SetCycle(newCycle < 1 ? newCycle : newCycle - 1 );// and make sure .9 to 1.2 does not end up 1.05
 		}
 		else
 		{
-			pPlayer->SetCycle( Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle ) );
+			pPlayer->SetCycle( Lerp( frac, track->m_masterCycle[nRecordSlot], track->m_masterCycle[nPrevRecordSlot] ) );
 		}
 	}
 	if( !interpolatedMasters )
 	{
-		pPlayer->SetSequence(record->m_masterSequence);
-		pPlayer->SetCycle(record->m_masterCycle);
+		pPlayer->SetSequence(track->m_masterSequence[nRecordSlot]);
+		pPlayer->SetCycle(track->m_masterCycle[nRecordSlot]);
 	}
 
 	////////////////////////
@@ -678,8 +975,8 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 			bool interpolated = false;
 			if( (frac > 0.0f)  &&  interpolationAllowed )
 			{
-				LayerRecord &recordsLayerRecord = record->m_layerRecords[layerIndex];
-				LayerRecord &prevRecordsLayerRecord = prevRecord->m_layerRecords[layerIndex];
+				const LayerRecord &recordsLayerRecord = track->m_layerRecords[nRecordSlot][layerIndex];
+				const LayerRecord &prevRecordsLayerRecord = track->m_layerRecords[nPrevRecordSlot][layerIndex];
 				if( (recordsLayerRecord.m_order == prevRecordsLayerRecord.m_order)
 					&& (recordsLayerRecord.m_sequence == prevRecordsLayerRecord.m_sequence)
 					)
@@ -705,10 +1002,10 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 			if( !interpolated )
 			{
 				//Either no interp, or interp failed.  Just use record.
-				currentLayer->m_flCycle = record->m_layerRecords[layerIndex].m_cycle;
-				currentLayer->m_nOrder = record->m_layerRecords[layerIndex].m_order;
-				currentLayer->m_nSequence = record->m_layerRecords[layerIndex].m_sequence;
-				currentLayer->m_flWeight = record->m_layerRecords[layerIndex].m_weight;
+				currentLayer->m_flCycle = track->m_layerRecords[nRecordSlot][layerIndex].m_cycle;
+				currentLayer->m_nOrder = track->m_layerRecords[nRecordSlot][layerIndex].m_order;
+				currentLayer->m_nSequence = track->m_layerRecords[nRecordSlot][layerIndex].m_sequence;
+				currentLayer->m_flWeight = track->m_layerRecords[nRecordSlot][layerIndex].m_weight;
 			}
 		}
 	}
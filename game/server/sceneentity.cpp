@@ -2200,7 +2200,7 @@ void CSceneEntity::InputInterjectResponse( inputdata_t &inputdata )
 	}
 	else
 	{
-		CUtlString modifiers("scene:");
+		CUtlStringBuilder modifiers( "scene:" );
 		modifiers += STRING( GetEntityName() );
 
 		while (candidates.Count() > 0)
@@ -0,0 +1,813 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Console commands that check and time tier1 code on the data of a
+//			running server. They are cheats, since some take seconds to run.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "checksum_crc.h"
+#include "checksum_md5.h"
+#include "checksum_sha1.h"
+#include "tier0/fasttimer.h"
+#include "utldict.h"
+#include "generichash.h"
+#include "networkstringtable_gamedll.h"
+#include "utlbtreemap.h"
+#include "UtlSortVector.h"
+#include "filesystem.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/diff.h"
+#include "tier1/CommandBuffer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Throughput of the checksums used on map load and for pure server
+//			file checks, against their scalar reference implementations
+//-----------------------------------------------------------------------------
+static float ChecksumGBPerSecond( int nBytes, const CFastTimer &timer )
+{
+	return (float)( nBytes / timer.GetDuration().GetSeconds() / ( 1024.0 * 1024.0 * 1024.0 ) );
+}
+
+CON_COMMAND_F( checksum_benchmark, "Print CRC32, MD5 and SHA-1 throughput in GB/s. Usage: checksum_benchmark [megabytes]", FCVAR_CHEAT )
+{
+	int nBytes = ( ( args.ArgC() > 1 ) ? clamp( atoi( args[1] ), 1, 1024 ) : 64 ) * 1024 * 1024;
+	unsigned char *pBuffer = new unsigned char[ nBytes ];
+	for ( int i = 0; i < nBytes; i++ )
+	{
+		pBuffer[i] = (unsigned char)( ( i * 2654435761u ) >> 24 );
+	}
+
+	CFastTimer timer;
+
+	// CRC32
+	CRC32_t crcTable, crcFast;
+	CRC32_Init( &crcTable );
+	timer.Start();
+	CRC32_ProcessBufferTable( &crcTable, pBuffer, nBytes );
+	timer.End();
+	float flCRCTable = ChecksumGBPerSecond( nBytes, timer );
+
+	CRC32_Init( &crcFast );
+	timer.Start();
+	CRC32_ProcessBuffer( &crcFast, pBuffer, nBytes );
+	timer.End();
+	float flCRCFast = ChecksumGBPerSecond( nBytes, timer );
+
+	Msg( "CRC32: table %.2f GB/s, current %.2f GB/s%s\n", flCRCTable, flCRCFast, ( crcTable == crcFast ) ? "" : " MISMATCH" );
+
+	// MD5 and SHA-1, over eight independent eighths of the buffer, so the AVX2
+	// path gets full groups where it's available
+	const int nStreams = 8;
+	int nStreamBytes = nBytes / nStreams;
+	const void *ppStreams[nStreams];
+	int pnLengths[nStreams];
+	for ( int i = 0; i < nStreams; i++ )
+	{
+		ppStreams[i] = pBuffer + i * nStreamBytes;
+		pnLengths[i] = nStreamBytes;
+	}
+
+	MD5Value_t md5Single[nStreams], md5Multi[nStreams];
+	timer.Start();
+	for ( int i = 0; i < nStreams; i++ )
+	{
+		MD5_ProcessSingleBuffer( ppStreams[i], pnLengths[i], md5Single[i] );
+	}
+	timer.End();
+	float flMD5Single = ChecksumGBPerSecond( nStreamBytes * nStreams, timer );
+
+	timer.Start();
+	MD5_ProcessMultipleBuffers( nStreams, ppStreams, pnLengths, md5Multi );
+	timer.End();
+	float flMD5Multi = ChecksumGBPerSecond( nStreamBytes * nStreams, timer );
+
+	bool bMD5Match = true;
+	for ( int i = 0; i < nStreams; i++ )
+	{
+		bMD5Match = bMD5Match && ( md5Single[i] == md5Multi[i] );
+	}
+	Msg( "MD5:   one at a time %.2f GB/s, %d at a time %.2f GB/s%s\n", flMD5Single, nStreams, flMD5Multi, bMD5Match ? "" : " MISMATCH" );
+
+	SHADigest_t shaSingle[nStreams], shaMulti[nStreams];
+	timer.Start();
+	for ( int i = 0; i < nStreams; i++ )
+	{
+		CSHA1 sha1;
+		sha1.Update( (unsigned char *)ppStreams[i], pnLengths[i] );
+		sha1.Final();
+		sha1.GetHash( shaSingle[i] );
+	}
+	timer.End();
+	float flSHASingle = ChecksumGBPerSecond( nStreamBytes * nStreams, timer );
+
+	timer.Start();
+	SHA1_ProcessMultipleBuffers( nStreams, ppStreams, pnLengths, shaMulti );
+	timer.End();
+	float flSHAMulti = ChecksumGBPerSecond( nStreamBytes * nStreams, timer );
+
+	bool bSHAMatch = !V_memcmp( shaSingle, shaMulti, sizeof( shaSingle ) );
+	Msg( "SHA-1: one at a time %.2f GB/s, %d at a time %.2f GB/s%s\n", flSHASingle, nStreams, flSHAMulti, bSHAMatch ? "" : " MISMATCH" );
+
+	delete [] pBuffer;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Speed and distribution of the generic string hashes over the keys
+//			a running server actually hashes: entity names, class names, cvar
+//			names and precached asset paths
+//-----------------------------------------------------------------------------
+typedef unsigned (*HashStringFunc_t)( const char *pszKey );
+
+static unsigned HashStringOld( const char *pszKey )				{ return HashString( pszKey ); }
+static unsigned HashStringCaselessOld( const char *pszKey )		{ return HashStringCaseless( pszKey ); }
+static unsigned HashStringNew( const char *pszKey )				{ return FastHashString32( pszKey ); }
+static unsigned HashStringCaselessNew( const char *pszKey )		{ return FastHashStringCaseless32( pszKey ); }
+
+static int HashBenchmarkCompare( const unsigned *a, const unsigned *b )
+{
+	return ( *a < *b ) ? -1 : ( *a > *b );
+}
+
+// keeps the timed loop from being optimized away
+static volatile unsigned s_nHashBenchmarkSink;
+
+static void HashBenchmarkKeySet( const CUtlVector< const char * > &keys, const char *pszFunc, HashStringFunc_t pfnHash )
+{
+	int nKeys = keys.Count();
+	if ( !nKeys )
+		return;
+
+	// throughput, over at least a million hashes
+	int nPasses = MAX( 1, 1000000 / nKeys );
+	unsigned nSink = 0;
+	CFastTimer timer;
+	timer.Start();
+	for ( int nPass = 0; nPass < nPasses; nPass++ )
+	{
+		for ( int i = 0; i < nKeys; i++ )
+		{
+			nSink += pfnHash( keys[i] );
+		}
+	}
+	timer.End();
+	double flNanoseconds = timer.GetDuration().GetSeconds() * 1e9 / ( (double)nPasses * nKeys );
+
+	// full 32 bit collisions
+	CUtlVector< unsigned > hashes;
+	hashes.SetCount( nKeys );
+	for ( int i = 0; i < nKeys; i++ )
+	{
+		hashes[i] = pfnHash( keys[i] );
+	}
+	hashes.Sort( HashBenchmarkCompare );
+	int nCollisions = 0;
+	for ( int i = 1; i < nKeys; i++ )
+	{
+		nCollisions += ( hashes[i] == hashes[i - 1] );
+	}
+
+	// chi-square of the low bits over a power of two table, as CUtlHash and
+	// friends use them; normalized so that 1.0 is a uniform random function
+	int nBuckets = 16;
+	while ( nBuckets < nKeys )
+	{
+		nBuckets <<= 1;
+	}
+	CUtlVector< int > counts;
+	counts.SetCount( nBuckets );
+	V_memset( counts.Base(), 0, nBuckets * sizeof( int ) );
+	for ( int i = 0; i < nKeys; i++ )
+	{
+		counts[ hashes[i] & ( nBuckets - 1 ) ]++;
+	}
+	double flExpected = (double)nKeys / nBuckets;
+	double flChiSquare = 0.0;
+	for ( int i = 0; i < nBuckets; i++ )
+	{
+		double flDelta = counts[i] - flExpected;
+		flChiSquare += flDelta * flDelta / flExpected;
+	}
+
+	s_nHashBenchmarkSink = nSink;
+
+	Msg( "  %-24s %6.1f ns/key  %5d collisions  chi2 %.2f\n", pszFunc, flNanoseconds, nCollisions, flChiSquare / ( nBuckets - 1 ) );
+}
+
+static void HashBenchmarkAddKey( CUtlDict< int, int > &unique, CUtlVector< const char * > &keys, const char *pszKey )
+{
+	if ( !pszKey || !pszKey[0] || unique.Find( pszKey ) != unique.InvalidIndex() )
+		return;
+
+	unique.Insert( pszKey, 0 );
+	keys.AddToTail( unique.GetElementName( unique.Find( pszKey ) ) );
+}
+
+CON_COMMAND_F( hash_benchmark, "Compare the generic string hashes over the current entity, cvar and asset names", FCVAR_CHEAT )
+{
+	CUtlDict< int, int > entityNames( k_eDictCompareTypeCaseSensitive ), classNames( k_eDictCompareTypeCaseSensitive );
+	CUtlDict< int, int > cvarNames( k_eDictCompareTypeCaseSensitive ), assetPaths( k_eDictCompareTypeCaseSensitive );
+	CUtlVector< const char * > entityNameKeys, classNameKeys, cvarNameKeys, assetPathKeys;
+
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		HashBenchmarkAddKey( entityNames, entityNameKeys, STRING( pEntity->GetEntityName() ) );
+		HashBenchmarkAddKey( classNames, classNameKeys, pEntity->GetClassname() );
+	}
+
+	ICvar::Iterator iter( cvar );
+	for ( iter.SetFirst(); iter.IsValid(); iter.Next() )
+	{
+		HashBenchmarkAddKey( cvarNames, cvarNameKeys, iter.Get()->GetName() );
+	}
+
+	static const char *s_pPrecacheTables[] = { "modelprecache", "soundprecache", "genericprecache" };
+	for ( int nTable = 0; nTable < ARRAYSIZE( s_pPrecacheTables ); nTable++ )
+	{
+		INetworkStringTable *pTable = networkstringtable->FindTable( s_pPrecacheTables[nTable] );
+		for ( int i = 0; pTable && i < pTable->GetNumStrings(); i++ )
+		{
+			HashBenchmarkAddKey( assetPaths, assetPathKeys, pTable->GetString( i ) );
+		}
+	}
+
+	struct KeySet_t { const char *pszName; CUtlVector< const char * > *pKeys; };
+	KeySet_t keySets[] =
+	{
+		{ "entity names", &entityNameKeys },
+		{ "class names", &classNameKeys },
+		{ "cvar names", &cvarNameKeys },
+		{ "asset paths", &assetPathKeys },
+	};
+
+	for ( int nSet = 0; nSet < ARRAYSIZE( keySets ); nSet++ )
+	{
+		const CUtlVector< const char * > &keys = *keySets[nSet].pKeys;
+		Msg( "%s: %d unique keys\n", keySets[nSet].pszName, keys.Count() );
+		HashBenchmarkKeySet( keys, "HashString", HashStringOld );
+		HashBenchmarkKeySet( keys, "FastHashString32", HashStringNew );
+		HashBenchmarkKeySet( keys, "HashStringCaseless", HashStringCaselessOld );
+		HashBenchmarkKeySet( keys, "FastHashStringCaseless32", HashStringCaselessNew );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Check the vectorized caseless string functions against plain byte
+//			loops on random strings, then time both on the current entity
+//			and asset names
+//-----------------------------------------------------------------------------
+static int StrToolsRefLower( unsigned char c )
+{
+	return ( c >= 'A' && c <= 'Z' ) ? c + 'a' - 'A' : c;
+}
+
+static int StrToolsRefStricmp( const char *s1, const char *s2, int n )
+{
+	for ( ; n > 0; n--, s1++, s2++ )
+	{
+		int c1 = StrToolsRefLower( *s1 ), c2 = StrToolsRefLower( *s2 );
+		if ( c1 != c2 )
+			return ( c1 < c2 ) ? -1 : 1;
+		if ( !c1 )
+			break;
+	}
+	return 0;
+}
+
+static const char *StrToolsRefStristr( const char *pStr, const char *pSearch, int n )
+{
+	if ( !*pSearch )
+		return NULL;
+
+	for ( const char *pLetter = pStr; *pLetter && n > 0; pLetter++, n-- )
+	{
+		int i = 0;
+		while ( pSearch[i] && i < n && StrToolsRefLower( pLetter[i] ) == StrToolsRefLower( pSearch[i] ) )
+		{
+			i++;
+		}
+		if ( !pSearch[i] )
+			return pLetter;
+	}
+	return NULL;
+}
+
+static void StrToolsRandomString( char *pDest, int nLength )
+{
+	// mostly characters that differ only by case or by the 0x20 bit
+	static const char s_Chars[] = "aAbBzZ@`[{/\\._-09";
+	for ( int i = 0; i < nLength; i++ )
+	{
+		pDest[i] = s_Chars[ RandomInt( 0, sizeof( s_Chars ) - 2 ) ];
+	}
+	pDest[nLength] = 0;
+}
+
+static inline int StrToolsSign( int n )
+{
+	return ( n > 0 ) - ( n < 0 );
+}
+
+CON_COMMAND_F( strtools_benchmark, "Fuzz the caseless string functions against byte loops and time them. Usage: strtools_benchmark [iterations]", FCVAR_CHEAT )
+{
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 100000;
+
+	int nFailures = 0;
+	for ( int nIter = 0; nIter < nIterations; nIter++ )
+	{
+		char a[80], b[80], search[8];
+		StrToolsRandomString( a, RandomInt( 0, 70 ) );
+		V_strcpy_safe( b, a );
+
+		// flip case, change a character or truncate
+		int nLength = V_strlen( b );
+		for ( int i = 0; i < nLength; i++ )
+		{
+			if ( RandomInt( 0, 3 ) == 0 && isalpha( (unsigned char)b[i] ) )
+			{
+				b[i] ^= 0x20;
+			}
+		}
+		if ( nLength && RandomInt( 0, 2 ) == 0 )
+		{
+			b[ RandomInt( 0, nLength - 1 ) ] = 'x';
+		}
+		if ( RandomInt( 0, 3 ) == 0 )
+		{
+			b[ RandomInt( 0, nLength ) ] = 0;
+		}
+
+		int nStart = nLength ? RandomInt( 0, nLength - 1 ) : 0;
+		V_strncpy( search, b + nStart, RandomInt( 1, sizeof( search ) ) );
+
+		int n = RandomInt( 0, 80 );
+		nFailures += StrToolsSign( V_stricmp( a, b ) ) != StrToolsRefStricmp( a, b, INT_MAX );
+		nFailures += StrToolsSign( V_strnicmp( a, b, n ) ) != StrToolsRefStricmp( a, b, n );
+		nFailures += V_stristr( a, search ) != StrToolsRefStristr( a, search, INT_MAX );
+		nFailures += V_strnistr( a, search, n ) != StrToolsRefStristr( a, search, n );
+	}
+	Msg( "%d random cases, %d failures\n", nIterations, nFailures );
+
+	// timing, over pairs of the current entity class names and model names
+	CUtlVector< const char * > keys;
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		keys.AddToTail( pEntity->GetClassname() );
+		if ( pEntity->GetModelName() != NULL_STRING )
+		{
+			keys.AddToTail( STRING( pEntity->GetModelName() ) );
+		}
+	}
+	if ( keys.Count() < 2 )
+		return;
+
+	int nCalls = keys.Count() * 64;
+	volatile int nSink = 0;
+	CFastTimer timer;
+
+	timer.Start();
+	for ( int i = 0; i < nCalls; i++ )
+	{
+		nSink += StrToolsRefStricmp( keys[ i % keys.Count() ], keys[ ( i / 7 ) % keys.Count() ], INT_MAX );
+	}
+	timer.End();
+	float flRefCompare = timer.GetDuration().GetSeconds() * 1e9 / nCalls;
+
+	timer.Start();
+	for ( int i = 0; i < nCalls; i++ )
+	{
+		nSink += V_stricmp( keys[ i % keys.Count() ], keys[ ( i / 7 ) % keys.Count() ] );
+	}
+	timer.End();
+	float flCompare = timer.GetDuration().GetSeconds() * 1e9 / nCalls;
+
+	timer.Start();
+	for ( int i = 0; i < nCalls; i++ )
+	{
+		nSink += ( StrToolsRefStristr( keys[ i % keys.Count() ], "PROP", INT_MAX ) != NULL );
+	}
+	timer.End();
+	float flRefSearch = timer.GetDuration().GetSeconds() * 1e9 / nCalls;
+
+	timer.Start();
+	for ( int i = 0; i < nCalls; i++ )
+	{
+		nSink += ( V_stristr( keys[ i % keys.Count() ], "PROP" ) != NULL );
+	}
+	timer.End();
+	float flSearch = timer.GetDuration().GetSeconds() * 1e9 / nCalls;
+
+	Msg( "V_stricmp: byte loop %.1f ns, current %.1f ns\n", flRefCompare, flCompare );
+	Msg( "V_stristr: byte loop %.1f ns, current %.1f ns\n", flRefSearch, flSearch );
+}
+
+
+//-----------------------------------------------------------------------------
+// Element that counts its copies and moves, for utlvector_benchmark
+//-----------------------------------------------------------------------------
+struct UtlVectorBenchmarkItem_t
+{
+	UtlVectorBenchmarkItem_t() {}
+	UtlVectorBenchmarkItem_t( const char *pName ) : m_Name( pName ) {}
+	UtlVectorBenchmarkItem_t( const UtlVectorBenchmarkItem_t &src ) : m_Name( src.m_Name ) { ++s_nCopies; }
+#ifdef MOVE_CONSTRUCTOR_SUPPORT
+	UtlVectorBenchmarkItem_t( UtlVectorBenchmarkItem_t &&src ) : m_Name( static_cast< CUtlString && >( src.m_Name ) ) { ++s_nMoves; }
+#endif
+	UtlVectorBenchmarkItem_t &operator=( const UtlVectorBenchmarkItem_t &src ) { m_Name = src.m_Name; ++s_nCopies; return *this; }
+
+	CUtlString m_Name;
+
+	static int s_nCopies;
+	static int s_nMoves;
+};
+
+int UtlVectorBenchmarkItem_t::s_nCopies;
+int UtlVectorBenchmarkItem_t::s_nMoves;
+
+typedef CUtlVector< UtlVectorBenchmarkItem_t > UtlVectorBenchmarkGroup_t;
+
+static void UtlVectorBenchmarkGroup( UtlVectorBenchmarkGroup_t &group, const CUtlVector< const char * > &names, int nFirst )
+{
+	for ( int i = nFirst; i < MIN( nFirst + 16, names.Count() ); i++ )
+	{
+		group.EmplaceToTail( names[i] );
+	}
+}
+
+CON_COMMAND_F( utlvector_benchmark, "Build nested vectors of the entity class names by copying and by moving, and print the cost. Usage: utlvector_benchmark [rounds]", FCVAR_CHEAT )
+{
+	int nRounds = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 100;
+
+	CUtlVector< const char * > names;
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		names.AddToTail( pEntity->GetClassname() );
+	}
+	if ( names.Count() == 0 )
+		return;
+
+	CFastTimer timer;
+	int nReallocs = 0;
+	UtlVectorBenchmarkItem_t::s_nCopies = 0;
+	UtlVectorBenchmarkItem_t::s_nMoves = 0;
+
+	timer.Start();
+	for ( int nRound = 0; nRound < nRounds; nRound++ )
+	{
+		CUtlVector< UtlVectorBenchmarkGroup_t > groups;
+		for ( int i = 0; i < names.Count(); i += 16 )
+		{
+			const void *pBase = groups.Base();
+			UtlVectorBenchmarkGroup_t group;
+			UtlVectorBenchmarkGroup( group, names, i );
+			groups[ groups.AddToTail() ] = group;
+			nReallocs += ( groups.Base() != pBase );
+		}
+	}
+	timer.End();
+	Msg( "copy: %.1f us per round, %d element copies, %d moves, %d reallocs\n", timer.GetDuration().GetSeconds() * 1e6 / nRounds,
+		UtlVectorBenchmarkItem_t::s_nCopies / nRounds, UtlVectorBenchmarkItem_t::s_nMoves / nRounds, nReallocs / nRounds );
+
+#ifdef MOVE_CONSTRUCTOR_SUPPORT
+	nReallocs = 0;
+	UtlVectorBenchmarkItem_t::s_nCopies = 0;
+	UtlVectorBenchmarkItem_t::s_nMoves = 0;
+
+	timer.Start();
+	for ( int nRound = 0; nRound < nRounds; nRound++ )
+	{
+		CUtlVector< UtlVectorBenchmarkGroup_t > groups;
+		for ( int i = 0; i < names.Count(); i += 16 )
+		{
+			const void *pBase = groups.Base();
+			UtlVectorBenchmarkGroup_t group;
+			UtlVectorBenchmarkGroup( group, names, i );
+			groups.AddToTailMove( group );
+			nReallocs += ( groups.Base() != pBase );
+		}
+	}
+	timer.End();
+	Msg( "move: %.1f us per round, %d element copies, %d moves, %d reallocs\n", timer.GetDuration().GetSeconds() * 1e6 / nRounds,
+		UtlVectorBenchmarkItem_t::s_nCopies / nRounds, UtlVectorBenchmarkItem_t::s_nMoves / nRounds, nReallocs / nRounds );
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Random inserts and lookups in CUtlBTreeMap, CUtlMap and
+//			CUtlSortVector, and a bulk loaded CUtlBTreeMap
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( btreemap_benchmark, "Compare CUtlBTreeMap with CUtlMap and CUtlSortVector on random int keys. Usage: btreemap_benchmark [max keys]", FCVAR_CHEAT )
+{
+	int nMaxKeys = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1000 ) : 1000000;
+	const int nProbes = 1000000;
+
+	CUtlVector< int > probes;
+	probes.SetCount( nProbes );
+
+	for ( int nKeys = 1000; nKeys <= nMaxKeys; nKeys *= 10 )
+	{
+		CUtlVector< int > keys;
+		keys.SetCount( nKeys );
+		for ( int i = 0; i < nKeys; i++ )
+		{
+			keys[i] = RandomInt( 0, 0x7fffffff );
+		}
+
+		// half the lookups hit
+		for ( int i = 0; i < nProbes; i++ )
+		{
+			probes[i] = ( i & 1 ) ? keys[ RandomInt( 0, nKeys - 1 ) ] : RandomInt( 0, 0x7fffffff );
+		}
+
+		CFastTimer timer;
+		volatile int nSink = 0;
+
+		CUtlMap< int, int, int > map( DefLessFunc( int ) );
+		timer.Start();
+		for ( int i = 0; i < nKeys; i++ )
+		{
+			map.Insert( keys[i], i );
+		}
+		timer.End();
+		float flMapInsert = timer.GetDuration().GetSeconds() * 1e9 / nKeys;
+
+		timer.Start();
+		for ( int i = 0; i < nProbes; i++ )
+		{
+			nSink += map.Find( probes[i] );
+		}
+		timer.End();
+		float flMapFind = timer.GetDuration().GetSeconds() * 1e9 / nProbes;
+		map.Purge();
+
+		CUtlSortVector< int > sortVector;
+		timer.Start();
+		for ( int i = 0; i < nKeys; i++ )
+		{
+			sortVector.InsertNoSort( keys[i] );
+		}
+		sortVector.RedoSort();
+		timer.End();
+		float flSortInsert = timer.GetDuration().GetSeconds() * 1e9 / nKeys;
+
+		timer.Start();
+		for ( int i = 0; i < nProbes; i++ )
+		{
+			nSink += sortVector.Find( probes[i] );
+		}
+		timer.End();
+		float flSortFind = timer.GetDuration().GetSeconds() * 1e9 / nProbes;
+
+		CUtlBTreeMap< int, int > btree;
+		timer.Start();
+		for ( int i = 0; i < nKeys; i++ )
+		{
+			btree.Insert( keys[i], i );
+		}
+		timer.End();
+		float flTreeInsert = timer.GetDuration().GetSeconds() * 1e9 / nKeys;
+
+		timer.Start();
+		for ( int i = 0; i < nProbes; i++ )
+		{
+			nSink += btree.Find( probes[i] );
+		}
+		timer.End();
+		float flTreeFind = timer.GetDuration().GetSeconds() * 1e9 / nProbes;
+		bool bValid = btree.IsValid();
+
+		// bulk load from the sorted vector
+		timer.Start();
+		btree.BulkLoad( sortVector.Base(), NULL, sortVector.Count() );
+		timer.End();
+		float flBulkLoad = timer.GetDuration().GetSeconds() * 1e9 / nKeys;
+
+		timer.Start();
+		for ( int i = 0; i < nProbes; i++ )
+		{
+			nSink += btree.Find( probes[i] );
+		}
+		timer.End();
+		float flBulkFind = timer.GetDuration().GetSeconds() * 1e9 / nProbes;
+		bValid = bValid && btree.IsValid();
+
+		Msg( "%7d keys, ns per insert / find:\n", nKeys );
+		Msg( "  CUtlMap        %6.1f / %6.1f\n", flMapInsert, flMapFind );
+		Msg( "  CUtlSortVector %6.1f / %6.1f (unsorted inserts, then one sort)\n", flSortInsert, flSortFind );
+		Msg( "  CUtlBTreeMap   %6.1f / %6.1f, bulk loaded %6.1f / %6.1f, depth %d%s\n", flTreeInsert, flTreeFind, flBulkLoad, flBulkFind, btree.Depth(), bValid ? "" : ", INVALID" );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Diffs two files with each diff mode, and checks the result of
+//			applying each diff, in memory and streamed
+//-----------------------------------------------------------------------------
+static bool DiffBenchmarkWrite( void *pContext, uint8 const *pData, int nSize )
+{
+	CUtlBuffer *pBuf = (CUtlBuffer *)pContext;
+	pBuf->Put( pData, nSize );
+	return pBuf->IsValid();
+}
+
+CON_COMMAND_F( diff_benchmark, "Diff two revisions of a file (e.g. a bsp) with each diff mode and check the results. Usage: diff_benchmark <old file> <new file> [threads]", FCVAR_CHEAT )
+{
+	if ( args.ArgC() < 3 )
+	{
+		Msg( "Usage: diff_benchmark <old file> <new file> [threads]\n" );
+		return;
+	}
+
+	CUtlBuffer oldBuf, newBuf;
+	if ( !filesystem->ReadFile( args[1], NULL, oldBuf ) || !filesystem->ReadFile( args[2], NULL, newBuf ) )
+	{
+		Msg( "diff_benchmark: couldn't read %s and %s\n", args[1], args[2] );
+		return;
+	}
+
+	int nThreads = ( args.ArgC() > 3 ) ? atoi( args[3] ) : 0;
+	uint8 const *pOld = (uint8 const *)oldBuf.Base();
+	uint8 const *pNew = (uint8 const *)newBuf.Base();
+	int nOldSize = oldBuf.TellPut();
+	int nNewSize = newBuf.TellPut();
+
+	// only FindDiffsChunked checks the output size, leave room for the others
+	uint32 nOutSize = nNewSize + nNewSize / 4 + 1024;
+	CUtlMemory< uint8 > diff( 0, nOutSize );
+	CUtlMemory< uint8 > result( 0, nNewSize + 1 );
+	int nDiffSize = 0;
+
+	static const char *s_pModeNames[] = { "FindDiffs", "FindDiffsForLargeFiles", "FindDiffsLowMemory", "FindDiffsChunked" };
+	for ( int nMode = 0; nMode < ARRAYSIZE( s_pModeNames ); nMode++ )
+	{
+		// the hash chain modes need 8-16 bytes per byte of the old file
+		if ( nMode < 2 && nOldSize > 64 * 1024 * 1024 )
+		{
+			Msg( "%-24s skipped, old file is too big\n", s_pModeNames[nMode] );
+			continue;
+		}
+
+		CFastTimer timer;
+		int ret;
+		timer.Start();
+		switch ( nMode )
+		{
+		case 0:
+			ret = FindDiffs( pNew, pOld, nNewSize, nOldSize, nDiffSize, diff.Base(), nOutSize );
+			break;
+		case 1:
+			ret = FindDiffsForLargeFiles( pNew, pOld, nNewSize, nOldSize, nDiffSize, diff.Base(), nOutSize );
+			break;
+		case 2:
+			ret = FindDiffsLowMemory( pNew, pOld, nNewSize, nOldSize, nDiffSize, diff.Base(), nOutSize );
+			break;
+		default:
+			ret = FindDiffsChunked( pNew, pOld, nNewSize, nOldSize, nDiffSize, diff.Base(), nOutSize, nThreads );
+			break;
+		}
+		timer.End();
+		float flSeconds = timer.GetDuration().GetSeconds();
+
+		int nResultSize = 0;
+		if ( ret >= 0 )
+		{
+			ApplyDiffs( pOld, diff.Base(), nOldSize, nDiffSize, nResultSize, result.Base(), nNewSize + 1 );
+		}
+		bool bOk = ( ret >= 0 && nResultSize == nNewSize && !V_memcmp( result.Base(), pNew, nNewSize ) );
+
+		Msg( "%-24s %8.3f s %8.1f MB/s, diff %d bytes (%.2f%%)%s\n", s_pModeNames[nMode], flSeconds, nNewSize / ( 1024.0f * 1024.0f * MAX( flSeconds, 1e-6f ) ),
+			nDiffSize, 100.0f * nDiffSize / MAX( nNewSize, 1 ), bOk ? "" : ", BAD RESULT" );
+	}
+
+	// apply the last diff again, without building the result in memory
+	CUtlBuffer streamed( 0, nNewSize );
+	CFastTimer timer;
+	timer.Start();
+	bool bOk = ApplyDiffsStreaming( pOld, diff.Base(), nOldSize, nDiffSize, DiffBenchmarkWrite, &streamed );
+	timer.End();
+	bOk = bOk && streamed.TellPut() == nNewSize && !V_memcmp( streamed.Base(), pNew, nNewSize );
+	Msg( "%-24s %8.3f s%s\n", "ApplyDiffsStreaming", timer.GetDuration().GetSeconds(), bOk ? "" : ", BAD RESULT" );
+}
+
+
+//-----------------------------------------------------------------------------
+// Queues and executes a config through a CCommandBuffer, a chunk of lines at a
+// time since the buffer only holds a few KB of text.
+//-----------------------------------------------------------------------------
+static void CommandBufferBenchmarkPass( char *pConfig, const CUtlVector< int > &chunkEnds, int nBatchSize, float &flQueueSeconds, float &flDequeueSeconds, int &nCommands, int &nArgs )
+{
+	CCommandBuffer commandBuffer;
+	CCommand *pBatch = new CCommand[ nBatchSize ];
+	flQueueSeconds = flDequeueSeconds = 0.0f;
+	nCommands = nArgs = 0;
+
+	int nChunkStart = 0;
+	FOR_EACH_VEC( chunkEnds, i )
+	{
+		char cSaved = pConfig[ chunkEnds[i] ];
+		pConfig[ chunkEnds[i] ] = 0;
+
+		CFastTimer timer;
+		timer.Start();
+		bool bQueued = commandBuffer.AddText( pConfig + nChunkStart );
+		timer.End();
+		flQueueSeconds += timer.GetDuration().GetSeconds();
+		pConfig[ chunkEnds[i] ] = cSaved;
+		nChunkStart = chunkEnds[i];
+		if ( !bQueued )
+		{
+			Msg( "commandbuffer_benchmark: chunk %d overflowed the command buffer\n", i );
+			break;
+		}
+
+		timer.Start();
+		commandBuffer.BeginProcessingCommands( 1 );
+		if ( nBatchSize > 1 )
+		{
+			int nDequeued;
+			while ( ( nDequeued = commandBuffer.DequeueNextCommands( pBatch, nBatchSize ) ) > 0 )
+			{
+				for ( int j = 0; j < nDequeued; j++ )
+				{
+					nArgs += pBatch[j].ArgC();
+				}
+				nCommands += nDequeued;
+			}
+		}
+		else
+		{
+			while ( commandBuffer.DequeueNextCommand() )
+			{
+				nArgs += commandBuffer.ArgC();
+				++nCommands;
+			}
+		}
+		commandBuffer.EndProcessingCommands();
+		timer.End();
+		flDequeueSeconds += timer.GetDuration().GetSeconds();
+	}
+
+	delete[] pBatch;
+}
+
+CON_COMMAND_F( commandbuffer_benchmark, "Queue and tokenize a generated config through a command buffer, one command and a batch at a time. Usage: commandbuffer_benchmark [lines]", FCVAR_CHEAT )
+{
+	int nLines = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 50000;
+	if ( nLines <= 0 )
+	{
+		Msg( "Usage: commandbuffer_benchmark [lines]\n" );
+		return;
+	}
+
+	// a mix of the things autoexec and bind configs are made of
+	CUtlBuffer config( 0, nLines * 48, CUtlBuffer::TEXT_BUFFER );
+	CUtlVector< int > chunkEnds;
+	for ( int i = 0; i < nLines; i++ )
+	{
+		switch ( i % 5 )
+		{
+		case 0:
+			config.Printf( "// settings block %d\n", i );
+			break;
+		case 1:
+			config.Printf( "sv_benchmark_cvar_%d \"%d\"\n", i, i * 7 );
+			break;
+		case 2:
+			config.Printf( "bind \"KP_%d\" \"+attack; +jump; say hello %d\"\n", i % 10, i );
+			break;
+		case 3:
+			config.Printf( "alias a%d \"echo {%d}: (x)\"; echo 'chained' %d // trailing comment\n", i, i, i );
+			break;
+		default:
+			config.Printf( "exec cfg/file_%d.cfg;sv_gravity %d\n", i, 600 + i % 200 );
+			break;
+		}
+
+		if ( ( i % 50 ) == 49 || i == nLines - 1 )
+		{
+			chunkEnds.AddToTail( config.TellPut() );
+		}
+	}
+	config.PutChar( 0 );
+
+	char *pConfig = (char *)config.Base();
+	Msg( "%d lines, %d bytes\n", nLines, chunkEnds.Tail() );
+
+	static const int s_nBatchSizes[] = { 1, 64 };
+	for ( int i = 0; i < ARRAYSIZE( s_nBatchSizes ); i++ )
+	{
+		float flQueueSeconds, flDequeueSeconds;
+		int nCommands, nArgs;
+		CommandBufferBenchmarkPass( pConfig, chunkEnds, s_nBatchSizes[i], flQueueSeconds, flDequeueSeconds, nCommands, nArgs );
+		Msg( "batch %2d: queue %7.3f ms, dequeue + tokenize %7.3f ms, %6.1f ns/line, %d commands, %d args\n", s_nBatchSizes[i],
+			flQueueSeconds * 1000.0f, flDequeueSeconds * 1000.0f, ( flQueueSeconds + flDequeueSeconds ) * 1e9f / nLines, nCommands, nArgs );
+	}
+}
@@ -1387,7 +1387,7 @@ ConVarRef suitcharger( "sk_suitcharger" );
 		// Load server's mapcycle into network string table for client-side voting
 		if ( g_pStringTableServerMapCycle )
 		{
-			CUtlString sFileList;
+			CUtlStringBuilder sFileList;
 			for ( int i = 0; i < m_MapList.Count(); i++ )
 			{
 				sFileList += m_MapList[i];
@@ -1401,7 +1401,7 @@ ConVarRef suitcharger( "sk_suitcharger" );
 		if ( g_pStringTableServerPopFiles )
 		{
 			// Search for all pop files that are prefixed with the current map name
-			CUtlString sFileList;
+			CUtlStringBuilder sFileList;
 
 			char szBaseName[_MAX_PATH];
 			V_snprintf( szBaseName, sizeof( szBaseName ), "scripts/population/%s*.pop", STRING(gpGlobals->mapname) );
@@ -1474,7 +1474,7 @@ ConVarRef suitcharger( "sk_suitcharger" );
 
 				if ( mapList.Count() )
 				{
-					CUtlString sFileList;
+					CUtlStringBuilder sFileList;
 					for ( int i = 0; i < mapList.Count(); i++ )
 					{
 						sFileList += mapList[i];
@@ -21,6 +21,8 @@
 #include "predictioncopy.h"
 #include "engine/ivmodelinfo.h"
 #include "tier1/fmtstr.h"
+#include "tier1/utlmap.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1373,6 +1375,462 @@ void CPredictionCopy::DetermineWatchField( const char *operation, int entindex,
 	m_pWatchField = FindFieldByName( pwatchvar.GetString(), dmap );
 }
 
+//-----------------------------------------------------------------------------
+//
+// Compiled copy plans
+//
+// Walking the datamaps and switching on every field type is slow, and most
+// transfers don't report or describe anything. The fields of a datamap chain
+// are flattened once per copy type and offset layout into a list of copy
+// blocks - contiguous fields merged into one memcpy - and a list of compare
+// ops, used when counting errors.
+//
+//-----------------------------------------------------------------------------
+
+static ConVar pcompiledcopy( "pcompiledcopy", "1", FCVAR_CHEAT, "Use compiled copy plans for prediction data transfers that don't report or watch fields." );
+
+enum
+{
+	PCOP_COPY = 0,				// memcpy
+	PCOP_COPY_STRING,			// null-terminated string
+	PCOP_COMPARE_BLOCK,			// memcmp of the next fieldCount exact ops, which are checked one by one only if it differs
+	PCOP_COMPARE_DATA,			// exact compare of one field
+	PCOP_COMPARE_FLOAT,			// floats, vectors and quaternions, with tolerance
+	PCOP_COMPARE_STRING,
+	PCOP_COMPARE_EHANDLE,
+};
+
+struct PredictionCopyOp_t
+{
+	int		op;
+	int		destOffset;
+	int		srcOffset;
+	int		size;				// bytes
+	int		fieldCount;			// PCOP_COMPARE_BLOCK only
+	int		errorCount;			// errors counted when the field differs
+	float	tolerance;
+};
+
+class CPredictionCopyPlan
+{
+public:
+	CPredictionCopyPlan() : m_bValid( true ), m_bCheckValid( true ) {}
+
+	bool		m_bValid;						// false if the fields can't be flattened (embedded pointers)
+	bool		m_bCheckValid;					// false if fields overlap, so compare order matters
+
+	CUtlVector< PredictionCopyOp_t >	m_CopyOps;
+	CUtlVector< PredictionCopyOp_t >	m_CheckOps;
+};
+
+static bool PredictionCopyOpLessFunc( const PredictionCopyOp_t &lhs, const PredictionCopyOp_t &rhs )
+{
+	if ( lhs.srcOffset != rhs.srcOffset )
+		return lhs.srcOffset < rhs.srcOffset;
+	return lhs.destOffset < rhs.destOffset;
+}
+
+static int __cdecl PredictionCopyOpCompare( const PredictionCopyOp_t *lhs, const PredictionCopyOp_t *rhs )
+{
+	if ( PredictionCopyOpLessFunc( *lhs, *rhs ) )
+		return -1;
+	if ( PredictionCopyOpLessFunc( *rhs, *lhs ) )
+		return 1;
+	return 0;
+}
+
+static int __cdecl PredictionCopyOpDestCompare( const PredictionCopyOp_t *lhs, const PredictionCopyOp_t *rhs )
+{
+	return lhs->destOffset - rhs->destOffset;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Flatten fields the same way CopyFields walks them
+//-----------------------------------------------------------------------------
+static void CompileCopyPlanFields_R( CPredictionCopyPlan *pPlan, CUtlVector< typedescription_t * > &overridden, int type, int destIndex, int srcIndex,
+	int destBase, int srcBase, typedescription_t *pFields, int fieldCount )
+{
+	for ( int i = 0; i < fieldCount && pPlan->m_bValid; i++ )
+	{
+		typedescription_t *pField = &pFields[ i ];
+		int flags = pField->flags;
+
+		// Mark any subchains first
+		if ( pField->override_field != NULL )
+		{
+			overridden.AddToTail( pField->override_field );
+		}
+
+		// Skip this field?
+		if ( overridden.Find( pField ) != overridden.InvalidIndex() )
+			continue;
+
+		int destOffset = destBase + pField->fieldOffset[ destIndex ];
+		int srcOffset = srcBase + pField->fieldOffset[ srcIndex ];
+
+		if ( pField->fieldType == FIELD_EMBEDDED )
+		{
+			// Following pointers needs the object, leave these to CopyFields
+			if ( ( flags & FTYPEDESC_PTR ) && ( srcIndex == PC_DATA_NORMAL || destIndex == PC_DATA_NORMAL ) )
+			{
+				pPlan->m_bValid = false;
+				return;
+			}
+
+			CompileCopyPlanFields_R( pPlan, overridden, type, destIndex, srcIndex, destOffset, srcOffset, pField->td->dataDesc, pField->td->dataNumFields );
+			continue;
+		}
+
+		if ( flags & FTYPEDESC_PRIVATE )
+			continue;
+
+		if ( type == PC_NON_NETWORKED_ONLY && ( flags & FTYPEDESC_INSENDTABLE ) )
+			continue;
+
+		if ( type == PC_NETWORKED_ONLY && !( flags & FTYPEDESC_INSENDTABLE ) )
+			continue;
+
+		PredictionCopyOp_t op;
+		op.destOffset	= destOffset;
+		op.srcOffset	= srcOffset;
+		op.fieldCount	= 0;
+		op.errorCount	= 1;
+		op.tolerance	= pField->fieldTolerance;
+
+		int compareOp;
+		int fieldSize = pField->fieldSize;
+
+		switch( pField->fieldType )
+		{
+		case FIELD_FLOAT:		op.size = sizeof( float ) * fieldSize;			compareOp = PCOP_COMPARE_FLOAT;		break;
+		case FIELD_VECTOR:		op.size = sizeof( Vector ) * fieldSize;			compareOp = PCOP_COMPARE_FLOAT;		break;
+		case FIELD_QUATERNION:	op.size = sizeof( Quaternion ) * fieldSize;		compareOp = PCOP_COMPARE_FLOAT;		break;
+		case FIELD_STRING:		op.size = 0;									compareOp = PCOP_COMPARE_STRING;	break;
+		case FIELD_COLOR32:		op.size = 4 * fieldSize;						compareOp = PCOP_COMPARE_DATA;		break;
+		case FIELD_BOOLEAN:		op.size = sizeof( bool ) * fieldSize;			compareOp = PCOP_COMPARE_DATA;		break;
+		case FIELD_SHORT:		op.size = sizeof( short ) * fieldSize;			compareOp = PCOP_COMPARE_DATA;		break;
+		case FIELD_CHARACTER:	op.size = fieldSize;							compareOp = PCOP_COMPARE_DATA;		break;
+		case FIELD_EHANDLE:		op.size = sizeof( EHANDLE ) * fieldSize;		compareOp = PCOP_COMPARE_EHANDLE;	break;
+		case FIELD_INTEGER:
+			// CompareInt reports the difference too
+			op.size = sizeof( int ) * fieldSize;
+			op.errorCount = 2;
+			compareOp = PCOP_COMPARE_DATA;
+			break;
+
+		case FIELD_VOID:
+			continue;
+
+		default:
+			// Unsupported in prediction, let CopyFields complain about it
+			pPlan->m_bValid = false;
+			return;
+		}
+
+		op.op = ( compareOp == PCOP_COMPARE_STRING ) ? PCOP_COPY_STRING : PCOP_COPY;
+		pPlan->m_CopyOps.AddToTail( op );
+
+		// Fields that aren't error checked are never copied when checking errors
+		if ( flags & FTYPEDESC_NOERRORCHECK )
+			continue;
+
+		op.op = compareOp;
+		pPlan->m_CheckOps.AddToTail( op );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Merge copy ops that are contiguous on both sides, group exact 
+//			compares that are contiguous on both sides into blocks
+//-----------------------------------------------------------------------------
+static void OptimizeCopyPlan( CPredictionCopyPlan *pPlan )
+{
+	CUtlVector< PredictionCopyOp_t > ops;
+
+	pPlan->m_CopyOps.Sort( PredictionCopyOpCompare );
+	FOR_EACH_VEC( pPlan->m_CopyOps, i )
+	{
+		const PredictionCopyOp_t &op = pPlan->m_CopyOps[ i ];
+		if ( op.op == PCOP_COPY && ops.Count() )
+		{
+			PredictionCopyOp_t &last = ops.Tail();
+			if ( last.op == PCOP_COPY )
+			{
+				// Same field listed twice
+				if ( last.srcOffset == op.srcOffset && last.destOffset == op.destOffset && last.size >= op.size )
+					continue;
+
+				if ( last.srcOffset + last.size == op.srcOffset && last.destOffset + last.size == op.destOffset )
+				{
+					last.size += op.size;
+					continue;
+				}
+			}
+		}
+
+		ops.AddToTail( op );
+	}
+	pPlan->m_CopyOps.Swap( ops );
+
+	// A compare can change what the next one sees if fields overlap, so keep those on the slow path.
+	// String lengths aren't known up front.
+	ops.CopyArray( pPlan->m_CheckOps.Base(), pPlan->m_CheckOps.Count() );
+	ops.Sort( PredictionCopyOpDestCompare );
+	for ( int i = 0; i < ops.Count(); i++ )
+	{
+		bool bOverlaps = ( i > 0 && ops[ i - 1 ].destOffset + ops[ i - 1 ].size > ops[ i ].destOffset );
+		if ( bOverlaps || ops[ i ].op == PCOP_COMPARE_STRING )
+		{
+			pPlan->m_bCheckValid = false;
+			return;
+		}
+	}
+
+	pPlan->m_CheckOps.Sort( PredictionCopyOpCompare );
+	ops.RemoveAll();
+	for ( int i = 0; i < pPlan->m_CheckOps.Count(); )
+	{
+		const PredictionCopyOp_t &op = pPlan->m_CheckOps[ i ];
+
+		int last = i;
+		if ( op.op == PCOP_COMPARE_DATA )
+		{
+			while ( last + 1 < pPlan->m_CheckOps.Count() )
+			{
+				const PredictionCopyOp_t &prev = pPlan->m_CheckOps[ last ];
+				const PredictionCopyOp_t &next = pPlan->m_CheckOps[ last + 1 ];
+				if ( next.op != PCOP_COMPARE_DATA ||
+					 prev.srcOffset + prev.size != next.srcOffset || 
+					 prev.destOffset + prev.size != next.destOffset )
+					break;
+				++last;
+			}
+		}
+
+		if ( last > i )
+		{
+			PredictionCopyOp_t block = op;
+			block.op			= PCOP_COMPARE_BLOCK;
+			block.fieldCount	= last - i + 1;
+			block.size			= pPlan->m_CheckOps[ last ].srcOffset + pPlan->m_CheckOps[ last ].size - op.srcOffset;
+			ops.AddToTail( block );
+		}
+
+		ops.AddMultipleToTail( last - i + 1, &pPlan->m_CheckOps[ i ] );
+		i = last + 1;
+	}
+	pPlan->m_CheckOps.Swap( ops );
+}
+
+struct PredictionCopyPlanKey_t
+{
+	datamap_t	*dmap;
+	int			layout;				// copy type and offset indices
+};
+
+static bool PredictionCopyPlanKeyLessFunc( const PredictionCopyPlanKey_t &lhs, const PredictionCopyPlanKey_t &rhs )
+{
+	if ( lhs.dmap != rhs.dmap )
+		return lhs.dmap < rhs.dmap;
+	return lhs.layout < rhs.layout;
+}
+
+class CPredictionCopyPlanCache
+{
+public:
+	CPredictionCopyPlanCache() : m_Plans( 0, 0, PredictionCopyPlanKeyLessFunc ) {}
+	~CPredictionCopyPlanCache()
+	{
+		FOR_EACH_MAP_FAST( m_Plans, i )
+		{
+			delete m_Plans[ i ];
+		}
+	}
+
+	const CPredictionCopyPlan *GetPlan( datamap_t *dmap, int type, int destIndex, int srcIndex )
+	{
+		AUTO_LOCK_FM( m_Mutex );
+
+		PredictionCopyPlanKey_t key;
+		key.dmap = dmap;
+		key.layout = ( type * TD_OFFSET_COUNT + destIndex ) * TD_OFFSET_COUNT + srcIndex;
+
+		int i = m_Plans.Find( key );
+		if ( i == m_Plans.InvalidIndex() )
+		{
+			CPredictionCopyPlan *pPlan = new CPredictionCopyPlan;
+
+			CUtlVector< typedescription_t * > overridden;
+			for ( datamap_t *pMap = dmap; pMap && pPlan->m_bValid; pMap = pMap->baseMap )
+			{
+				CompileCopyPlanFields_R( pPlan, overridden, type, destIndex, srcIndex, 0, 0, pMap->dataDesc, pMap->dataNumFields );
+			}
+
+			if ( pPlan->m_bValid )
+			{
+				OptimizeCopyPlan( pPlan );
+			}
+
+			i = m_Plans.Insert( key, pPlan );
+		}
+
+		return m_Plans[ i ];
+	}
+
+private:
+	CThreadFastMutex m_Mutex;
+	CUtlMap< PredictionCopyPlanKey_t, CPredictionCopyPlan * > m_Plans;
+};
+
+static CPredictionCopyPlanCache g_PredictionCopyPlans;
+
+//-----------------------------------------------------------------------------
+// Purpose: Same result as CompareFloat on a block of floats, four at a time
+//-----------------------------------------------------------------------------
+static CPredictionCopy::difftype_t CompareFloatBlock( const float *outvalue, const float *invalue, int count, float tolerance )
+{
+	CPredictionCopy::difftype_t retval = CPredictionCopy::IDENTICAL;
+
+	int i = 0;
+	if ( count >= 4 )
+	{
+		fltx4 tol = ReplicateX4( tolerance );
+		for ( ; i + 4 <= count; i += 4 )
+		{
+			fltx4 out = LoadUnalignedSIMD( outvalue + i );
+			fltx4 in = LoadUnalignedSIMD( invalue + i );
+			fltx4 equal = CmpEqSIMD( out, in );
+			if ( TestSignSIMD( equal ) == 0xf )
+				continue;
+
+			fltx4 within = CmpLeSIMD( fabs( SubSIMD( out, in ) ), tol );
+			if ( TestSignSIMD( OrSIMD( equal, within ) ) != 0xf )
+				return CPredictionCopy::DIFFERS;
+
+			retval = CPredictionCopy::WITHINTOLERANCE;
+		}
+	}
+
+	for ( ; i < count; i++ )
+	{
+		if ( outvalue[ i ] == invalue[ i ] )
+			continue;
+
+		// written so NaN differs, as in CompareFloat and the SIMD loop
+		if ( !( tolerance > 0.0f && fabs( outvalue[ i ] - invalue[ i ] ) <= tolerance ) )
+			return CPredictionCopy::DIFFERS;
+
+		retval = CPredictionCopy::WITHINTOLERANCE;
+	}
+
+	return retval;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Transfer using a compiled plan, same results as TransferData_R
+//			when nothing is reported, described or watched
+//-----------------------------------------------------------------------------
+void CPredictionCopy::RunCopyPlan( const CPredictionCopyPlan *pPlan )
+{
+	char *pDest = (char *)m_pDest;
+	const char *pSrc = (const char *)m_pSrc;
+
+	if ( !m_bErrorCheck )
+	{
+		if ( !m_bPerformCopy )
+			return;
+
+		int c = pPlan->m_CopyOps.Count();
+		const PredictionCopyOp_t *pOps = pPlan->m_CopyOps.Base();
+		for ( int i = 0; i < c; i++ )
+		{
+			const PredictionCopyOp_t &op = pOps[ i ];
+			if ( op.op == PCOP_COPY )
+			{
+				memcpy( pDest + op.destOffset, pSrc + op.srcOffset, op.size );
+			}
+			else
+			{
+				Q_strcpy( pDest + op.destOffset, pSrc + op.srcOffset );
+			}
+		}
+		return;
+	}
+
+	int c = pPlan->m_CheckOps.Count();
+	const PredictionCopyOp_t *pOps = pPlan->m_CheckOps.Base();
+	for ( int i = 0; i < c; i++ )
+	{
+		const PredictionCopyOp_t &op = pOps[ i ];
+		char *pOut = pDest + op.destOffset;
+		const char *pIn = pSrc + op.srcOffset;
+
+		difftype_t difftype;
+		switch( op.op )
+		{
+		case PCOP_COMPARE_BLOCK:
+			if ( !memcmp( pOut, pIn, op.size ) )
+			{
+				// Skip the fields in the block
+				i += op.fieldCount;
+			}
+			continue;
+
+		case PCOP_COMPARE_DATA:
+			difftype = memcmp( pOut, pIn, op.size ) ? DIFFERS : IDENTICAL;
+			break;
+
+		case PCOP_COMPARE_FLOAT:
+			difftype = CompareFloatBlock( (const float *)pOut, (const float *)pIn, op.size / sizeof( float ), op.tolerance );
+			break;
+
+		case PCOP_COMPARE_STRING:
+			difftype = Q_strcmp( pOut, pIn ) ? DIFFERS : IDENTICAL;
+			break;
+
+		case PCOP_COMPARE_EHANDLE:
+			{
+				difftype = IDENTICAL;
+				const EHANDLE *pOutHandles = (const EHANDLE *)pOut;
+				const EHANDLE *pInHandles = (const EHANDLE *)pIn;
+				for ( int j = 0; j < op.size / (int)sizeof( EHANDLE ); j++ )
+				{
+					if ( pOutHandles[ j ].Get() != pInHandles[ j ].Get() )
+					{
+						difftype = DIFFERS;
+						break;
+					}
+				}
+			}
+			break;
+
+		default:
+			Assert( 0 );
+			continue;
+		}
+
+		if ( difftype == IDENTICAL )
+			continue;
+
+		if ( difftype == DIFFERS )
+		{
+			m_nErrorCount += op.errorCount;
+		}
+
+		if ( m_bPerformCopy )
+		{
+			if ( op.op == PCOP_COMPARE_STRING )
+			{
+				Q_strcpy( pOut, pIn );
+			}
+			else
+			{
+				memcpy( pOut, pIn, op.size );
+			}
+		}
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *operation - 
@@ -1391,6 +1849,17 @@ int CPredictionCopy::TransferData( const char *operation, int entindex, datamap_
 	
 	DetermineWatchField( operation, entindex, dmap );
 
+	// Reporting, describing and watching need the fields, everything else can use the compiled plan
+	if ( !m_pWatchField && !m_bReportErrors && !m_bDescribeFields && !m_FieldCompareFunc && pcompiledcopy.GetBool() )
+	{
+		const CPredictionCopyPlan *pPlan = g_PredictionCopyPlans.GetPlan( dmap, m_nType, m_nDestOffsetIndex, m_nSrcOffsetIndex );
+		if ( pPlan->m_bValid && ( pPlan->m_bCheckValid || !m_bErrorCheck ) )
+		{
+			RunCopyPlan( pPlan );
+			return m_nErrorCount;
+		}
+	}
+
 	TransferData_R( g_nChainCount, dmap );
 
 	return m_nErrorCount;
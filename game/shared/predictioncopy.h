@@ -41,6 +41,8 @@ enum
 #define PC_DATA_PACKED			true
 #define PC_DATA_NORMAL			false
 
+class CPredictionCopyPlan;
+
 typedef void ( *FN_FIELD_COMPARE )( const char *classname, const char *fieldname, const char *fieldtype,
 	bool networked, bool noterrorchecked, bool differs, bool withintolerance, const char *value );
 
@@ -84,6 +86,7 @@ public:
 
 private:
 	void	TransferData_R( int chaincount, datamap_t *dmap );
+	void	RunCopyPlan( const CPredictionCopyPlan *pPlan );
 
 	void	DetermineWatchField( const char *operation, int entindex,  datamap_t *dmap );
 	void	DumpWatchField( typedescription_t *field );
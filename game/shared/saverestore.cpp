@@ -24,6 +24,8 @@
 #include "vphysics/object_hash.h"
 #include "datacache/imdlcache.h"
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
+#include "utlmap.h"
 
 #if !defined( CLIENT_DLL )
 
@@ -54,6 +56,8 @@ void AddRestoredEntity( C_BaseEntity *pEntity );
 
 ASSERT_INVARIANT( sizeof(EHandlePlaceholder_t) == sizeof(EHANDLE) );
 
+static ConVar save_field_plans( "save_field_plans", "1", 0, "Write datamaps through precompiled lists of their saved fields." );
+
 //-----------------------------------------------------------------------------
 
 static int gSizes[FIELD_TYPECOUNT] = 
@@ -858,6 +862,128 @@ int CSave::WriteFields( const char *pname, const void *pBaseData, datamap_t *pRo
 	return 1;
 }
 
+//-------------------------------------
+// Compiled field plans: the saved fields of each datamap, flattened once so
+// that WriteAll() doesn't walk every field description of every entity. Fields
+// whose saved bytes are exactly their memory are copied without going through
+// the WriteField() type switch.
+//
+// Saves only ever run one at a time, so the plans aren't locked.
+
+struct SaveFieldOp_t
+{
+	typedescription_t	*pField;
+	int					nRawBytes;		// size of a plain data field, or 0 if it is written by WriteField()
+};
+
+struct SaveFieldPlan_t
+{
+	int					iFirstOp;
+	int					nOps;
+};
+
+static CUtlVector<SaveFieldOp_t> g_SaveFieldOps;
+static CUtlMap<datamap_t *, SaveFieldPlan_t> g_SaveFieldPlans( DefLessFunc( datamap_t * ) );
+
+static int SaveFieldRawBytes( const typedescription_t *pField )
+{
+	switch ( pField->fieldType )
+	{
+	case FIELD_FLOAT:
+	case FIELD_VECTOR:
+	case FIELD_QUATERNION:
+	case FIELD_INTEGER:
+	case FIELD_BOOLEAN:
+	case FIELD_SHORT:
+	case FIELD_CHARACTER:
+	case FIELD_COLOR32:
+		{
+			// Mismatched sizes take the slow path, which warns about them
+			int nBytes = pField->fieldSize * gSizes[pField->fieldType];
+			return ( pField->fieldSizeInBytes == nBytes ) ? nBytes : 0;
+		}
+
+	default:
+		return 0;
+	}
+}
+
+static SaveFieldPlan_t GetSaveFieldPlan( datamap_t *pMap )
+{
+	unsigned short iPlan = g_SaveFieldPlans.Find( pMap );
+	if ( iPlan != g_SaveFieldPlans.InvalidIndex() )
+		return g_SaveFieldPlans[iPlan];
+
+	SaveFieldPlan_t plan;
+	plan.iFirstOp = g_SaveFieldOps.Count();
+	plan.nOps = 0;
+
+	for ( int i = 0; i < pMap->dataNumFields; i++ )
+	{
+		typedescription_t *pField = &pMap->dataDesc[i];
+		if ( !(pField->flags & FTYPEDESC_SAVE) || pField->fieldType == FIELD_VOID )
+			continue;
+
+		SaveFieldOp_t &op = g_SaveFieldOps[ g_SaveFieldOps.AddToTail() ];
+		op.pField = pField;
+		op.nRawBytes = SaveFieldRawBytes( pField );
+		plan.nOps++;
+	}
+
+	g_SaveFieldPlans.Insert( pMap, plan );
+	return plan;
+}
+
+//-------------------------------------
+// Purpose: Same output as WriteFields() over all the fields of pCurMap, using its compiled plan
+
+int CSave::WriteFieldPlan( const char *pname, const void *pBaseData, datamap_t *pRootMap, datamap_t *pCurMap )
+{
+	// Copied, as embedded fields may compile more plans while this one is written
+	SaveFieldPlan_t plan = GetSaveFieldPlan( pCurMap );
+
+	int iHeaderPos = m_pData->GetCurPos();
+	int count = -1;
+	WriteInt( pname, &count, 1 );
+
+	count = 0;
+
+	for ( int i = plan.iFirstOp; i < plan.iFirstOp + plan.nOps; i++ )
+	{
+		SaveFieldOp_t op = g_SaveFieldOps[i];
+		void *pOutputData = ( (char *)pBaseData + op.pField->fieldOffset[ TD_OFFSET_NORMAL ] );
+
+		if ( op.nRawBytes )
+		{
+			if ( DataEmpty( (const char *)pOutputData, op.nRawBytes ) )
+				continue;
+
+#ifdef _DEBUG
+			Log( pname, (fieldtype_t)op.pField->fieldType, pOutputData, op.pField->fieldSize );
+#endif
+			BufferField( op.pField->fieldName, op.nRawBytes, (const char *)pOutputData );
+		}
+		else
+		{
+			if ( !ShouldSaveField( pOutputData, op.pField ) )
+				continue;
+
+			if ( !WriteField( pname, pOutputData, pRootMap, op.pField ) )
+				break;
+		}
+		count++;
+	}
+
+	int iCurPos = m_pData->GetCurPos();
+	int iRewind = iCurPos - iHeaderPos;
+	m_pData->Rewind( iRewind );
+	WriteInt( pname, &count, 1 );
+	iCurPos = m_pData->GetCurPos();
+	m_pData->MoveCurPos( iRewind - ( iCurPos - iHeaderPos ) );
+
+	return 1;
+}
+
 //-------------------------------------
 // Purpose: Recursively saves all the classes in an object, in reverse order (top down)
 // Output : int 0 on failure, 1 on success
@@ -872,6 +998,9 @@ int CSave::DoWriteAll( const void *pLeafObject, datamap_t *pLeafMap, datamap_t *
 			return status;
 	}
 
+	if ( save_field_plans.GetBool() )
+		return WriteFieldPlan( pCurMap->dataClassName, pLeafObject, pLeafMap, pCurMap );
+
 	return WriteFields( pCurMap->dataClassName, pLeafObject, pLeafMap, pCurMap->dataDesc, pCurMap->dataNumFields );
 }
 	
@@ -3440,3 +3569,76 @@ int CreateEntityTransitionList( CSaveRestoreData *pSaveData, int levelMask )
 	return movedCount;
 }
 #endif
+
+#if !defined( CLIENT_DLL )
+//-----------------------------------------------------------------------------
+// Purpose: Times writing every entity into a scratch save buffer, the bulk of
+//			an autosave hitch, with and without compiled field plans
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( save_benchmark, "Time writing all entities to a save buffer with and without compiled field plans. Usage: save_benchmark [iterations]", FCVAR_CHEAT )
+{
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 10;
+	const int nBufferSize = 32*1024*1024;
+	const int nTokens = 0xfff;
+
+	char *pSaveMemory = new char[ sizeof(CSaveRestoreData) + nBufferSize ];
+	char **pTokens = new char *[ nTokens ];
+	CSaveRestoreData *pSaveData = MakeSaveRestoreData( pSaveMemory );
+	pSaveData->InitSymbolTable( pTokens, nTokens );
+	pSaveData->levelInfo.time = gpGlobals->curtime;
+
+	bool bUsePlans = save_field_plans.GetBool();
+	CUtlMemory<char> firstPass;
+	float flMilliseconds[2];
+	int nBytes[2];
+	int nEntities = 0;
+
+	for ( int iMode = 0; iMode < 2; iMode++ )
+	{
+		save_field_plans.SetValue( iMode );
+
+		CFastTimer timer;
+		timer.Start();
+		for ( int iIteration = 0; iIteration < nIterations; iIteration++ )
+		{
+			pSaveData->Init( (char *)(pSaveData + 1), nBufferSize );
+			CSave saveHelper( pSaveData );
+
+			nEntities = 0;
+			CBaseEntity *pEnt = NULL;
+			while ( (pEnt = gEntList.NextEnt( pEnt )) != NULL )
+			{
+				if ( pEnt->ObjectCaps() & FCAP_DONT_SAVE )
+					continue;
+
+				pSaveData->SetCurrentEntityContext( pEnt );
+				pEnt->Save( saveHelper );
+				pSaveData->SetCurrentEntityContext( NULL );
+				nEntities++;
+			}
+		}
+		timer.End();
+
+		flMilliseconds[iMode] = timer.GetDuration().GetMillisecondsF() / nIterations;
+		nBytes[iMode] = pSaveData->GetCurPos();
+		if ( iMode == 0 )
+		{
+			firstPass.EnsureCapacity( nBytes[0] );
+			memcpy( firstPass.Base(), pSaveData->GetBuffer(), nBytes[0] );
+		}
+	}
+
+	bool bMatch = ( nBytes[0] == nBytes[1] ) && !memcmp( firstPass.Base(), pSaveData->GetBuffer(), nBytes[0] );
+
+	save_field_plans.SetValue( bUsePlans );
+
+	Msg( "save_benchmark: %d entities, %d iterations\n", nEntities, nIterations );
+	Msg( "  field walk:     %.3f ms/save, %d bytes\n", flMilliseconds[0], nBytes[0] );
+	Msg( "  compiled plans: %.3f ms/save, %d bytes\n", flMilliseconds[1], nBytes[1] );
+	Msg( "  output %s\n", bMatch ? "matches" : "DIFFERS" );
+
+	pSaveData->DetachSymbolTable();
+	delete [] pTokens;
+	delete [] pSaveMemory;
+}
+#endif
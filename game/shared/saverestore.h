@@ -150,6 +150,7 @@ private:
 	void			WriteHeader( const char *pname, int size );
 
 	int				DoWriteAll( const void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap );
+	int				WriteFieldPlan( const char *pname, const void *pBaseData, datamap_t *pRootMap, datamap_t *pCurMap );
 	bool 			WriteField( const char *pname, void *pData, datamap_t *pRootMap, typedescription_t *pField );
 	
 	bool 			WriteBasicField( const char *pname, void *pData, datamap_t *pRootMap, typedescription_t *pField );
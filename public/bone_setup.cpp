@@ -20,6 +20,7 @@
 #include "datamanager.h"
 #include "convar.h"
 #include "tier0/tslist.h"
+#include "tier1/utlmap.h"
 #include "vphysics_interface.h"
 #ifdef CLIENT_DLL
 	#include "posedebugger.h"
@@ -212,30 +213,27 @@ short *CBoneCache::CachedToStudio()
 	return (short *)( (char *)(this+1) + m_cachedToStudioOffset );
 }
 
-// Construct a singleton
-static CDataManager<CBoneCache, bonecacheparams_t, CBoneCache *, CThreadFastMutex> g_StudioBoneCache( 128 * 1024L );
+// Construct a singleton. Split in four so threaded bone setup doesn't serialize on one lock
+static CDataManagerSharded<CBoneCache, bonecacheparams_t, CBoneCache *, CThreadFastMutex, 2> g_StudioBoneCache( 128 * 1024L, "bone cache" );
 
 CBoneCache *Studio_GetBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	return g_StudioBoneCache.GetResource_NoLock( cacheHandle );
 }
 
 memhandle_t Studio_CreateBoneCache( bonecacheparams_t &params )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	return g_StudioBoneCache.CreateResource( params );
 }
 
 void Studio_DestroyBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
 	g_StudioBoneCache.DestroyResource( cacheHandle );
 }
 
 void Studio_InvalidateBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
+	AUTO_LOCK( g_StudioBoneCache.AccessMutex( cacheHandle ) );
 	CBoneCache *pCache = g_StudioBoneCache.GetResource_NoLock( cacheHandle );
 	if ( pCache )
 	{
@@ -368,13 +366,465 @@ void ExtractAnimValue( int frame, mstudioanimvalue_t *panimvalue, float scale, f
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Decoded animation cache. The run length encoded values of recently used
+// (animation, section) pairs are expanded to one entry per frame, so sampling a
+// bone is a lookup instead of a walk from the start of the section's data.
+//-----------------------------------------------------------------------------
+static ConVar anim_decodecache( "anim_decodecache", "1", 0, "Cache decoded animation data for bone setup." );
+
+struct decodedanimkey_t
+{
+	const mstudioanimdesc_t	*pAnimdesc;
+	int						section;
+	int						checksum;
+};
+
+struct decodedanimparams_t
+{
+	decodedanimkey_t	key;
+	const mstudioanim_t	*pAnim;
+	int					numAnims;		// mstudioanim_t's in the section
+	int					numFrames;		// frames to decode per value stream
+};
+
+// One per mstudioanim_t of the section, in list order
+struct decodedanimbone_t
+{
+	int				rotOffset;		// first frame of the decoded rotation values, -1 if not animated
+	int				posOffset;		// first frame of the decoded position values, -1 if not animated
+	unsigned short	numRotFrames;	// frames that could be decoded
+	unsigned short	numPosFrames;
+};
+
+class CDecodedAnimSection
+{
+public:
+	// you must implement these static functions for the ResourceManager
+	// -----------------------------------------------------------
+	static CDecodedAnimSection *CreateResource( const decodedanimparams_t &params );
+	static unsigned int EstimatedSize( const decodedanimparams_t &params );
+	// -----------------------------------------------------------
+	// member functions that must be present for the ResourceManager
+	void			DestroyResource();
+	CDecodedAnimSection *GetData() { return this; }
+	unsigned int	Size() { return m_size; }
+	// -----------------------------------------------------------
+
+	// Same results as ExtractAnimValue() on the three value streams of a channel, unscaled.
+	// Returns false if the frame wasn't decoded and ExtractAnimValue() has to be used.
+	bool			GetRotation( int iAnim, int frame, fltx4 &v1, fltx4 &v2 ) const;
+	bool			GetRotation( int iAnim, int frame, fltx4 &v1 ) const;
+	bool			GetPosition( int iAnim, int frame, fltx4 &v1, fltx4 &v2 ) const;
+	bool			GetPosition( int iAnim, int frame, fltx4 &v1 ) const;
+
+	void			SetHandle( memhandle_t hSelf )	{ m_hSelf = hSelf; }
+
+private:
+	static unsigned int ComputeSize( int numAnims, int numDecodedFrames );
+	static int		DecodeAnimValues( const mstudioanimvalue_t *panimvalue, int numFrames, float *pOut );
+	static int		DecodeChannel( const mstudioanim_valueptr_t *pValuesPtr, int numFrames, float *pOut );
+
+	decodedanimbone_t	*Anims() const	{ return (decodedanimbone_t *)( this + 1 ); }
+	const float		*Frame( int offset, int frame ) const	{ return (const float *)( (byte *)( this + 1 ) + m_framesOffset ) + ( offset + frame ) * 4; }
+
+	decodedanimkey_t	m_key;
+	memhandle_t		m_hSelf;		// set once the cache has stored the section
+	unsigned int	m_size;
+	unsigned int	m_framesOffset;
+};
+
+unsigned int CDecodedAnimSection::ComputeSize( int numAnims, int numDecodedFrames )
+{
+	unsigned int framesOffset = ( sizeof(decodedanimbone_t) * numAnims + 15 ) & ~15;
+	return sizeof(CDecodedAnimSection) + framesOffset + numDecodedFrames * 4 * sizeof(float);
+}
+
+unsigned int CDecodedAnimSection::EstimatedSize( const decodedanimparams_t &params )
+{
+	// conservative estimate - every bone animates rotation and position
+	return ComputeSize( params.numAnims, params.numAnims * 2 * params.numFrames );
+}
+
+//-----------------------------------------------------------------------------
+// Expands one value stream into pOut[frame*4]. Returns the number of frames
+// decoded, which is less than numFrames if the stream ends early or has data
+// ExtractAnimValue() reads differently.
+//-----------------------------------------------------------------------------
+int CDecodedAnimSection::DecodeAnimValues( const mstudioanimvalue_t *panimvalue, int numFrames, float *pOut )
+{
+	int frame;
+	if ( !panimvalue )
+	{
+		for ( frame = 0; frame < numFrames; frame++ )
+		{
+			pOut[frame*4] = 0.0f;
+		}
+		return numFrames;
+	}
+
+	// ExtractAnimValue() treats these as a single value held for the whole animation
+	if ( ( panimvalue->num.total == 1 ) && ( panimvalue->num.valid == 1 ) )
+		return 0;
+
+	frame = 0;
+	while ( frame < numFrames )
+	{
+		int total = panimvalue->num.total;
+		int valid = panimvalue->num.valid;
+		if ( total == 0 || valid == 0 )
+			break;
+
+		// valid values, then the last one repeats for the rest of the run
+		int k;
+		for ( k = 0; k < total && frame < numFrames; k++, frame++ )
+		{
+			pOut[frame*4] = panimvalue[ MIN( k, valid - 1 ) + 1 ].value;
+		}
+		panimvalue += valid + 1;
+	}
+	return frame;
+}
+
+int CDecodedAnimSection::DecodeChannel( const mstudioanim_valueptr_t *pValuesPtr, int numFrames, float *pOut )
+{
+	int numDecoded = numFrames;
+	for ( int j = 0; j < 3; j++ )
+	{
+		numDecoded = MIN( numDecoded, DecodeAnimValues( pValuesPtr->pAnimvalue( j ), numFrames, pOut + j ) );
+	}
+	for ( int i = 0; i < numDecoded; i++ )
+	{
+		pOut[i*4+3] = 0.0f;
+	}
+	return numDecoded;
+}
+
+CDecodedAnimSection *CDecodedAnimSection::CreateResource( const decodedanimparams_t &params )
+{
+	// first pass - count the decoded frames
+	int numDecodedFrames = 0;
+	const mstudioanim_t *panim = params.pAnim;
+	for ( int i = 0; i < params.numAnims; i++, panim = panim->pNext() )
+	{
+		if ( ( panim->flags & ( STUDIO_ANIM_RAWROT | STUDIO_ANIM_RAWROT2 | STUDIO_ANIM_ANIMROT ) ) == STUDIO_ANIM_ANIMROT )
+		{
+			numDecodedFrames += params.numFrames;
+		}
+		if ( ( panim->flags & ( STUDIO_ANIM_RAWPOS | STUDIO_ANIM_ANIMPOS ) ) == STUDIO_ANIM_ANIMPOS )
+		{
+			numDecodedFrames += params.numFrames;
+		}
+	}
+
+	unsigned int size = ComputeSize( params.numAnims, numDecodedFrames );
+	CDecodedAnimSection *pMem = (CDecodedAnimSection *)malloc( size );
+	pMem->m_key = params.key;
+	pMem->m_hSelf = INVALID_MEMHANDLE;
+	pMem->m_size = size;
+	pMem->m_framesOffset = ( sizeof(decodedanimbone_t) * params.numAnims + 15 ) & ~15;
+
+	// second pass - decode
+	int offset = 0;
+	decodedanimbone_t *pAnims = pMem->Anims();
+	panim = params.pAnim;
+	for ( int i = 0; i < params.numAnims; i++, panim = panim->pNext() )
+	{
+		decodedanimbone_t &anim = pAnims[i];
+		anim.rotOffset = anim.posOffset = -1;
+		anim.numRotFrames = anim.numPosFrames = 0;
+
+		if ( ( panim->flags & ( STUDIO_ANIM_RAWROT | STUDIO_ANIM_RAWROT2 | STUDIO_ANIM_ANIMROT ) ) == STUDIO_ANIM_ANIMROT )
+		{
+			anim.rotOffset = offset;
+			anim.numRotFrames = DecodeChannel( panim->pRotV(), params.numFrames, (float *)pMem->Frame( offset, 0 ) );
+			offset += params.numFrames;
+		}
+		if ( ( panim->flags & ( STUDIO_ANIM_RAWPOS | STUDIO_ANIM_ANIMPOS ) ) == STUDIO_ANIM_ANIMPOS )
+		{
+			anim.posOffset = offset;
+			anim.numPosFrames = DecodeChannel( panim->pPosV(), params.numFrames, (float *)pMem->Frame( offset, 0 ) );
+			offset += params.numFrames;
+		}
+	}
+	return pMem;
+}
+
+// The blend value of a frame is the value of the next one, see ExtractAnimValue()
+inline bool CDecodedAnimSection::GetRotation( int iAnim, int frame, fltx4 &v1, fltx4 &v2 ) const
+{
+	const decodedanimbone_t &anim = Anims()[iAnim];
+	if ( frame + 1 >= anim.numRotFrames )
+		return false;
+	v1 = LoadUnalignedSIMD( Frame( anim.rotOffset, frame ) );
+	v2 = LoadUnalignedSIMD( Frame( anim.rotOffset, frame + 1 ) );
+	return true;
+}
+
+inline bool CDecodedAnimSection::GetRotation( int iAnim, int frame, fltx4 &v1 ) const
+{
+	const decodedanimbone_t &anim = Anims()[iAnim];
+	if ( frame >= anim.numRotFrames )
+		return false;
+	v1 = LoadUnalignedSIMD( Frame( anim.rotOffset, frame ) );
+	return true;
+}
+
+inline bool CDecodedAnimSection::GetPosition( int iAnim, int frame, fltx4 &v1, fltx4 &v2 ) const
+{
+	const decodedanimbone_t &anim = Anims()[iAnim];
+	if ( frame + 1 >= anim.numPosFrames )
+		return false;
+	v1 = LoadUnalignedSIMD( Frame( anim.posOffset, frame ) );
+	v2 = LoadUnalignedSIMD( Frame( anim.posOffset, frame + 1 ) );
+	return true;
+}
+
+inline bool CDecodedAnimSection::GetPosition( int iAnim, int frame, fltx4 &v1 ) const
+{
+	const decodedanimbone_t &anim = Anims()[iAnim];
+	if ( frame >= anim.numPosFrames )
+		return false;
+	v1 = LoadUnalignedSIMD( Frame( anim.posOffset, frame ) );
+	return true;
+}
+
+static bool DecodedAnimKeyLessFunc( const decodedanimkey_t &lhs, const decodedanimkey_t &rhs )
+{
+	if ( lhs.pAnimdesc != rhs.pAnimdesc )
+		return lhs.pAnimdesc < rhs.pAnimdesc;
+	if ( lhs.section != rhs.section )
+		return lhs.section < rhs.section;
+	return lhs.checksum < rhs.checksum;
+}
+
+#define DECODEDANIM_SHARD_BITS	2
+
+class CDecodedAnimSectionMap : public CUtlMap<decodedanimkey_t, memhandle_t>
+{
+public:
+	CDecodedAnimSectionMap() : CUtlMap<decodedanimkey_t, memhandle_t>( DecodedAnimKeyLessFunc ) {}
+};
+
+// Construct singletons. A section is created in the shard its key hashes to, and listed in
+// that shard's map, which the shard's mutex protects. The maps are declared first so they
+// outlive the sections the cache destroys on shutdown.
+static CDecodedAnimSectionMap g_DecodedAnimSections[ 1 << DECODEDANIM_SHARD_BITS ];
+static CDataManagerSharded<CDecodedAnimSection, decodedanimparams_t, CDecodedAnimSection *, CThreadFastMutex, DECODEDANIM_SHARD_BITS> g_DecodedAnimCache( 2 * 1024 * 1024, "decoded anim cache" );
+static CInterlockedInt g_nDecodedAnimHits;
+static CInterlockedInt g_nDecodedAnimMisses;
+
+static inline int DecodedAnimShard( const decodedanimkey_t &key )
+{
+	unsigned int hash = (unsigned int)( (uintp)key.pAnimdesc >> 4 ) ^ ( (unsigned int)key.section * 2654435761u );
+	return ( hash ^ ( hash >> 16 ) ) & ( ( 1 << DECODEDANIM_SHARD_BITS ) - 1 );
+}
+
+// Unlists the section when it is evicted or flushed. Flushes destroy sections after
+// releasing the shard's mutex, and by then the key may list a newer section.
+void CDecodedAnimSection::DestroyResource()
+{
+	int iShard = DecodedAnimShard( m_key );
+	CDecodedAnimSectionMap &sections = g_DecodedAnimSections[iShard];
+	{
+		AUTO_LOCK( g_DecodedAnimCache.GetShard( iShard ).AccessMutex() );
+		unsigned short i = sections.Find( m_key );
+		if ( i != sections.InvalidIndex() && sections[i] == m_hSelf )
+		{
+			sections.RemoveAt( i );
+		}
+	}
+	free( this );
+}
+
+//-----------------------------------------------------------------------------
+// Drops the decoded sections that aren't in use, so sections of models that
+// were unloaded don't stay in the cache. Called on level shutdown.
+//-----------------------------------------------------------------------------
+void Studio_FlushDecodedAnimCache()
+{
+	g_DecodedAnimCache.FlushAllUnlocked();
+}
+
+//-----------------------------------------------------------------------------
+// Locks the decoded data of the section animdesc.pAnim() returned for iFrame,
+// for as long as this is in scope. Get() returns NULL if there isn't any.
+//-----------------------------------------------------------------------------
+class CDecodedAnimSectionLock
+{
+public:
+	CDecodedAnimSectionLock( const studiohdr_t *pAnimStudioHdr, const mstudioanimdesc_t &animdesc, int iFrame, int iLocalFrame, const mstudioanim_t *panim );
+	~CDecodedAnimSectionLock();
+
+	const CDecodedAnimSection *Get() const { return m_pSection; }
+
+private:
+	memhandle_t				m_hSection;
+	CDecodedAnimSection		*m_pSection;
+};
+
+CDecodedAnimSectionLock::CDecodedAnimSectionLock( const studiohdr_t *pAnimStudioHdr, const mstudioanimdesc_t &animdesc, int iFrame, int iLocalFrame, const mstudioanim_t *panim )
+{
+	m_hSection = INVALID_MEMHANDLE;
+	m_pSection = NULL;
+
+	if ( !panim || !anim_decodecache.GetBool() )
+		return;
+
+	// Same section and frame range as mstudioanimdesc_t::pAnim()
+	int section = 0;
+	int numFrames = animdesc.numframes;
+	if ( animdesc.sectionframes != 0 )
+	{
+		if ( animdesc.numframes > animdesc.sectionframes && iFrame == animdesc.numframes - 1 )
+		{
+			// last frame on long anims is stored separately
+			section = ( animdesc.numframes / animdesc.sectionframes ) + 1;
+			numFrames = 1;
+			if ( iLocalFrame != 0 )
+				return;
+		}
+		else
+		{
+			section = iFrame / animdesc.sectionframes;
+			numFrames = MIN( animdesc.sectionframes, animdesc.numframes - 1 - section * animdesc.sectionframes ) + 1;
+			if ( iLocalFrame != iFrame - section * animdesc.sectionframes )
+				return;
+		}
+
+		// pAnim() falls back to an earlier section while this one is loading
+		const mstudioanimsections_t *pSection = animdesc.pSection( section );
+		if ( pSection->animblock != 0 && panim != animdesc.pAnimBlock( pSection->animblock, pSection->animindex ) )
+			return;
+	}
+
+	if ( numFrames <= 0 || numFrames > 0xffff )
+		return;
+
+	decodedanimkey_t key;
+	key.pAnimdesc = &animdesc;
+	key.section = section;
+	key.checksum = pAnimStudioHdr->checksum;
+
+	int iShard = DecodedAnimShard( key );
+	CDecodedAnimSectionMap &sections = g_DecodedAnimSections[iShard];
+	AUTO_LOCK( g_DecodedAnimCache.GetShard( iShard ).AccessMutex() );
+
+	unsigned short i = sections.Find( key );
+	if ( i != sections.InvalidIndex() )
+	{
+		m_hSection = sections[i];
+		m_pSection = g_DecodedAnimCache.LockResource( m_hSection );
+		if ( m_pSection )
+		{
+			++g_nDecodedAnimHits;
+			return;
+		}
+
+		// destroyed by a flush that hasn't unlisted it yet
+		sections.RemoveAt( i );
+	}
+
+	++g_nDecodedAnimMisses;
+
+	decodedanimparams_t params;
+	params.key = key;
+	params.pAnim = panim;
+	params.numFrames = numFrames;
+	params.numAnims = 0;
+	for ( const mstudioanim_t *pCount = panim; pCount; pCount = pCount->pNext() )
+	{
+		params.numAnims++;
+	}
+
+	m_hSection = g_DecodedAnimCache.GetShard( iShard ).CreateResource( params, true );
+	m_pSection = g_DecodedAnimCache.GetResource_NoLock( m_hSection );
+	m_pSection->SetHandle( m_hSection );
+	sections.Insert( key, m_hSection );
+}
+
+CDecodedAnimSectionLock::~CDecodedAnimSectionLock()
+{
+	if ( m_pSection )
+	{
+		g_DecodedAnimCache.UnlockResource( m_hSection );
+	}
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_anim_decodecache_stats, "Print decoded animation cache statistics." )
+#else
+CON_COMMAND( anim_decodecache_stats, "Print decoded animation cache statistics." )
+#endif
+{
+	int nHits = g_nDecodedAnimHits;
+	int nMisses = g_nDecodedAnimMisses;
+	int nLookups = nHits + nMisses;
+
+	int nSections = 0;
+	for ( int i = 0; i < ARRAYSIZE( g_DecodedAnimSections ); i++ )
+	{
+		AUTO_LOCK( g_DecodedAnimCache.GetShard( i ).AccessMutex() );
+		nSections += g_DecodedAnimSections[i].Count();
+	}
+
+	Msg( "Decoded animation cache: %d hits, %d misses (%.1f%% hit rate), %d sections cached, %u of %u bytes used\n",
+		nHits, nMisses, nLookups ? 100.0f * nHits / nLookups : 0.0f, nSections,
+		g_DecodedAnimCache.UsedSize(), g_DecodedAnimCache.TargetSize() );
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		g_nDecodedAnimHits = 0;
+		g_nDecodedAnimMisses = 0;
+	}
+}
+
+// Each DLL links its own tier1 and so has its own list of data managers. These
+// only see the caches of the DLL they're built into, not the engine's.
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_datamanager_stats, "Print hits, misses, evictions and memory of each data manager cache in the client DLL. Add 'reset' to clear the counters." )
+#else
+CON_COMMAND( datamanager_stats, "Print hits, misses, evictions and memory of each data manager cache in the server DLL. Add 'reset' to clear the counters." )
+#endif
+{
+	bool bReset = ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) );
+
+	Msg( "%-24s %10s %10s %6s %10s %10s %12s %17s %s\n", "cache", "hits", "misses", "hit%", "creates", "evictions", "evicted KB", "used/target KB", "probation/protected/locked" );
+	for ( CDataManagerBase *pManager = CDataManagerBase::GetFirstManager(); pManager; pManager = pManager->GetNextManager() )
+	{
+		datamanagerstats_t stats;
+		pManager->GetStats( stats );
+
+		char name[64];
+		Q_snprintf( name, sizeof( name ), pManager->GetShard() ? "%s [%d]" : "%s", pManager->GetName() ? pManager->GetName() : "unnamed", pManager->GetShard() );
+
+		unsigned int nLookups = stats.hits + stats.misses;
+		Msg( "%-24s %10u %10u %5.1f%% %10u %10u %12u %8u/%-8u %u/%u/%u\n", name, stats.hits, stats.misses, nLookups ? 100.0f * stats.hits / nLookups : 0.0f,
+			stats.creates, stats.evictions, stats.evictedBytes / 1024, stats.usedBytes / 1024, stats.targetBytes / 1024,
+			stats.probationCount, stats.protectedCount, stats.lockedCount );
+
+		if ( bReset )
+		{
+			pManager->ResetStats();
+		}
+	}
+}
+
+// Loads the three floats of a Vector, without reading past its end like LoadUnaligned3SIMD
+static inline fltx4 LoadVectorSIMD( const Vector &v )
+{
+	VectorAligned va( v.x, v.y, v.z );
+	return LoadAlignedSIMD( va );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: return a sub frame rotation for a single bone
 //-----------------------------------------------------------------------------
 void CalcBoneQuaternion( int frame, float s, 
 						const Quaternion &baseQuat, const RadianEuler &baseRot, const Vector &baseRotScale, 
 						int iBaseFlags, const Quaternion &baseAlignment, 
-						const mstudioanim_t *panim, Quaternion &q )
+						const mstudioanim_t *panim, Quaternion &q,
+						const CDecodedAnimSection *pDecoded = NULL, int iDecodedAnim = 0 )
 {
 	if ( panim->flags & STUDIO_ANIM_RAWROT )
 	{
@@ -409,10 +859,20 @@ void CalcBoneQuaternion( int frame, float s,
 	{
 		QuaternionAligned	q1, q2;
 		RadianEuler			angle1, angle2;
+		fltx4				v1, v2;
 
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x, angle2.x );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y, angle2.y );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z, angle2.z );
+		if ( pDecoded && pDecoded->GetRotation( iDecodedAnim, frame, v1, v2 ) )
+		{
+			fltx4 scale = LoadVectorSIMD( baseRotScale );
+			StoreUnaligned3SIMD( &angle1.x, MulSIMD( v1, scale ) );
+			StoreUnaligned3SIMD( &angle2.x, MulSIMD( v2, scale ) );
+		}
+		else
+		{
+			ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x, angle2.x );
+			ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y, angle2.y );
+			ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z, angle2.z );
+		}
 
 		if (!(panim->flags & STUDIO_ANIM_DELTA))
 		{
@@ -448,10 +908,18 @@ void CalcBoneQuaternion( int frame, float s,
 	else
 	{
 		RadianEuler			angle;
+		fltx4				v1;
 
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle.x );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle.y );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle.z );
+		if ( pDecoded && pDecoded->GetRotation( iDecodedAnim, frame, v1 ) )
+		{
+			StoreUnaligned3SIMD( &angle.x, MulSIMD( v1, LoadVectorSIMD( baseRotScale ) ) );
+		}
+		else
+		{
+			ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle.x );
+			ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle.y );
+			ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle.z );
+		}
 
 		if (!(panim->flags & STUDIO_ANIM_DELTA))
 		{
@@ -476,15 +944,16 @@ void CalcBoneQuaternion( int frame, float s,
 inline void CalcBoneQuaternion( int frame, float s, 
 						const mstudiobone_t *pBone,
 						const mstudiolinearbone_t *pLinearBones,
-						const mstudioanim_t *panim, Quaternion &q )
+						const mstudioanim_t *panim, Quaternion &q,
+						const CDecodedAnimSection *pDecoded = NULL, int iDecodedAnim = 0 )
 {
 	if (pLinearBones)
 	{
-		CalcBoneQuaternion( frame, s, pLinearBones->quat(panim->bone), pLinearBones->rot(panim->bone), pLinearBones->rotscale(panim->bone), pLinearBones->flags(panim->bone), pLinearBones->qalignment(panim->bone), panim, q );
+		CalcBoneQuaternion( frame, s, pLinearBones->quat(panim->bone), pLinearBones->rot(panim->bone), pLinearBones->rotscale(panim->bone), pLinearBones->flags(panim->bone), pLinearBones->qalignment(panim->bone), panim, q, pDecoded, iDecodedAnim );
 	}
 	else
 	{
-		CalcBoneQuaternion( frame, s, pBone->quat, pBone->rot, pBone->rotscale, pBone->flags, pBone->qAlignment, panim, q );
+		CalcBoneQuaternion( frame, s, pBone->quat, pBone->rot, pBone->rotscale, pBone->flags, pBone->qAlignment, panim, q, pDecoded, iDecodedAnim );
 	}
 }
 
@@ -497,7 +966,8 @@ inline void CalcBoneQuaternion( int frame, float s,
 //-----------------------------------------------------------------------------
 void CalcBonePosition(	int frame, float s,
 						const Vector &basePos, const Vector &baseBoneScale, 
-						const mstudioanim_t *panim, Vector &pos	)
+						const mstudioanim_t *panim, Vector &pos,
+						const CDecodedAnimSection *pDecoded = NULL, int iDecodedAnim = 0 )
 {
 	if (panim->flags & STUDIO_ANIM_RAWPOS)
 	{
@@ -521,21 +991,43 @@ void CalcBonePosition(	int frame, float s,
 
 	mstudioanim_valueptr_t *pPosV = panim->pPosV();
 	int					j;
+	fltx4				decoded1, decoded2;
 
 	if (s > 0.001f)
 	{
-		float v1, v2;
-		for (j = 0; j < 3; j++)
+		if ( pDecoded && pDecoded->GetPosition( iDecodedAnim, frame, decoded1, decoded2 ) )
+		{
+			fltx4 scale = LoadVectorSIMD( baseBoneScale );
+			Vector v1, v2;
+			StoreUnaligned3SIMD( v1.Base(), MulSIMD( decoded1, scale ) );
+			StoreUnaligned3SIMD( v2.Base(), MulSIMD( decoded2, scale ) );
+			for (j = 0; j < 3; j++)
+			{
+				pos[j] = v1[j] * (1.0 - s) + v2[j] * s;
+			}
+		}
+		else
 		{
-			ExtractAnimValue( frame, pPosV->pAnimvalue( j ), baseBoneScale[j], v1, v2 );
-			pos[j] = v1 * (1.0 - s) + v2 * s;
+			float v1, v2;
+			for (j = 0; j < 3; j++)
+			{
+				ExtractAnimValue( frame, pPosV->pAnimvalue( j ), baseBoneScale[j], v1, v2 );
+				pos[j] = v1 * (1.0 - s) + v2 * s;
+			}
 		}
 	}
 	else
 	{
-		for (j = 0; j < 3; j++)
+		if ( pDecoded && pDecoded->GetPosition( iDecodedAnim, frame, decoded1 ) )
+		{
+			StoreUnaligned3SIMD( pos.Base(), MulSIMD( decoded1, LoadVectorSIMD( baseBoneScale ) ) );
+		}
+		else
 		{
-			ExtractAnimValue( frame, pPosV->pAnimvalue( j ), baseBoneScale[j], pos[j] );
+			for (j = 0; j < 3; j++)
+			{
+				ExtractAnimValue( frame, pPosV->pAnimvalue( j ), baseBoneScale[j], pos[j] );
+			}
 		}
 	}
 
@@ -553,15 +1045,16 @@ void CalcBonePosition(	int frame, float s,
 inline void CalcBonePosition( int frame, float s, 
 						const mstudiobone_t *pBone,
 						const mstudiolinearbone_t *pLinearBones,
-						const mstudioanim_t *panim, Vector &pos )
+						const mstudioanim_t *panim, Vector &pos,
+						const CDecodedAnimSection *pDecoded = NULL, int iDecodedAnim = 0 )
 {
 	if (pLinearBones)
 	{
-		CalcBonePosition( frame, s, pLinearBones->pos(panim->bone), pLinearBones->posscale(panim->bone), panim, pos );
+		CalcBonePosition( frame, s, pLinearBones->pos(panim->bone), pLinearBones->posscale(panim->bone), panim, pos, pDecoded, iDecodedAnim );
 	}
 	else
 	{
-		CalcBonePosition( frame, s, pBone->pos, pBone->posscale, panim, pos );
+		CalcBonePosition( frame, s, pBone->pos, pBone->posscale, panim, pos, pDecoded, iDecodedAnim );
 	}
 }
 
@@ -965,8 +1458,11 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 		return;
 	}
 
+	CDecodedAnimSectionLock decoded( pAnimStudioHdr, animdesc, iFrame, iLocalFrame, panim );
+	const CDecodedAnimSection *pDecoded = decoded.Get();
+
 	// FIXME: change encoding so that bone -1 is never the case
-	while (panim && panim->bone < 255)
+	for ( int iAnim = 0; panim && panim->bone < 255; iAnim++ )
 	{
 		j = pAnimGroup->masterBone[panim->bone];
 		if ( j >= 0 && ( pStudioHdr->boneFlags(j) & boneMask ) )
@@ -975,8 +1471,8 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 
 			if (k >= 0 && pweight[k] > 0.0f)
 			{
-				CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j] );
-				CalcBonePosition  ( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pos[j] );
+				CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j], pDecoded, iAnim );
+				CalcBonePosition  ( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pos[j], pDecoded, iAnim );
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
 #endif
@@ -1096,6 +1592,10 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		return;
 	}
 
+	CDecodedAnimSectionLock decoded( pStudioHdr->GetRenderHdr(), animdesc, iFrame, iLocalFrame, panim );
+	const CDecodedAnimSection *pDecoded = decoded.Get();
+	int iAnim = 0;
+
 	// BUGBUG: the sequence, the anim, and the model can have all different bone mappings.
 	for (i = 0; i < pStudioHdr->numbones(); i++, pbone++, pweight++)
 	{
@@ -1103,14 +1603,15 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		{
 			if (*pweight > 0 && (pStudioHdr->boneFlags(i) & boneMask))
 			{
-				CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i] );
-				CalcBonePosition  ( iLocalFrame, s, pbone, pLinearBones, panim, pos[i] );
+				CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i], pDecoded, iAnim );
+				CalcBonePosition  ( iLocalFrame, s, pbone, pLinearBones, panim, pos[i], pDecoded, iAnim );
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
 				pStudioHdr->m_nPerfUsedBones++;
 #endif
 			}
 			panim = panim->pNext();
+			iAnim++;
 		}
 		else if (*pweight > 0 && (pStudioHdr->boneFlags(i) & boneMask))
 		{
@@ -1246,6 +1747,571 @@ FORCEINLINE fltx4 QuaternionAccumulateSIMD( const fltx4 &p, float s, const fltx4
 
 
 
+//-----------------------------------------------------------------------------
+// SoA pose blending
+//
+// SlerpBones, BlendBones and ScaleBones blend whole poses, but the Quaternion
+// and Vector arrays they're given are AoS, and the AoS quaternion SIMD code
+// above is 360 only since it spends most of its time shuffling on PC.  Instead
+// the poses are converted to blocks of four bones, one fltx4 per component, and
+// the kernels below blend four bones with each instruction.  Lanes with a zero
+// weight keep their original bits, so the results are written straight back.
+//-----------------------------------------------------------------------------
+static ConVar anim_soablend( "anim_soablend", "1", 0, "Blend bone poses four bones at a time." );
+
+struct FourQuaternionsSoA_t
+{
+	fltx4 x, y, z, w;
+};
+
+struct BonePoseBlockSoA_t
+{
+	FourQuaternionsSoA_t q;
+	fltx4 px, py, pz;
+};
+
+class CBonePoseSoA
+{
+public:
+	static int BlockCount( int nBoneCount ) { return ( nBoneCount + 3 ) >> 2; }
+
+	void Load( int nBoneCount, const Quaternion *q, const Vector *pos );
+	void Store( int nBoneCount, Quaternion *q, Vector *pos ) const;
+
+	BonePoseBlockSoA_t &operator[]( int i ) { return m_Blocks[i]; }
+	const BonePoseBlockSoA_t &operator[]( int i ) const { return m_Blocks[i]; }
+
+private:
+	BonePoseBlockSoA_t m_Blocks[ MAXSTUDIOBONES / 4 ];
+};
+
+void CBonePoseSoA::Load( int nBoneCount, const Quaternion *q, const Vector *pos )
+{
+	int nBlocks = BlockCount( nBoneCount );
+	for ( int b = 0; b < nBlocks; b++ )
+	{
+		BonePoseBlockSoA_t &block = m_Blocks[b];
+		int i = b * 4;
+		if ( i + 4 < nBoneCount )
+		{
+			block.q.x = LoadUnalignedSIMD( q[i].Base() );
+			block.q.y = LoadUnalignedSIMD( q[i+1].Base() );
+			block.q.z = LoadUnalignedSIMD( q[i+2].Base() );
+			block.q.w = LoadUnalignedSIMD( q[i+3].Base() );
+			TransposeSIMD( block.q.x, block.q.y, block.q.z, block.q.w );
+
+			// LoadUnaligned3SIMD reads one float past each Vector, which is still in the array here
+			fltx4 pw;
+			block.px = LoadUnaligned3SIMD( pos[i].Base() );
+			block.py = LoadUnaligned3SIMD( pos[i+1].Base() );
+			block.pz = LoadUnaligned3SIMD( pos[i+2].Base() );
+			pw = LoadUnaligned3SIMD( pos[i+3].Base() );
+			TransposeSIMD( block.px, block.py, block.pz, pw );
+			continue;
+		}
+
+		// last block, unused lanes are identity bones
+		block.q.x = block.q.y = block.q.z = Four_Zeros;
+		block.q.w = Four_Ones;
+		block.px = block.py = block.pz = Four_Zeros;
+		for ( int k = 0; i + k < nBoneCount; k++ )
+		{
+			SubFloat( block.q.x, k ) = q[i+k].x;
+			SubFloat( block.q.y, k ) = q[i+k].y;
+			SubFloat( block.q.z, k ) = q[i+k].z;
+			SubFloat( block.q.w, k ) = q[i+k].w;
+			SubFloat( block.px, k ) = pos[i+k].x;
+			SubFloat( block.py, k ) = pos[i+k].y;
+			SubFloat( block.pz, k ) = pos[i+k].z;
+		}
+	}
+}
+
+void CBonePoseSoA::Store( int nBoneCount, Quaternion *q, Vector *pos ) const
+{
+	int nBlocks = BlockCount( nBoneCount );
+	for ( int b = 0; b < nBlocks; b++ )
+	{
+		const BonePoseBlockSoA_t &block = m_Blocks[b];
+		fltx4 rot[4] = { block.q.x, block.q.y, block.q.z, block.q.w };
+		fltx4 trans[4] = { block.px, block.py, block.pz, Four_Zeros };
+		TransposeSIMD( rot[0], rot[1], rot[2], rot[3] );
+		TransposeSIMD( trans[0], trans[1], trans[2], trans[3] );
+
+		int i = b * 4;
+		int nCount = MIN( 4, nBoneCount - i );
+		for ( int k = 0; k < nCount; k++ )
+		{
+			StoreUnalignedSIMD( q[i+k].Base(), rot[k] );
+			StoreUnaligned3SIMD( pos[i+k].Base(), trans[k] );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: per lane versions of QuaternionAlign, QuaternionNormalize,
+//			QuaternionScale and QuaternionMult.  The operations are done in the
+//			same order as the scalar code.
+//-----------------------------------------------------------------------------
+FORCEINLINE void QuaternionAlignSoA( const FourQuaternionsSoA_t &p, FourQuaternionsSoA_t &q, const fltx4 &mask )
+{
+	fltx4 d, a, b;
+	d = SubSIMD( p.x, q.x );
+	a = MulSIMD( d, d );
+	d = SubSIMD( p.y, q.y );
+	a = AddSIMD( a, MulSIMD( d, d ) );
+	d = SubSIMD( p.z, q.z );
+	a = AddSIMD( a, MulSIMD( d, d ) );
+	d = SubSIMD( p.w, q.w );
+	a = AddSIMD( a, MulSIMD( d, d ) );
+
+	d = AddSIMD( p.x, q.x );
+	b = MulSIMD( d, d );
+	d = AddSIMD( p.y, q.y );
+	b = AddSIMD( b, MulSIMD( d, d ) );
+	d = AddSIMD( p.z, q.z );
+	b = AddSIMD( b, MulSIMD( d, d ) );
+	d = AddSIMD( p.w, q.w );
+	b = AddSIMD( b, MulSIMD( d, d ) );
+
+	fltx4 flip = AndSIMD( CmpGtSIMD( a, b ), mask );
+	q.x = MaskedAssign( flip, NegSIMD( q.x ), q.x );
+	q.y = MaskedAssign( flip, NegSIMD( q.y ), q.y );
+	q.z = MaskedAssign( flip, NegSIMD( q.z ), q.z );
+	q.w = MaskedAssign( flip, NegSIMD( q.w ), q.w );
+}
+
+FORCEINLINE void QuaternionNormalizeSoA( FourQuaternionsSoA_t &q )
+{
+	fltx4 radius = MulSIMD( q.x, q.x );
+	radius = AddSIMD( radius, MulSIMD( q.y, q.y ) );
+	radius = AddSIMD( radius, MulSIMD( q.z, q.z ) );
+	radius = AddSIMD( radius, MulSIMD( q.w, q.w ) );
+
+	fltx4 nonzero = CmpGtSIMD( radius, Four_Zeros );
+	fltx4 iradius = DivSIMD( Four_Ones, SqrtSIMD( radius ) );
+	q.x = MaskedAssign( nonzero, MulSIMD( q.x, iradius ), q.x );
+	q.y = MaskedAssign( nonzero, MulSIMD( q.y, iradius ), q.y );
+	q.z = MaskedAssign( nonzero, MulSIMD( q.z, iradius ), q.z );
+	q.w = MaskedAssign( nonzero, MulSIMD( q.w, iradius ), q.w );
+}
+
+FORCEINLINE void QuaternionScaleSoA( const FourQuaternionsSoA_t &p, const fltx4 &t, FourQuaternionsSoA_t &q )
+{
+	fltx4 sinom = MulSIMD( p.x, p.x );
+	sinom = AddSIMD( sinom, MulSIMD( p.y, p.y ) );
+	sinom = AddSIMD( sinom, MulSIMD( p.z, p.z ) );
+	sinom = MinSIMD( SqrtSIMD( sinom ), Four_Ones );
+
+	fltx4 sinsom = SinSIMD( MulSIMD( ArcSinSIMD( sinom ), t ) );
+	fltx4 scale = DivSIMD( sinsom, AddSIMD( sinom, Four_Epsilons ) );
+	q.x = MulSIMD( p.x, scale );
+	q.y = MulSIMD( p.y, scale );
+	q.z = MulSIMD( p.z, scale );
+
+	// rescale rotation, keeping its sign
+	fltx4 r = SubSIMD( Four_Ones, MulSIMD( sinsom, sinsom ) );
+	r = SqrtSIMD( MaxSIMD( r, Four_Zeros ) );
+	q.w = MaskedAssign( CmpLtSIMD( p.w, Four_Zeros ), NegSIMD( r ), r );
+}
+
+FORCEINLINE void QuaternionMultSoA( const FourQuaternionsSoA_t &p, const FourQuaternionsSoA_t &q, FourQuaternionsSoA_t &qt )
+{
+	FourQuaternionsSoA_t q2 = q;
+	QuaternionAlignSoA( p, q2, LoadAlignedSIMD( g_SIMD_AllOnesMask ) );
+
+	qt.x = AddSIMD( SubSIMD( AddSIMD( MulSIMD( p.x, q2.w ), MulSIMD( p.y, q2.z ) ), MulSIMD( p.z, q2.y ) ), MulSIMD( p.w, q2.x ) );
+	qt.y = AddSIMD( AddSIMD( SubSIMD( MulSIMD( p.y, q2.w ), MulSIMD( p.x, q2.z ) ), MulSIMD( p.z, q2.x ) ), MulSIMD( p.w, q2.y ) );
+	qt.z = AddSIMD( AddSIMD( SubSIMD( MulSIMD( p.x, q2.y ), MulSIMD( p.y, q2.x ) ), MulSIMD( p.z, q2.w ) ), MulSIMD( p.w, q2.z ) );
+	qt.w = AddSIMD( SubSIMD( SubSIMD( NegSIMD( MulSIMD( p.x, q2.x ) ), MulSIMD( p.y, q2.y ) ), MulSIMD( p.z, q2.z ) ), MulSIMD( p.w, q2.w ) );
+}
+
+FORCEINLINE void BlendPositionSoA( BonePoseBlockSoA_t &pose1, const BonePoseBlockSoA_t &pose2, const fltx4 &s1, const fltx4 &s2, const fltx4 &active )
+{
+	pose1.px = MaskedAssign( active, AddSIMD( MulSIMD( pose1.px, s1 ), MulSIMD( pose2.px, s2 ) ), pose1.px );
+	pose1.py = MaskedAssign( active, AddSIMD( MulSIMD( pose1.py, s1 ), MulSIMD( pose2.py, s2 ) ), pose1.py );
+	pose1.pz = MaskedAssign( active, AddSIMD( MulSIMD( pose1.pz, s1 ), MulSIMD( pose2.pz, s2 ) ), pose1.pz );
+}
+
+FORCEINLINE void AssignRotationSoA( BonePoseBlockSoA_t &pose1, const FourQuaternionsSoA_t &q, const fltx4 &active )
+{
+	pose1.q.x = MaskedAssign( active, q.x, pose1.q.x );
+	pose1.q.y = MaskedAssign( active, q.y, pose1.q.y );
+	pose1.q.z = MaskedAssign( active, q.z, pose1.q.z );
+	pose1.q.w = MaskedAssign( active, q.w, pose1.q.w );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: blend kernels.  pWeights holds the weight of pose2 for each bone,
+//			pAlign is non-zero for the bones without BONE_FIXED_ALIGNMENT.
+//			Both are padded with zeros to a whole number of blocks.
+//-----------------------------------------------------------------------------
+
+// QuaternionSlerp( q2, q1, 1 - s2 ) and a linear blend of the positions
+static void SlerpPoseSoA( CBonePoseSoA &pose1, const CBonePoseSoA &pose2, int nBoneCount, const float *pWeights, const float *pAlign )
+{
+	const fltx4 epsilon = ReplicateX4( 0.000001f );
+	const fltx4 halfPi = ReplicateX4( 0.5f * M_PI );
+
+	int nBlocks = CBonePoseSoA::BlockCount( nBoneCount );
+	for ( int b = 0; b < nBlocks; b++ )
+	{
+		fltx4 s2 = LoadUnalignedSIMD( pWeights + b * 4 );
+		fltx4 active = CmpGtSIMD( s2, Four_Zeros );
+		if ( IsAllZeros( active ) )
+			continue;
+
+		fltx4 s1 = SubSIMD( Four_Ones, s2 );
+		fltx4 sclp1 = SubSIMD( Four_Ones, s1 );
+
+		const FourQuaternionsSoA_t &p = pose2[b].q;
+		FourQuaternionsSoA_t q = pose1[b].q;
+		QuaternionAlignSoA( p, q, CmpGtSIMD( LoadUnalignedSIMD( pAlign + b * 4 ), Four_Zeros ) );
+
+		fltx4 cosom = MulSIMD( p.x, q.x );
+		cosom = AddSIMD( cosom, MulSIMD( p.y, q.y ) );
+		cosom = AddSIMD( cosom, MulSIMD( p.z, q.z ) );
+		cosom = AddSIMD( cosom, MulSIMD( p.w, q.w ) );
+
+		// close quaternions are blended linearly, the rest are slerped
+		fltx4 sclp = sclp1;
+		fltx4 sclq = s1;
+		fltx4 slerp = CmpGtSIMD( SubSIMD( Four_Ones, cosom ), epsilon );
+		if ( !IsAllZeros( slerp ) )
+		{
+			fltx4 omega = ArcCosSIMD( cosom );
+			fltx4 sinom = SinSIMD( omega );
+			sclp = MaskedAssign( slerp, DivSIMD( SinSIMD( MulSIMD( sclp1, omega ) ), sinom ), sclp );
+			sclq = MaskedAssign( slerp, DivSIMD( SinSIMD( MulSIMD( s1, omega ) ), sinom ), sclq );
+		}
+
+		FourQuaternionsSoA_t qt;
+		qt.x = AddSIMD( MulSIMD( sclp, p.x ), MulSIMD( sclq, q.x ) );
+		qt.y = AddSIMD( MulSIMD( sclp, p.y ), MulSIMD( sclq, q.y ) );
+		qt.z = AddSIMD( MulSIMD( sclp, p.z ), MulSIMD( sclq, q.z ) );
+		qt.w = AddSIMD( MulSIMD( sclp, p.w ), MulSIMD( sclq, q.w ) );
+
+		// opposite quaternions slerp through a perpendicular one
+		fltx4 opposite = CmpLeSIMD( AddSIMD( Four_Ones, cosom ), epsilon );
+		if ( !IsAllZeros( opposite ) )
+		{
+			fltx4 oppp = SinSIMD( MulSIMD( sclp1, halfPi ) );
+			fltx4 oppq = SinSIMD( MulSIMD( s1, halfPi ) );
+			qt.x = MaskedAssign( opposite, AddSIMD( MulSIMD( oppp, p.x ), MulSIMD( oppq, NegSIMD( q.y ) ) ), qt.x );
+			qt.y = MaskedAssign( opposite, AddSIMD( MulSIMD( oppp, p.y ), MulSIMD( oppq, q.x ) ), qt.y );
+			qt.z = MaskedAssign( opposite, AddSIMD( MulSIMD( oppp, p.z ), MulSIMD( oppq, NegSIMD( q.w ) ) ), qt.z );
+			qt.w = MaskedAssign( opposite, q.z, qt.w );
+		}
+
+		AssignRotationSoA( pose1[b], qt, active );
+		BlendPositionSoA( pose1[b], pose2[b], s1, s2, active );
+	}
+}
+
+// QuaternionMA( q1, s2, q2 ) for STUDIO_POST, QuaternionSM( s2, q2, q1 ) otherwise, and positions added
+static void AddPoseSoA( CBonePoseSoA &pose1, const CBonePoseSoA &pose2, int nBoneCount, const float *pWeights, bool bPost )
+{
+	int nBlocks = CBonePoseSoA::BlockCount( nBoneCount );
+	for ( int b = 0; b < nBlocks; b++ )
+	{
+		fltx4 s2 = LoadUnalignedSIMD( pWeights + b * 4 );
+		fltx4 active = CmpGtSIMD( s2, Four_Zeros );
+		if ( IsAllZeros( active ) )
+			continue;
+
+		FourQuaternionsSoA_t scaled, qt;
+		QuaternionScaleSoA( pose2[b].q, s2, scaled );
+		if ( bPost )
+		{
+			QuaternionMultSoA( pose1[b].q, scaled, qt );
+		}
+		else
+		{
+			QuaternionMultSoA( scaled, pose1[b].q, qt );
+		}
+		QuaternionNormalizeSoA( qt );
+
+		AssignRotationSoA( pose1[b], qt, active );
+		BlendPositionSoA( pose1[b], pose2[b], Four_Ones, s2, active );
+	}
+}
+
+// QuaternionBlend( q2, q1, 1 - s2 ) and a linear blend of the positions
+static void BlendPoseSoA( CBonePoseSoA &pose1, const CBonePoseSoA &pose2, int nBoneCount, const float *pWeights, const float *pAlign )
+{
+	int nBlocks = CBonePoseSoA::BlockCount( nBoneCount );
+	for ( int b = 0; b < nBlocks; b++ )
+	{
+		fltx4 s2 = LoadUnalignedSIMD( pWeights + b * 4 );
+		fltx4 active = CmpGtSIMD( s2, Four_Zeros );
+		if ( IsAllZeros( active ) )
+			continue;
+
+		fltx4 s1 = SubSIMD( Four_Ones, s2 );
+		fltx4 sclp = SubSIMD( Four_Ones, s1 );
+
+		const FourQuaternionsSoA_t &p = pose2[b].q;
+		FourQuaternionsSoA_t q = pose1[b].q;
+		QuaternionAlignSoA( p, q, CmpGtSIMD( LoadUnalignedSIMD( pAlign + b * 4 ), Four_Zeros ) );
+
+		FourQuaternionsSoA_t qt;
+		qt.x = AddSIMD( MulSIMD( sclp, p.x ), MulSIMD( s1, q.x ) );
+		qt.y = AddSIMD( MulSIMD( sclp, p.y ), MulSIMD( s1, q.y ) );
+		qt.z = AddSIMD( MulSIMD( sclp, p.z ), MulSIMD( s1, q.z ) );
+		qt.w = AddSIMD( MulSIMD( sclp, p.w ), MulSIMD( s1, q.w ) );
+		QuaternionNormalizeSoA( qt );
+
+		AssignRotationSoA( pose1[b], qt, active );
+		BlendPositionSoA( pose1[b], pose2[b], s1, s2, active );
+	}
+}
+
+// QuaternionIdentityBlend( q1, 1 - s2 ) and positions scaled by s2
+static void ScalePoseSoA( CBonePoseSoA &pose1, int nBoneCount, const float *pWeights )
+{
+	int nBlocks = CBonePoseSoA::BlockCount( nBoneCount );
+	for ( int b = 0; b < nBlocks; b++ )
+	{
+		fltx4 s2 = LoadUnalignedSIMD( pWeights + b * 4 );
+		fltx4 active = CmpGtSIMD( s2, Four_Zeros );
+		if ( IsAllZeros( active ) )
+			continue;
+
+		fltx4 s1 = SubSIMD( Four_Ones, s2 );
+		fltx4 sclp = SubSIMD( Four_Ones, s1 );
+
+		const FourQuaternionsSoA_t &p = pose1[b].q;
+		FourQuaternionsSoA_t qt;
+		qt.x = MulSIMD( p.x, sclp );
+		qt.y = MulSIMD( p.y, sclp );
+		qt.z = MulSIMD( p.z, sclp );
+		qt.w = MulSIMD( p.w, sclp );
+		qt.w = MaskedAssign( CmpLtSIMD( p.w, Four_Zeros ), SubSIMD( qt.w, s1 ), AddSIMD( qt.w, s1 ) );
+		QuaternionNormalizeSoA( qt );
+
+		AssignRotationSoA( pose1[b], qt, active );
+		pose1[b].px = MaskedAssign( active, MulSIMD( pose1[b].px, s2 ), pose1[b].px );
+		pose1[b].py = MaskedAssign( active, MulSIMD( pose1[b].py, s2 ), pose1[b].py );
+		pose1[b].pz = MaskedAssign( active, MulSIMD( pose1[b].pz, s2 ), pose1[b].pz );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: run one of the kernels on AoS poses.  pS2 holds the weight of
+//			pose2 for each bone, bones with a zero weight are left alone.
+//-----------------------------------------------------------------------------
+enum BonePoseBlendSoA_t
+{
+	POSE_BLEND_SLERP = 0,
+	POSE_BLEND_ADD,				// STUDIO_DELTA
+	POSE_BLEND_ADD_POST,		// STUDIO_DELTA | STUDIO_POST
+	POSE_BLEND_NLERP,
+	POSE_BLEND_SCALE,
+};
+
+static void BlendPosesSoA( BonePoseBlendSoA_t blend, const CStudioHdr *pStudioHdr, int nBoneCount,
+	Quaternion q1[MAXSTUDIOBONES], Vector pos1[MAXSTUDIOBONES],
+	const Quaternion *q2, const Vector *pos2, const float *pS2 )
+{
+	Assert( nBoneCount <= MAXSTUDIOBONES );
+
+	ALIGN16 float flWeights[MAXSTUDIOBONES] ALIGN16_POST;
+	ALIGN16 float flAlign[MAXSTUDIOBONES] ALIGN16_POST;
+	int nLanes = CBonePoseSoA::BlockCount( nBoneCount ) * 4;
+	for ( int i = 0; i < nLanes; i++ )
+	{
+		if ( i < nBoneCount )
+		{
+			flWeights[i] = pS2[i];
+			flAlign[i] = ( pStudioHdr && ( pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT ) ) ? 0.0f : 1.0f;
+		}
+		else
+		{
+			flWeights[i] = 0.0f;
+			flAlign[i] = 0.0f;
+		}
+	}
+
+	CBonePoseSoA pose1;
+	pose1.Load( nBoneCount, q1, pos1 );
+
+	if ( blend == POSE_BLEND_SCALE )
+	{
+		ScalePoseSoA( pose1, nBoneCount, flWeights );
+	}
+	else
+	{
+		CBonePoseSoA pose2;
+		pose2.Load( nBoneCount, q2, pos2 );
+
+		switch ( blend )
+		{
+		case POSE_BLEND_SLERP:
+			SlerpPoseSoA( pose1, pose2, nBoneCount, flWeights, flAlign );
+			break;
+		case POSE_BLEND_ADD:
+		case POSE_BLEND_ADD_POST:
+			AddPoseSoA( pose1, pose2, nBoneCount, flWeights, blend == POSE_BLEND_ADD_POST );
+			break;
+		default:
+			BlendPoseSoA( pose1, pose2, nBoneCount, flWeights, flAlign );
+			break;
+		}
+	}
+
+	pose1.Store( nBoneCount, q1, pos1 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: weights for BlendBones and ScaleBones, s for the bones the
+//			sequence animates and zero for the rest
+//-----------------------------------------------------------------------------
+static void BuildBoneWeights( const CStudioHdr *pStudioHdr, mstudioseqdesc_t &seqdesc, const virtualgroup_t *pSeqGroup,
+	float s, int boneMask, int nBoneCount, float *pS2 )
+{
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		pS2[i] = 0.0f;
+
+		// skip unused bones
+		if ( !( pStudioHdr->boneFlags(i) & boneMask ) )
+			continue;
+
+		int j = pSeqGroup ? pSeqGroup->boneMap[i] : i;
+		if ( j >= 0 && seqdesc.weight( j ) > 0.0 )
+		{
+			pS2[i] = s;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: the per bone blends the kernels replace, for anim_soablend_benchmark
+//-----------------------------------------------------------------------------
+static void BlendPosesScalar( BonePoseBlendSoA_t blend, int nBoneCount, 
+	Quaternion *q1, Vector *pos1, const Quaternion *q2, const Vector *pos2, const float *pS2 )
+{
+	Quaternion q3;
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		float s2 = pS2[i];
+		if ( s2 <= 0.0f )
+			continue;
+
+		float s1 = 1.0 - s2;
+		switch ( blend )
+		{
+		case POSE_BLEND_SLERP:
+			QuaternionSlerp( q2[i], q1[i], s1, q3 );
+			q1[i] = q3;
+			pos1[i] = pos1[i] * s1 + pos2[i] * s2;
+			break;
+		case POSE_BLEND_ADD:
+			QuaternionSM( s2, q2[i], q1[i], q1[i] );
+			pos1[i] = pos1[i] + pos2[i] * s2;
+			break;
+		case POSE_BLEND_ADD_POST:
+			QuaternionMA( q1[i], s2, q2[i], q1[i] );
+			pos1[i] = pos1[i] + pos2[i] * s2;
+			break;
+		case POSE_BLEND_NLERP:
+			QuaternionBlend( q2[i], q1[i], s1, q3 );
+			q1[i] = q3;
+			pos1[i] = pos1[i] * s1 + pos2[i] * s2;
+			break;
+		case POSE_BLEND_SCALE:
+			QuaternionIdentityBlend( q1[i], s1, q1[i] );
+			VectorScale( pos1[i], s2, pos1[i] );
+			break;
+		}
+	}
+}
+
+static void BenchmarkPoseBlend( BonePoseBlendSoA_t blend, const char *pBlendName, int nBones, int nLayers, int nIterations )
+{
+	int nLayerBones = nLayers * nBones;
+	Quaternion *pLayerQ = new Quaternion[ nLayerBones ];
+	Vector *pLayerPos = new Vector[ nLayerBones ];
+	float *pLayerWeights = new float[ nLayerBones ];
+	for ( int i = 0; i < nLayerBones; i++ )
+	{
+		pLayerQ[i].Init( RandomFloat( -1.0f, 1.0f ), RandomFloat( -1.0f, 1.0f ), RandomFloat( -1.0f, 1.0f ), RandomFloat( -1.0f, 1.0f ) );
+		QuaternionNormalize( pLayerQ[i] );
+		pLayerPos[i].Init( RandomFloat( -10.0f, 10.0f ), RandomFloat( -10.0f, 10.0f ), RandomFloat( -10.0f, 10.0f ) );
+
+		// layers usually leave some bones alone
+		pLayerWeights[i] = ( RandomInt( 0, 7 ) == 0 ) ? 0.0f : RandomFloat( 0.05f, 1.0f );
+	}
+
+	Quaternion q[2][MAXSTUDIOBONES];
+	Vector pos[2][MAXSTUDIOBONES];
+	float flTime[2];
+	for ( int nPass = 0; nPass < 2; nPass++ )
+	{
+		double flStart = Plat_FloatTime();
+		for ( int nIteration = 0; nIteration < nIterations; nIteration++ )
+		{
+			for ( int i = 0; i < nBones; i++ )
+			{
+				q[nPass][i] = pLayerQ[i];
+				pos[nPass][i] = pLayerPos[i];
+			}
+
+			for ( int nLayer = 1; nLayer < nLayers; nLayer++ )
+			{
+				int nFirst = nLayer * nBones;
+				if ( nPass == 0 )
+				{
+					BlendPosesScalar( blend, nBones, q[nPass], pos[nPass], pLayerQ + nFirst, pLayerPos + nFirst, pLayerWeights + nFirst );
+				}
+				else
+				{
+					BlendPosesSoA( blend, NULL, nBones, q[nPass], pos[nPass], pLayerQ + nFirst, pLayerPos + nFirst, pLayerWeights + nFirst );
+				}
+			}
+		}
+		flTime[nPass] = (float)( Plat_FloatTime() - flStart );
+	}
+
+	float flMaxError = 0.0f;
+	for ( int i = 0; i < nBones; i++ )
+	{
+		for ( int k = 0; k < 4; k++ )
+		{
+			flMaxError = MAX( flMaxError, fabs( q[0][i][k] - q[1][i][k] ) );
+		}
+		for ( int k = 0; k < 3; k++ )
+		{
+			flMaxError = MAX( flMaxError, fabs( pos[0][i][k] - pos[1][i][k] ) );
+		}
+	}
+
+	Msg( "%-10s %3d bones x %d layers: per bone %.2f us, SoA %.2f us, max difference %g\n",
+		pBlendName, nBones, nLayers, flTime[0] * 1000000.0f / nIterations, flTime[1] * 1000000.0f / nIterations, flMaxError );
+
+	delete[] pLayerWeights;
+	delete[] pLayerPos;
+	delete[] pLayerQ;
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND_F( cl_anim_soablend_benchmark, "Time blending poses per bone and as SoA blocks. Arguments: [bone count] [layer count]", FCVAR_CHEAT )
+#else
+CON_COMMAND_F( anim_soablend_benchmark, "Time blending poses per bone and as SoA blocks. Arguments: [bone count] [layer count]", FCVAR_CHEAT )
+#endif
+{
+	int nBones = ( args.ArgC() >= 2 ) ? clamp( atoi( args[1] ), 1, MAXSTUDIOBONES ) : MAXSTUDIOBONES;
+	int nLayers = ( args.ArgC() >= 3 ) ? clamp( atoi( args[2] ), 2, 64 ) : 8;
+	int nIterations = 1000;
+
+	BenchmarkPoseBlend( POSE_BLEND_SLERP, "slerp", nBones, nLayers, nIterations );
+	BenchmarkPoseBlend( POSE_BLEND_ADD, "add", nBones, nLayers, nIterations );
+	BenchmarkPoseBlend( POSE_BLEND_ADD_POST, "add post", nBones, nLayers, nIterations );
+	BenchmarkPoseBlend( POSE_BLEND_NLERP, "blend", nBones, nLayers, nIterations );
+	BenchmarkPoseBlend( POSE_BLEND_SCALE, "scale", nBones, nLayers, nIterations );
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: blend together in world space q1,pos1 with q2,pos2.  Return result in q1,pos1.  
 //			0 returns q1, pos1.  1 returns q2, pos2
@@ -1437,6 +2503,17 @@ void SlerpBones(
 		}
 	}
 
+	if ( anim_soablend.GetBool() )
+	{
+		BonePoseBlendSoA_t blend = POSE_BLEND_SLERP;
+		if ( seqdesc.flags & STUDIO_DELTA )
+		{
+			blend = ( seqdesc.flags & STUDIO_POST ) ? POSE_BLEND_ADD_POST : POSE_BLEND_ADD;
+		}
+		BlendPosesSoA( blend, pStudioHdr, nBoneCount, q1, pos1, q2, pos2, pS2 );
+		return;
+	}
+
 	float s1, s2;
 	if ( seqdesc.flags & STUDIO_DELTA )
 	{
@@ -1592,6 +2669,15 @@ void BlendBones(
 	float s2 = s;
 	float s1 = 1.0 - s2;
 
+	if ( anim_soablend.GetBool() )
+	{
+		int nBoneCount = pStudioHdr->numbones();
+		float *pS2 = (float*)stackalloc( nBoneCount * sizeof(float) );
+		BuildBoneWeights( pStudioHdr, seqdesc, pSeqGroup, s2, boneMask, nBoneCount, pS2 );
+		BlendPosesSoA( POSE_BLEND_NLERP, pStudioHdr, nBoneCount, q1, pos1, q2, pos2, pS2 );
+		return;
+	}
+
 	for (i = 0; i < pStudioHdr->numbones(); i++)
 	{
 		// skip unused bones
@@ -1658,6 +2744,16 @@ void ScaleBones(
 	float s2 = s;
 	float s1 = 1.0 - s2;
 
+	// the kernel leaves bones with a weight of zero or less alone
+	if ( s2 > 0.0f && anim_soablend.GetBool() )
+	{
+		int nBoneCount = pStudioHdr->numbones();
+		float *pS2 = (float*)stackalloc( nBoneCount * sizeof(float) );
+		BuildBoneWeights( pStudioHdr, seqdesc, pSeqGroup, s2, boneMask, nBoneCount, pS2 );
+		BlendPosesSoA( POSE_BLEND_SCALE, pStudioHdr, nBoneCount, q1, pos1, NULL, NULL, pS2 );
+		return;
+	}
+
 	for (i = 0; i < pStudioHdr->numbones(); i++)
 	{
 		// skip unused bones
@@ -436,6 +436,9 @@ memhandle_t Studio_CreateBoneCache( bonecacheparams_t &params );
 void Studio_DestroyBoneCache( memhandle_t cacheHandle );
 void Studio_InvalidateBoneCache( memhandle_t cacheHandle );
 
+// Drop the cached decoded animation data that isn't in use, on level shutdown
+void Studio_FlushDecodedAnimCache();
+
 // Given a ray, trace for an intersection with this studiomodel.  Get the array of bones from StudioSetupHitboxBones
 bool TraceToStudio( class IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, matrix3x4_t **hitboxbones, int fContentsMask, const Vector &vecOrigin, float flScale, trace_t &trace );
 
@@ -1373,6 +1373,14 @@ inline const char *GetPlatformExt( void )
 #include "xbox/xbox_core.h"
 #endif
 
+//-----------------------------------------------------------------------------
+// Compilers with rvalue references get move constructors in the container and
+// string classes
+//-----------------------------------------------------------------------------
+#if !defined( MOVE_CONSTRUCTOR_SUPPORT ) && ( defined( __GXX_EXPERIMENTAL_CXX0X__ ) || __cplusplus >= 201103L || ( defined( _MSC_VER ) && _MSC_VER >= 1600 ) )
+#define MOVE_CONSTRUCTOR_SUPPORT
+#endif
+
 //-----------------------------------------------------------------------------
 // Methods to invoke the constructor, copy constructor, and destructor
 //-----------------------------------------------------------------------------
@@ -1437,6 +1445,17 @@ inline T* CopyConstruct( T* pMemory, T const& src )
 	return ::new( pMemory ) T(src);
 }
 
+// Constructs from src, leaving it in its moved-from state. Copies without rvalue references.
+template <class T>
+inline T* MoveConstruct( T* pMemory, T& src )
+{
+#ifdef MOVE_CONSTRUCTOR_SUPPORT
+	return ::new( pMemory ) T( static_cast< T&& >( src ) );
+#else
+	return ::new( pMemory ) T( src );
+#endif
+}
+
 template <class T>
 inline void Destruct( T* pMemory )
 {
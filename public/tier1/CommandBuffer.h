@@ -19,12 +19,6 @@
 #include "tier1/convar.h"
 
 
-//-----------------------------------------------------------------------------
-// Forward declarations
-//-----------------------------------------------------------------------------
-class CUtlBuffer;
-
-
 //-----------------------------------------------------------------------------
 // Invalid command handle
 //-----------------------------------------------------------------------------
@@ -53,6 +47,7 @@ public:
 	void BeginProcessingCommands( int nDeltaTicks );
 	bool DequeueNextCommand( );
 	int DequeueNextCommand( const char **& ppArgv );
+	int DequeueNextCommands( CCommand *pCommands, int nMaxCommands );
 	int ArgC() const;
 	const char **ArgV() const;
 	const char *ArgS() const;		// All args that occur after the 0th arg, in string form
@@ -115,8 +110,8 @@ private:
 	// Compacts the command buffer
 	void Compact();
 
-	// Parses argv0 out of the buffer
-	bool ParseArgV0( CUtlBuffer &buf, char *pArgv0, int nMaxLen, const char **pArgs );
+	// Parses argv0 out of the command
+	bool ParseArgV0( const char *pCommand, int nLen, char *pArgv0, int nMaxLen, const char **pArgs );
 
 	char	m_pArgSBuffer[ ARGS_BUFFER_LENGTH ];
 	int		m_nLastUsedArgSSize;
@@ -14,6 +14,7 @@ typedef unsigned int CRC32_t;
 
 void CRC32_Init( CRC32_t *pulCRC );
 void CRC32_ProcessBuffer( CRC32_t *pulCRC, const void *p, int len );
+void CRC32_ProcessBufferTable( CRC32_t *pulCRC, const void *p, int len );	// byte at a time, for comparison
 void CRC32_Final( CRC32_t *pulCRC );
 CRC32_t	CRC32_GetTableEntry( unsigned int slot );
 
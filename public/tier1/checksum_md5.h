@@ -44,6 +44,10 @@ char *MD5_Print(unsigned char *digest, int hashlen );
 /// bothering with the context object.
 void MD5_ProcessSingleBuffer( const void *p, int len, MD5Value_t &md5Result );
 
+/// MD5 of each of several independent buffers, hashed several at a time with SIMD
+/// where available. Hashing buffers of similar lengths together is fastest.
+void MD5_ProcessMultipleBuffers( int nBuffers, const void * const *ppBuffers, const int *pnLengths, MD5Value_t *pResults );
+
 unsigned int MD5_PseudoRandom(unsigned int nSeed);
 
 /// Returns true if the values match.
@@ -112,6 +112,10 @@ private:
 // hash comparison function, for use with CUtlMap/CUtlRBTree
 bool HashLessFunc( SHADigest_t const &lhs, SHADigest_t const &rhs );
 
+// SHA-1 of each of several independent buffers, hashed several at a time with SIMD
+// where available. Hashing buffers of similar lengths together is fastest.
+void SHA1_ProcessMultipleBuffers( int nBuffers, const void * const *ppBuffers, const int *pnLengths, SHADigest_t *pResults );
+
 // utility class for manipulating SHA1 hashes in their compact form
 struct CSHA
 {
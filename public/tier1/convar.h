@@ -205,6 +205,11 @@ public:
 	static int MaxCommandLength();
 	static characterset_t* DefaultBreakSet();
 
+	// Parses the token at nPos of the first nLen chars of pCommand into pTokenBuf and moves nPos past it,
+	// the same way CUtlBuffer::ParseToken would. Returns the token length, -1 when there are no more
+	// tokens, or nMaxLen if the token and its terminator didn't fit.
+	static int ParseToken( const char *pCommand, int nLen, int &nPos, char *pTokenBuf, int nMaxLen, characterset_t *pBreakSet = NULL );
+
 private:
 	enum
 	{
@@ -18,6 +18,31 @@ FORWARD_DECLARE_HANDLE( memhandle_t );
 
 #define INVALID_MEMHANDLE ((memhandle_t)0xffffffff)
 
+// Counters kept by each data manager, see CDataManagerBase::GetStats
+struct datamanagerstats_t
+{
+	unsigned int hits;				// handle lookups that found the resource
+	unsigned int misses;			// handle lookups of resources that are gone
+	unsigned int creates;
+	unsigned int evictions;			// resources freed to make room
+	unsigned int evictedBytes;
+	unsigned int usedBytes;
+	unsigned int targetBytes;
+	unsigned int probationCount;	// unlocked, used once since they were created
+	unsigned int protectedCount;	// unlocked, used again
+	unsigned int lockedCount;
+};
+
+//-----------------------------------------------------------------------------
+// Unlocked resources are kept in two lists, in the manner of the 2Q policy.
+// New resources go on the probation list and move to the protected list when
+// they're used again; resources are evicted from the probation list first.
+// The protected list is held to 3/4 of the target size by moving its least
+// recently used resources back to probation, so a one-off sweep over many
+// resources can only displace the probation list, not the working set.
+// (2Q's ghost list of evicted resources isn't kept, as a resource that comes
+// back gets a new handle and can't be recognised.)
+//-----------------------------------------------------------------------------
 class CDataManagerBase
 {
 public:
@@ -31,7 +56,7 @@ public:
 	//void					*LockResource( memhandle_t handle );
 	int						UnlockResource( memhandle_t handle );
 	void					TouchResource( memhandle_t handle );
-	void					MarkAsStale( memhandle_t handle );		// move to head of LRU
+	void					MarkAsStale( memhandle_t handle );		// move to head of probation list
 
 	int						LockCount( memhandle_t handle );
 	int						BreakLock( memhandle_t handle );
@@ -69,6 +94,22 @@ public:
 	void					GetLRUHandleList( CUtlVector< memhandle_t >& list );
 	void					GetLockHandleList( CUtlVector< memhandle_t >& list );
 
+	// Statistics
+	void					GetStats( datamanagerstats_t &stats );
+	void					ResetStats();
+
+	// All the managers in this module, for reporting
+	const char				*GetName() const			{ return m_pName; }
+	void					SetName( const char *pName )	{ m_pName = pName; }
+	int						GetShard() const			{ return m_nShard; }
+	static CDataManagerBase	*GetFirstManager()			{ return s_pFirstManager; }
+	CDataManagerBase		*GetNextManager() const		{ return m_pNextManager; }
+
+	// Encode nShard in the low nShardBits of each handle's index, so that a
+	// handle identifies its shard in a CDataManagerSharded. Set before use.
+	void					SetHandleShard( int nShard, int nShardBits );
+	static int				ShardFromHandle( memhandle_t handle, int nShardBits );
+
 
 protected:
 	// derived class must call these to implement public API
@@ -81,7 +122,7 @@ protected:
 	// NOTE: you must call this from the destructor of the derived class! (will assert otherwise)
 	void					FreeAllLists()	{ FlushAll(); m_listsAreFreed = true; }
 
-							CDataManagerBase( unsigned int maxSize );
+							CDataManagerBase( unsigned int maxSize, const char *pName = NULL );
 	virtual					~CDataManagerBase();
 	
 	
@@ -99,6 +140,11 @@ protected:
 	void					TouchByIndex( unsigned short memoryIndex );
 	void *					GetForFreeByIndex( unsigned short memoryIndex );
 
+	// Moves unlocked resources on and off the probation and protected lists
+	void					LinkUnlocked( unsigned short memoryIndex );
+	void					UnlinkUnlocked( unsigned short memoryIndex );
+	void					TrimProtected();
+
 	// One of these is stored per active allocation
 	struct resource_lru_element_t
 	{
@@ -106,25 +152,39 @@ protected:
 		{
 			lockCount = 0;
 			serial = 1;
+			isProtected = false;
 			pStore = 0;
+			size = 0;
 		}
 
 		unsigned short lockCount;
 		unsigned short serial;
+		bool	isProtected;		// belongs on the protected list while unlocked
 		void	*pStore;
+		unsigned int size;
 	};
 
 	unsigned int m_targetMemorySize;
 	unsigned int m_memUsed;
+	unsigned int m_protectedMemUsed;
 	
 	CUtlMultiList< resource_lru_element_t, unsigned short >  m_memoryLists;
 	
-	unsigned short m_lruList;
+	unsigned short m_lruList;			// protected
+	unsigned short m_probationList;
 	unsigned short m_lockList;
 	unsigned short m_freeList;
 	unsigned short m_listsAreFreed : 1;
 	unsigned short m_unused : 15;
 
+	unsigned short m_nShard;
+	unsigned short m_nShardBits;
+
+	datamanagerstats_t m_stats;
+
+	const char *m_pName;
+	CDataManagerBase *m_pNextManager;
+	static CDataManagerBase *s_pFirstManager;
 };
 
 template< class STORAGE_TYPE, class CREATE_PARAMS, class LOCK_TYPE = STORAGE_TYPE *, class MUTEX_TYPE = CThreadNullMutex>
@@ -133,7 +193,7 @@ class CDataManager : public CDataManagerBase
 	typedef CDataManagerBase BaseClass;
 public:
 
-	CDataManager<STORAGE_TYPE, CREATE_PARAMS, LOCK_TYPE, MUTEX_TYPE>( unsigned int size = (unsigned)-1 ) : BaseClass(size) {}
+	CDataManager<STORAGE_TYPE, CREATE_PARAMS, LOCK_TYPE, MUTEX_TYPE>( unsigned int size = (unsigned)-1, const char *pName = NULL ) : BaseClass( size, pName ) {}
 	
 
 	~CDataManager<STORAGE_TYPE, CREATE_PARAMS, LOCK_TYPE, MUTEX_TYPE>()
@@ -186,10 +246,14 @@ public:
 		return BaseClass::StoreResourceInHandle( memoryIndex, pStore, pStore->Size() );
 	}
 
-	// Iteration. Must lock first
+	// Iteration. Must lock first. Unlocked resources are visited probation list first.
 	memhandle_t GetFirstUnlocked()
 	{
-		unsigned node = m_memoryLists.Head(m_lruList);
+		unsigned node = m_memoryLists.Head(m_probationList);
+		if ( node == m_memoryLists.InvalidIndex() )
+		{
+			node = m_memoryLists.Head(m_lruList);
+		}
 		if ( node == m_memoryLists.InvalidIndex() )
 		{
 			return INVALID_MEMHANDLE;
@@ -214,7 +278,13 @@ public:
 			return INVALID_MEMHANDLE;
 		}
 
-		unsigned short iNext = m_memoryLists.Next( FromHandle( hPrev ) );
+		unsigned short iPrev = FromHandle( hPrev );
+		unsigned short iNext = m_memoryLists.Next( iPrev );
+		if ( iNext == m_memoryLists.InvalidIndex() && m_memoryLists[iPrev].lockCount == 0 && !m_memoryLists[iPrev].isProtected )
+		{
+			// end of the probation list, carry on with the protected list
+			iNext = m_memoryLists.Head(m_lruList);
+		}
 		if ( iNext == m_memoryLists.InvalidIndex() ) 
 		{
 			return INVALID_MEMHANDLE;
@@ -247,6 +317,83 @@ private:
 	MUTEX_TYPE m_mutex;
 };
 
+//-----------------------------------------------------------------------------
+// A data manager split into 1 << SHARD_BITS independent shards, each with its
+// own lock and an equal part of the memory budget. New resources are dealt out
+// to the shards in turn and the handle records the shard, so threads working
+// on different resources rarely wait for the same lock.
+//-----------------------------------------------------------------------------
+template< class STORAGE_TYPE, class CREATE_PARAMS, class LOCK_TYPE = STORAGE_TYPE *, class MUTEX_TYPE = CThreadFastMutex, int SHARD_BITS = 3 >
+class CDataManagerSharded
+{
+public:
+	typedef CDataManager<STORAGE_TYPE, CREATE_PARAMS, LOCK_TYPE, MUTEX_TYPE> CShard;
+	enum { NUM_SHARDS = 1 << SHARD_BITS };
+
+	CDataManagerSharded( unsigned int size = (unsigned)-1, const char *pName = NULL )
+	{
+		COMPILE_TIME_ASSERT( SHARD_BITS >= 1 && SHARD_BITS <= 8 );
+		for ( int i = 0; i < NUM_SHARDS; i++ )
+		{
+			m_shards[i].SetTargetSize( size / NUM_SHARDS );
+			m_shards[i].SetName( pName );
+			m_shards[i].SetHandleShard( i, SHARD_BITS );
+		}
+	}
+
+	memhandle_t CreateResource( const CREATE_PARAMS &createParams, bool bCreateLocked = false )
+	{
+		CShard &shard = m_shards[ ( ++m_nNextShard ) & ( NUM_SHARDS - 1 ) ];
+		AUTO_LOCK( shard.AccessMutex() );
+		return shard.CreateResource( createParams, bCreateLocked );
+	}
+
+	void DestroyResource( memhandle_t handle )					{ Shard( handle ).DestroyResource( handle ); }
+	LOCK_TYPE LockResource( memhandle_t handle )				{ return Shard( handle ).LockResource( handle ); }
+	int UnlockResource( memhandle_t handle )					{ return Shard( handle ).UnlockResource( handle ); }
+	LOCK_TYPE GetResource_NoLock( memhandle_t handle )			{ return Shard( handle ).GetResource_NoLock( handle ); }
+	LOCK_TYPE GetResource_NoLockNoLRUTouch( memhandle_t handle )	{ return Shard( handle ).GetResource_NoLockNoLRUTouch( handle ); }
+	void TouchResource( memhandle_t handle )					{ Shard( handle ).TouchResource( handle ); }
+	void MarkAsStale( memhandle_t handle )						{ Shard( handle ).MarkAsStale( handle ); }
+	int LockCount( memhandle_t handle )							{ return Shard( handle ).LockCount( handle ); }
+	int BreakLock( memhandle_t handle )							{ return Shard( handle ).BreakLock( handle ); }
+
+	// Lock the shard that owns handle, to use the resource without locking it
+	MUTEX_TYPE &AccessMutex( memhandle_t handle )				{ return Shard( handle ).AccessMutex(); }
+
+	void SetTargetSize( unsigned int targetSize )
+	{
+		for ( int i = 0; i < NUM_SHARDS; i++ )
+		{
+			m_shards[i].SetTargetSize( targetSize / NUM_SHARDS );
+		}
+	}
+
+	unsigned int TargetSize()			{ return SumShards( &CShard::TargetSize ); }
+	unsigned int UsedSize()				{ return SumShards( &CShard::UsedSize ); }
+	unsigned int FlushAllUnlocked()		{ return SumShards( &CShard::FlushAllUnlocked ); }
+	unsigned int FlushToTargetSize()	{ return SumShards( &CShard::FlushToTargetSize ); }
+	unsigned int FlushAll()				{ return SumShards( &CShard::FlushAll ); }
+
+	CShard &GetShard( int i )			{ return m_shards[i]; }
+
+private:
+	CShard &Shard( memhandle_t handle )	{ return m_shards[ CDataManagerBase::ShardFromHandle( handle, SHARD_BITS ) ]; }
+
+	unsigned int SumShards( unsigned int ( CDataManagerBase::*pfnGet )() )
+	{
+		unsigned int nTotal = 0;
+		for ( int i = 0; i < NUM_SHARDS; i++ )
+		{
+			nTotal += ( m_shards[i].*pfnGet )();
+		}
+		return nTotal;
+	}
+
+	CShard m_shards[NUM_SHARDS];
+	CInterlockedInt m_nNextShard;
+};
+
 //-----------------------------------------------------------------------------
 
 inline unsigned short CDataManagerBase::FromHandle( memhandle_t handle )
@@ -255,11 +402,21 @@ inline unsigned short CDataManagerBase::FromHandle( memhandle_t handle )
 	unsigned short serial = fullWord>>16;
 	unsigned short index = fullWord & 0xFFFF;
 	index--;
+	if ( ( index & ( ( 1 << m_nShardBits ) - 1 ) ) != m_nShard )
+		return m_memoryLists.InvalidIndex();
+	index >>= m_nShardBits;
 	if ( m_memoryLists.IsValidIndex(index) && m_memoryLists[index].serial == serial )
 		return index;
 	return m_memoryLists.InvalidIndex();
 }
 
+inline int CDataManagerBase::ShardFromHandle( memhandle_t handle, int nShardBits )
+{
+	unsigned short index = (unsigned int)handle & 0xFFFF;
+	index--;
+	return index & ( ( 1 << nShardBits ) - 1 );
+}
+
 inline int CDataManagerBase::LockCount( memhandle_t handle )
 {
 	Lock();
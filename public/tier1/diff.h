@@ -25,5 +25,22 @@ void ApplyDiffs(uint8 const *OldBlock, uint8 const *DiffList,
 int FindDiffsLowMemory(uint8 const *NewBlock, uint8 const *OldBlock,
 					   int NewSize, int OldSize, int &DiffListSize,uint8 *Output,uint32 OutSize);
 
+// Diff for very large files (bsps, vpks). Matches are found at content-defined anchors, so the
+// index of the old block takes about 1/8 of its size instead of 8x, and both blocks are scanned
+// on up to nThreads threads (0 = one per logical processor). Matches may come from anywhere in the
+// old block, using a far copy op that only this version of ApplyDiffs understands.
+// Returns -1 if the diff doesn't fit in OutSize bytes.
+int FindDiffsChunked(uint8 const *NewBlock, uint8 const *OldBlock,
+					 int NewSize, int OldSize, int &DiffListSize,uint8 *Output,uint32 OutSize,
+					 int nThreads=0);
+
+// Applies a diff without building the result in memory: each piece of it is passed to pfnWrite,
+// pointing straight into OldBlock or DiffList, so both can be memory mapped files. Every op is
+// checked against the block sizes. Returns false if the diff is corrupt or pfnWrite fails.
+typedef bool (*DiffWriteFunc_t)( void *pContext, uint8 const *pData, int nSize );
+
+bool ApplyDiffsStreaming(uint8 const *OldBlock, uint8 const *DiffList,
+						 int OldSize, int DiffListSize, DiffWriteFunc_t pfnWrite, void *pContext);
+
 #endif
 
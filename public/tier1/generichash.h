@@ -61,6 +61,47 @@ inline unsigned HashIntConventional( const int n ) // faster but less effective
 	*/
 }
 
+//-----------------------------------------------------------------------------
+// Fast 64 bit hash in the style of wyhash: 16 bytes per step through a 64x64->128
+// bit multiply. The string versions scan 16 bytes at a time and give the same
+// value as FastHash64() over the string's bytes (lowercased for the caseless one).
+// Not guaranteed stable between versions - don't write these to disk.
+//-----------------------------------------------------------------------------
+uint64 FastHash64( const void *pKey, int nLength, uint64 nSeed = 0 );
+uint64 FastHashString64( const char *pszKey, uint64 nSeed = 0 );
+uint64 FastHashStringCaseless64( const char *pszKey, uint64 nSeed = 0 );
+
+FORCEINLINE uint32 FastHashFold32( uint64 nHash )
+{
+	return (uint32)( nHash ^ ( nHash >> 32 ) );
+}
+
+inline uint32 FastHash32( const void *pKey, int nLength )
+{
+	return FastHashFold32( FastHash64( pKey, nLength ) );
+}
+
+inline uint32 FastHashString32( const char *pszKey )
+{
+	return FastHashFold32( FastHashString64( pszKey ) );
+}
+
+inline uint32 FastHashStringCaseless32( const char *pszKey )
+{
+	return FastHashFold32( FastHashStringCaseless64( pszKey ) );
+}
+
+// hash a uint64 into a uint32
+FORCEINLINE uint32 HashInt64( uint64 n )
+{
+	n ^= n >> 33;
+	n *= 0xff51afd7ed558ccdull;
+	n ^= n >> 33;
+	n *= 0xc4ceb9fe1a85ec53ull;
+	n ^= n >> 33;
+	return FastHashFold32( n );
+}
+
 //-----------------------------------------------------------------------------
 
 template <typename T>
@@ -70,13 +111,9 @@ inline unsigned HashItem( const T &item )
 	if ( sizeof(item) == 4 )
 		return Hash4( &item );
 	else if ( sizeof(item) == 8 )
-		return Hash8( &item );
-	else if ( sizeof(item) == 12 )
-		return Hash12( &item );
-	else if ( sizeof(item) == 16 )
-		return Hash16( &item );
+		return HashInt64( *(const uint64 *)&item );
 	else
-		return HashBlock( &item, sizeof(item) );
+		return FastHash32( &item, sizeof(item) );
 }
 
 template <> inline unsigned HashItem<int>(const int &key )
@@ -89,14 +126,24 @@ template <> inline unsigned HashItem<unsigned>(const unsigned &key )
 	return HashInt( (int)key );
 }
 
+template <> inline unsigned HashItem<int64>(const int64 &key )
+{
+	return HashInt64( (uint64)key );
+}
+
+template <> inline unsigned HashItem<uint64>(const uint64 &key )
+{
+	return HashInt64( key );
+}
+
 template<> inline unsigned HashItem<const char *>(const char * const &pszKey )
 {
-	return HashString( pszKey );
+	return FastHashString32( pszKey );
 }
 
 template<> inline unsigned HashItem<char *>(char * const &pszKey )
 {
-	return HashString( pszKey );
+	return FastHashString32( pszKey );
 }
 
 //-----------------------------------------------------------------------------
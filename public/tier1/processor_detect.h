@@ -9,4 +9,6 @@ bool CheckMMXTechnology(void);
 bool CheckSSETechnology(void);
 bool CheckSSE2Technology(void);
 bool Check3DNowTechnology(void);
+bool CheckPCLMULTechnology(void);
+bool CheckAVX2Technology(void);
 
@@ -0,0 +1,1001 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: An ordered map stored as a B+ tree.
+//
+// CUtlMap is a red-black tree, so a lookup visits about log2(n) nodes spread
+// over the whole node array. CUtlBTreeMap keeps up to a couple of cache lines
+// of keys in each node, so a lookup touches a handful of nodes, and the search
+// inside a node is a short linear scan (SSE2 for 32-bit integer keys).
+//
+// Usage notes:
+// - the API follows CUtlMap: indices are stable until the element is removed,
+//   duplicate keys are allowed, and FOR_EACH_MAP / FOR_EACH_MAP_FAST work
+// - keys can't be changed in place; remove and insert the element instead
+// - NextInorder() scans the element's leaf, so it's O(node size) rather than
+//   O(1); FOR_EACH_MAP_FAST is the cheapest way to visit every element
+// - removal frees nodes that become empty but doesn't merge sparse ones;
+//   BulkLoad() rebuilds a packed tree from sorted input
+// - keys and elements are moved with memcpy when the storage grows, like
+//   all the other utl containers
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef UTLBTREEMAP_H
+#define UTLBTREEMAP_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/dbg.h"
+#include "tier1/utlmemory.h"
+#include "tier1/utlvector.h"
+#include "tier1/utlmap.h"
+
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ ) )
+#include <emmintrin.h>
+#define UTLBTREEMAP_SSE2
+#endif
+
+// Bytes of keys held by a node
+#define UTLBTREEMAP_NODE_KEY_BYTES	128
+
+
+//-----------------------------------------------------------------------------
+// Searches the sorted keys of a node. LowerBound returns the number of keys
+// less than key, UpperBound the number not greater than key.
+//-----------------------------------------------------------------------------
+template < typename K, typename L >
+struct CUtlBTreeKeySearch
+{
+	static int LowerBound( const K *pKeys, int nCount, const K &key, const L &lessFunc )
+	{
+		int nLow = 0;
+		while ( nCount > 0 )
+		{
+			int nHalf = nCount >> 1;
+			if ( lessFunc( pKeys[nLow + nHalf], key ) )
+			{
+				nLow += nHalf + 1;
+				nCount -= nHalf + 1;
+			}
+			else
+			{
+				nCount = nHalf;
+			}
+		}
+		return nLow;
+	}
+
+	static int UpperBound( const K *pKeys, int nCount, const K &key, const L &lessFunc )
+	{
+		int nLow = 0;
+		while ( nCount > 0 )
+		{
+			int nHalf = nCount >> 1;
+			if ( !lessFunc( key, pKeys[nLow + nHalf] ) )
+			{
+				nLow += nHalf + 1;
+				nCount -= nHalf + 1;
+			}
+			else
+			{
+				nCount = nHalf;
+			}
+		}
+		return nLow;
+	}
+};
+
+#ifdef UTLBTREEMAP_SSE2
+// Counts the keys less than (or not greater than) key, four at a time. The keys
+// are sorted, so the scan stops at the first group that isn't entirely below.
+// nBias flips the sign bit so unsigned keys compare correctly as signed.
+template < bool bOrEqual >
+inline int UtlBTreeCountBelow32( const int32 *pKeys, int nCount, int32 key, int32 nBias )
+{
+	static const char s_BitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+	__m128i vBias = _mm_set1_epi32( nBias );
+	__m128i vKey = _mm_set1_epi32( key ^ nBias );
+	int i = 0;
+	for ( ; i + 4 <= nCount; i += 4 )
+	{
+		__m128i v = _mm_xor_si128( _mm_loadu_si128( (const __m128i *)( pKeys + i ) ), vBias );
+		__m128i vBelow = bOrEqual ? _mm_andnot_si128( _mm_cmpgt_epi32( v, vKey ), _mm_set1_epi32( -1 ) ) : _mm_cmplt_epi32( v, vKey );
+		int nMask = _mm_movemask_ps( _mm_castsi128_ps( vBelow ) );
+		if ( nMask != 0xf )
+			return i + s_BitCount[nMask];
+	}
+
+	for ( ; i < nCount; i++ )
+	{
+		int32 k = pKeys[i] ^ nBias;
+		if ( bOrEqual ? ( k > ( key ^ nBias ) ) : ( k >= ( key ^ nBias ) ) )
+			break;
+	}
+	return i;
+}
+
+template <>
+struct CUtlBTreeKeySearch< int32, CDefLess< int32 > >
+{
+	static int LowerBound( const int32 *pKeys, int nCount, int32 key, const CDefLess< int32 > & )	{ return UtlBTreeCountBelow32< false >( pKeys, nCount, key, 0 ); }
+	static int UpperBound( const int32 *pKeys, int nCount, int32 key, const CDefLess< int32 > & )	{ return UtlBTreeCountBelow32< true >( pKeys, nCount, key, 0 ); }
+};
+
+template <>
+struct CUtlBTreeKeySearch< uint32, CDefLess< uint32 > >
+{
+	static int LowerBound( const uint32 *pKeys, int nCount, uint32 key, const CDefLess< uint32 > & )	{ return UtlBTreeCountBelow32< false >( (const int32 *)pKeys, nCount, (int32)key, (int32)0x80000000 ); }
+	static int UpperBound( const uint32 *pKeys, int nCount, uint32 key, const CDefLess< uint32 > & )	{ return UtlBTreeCountBelow32< true >( (const int32 *)pKeys, nCount, (int32)key, (int32)0x80000000 ); }
+};
+#endif // UTLBTREEMAP_SSE2
+
+
+//-----------------------------------------------------------------------------
+// The map. L is a less functor or function pointer, like CUtlRBTree's.
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename L = CDefLess< K > >
+class CUtlBTreeMap : public base_utlmap_t
+{
+public:
+	typedef K KeyType_t;
+	typedef T ElemType_t;
+	typedef int IndexType_t;
+	typedef L LessFunc_t;
+
+	enum
+	{
+		// keys per node, a multiple of 4 so integer keys search in whole SSE registers
+		MAX_KEYS = ( UTLBTREEMAP_NODE_KEY_BYTES / sizeof( K ) < 8 ) ? 8 : ( ( UTLBTREEMAP_NODE_KEY_BYTES / sizeof( K ) ) & ~3 ),
+	};
+
+	CUtlBTreeMap( const LessFunc_t &lessFunc = LessFunc_t() );
+	~CUtlBTreeMap();
+
+	void SetLessFunc( const LessFunc_t &lessFunc )			{ Assert( Count() == 0 ); m_LessFunc = lessFunc; }
+
+	// gets particular elements
+	ElemType_t &		Element( IndexType_t i )			{ Assert( IsValidIndex( i ) ); return m_Elements[i].m_Elem; }
+	const ElemType_t &	Element( IndexType_t i ) const		{ Assert( IsValidIndex( i ) ); return m_Elements[i].m_Elem; }
+	ElemType_t &		operator[]( IndexType_t i )			{ return Element( i ); }
+	const ElemType_t &	operator[]( IndexType_t i ) const	{ return Element( i ); }
+	const KeyType_t &	Key( IndexType_t i ) const			{ Assert( IsValidIndex( i ) ); return m_Elements[i].m_Key; }
+
+	// Num elements
+	unsigned int Count() const								{ return m_nCount; }
+
+	// Max index ever used, for FOR_EACH_MAP_FAST
+	IndexType_t MaxElement() const							{ return m_nMaxElement; }
+
+	bool IsValidIndex( IndexType_t i ) const				{ return ( i >= 0 ) && ( i < m_nMaxElement ) && ( m_Elements[i].m_nLeaf != FREE_ELEMENT ); }
+	static IndexType_t InvalidIndex()						{ return -1; }
+
+	// Insert in order; equal keys go after the ones already in the map
+	IndexType_t Insert( const KeyType_t &key, const ElemType_t &insert );
+	IndexType_t Insert( const KeyType_t &key );
+	IndexType_t InsertOrReplace( const KeyType_t &key, const ElemType_t &insert );
+
+	// Finds the first element with this key
+	IndexType_t Find( const KeyType_t &key ) const;
+
+	// Finds the first element not less than / greater than key
+	IndexType_t FindFirstNotLess( const KeyType_t &key ) const;
+	IndexType_t FindFirstGreater( const KeyType_t &key ) const;
+
+	// Replaces the contents with nCount keys (and elements, if pElems is set)
+	// that are already sorted. Leaves are packed full.
+	void BulkLoad( const KeyType_t *pKeys, const ElemType_t *pElems, int nCount );
+
+	// Remove methods
+	void RemoveAt( IndexType_t i );
+	bool Remove( const KeyType_t &key );
+	void RemoveAll();
+	void Purge();
+
+	// Purges the map and calls delete on each element in it.
+	void PurgeAndDeleteElements();
+
+	// Iteration
+	IndexType_t FirstInorder() const;
+	IndexType_t NextInorder( IndexType_t i ) const;
+	IndexType_t PrevInorder( IndexType_t i ) const;
+	IndexType_t LastInorder() const;
+
+	// Depth of the tree, 0 when empty
+	int Depth() const;
+
+	// Checks the ordering and links of the whole tree
+	bool IsValid() const;
+
+protected:
+	enum
+	{
+		FREE_ELEMENT = -2,
+	};
+
+	struct Elem_t
+	{
+		KeyType_t	m_Key;
+		ElemType_t	m_Elem;
+		int			m_nLeaf;		// leaf holding the element, or FREE_ELEMENT
+	};
+
+	// Leaves hold element indices in m_Children, parallel to the keys. Interior
+	// nodes hold one more child than keys; the keys of child i are between
+	// m_Keys[i-1] and m_Keys[i], inclusive because of duplicates.
+	struct Node_t
+	{
+		KeyType_t	m_Keys[MAX_KEYS];
+		int			m_Children[MAX_KEYS + 1];
+		int			m_nCount;
+		int			m_nParent;
+		int			m_nPrev;		// sibling leaves, in order
+		int			m_nNext;
+		bool		m_bLeaf;
+	};
+
+	const KeyType_t *NodeKeys( int iNode ) const			{ return m_Nodes[iNode].m_Keys; }
+	int LowerBound( int iNode, const KeyType_t &key ) const	{ return CUtlBTreeKeySearch< K, L >::LowerBound( NodeKeys( iNode ), m_Nodes[iNode].m_nCount, key, m_LessFunc ); }
+	int UpperBound( int iNode, const KeyType_t &key ) const	{ return CUtlBTreeKeySearch< K, L >::UpperBound( NodeKeys( iNode ), m_Nodes[iNode].m_nCount, key, m_LessFunc ); }
+
+	int AllocNode( bool bLeaf );
+	void FreeNode( int iNode );
+	int AllocElement( const KeyType_t &key );
+	void FreeElement( int i );
+
+	int ChildSlot( int iNode, int iChild ) const;
+	void InsertIntoLeaf( int iLeaf, int nSlot, int iElem );
+	void InsertIntoParent( int iLeft, const KeyType_t &separator, int iRight );
+	void RemoveChild( int iNode, int iChild );
+	int LeafFor( const KeyType_t &key, bool bUpper ) const;
+	bool IsValidNode( int iNode, const KeyType_t *pMin, const KeyType_t *pMax, int nDepth, int &nLeafDepth, int &nElements ) const;
+
+	CUtlMemory< Node_t > m_Nodes;
+	CUtlMemory< Elem_t > m_Elements;
+	CUtlVector< int > m_FreeNodes;
+	CUtlVector< int > m_FreeElements;
+	int m_nMaxNode;
+	int m_nMaxElement;
+	int m_nCount;
+	int m_nRoot;
+	int m_nFirstLeaf;
+	int m_nLastLeaf;
+	LessFunc_t m_LessFunc;
+
+private:
+	// No copying
+	CUtlBTreeMap( const CUtlBTreeMap & );
+	CUtlBTreeMap &operator=( const CUtlBTreeMap & );
+};
+
+
+//-----------------------------------------------------------------------------
+// constructor, destructor
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename L >
+inline CUtlBTreeMap<K, T, L>::CUtlBTreeMap( const LessFunc_t &lessFunc ) :
+	m_nMaxNode( 0 ), m_nMaxElement( 0 ), m_nCount( 0 ), m_nRoot( -1 ), m_nFirstLeaf( -1 ), m_nLastLeaf( -1 ), m_LessFunc( lessFunc )
+{
+}
+
+template < typename K, typename T, typename L >
+inline CUtlBTreeMap<K, T, L>::~CUtlBTreeMap()
+{
+	Purge();
+}
+
+
+//-----------------------------------------------------------------------------
+// Node and element allocation. Freed slots are reused before the arrays grow.
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename L >
+int CUtlBTreeMap<K, T, L>::AllocNode( bool bLeaf )
+{
+	int iNode;
+	if ( m_FreeNodes.Count() )
+	{
+		iNode = m_FreeNodes.Tail();
+		m_FreeNodes.RemoveMultipleFromTail( 1 );
+	}
+	else
+	{
+		if ( m_nMaxNode >= m_Nodes.NumAllocated() )
+		{
+			MEM_ALLOC_CREDIT_CLASS();
+			m_Nodes.Grow();
+		}
+		iNode = m_nMaxNode++;
+	}
+
+	Node_t &node = m_Nodes[iNode];
+	for ( int i = 0; i < MAX_KEYS; i++ )
+	{
+		Construct( &node.m_Keys[i] );
+	}
+	node.m_nCount = 0;
+	node.m_nParent = -1;
+	node.m_nPrev = -1;
+	node.m_nNext = -1;
+	node.m_bLeaf = bLeaf;
+	return iNode;
+}
+
+template < typename K, typename T, typename L >
+void CUtlBTreeMap<K, T, L>::FreeNode( int iNode )
+{
+	Node_t &node = m_Nodes[iNode];
+	for ( int i = 0; i < MAX_KEYS; i++ )
+	{
+		Destruct( &node.m_Keys[i] );
+	}
+	m_FreeNodes.AddToTail( iNode );
+}
+
+template < typename K, typename T, typename L >
+int CUtlBTreeMap<K, T, L>::AllocElement( const KeyType_t &key )
+{
+	int i;
+	if ( m_FreeElements.Count() )
+	{
+		i = m_FreeElements.Tail();
+		m_FreeElements.RemoveMultipleFromTail( 1 );
+	}
+	else
+	{
+		if ( m_nMaxElement >= m_Elements.NumAllocated() )
+		{
+			MEM_ALLOC_CREDIT_CLASS();
+			m_Elements.Grow();
+		}
+		i = m_nMaxElement++;
+	}
+
+	CopyConstruct( &m_Elements[i].m_Key, key );
+	m_Elements[i].m_nLeaf = -1;
+	++m_nCount;
+	return i;
+}
+
+template < typename K, typename T, typename L >
+void CUtlBTreeMap<K, T, L>::FreeElement( int i )
+{
+	Destruct( &m_Elements[i].m_Key );
+	Destruct( &m_Elements[i].m_Elem );
+	m_Elements[i].m_nLeaf = FREE_ELEMENT;
+	m_FreeElements.AddToTail( i );
+	--m_nCount;
+}
+
+
+//-----------------------------------------------------------------------------
+// Finds the leaf a key belongs in: the first leaf that may hold it, or the
+// last one an insertion after equal keys should go to.
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename L >
+int CUtlBTreeMap<K, T, L>::LeafFor( const KeyType_t &key, bool bUpper ) const
+{
+	int iNode = m_nRoot;
+	while ( !m_Nodes[iNode].m_bLeaf )
+	{
+		int nSlot = bUpper ? UpperBound( iNode, key ) : LowerBound( iNode, key );
+		iNode = m_Nodes[iNode].m_Children[nSlot];
+	}
+	return iNode;
+}
+
+template < typename K, typename T, typename L >
+inline int CUtlBTreeMap<K, T, L>::ChildSlot( int iNode, int iChild ) const
+{
+	const Node_t &node = m_Nodes[iNode];
+	int nChildren = node.m_bLeaf ? node.m_nCount : node.m_nCount + 1;
+	for ( int i = 0; i < nChildren; i++ )
+	{
+		if ( node.m_Children[i] == iChild )
+			return i;
+	}
+	Assert( 0 );
+	return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Insertion
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename L >
+typename CUtlBTreeMap<K, T, L>::IndexType_t CUtlBTreeMap<K, T, L>::Insert( const KeyType_t &key, const ElemType_t &insert )
+{
+	int i = AllocElement( key );
+	CopyConstruct( &m_Elements[i].m_Elem, insert );
+
+	if ( m_nRoot < 0 )
+	{
+		m_nRoot = m_nFirstLeaf = m_nLastLeaf = AllocNode( true );
+	}
+
+	int iLeaf = LeafFor( key, true );
+	InsertIntoLeaf( iLeaf, UpperBound( iLeaf, key ), i );
+	return i;
+}
+
+template < typename K, typename T, typename L >
+typename CUtlBTreeMap<K, T, L>::IndexType_t CUtlBTreeMap<K, T, L>::Insert( const KeyType_t &key )
+{
+	int i = AllocElement( key );
+	Construct( &m_Elements[i].m_Elem );
+
+	if ( m_nRoot < 0 )
+	{
+		m_nRoot = m_nFirstLeaf = m_nLastLeaf = AllocNode( true );
+	}
+
+	int iLeaf = LeafFor( key, true );
+	InsertIntoLeaf( iLeaf, UpperBound( iLeaf, key ), i );
+	return i;
+}
+
+template < typename K, typename T, typename L >
+typename CUtlBTreeMap<K, T, L>::IndexType_t CUtlBTreeMap<K, T, L>::InsertOrReplace( const KeyType_t &key, const ElemType_t &insert )
+{
+	int i = Find( key );
+	if ( i != InvalidIndex() )
+	{
+		Element( i ) = insert;
+		return i;
+	}
+
+	return Insert( key, insert );
+}
+
+template < typename K, typename T, typename L >
+void CUtlBTreeMap<K, T, L>::InsertIntoLeaf( int iLeaf, int nSlot, int iElem )
+{
+	if ( m_Nodes[iLeaf].m_nCount == MAX_KEYS )
+	{
+		// split, moving the upper half to a new leaf after this one
+		int iRight = AllocNode( true );
+		Node_t &leaf = m_Nodes[iLeaf];
+		Node_t &right = m_Nodes[iRight];
+
+		const int nKeep = MAX_KEYS / 2;
+		right.m_nCount = MAX_KEYS - nKeep;
+		for ( int i = 0; i < right.m_nCount; i++ )
+		{
+			right.m_Keys[i] = leaf.m_Keys[nKeep + i];
+			right.m_Children[i] = leaf.m_Children[nKeep + i];
+			m_Elements[right.m_Children[i]].m_nLeaf = iRight;
+		}
+		leaf.m_nCount = nKeep;
+
+		right.m_nPrev = iLeaf;
+		right.m_nNext = leaf.m_nNext;
+		if ( leaf.m_nNext >= 0 )
+		{
+			m_Nodes[leaf.m_nNext].m_nPrev = iRight;
+		}
+		else
+		{
+			m_nLastLeaf = iRight;
+		}
+		leaf.m_nNext = iRight;
+
+		InsertIntoParent( iLeaf, right.m_Keys[0], iRight );
+
+		if ( nSlot > nKeep )
+		{
+			iLeaf = iRight;
+			nSlot -= nKeep;
+		}
+	}
+
+	Node_t &leaf = m_Nodes[iLeaf];
+	for ( int i = leaf.m_nCount; i > nSlot; i-- )
+	{
+		leaf.m_Keys[i] = leaf.m_Keys[i - 1];
+		leaf.m_Children[i] = leaf.m_Children[i - 1];
+	}
+	leaf.m_Keys[nSlot] = m_Elements[iElem].m_Key;
+	leaf.m_Children[nSlot] = iElem;
+	leaf.m_nCount++;
+	m_Elements[iElem].m_nLeaf = iLeaf;
+}
+
+template < typename K, typename T, typename L >
+void CUtlBTreeMap<K, T, L>::InsertIntoParent( int iLeft, const KeyType_t &separatorIn, int iRight )
+{
+	// copy, the separator may live in a node that moves when the array grows
+	KeyType_t separator = separatorIn;
+
+	int iParent = m_Nodes[iLeft].m_nParent;
+	if ( iParent < 0 )
+	{
+		int iRoot = AllocNode( false );
+		Node_t &root = m_Nodes[iRoot];
+		root.m_nCount = 1;
+		root.m_Keys[0] = separator;
+		root.m_Children[0] = iLeft;
+		root.m_Children[1] = iRight;
+		m_Nodes[iLeft].m_nParent = iRoot;
+		m_Nodes[iRight].m_nParent = iRoot;
+		m_nRoot = iRoot;
+		return;
+	}
+
+	int nSlot = ChildSlot( iParent, iLeft );
+	if ( m_Nodes[iParent].m_nCount == MAX_KEYS )
+	{
+		// split, pushing the middle key up
+		int iSplit = AllocNode( false );
+		Node_t &parent = m_Nodes[iParent];
+		Node_t &split = m_Nodes[iSplit];
+
+		const int nKeep = MAX_KEYS / 2;
+		KeyType_t promoted = parent.m_Keys[nKeep];
+		split.m_nCount = MAX_KEYS - nKeep - 1;
+		for ( int i = 0; i < split.m_nCount; i++ )
+		{
+			split.m_Keys[i] = parent.m_Keys[nKeep + 1 + i];
+		}
+		for ( int i = 0; i <= split.m_nCount; i++ )
+		{
+			split.m_Children[i] = parent.m_Children[nKeep + 1 + i];
+			m_Nodes[split.m_Children[i]].m_nParent = iSplit;
+		}
+		parent.m_nCount = nKeep;
+
+		InsertIntoParent( iParent, promoted, iSplit );
+
+		if ( nSlot > nKeep )
+		{
+			iParent = iSplit;
+			nSlot -= nKeep + 1;
+		}
+	}
+
+	Node_t &parent = m_Nodes[iParent];
+	for ( int i = parent.m_nCount; i > nSlot; i-- )
+	{
+		parent.m_Keys[i] = parent.m_Keys[i - 1];
+		parent.m_Children[i + 1] = parent.m_Children[i];
+	}
+	parent.m_Keys[nSlot] = separator;
+	parent.m_Children[nSlot + 1] = iRight;
+	parent.m_nCount++;
+	m_Nodes[iRight].m_nParent = iParent;
+}
+
+
+//-----------------------------------------------------------------------------
+// Bulk load from sorted input, building the tree a level at a time
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename L >
+void CUtlBTreeMap<K, T, L>::BulkLoad( const KeyType_t *pKeys, const ElemType_t *pElems, int nCount )
+{
+	Purge();
+	if ( nCount <= 0 )
+		return;
+
+	m_Elements.EnsureCapacity( nCount );
+	m_Nodes.EnsureCapacity( 2 * ( nCount / MAX_KEYS + 1 ) );
+
+	// spread the keys evenly over the fewest leaves
+	CUtlVector< int > level;
+	CUtlVector< KeyType_t > levelMin;
+	int nNodes = ( nCount + MAX_KEYS - 1 ) / MAX_KEYS;
+	int nFirst = 0;
+	for ( int n = 0; n < nNodes; n++ )
+	{
+		int nEnd = (int)( (int64)nCount * ( n + 1 ) / nNodes );
+		int iLeaf = AllocNode( true );
+		for ( int i = nFirst; i < nEnd; i++ )
+		{
+			Assert( i == 0 || !m_LessFunc( pKeys[i], pKeys[i - 1] ) );
+			int iElem = AllocElement( pKeys[i] );
+			if ( pElems )
+			{
+				CopyConstruct( &m_Elements[iElem].m_Elem, pElems[i] );
+			}
+			else
+			{
+				Construct( &m_Elements[iElem].m_Elem );
+			}
+			m_Elements[iElem].m_nLeaf = iLeaf;
+
+			Node_t &leaf = m_Nodes[iLeaf];
+			leaf.m_Keys[leaf.m_nCount] = pKeys[i];
+			leaf.m_Children[leaf.m_nCount] = iElem;
+			leaf.m_nCount++;
+		}
+
+		if ( level.Count() )
+		{
+			m_Nodes[iLeaf].m_nPrev = level.Tail();
+			m_Nodes[level.Tail()].m_nNext = iLeaf;
+		}
+		level.AddToTail( iLeaf );
+		levelMin.AddToTail( pKeys[nFirst] );
+		nFirst = nEnd;
+	}
+	m_nFirstLeaf = level.Head();
+	m_nLastLeaf = level.Tail();
+
+	// then group each level under the next, until one node is left
+	while ( level.Count() > 1 )
+	{
+		CUtlVector< int > parents;
+		CUtlVector< KeyType_t > parentMin;
+		nNodes = ( level.Count() + MAX_KEYS ) / ( MAX_KEYS + 1 );
+		nFirst = 0;
+		for ( int n = 0; n < nNodes; n++ )
+		{
+			int nEnd = (int)( (int64)level.Count() * ( n + 1 ) / nNodes );
+			int iNode = AllocNode( false );
+			Node_t &node = m_Nodes[iNode];
+			for ( int i = nFirst; i < nEnd; i++ )
+			{
+				if ( i > nFirst )
+				{
+					node.m_Keys[i - nFirst - 1] = levelMin[i];
+				}
+				node.m_Children[i - nFirst] = level[i];
+				m_Nodes[level[i]].m_nParent = iNode;
+			}
+			node.m_nCount = nEnd - nFirst - 1;
+
+			parents.AddToTail( iNode );
+			parentMin.AddToTail( levelMin[nFirst] );
+			nFirst = nEnd;
+		}
+
+		level.Swap( parents );
+		levelMin.Swap( parentMin );
+	}
+	m_nRoot = level.Head();
+}
+
+
+//-----------------------------------------------------------------------------
+// Find methods
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename L >
+typename CUtlBTreeMap<K, T, L>::IndexType_t CUtlBTreeMap<K, T, L>::FindFirstNotLess( const KeyType_t &key ) const
+{
+	if ( m_nRoot < 0 )
+		return InvalidIndex();
+
+	int iLeaf = LeafFor( key, false );
+	int nSlot = LowerBound( iLeaf, key );
+	if ( nSlot == m_Nodes[iLeaf].m_nCount )
+	{
+		// everything in this leaf is less, so it's the first key of the next one
+		iLeaf = m_Nodes[iLeaf].m_nNext;
+		if ( iLeaf < 0 )
+			return InvalidIndex();
+		nSlot = 0;
+	}
+	return m_Nodes[iLeaf].m_Children[nSlot];
+}
+
+template < typename K, typename T, typename L >
+typename CUtlBTreeMap<K, T, L>::IndexType_t CUtlBTreeMap<K, T, L>::FindFirstGreater( const KeyType_t &key ) const
+{
+	if ( m_nRoot < 0 )
+		return InvalidIndex();
+
+	int iLeaf = LeafFor( key, true );
+	int nSlot = UpperBound( iLeaf, key );
+	if ( nSlot == m_Nodes[iLeaf].m_nCount )
+	{
+		iLeaf = m_Nodes[iLeaf].m_nNext;
+		if ( iLeaf < 0 )
+			return InvalidIndex();
+		nSlot = 0;
+	}
+	return m_Nodes[iLeaf].m_Children[nSlot];
+}
+
+template < typename K, typename T, typename L >
+typename CUtlBTreeMap<K, T, L>::IndexType_t CUtlBTreeMap<K, T, L>::Find( const KeyType_t &key ) const
+{
+	int i = FindFirstNotLess( key );
+	if ( i == InvalidIndex() || m_LessFunc( key, m_Elements[i].m_Key ) )
+		return InvalidIndex();
+	return i;
+}
+
+
+//-----------------------------------------------------------------------------
+// Removal
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename L >
+void CUtlBTreeMap<K, T, L>::RemoveAt( IndexType_t i )
+{
+	Assert( IsValidIndex( i ) );
+
+	int iLeaf = m_Elements[i].m_nLeaf;
+	int nSlot = ChildSlot( iLeaf, i );
+	FreeElement( i );
+
+	Node_t &leaf = m_Nodes[iLeaf];
+	leaf.m_nCount--;
+	for ( int j = nSlot; j < leaf.m_nCount; j++ )
+	{
+		leaf.m_Keys[j] = leaf.m_Keys[j + 1];
+		leaf.m_Children[j] = leaf.m_Children[j + 1];
+	}
+
+	if ( leaf.m_nCount > 0 )
+		return;
+
+	// unlink the empty leaf
+	if ( leaf.m_nPrev >= 0 )
+	{
+		m_Nodes[leaf.m_nPrev].m_nNext = leaf.m_nNext;
+	}
+	else
+	{
+		m_nFirstLeaf = leaf.m_nNext;
+	}
+	if ( leaf.m_nNext >= 0 )
+	{
+		m_Nodes[leaf.m_nNext].m_nPrev = leaf.m_nPrev;
+	}
+	else
+	{
+		m_nLastLeaf = leaf.m_nPrev;
+	}
+
+	if ( leaf.m_nParent >= 0 )
+	{
+		RemoveChild( leaf.m_nParent, iLeaf );
+	}
+	else
+	{
+		m_nRoot = -1;
+	}
+	FreeNode( iLeaf );
+}
+
+template < typename K, typename T, typename L >
+void CUtlBTreeMap<K, T, L>::RemoveChild( int iNode, int iChild )
+{
+	int nSlot = ChildSlot( iNode, iChild );
+	Node_t &node = m_Nodes[iNode];
+
+	if ( node.m_nCount == 0 )
+	{
+		// that was the only child, so this node goes too
+		if ( node.m_nParent >= 0 )
+		{
+			RemoveChild( node.m_nParent, iNode );
+		}
+		else
+		{
+			m_nRoot = -1;
+		}
+		FreeNode( iNode );
+		return;
+	}
+
+	// drop the child along with the separator on its left (right for the first)
+	int nKey = ( nSlot > 0 ) ? nSlot - 1 : 0;
+	for ( int j = nKey; j < node.m_nCount - 1; j++ )
+	{
+		node.m_Keys[j] = node.m_Keys[j + 1];
+	}
+	for ( int j = nSlot; j < node.m_nCount; j++ )
+	{
+		node.m_Children[j] = node.m_Children[j + 1];
+	}
+	node.m_nCount--;
+
+	// collapse a root that's down to one child
+	if ( iNode == m_nRoot && node.m_nCount == 0 )
+	{
+		m_nRoot = node.m_Children[0];
+		m_Nodes[m_nRoot].m_nParent = -1;
+		FreeNode( iNode );
+	}
+}
+
+template < typename K, typename T, typename L >
+bool CUtlBTreeMap<K, T, L>::Remove( const KeyType_t &key )
+{
+	int i = Find( key );
+	if ( i == InvalidIndex() )
+		return false;
+
+	RemoveAt( i );
+	return true;
+}
+
+template < typename K, typename T, typename L >
+void CUtlBTreeMap<K, T, L>::RemoveAll()
+{
+	for ( int i = 0; i < m_nMaxElement; i++ )
+	{
+		if ( IsValidIndex( i ) )
+		{
+			Destruct( &m_Elements[i].m_Key );
+			Destruct( &m_Elements[i].m_Elem );
+		}
+	}
+
+	// free nodes have had their keys destructed already
+	CUtlVector< bool > bFree;
+	bFree.SetCount( m_nMaxNode );
+	V_memset( bFree.Base(), 0, m_nMaxNode * sizeof( bool ) );
+	for ( int i = 0; i < m_FreeNodes.Count(); i++ )
+	{
+		bFree[m_FreeNodes[i]] = true;
+	}
+	for ( int i = 0; i < m_nMaxNode; i++ )
+	{
+		if ( !bFree[i] )
+		{
+			for ( int j = 0; j < MAX_KEYS; j++ )
+			{
+				Destruct( &m_Nodes[i].m_Keys[j] );
+			}
+		}
+	}
+
+	m_FreeNodes.RemoveAll();
+	m_FreeElements.RemoveAll();
+	m_nMaxNode = 0;
+	m_nMaxElement = 0;
+	m_nCount = 0;
+	m_nRoot = m_nFirstLeaf = m_nLastLeaf = -1;
+}
+
+template < typename K, typename T, typename L >
+void CUtlBTreeMap<K, T, L>::Purge()
+{
+	RemoveAll();
+	m_Nodes.Purge();
+	m_Elements.Purge();
+	m_FreeNodes.Purge();
+	m_FreeElements.Purge();
+}
+
+template < typename K, typename T, typename L >
+void CUtlBTreeMap<K, T, L>::PurgeAndDeleteElements()
+{
+	for ( int i = 0; i < m_nMaxElement; i++ )
+	{
+		if ( IsValidIndex( i ) )
+		{
+			delete Element( i );
+		}
+	}
+
+	Purge();
+}
+
+
+//-----------------------------------------------------------------------------
+// Iteration
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename L >
+inline typename CUtlBTreeMap<K, T, L>::IndexType_t CUtlBTreeMap<K, T, L>::FirstInorder() const
+{
+	return ( m_nFirstLeaf >= 0 ) ? m_Nodes[m_nFirstLeaf].m_Children[0] : InvalidIndex();
+}
+
+template < typename K, typename T, typename L >
+inline typename CUtlBTreeMap<K, T, L>::IndexType_t CUtlBTreeMap<K, T, L>::LastInorder() const
+{
+	return ( m_nLastLeaf >= 0 ) ? m_Nodes[m_nLastLeaf].m_Children[m_Nodes[m_nLastLeaf].m_nCount - 1] : InvalidIndex();
+}
+
+template < typename K, typename T, typename L >
+typename CUtlBTreeMap<K, T, L>::IndexType_t CUtlBTreeMap<K, T, L>::NextInorder( IndexType_t i ) const
+{
+	Assert( IsValidIndex( i ) );
+	int iLeaf = m_Elements[i].m_nLeaf;
+	int nSlot = ChildSlot( iLeaf, i ) + 1;
+	if ( nSlot < m_Nodes[iLeaf].m_nCount )
+		return m_Nodes[iLeaf].m_Children[nSlot];
+
+	iLeaf = m_Nodes[iLeaf].m_nNext;
+	return ( iLeaf >= 0 ) ? m_Nodes[iLeaf].m_Children[0] : InvalidIndex();
+}
+
+template < typename K, typename T, typename L >
+typename CUtlBTreeMap<K, T, L>::IndexType_t CUtlBTreeMap<K, T, L>::PrevInorder( IndexType_t i ) const
+{
+	Assert( IsValidIndex( i ) );
+	int iLeaf = m_Elements[i].m_nLeaf;
+	int nSlot = ChildSlot( iLeaf, i ) - 1;
+	if ( nSlot >= 0 )
+		return m_Nodes[iLeaf].m_Children[nSlot];
+
+	iLeaf = m_Nodes[iLeaf].m_nPrev;
+	return ( iLeaf >= 0 ) ? m_Nodes[iLeaf].m_Children[m_Nodes[iLeaf].m_nCount - 1] : InvalidIndex();
+}
+
+
+//-----------------------------------------------------------------------------
+// Validation
+//-----------------------------------------------------------------------------
+template < typename K, typename T, typename L >
+int CUtlBTreeMap<K, T, L>::Depth() const
+{
+	int nDepth = 0;
+	for ( int iNode = m_nRoot; iNode >= 0; iNode = m_Nodes[iNode].m_bLeaf ? -1 : m_Nodes[iNode].m_Children[0] )
+	{
+		nDepth++;
+	}
+	return nDepth;
+}
+
+template < typename K, typename T, typename L >
+bool CUtlBTreeMap<K, T, L>::IsValidNode( int iNode, const KeyType_t *pMin, const KeyType_t *pMax, int nDepth, int &nLeafDepth, int &nElements ) const
+{
+	const Node_t &node = m_Nodes[iNode];
+	for ( int i = 0; i < node.m_nCount; i++ )
+	{
+		if ( ( pMin && m_LessFunc( node.m_Keys[i], *pMin ) ) || ( pMax && m_LessFunc( *pMax, node.m_Keys[i] ) ) )
+			return false;
+		if ( i > 0 && m_LessFunc( node.m_Keys[i], node.m_Keys[i - 1] ) )
+			return false;
+	}
+
+	if ( node.m_bLeaf )
+	{
+		if ( node.m_nCount <= 0 || ( nLeafDepth >= 0 && nLeafDepth != nDepth ) )
+			return false;
+		nLeafDepth = nDepth;
+
+		for ( int i = 0; i < node.m_nCount; i++ )
+		{
+			const Elem_t &elem = m_Elements[node.m_Children[i]];
+			if ( elem.m_nLeaf != iNode || m_LessFunc( elem.m_Key, node.m_Keys[i] ) || m_LessFunc( node.m_Keys[i], elem.m_Key ) )
+				return false;
+		}
+		nElements += node.m_nCount;
+		return true;
+	}
+
+	for ( int i = 0; i <= node.m_nCount; i++ )
+	{
+		int iChild = node.m_Children[i];
+		if ( m_Nodes[iChild].m_nParent != iNode )
+			return false;
+		if ( !IsValidNode( iChild, ( i > 0 ) ? &node.m_Keys[i - 1] : pMin, ( i < node.m_nCount ) ? &node.m_Keys[i] : pMax, nDepth + 1, nLeafDepth, nElements ) )
+			return false;
+	}
+	return true;
+}
+
+template < typename K, typename T, typename L >
+bool CUtlBTreeMap<K, T, L>::IsValid() const
+{
+	if ( m_nRoot < 0 )
+		return ( m_nCount == 0 ) && ( m_nFirstLeaf < 0 ) && ( m_nLastLeaf < 0 );
+
+	int nLeafDepth = -1;
+	int nElements = 0;
+	if ( m_Nodes[m_nRoot].m_nParent >= 0 || !IsValidNode( m_nRoot, NULL, NULL, 0, nLeafDepth, nElements ) )
+		return false;
+	if ( nElements != m_nCount )
+		return false;
+
+	// the leaf list runs through every element in order
+	int nListed = 0;
+	int iPrev = -1;
+	for ( int iLeaf = m_nFirstLeaf; iLeaf >= 0; iLeaf = m_Nodes[iLeaf].m_nNext )
+	{
+		if ( m_Nodes[iLeaf].m_nPrev != iPrev )
+			return false;
+		if ( iPrev >= 0 && m_LessFunc( m_Nodes[iLeaf].m_Keys[0], m_Nodes[iPrev].m_Keys[m_Nodes[iPrev].m_nCount - 1] ) )
+			return false;
+		nListed += m_Nodes[iLeaf].m_nCount;
+		iPrev = iLeaf;
+	}
+	return ( iPrev == m_nLastLeaf ) && ( nListed == m_nCount );
+}
+
+#endif // UTLBTREEMAP_H
@@ -10,6 +10,8 @@
 #define UTLCOMMON_H
 #pragma once
 
+#include "generichash.h"
+
 //-----------------------------------------------------------------------------
 // Henry Goffin (henryg) was here. Questions? Bugs? Go slap him around a bit.
 //-----------------------------------------------------------------------------
@@ -312,33 +314,17 @@ inline unsigned int Mix32HashFunctor::operator()( uint32 n ) const
 	return n;
 }
 
-// Based on the widely-used FNV-1A string hash with a final
-// mixing step to improve dispersion for very small and very
-// large hash table sizes.
+// These only key in-memory tables, so they use the fast string hash,
+// which isn't stable between versions.
 inline unsigned int StringHashFunctor::operator()( const char* s ) const
 {
-	uint32 h = 2166136261u;
-	for ( ; *s; ++s )
-	{
-		uint32 c = (unsigned char) *s;
-		h = (h ^ c) * 16777619;
-	}
-	return (h ^ (h << 17)) + (h >> 21);
+	return FastHashString32( s );
 }
 
 // Equivalent to StringHashFunctor on lower-case strings.
 inline unsigned int CaselessStringHashFunctor::operator()( const char* s ) const
 {
-	uint32 h = 2166136261u;
-	for ( ; *s; ++s )
-	{
-		uint32 c = (unsigned char) *s;
-		// Brutally fast branchless ASCII tolower():
-		// if ((c >= 'A') && (c <= 'Z')) c += ('a' - 'A');
-		c += (((('A'-1) - c) & (c - ('Z'+1))) >> 26) & 32;
-		h = (h ^ c) * 16777619;
-	}
-	return (h ^ (h << 17)) + (h >> 21);
+	return FastHashStringCaseless32( s );
 }
 
 
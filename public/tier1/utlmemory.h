@@ -39,6 +39,29 @@
 #endif
 
 
+//-----------------------------------------------------------------------------
+// The containers move their elements around with realloc and memmove, which is
+// only valid for types that don't point into themselves. That covers nearly
+// everything (CUtlString and CUtlVector included), so it's the default. A type
+// that can't be moved bytewise opts out with DECLARE_NOT_TRIVIALLY_RELOCATABLE,
+// and CUtlVector then relocates it with its move (or copy) constructor instead.
+// The other containers still require trivially relocatable elements.
+//-----------------------------------------------------------------------------
+template < bool b >
+struct CUtlBoolConstant
+{
+	enum { value = b };
+};
+
+template < class T >
+struct CUtlIsTriviallyRelocatable : public CUtlBoolConstant< true >
+{
+};
+
+#define DECLARE_NOT_TRIVIALLY_RELOCATABLE( T ) \
+	template <> struct CUtlIsTriviallyRelocatable< T > : public CUtlBoolConstant< false > {};
+
+
 //-----------------------------------------------------------------------------
 // The CUtlMemory class:
 // A growable memory class which doubles in size by default.
@@ -155,6 +178,22 @@ protected:
 };
 
 
+//-----------------------------------------------------------------------------
+// True for the allocators whose memory CUtlVector can take over with Swap. The
+// fixed allocators point into themselves (or have no Swap at all), so moving a
+// vector that uses one has to move its elements instead.
+//-----------------------------------------------------------------------------
+template < class A >
+struct CUtlMemoryIsSwappable : public CUtlBoolConstant< false >
+{
+};
+
+template < class T, class I >
+struct CUtlMemoryIsSwappable< CUtlMemory< T, I > > : public CUtlBoolConstant< true >
+{
+};
+
+
 //-----------------------------------------------------------------------------
 // The CUtlMemory class:
 // A growable memory class which doubles in size by default.
@@ -657,6 +696,27 @@ inline bool CUtlMemory<T,I>::IsIdxValid( I i ) const
 	return (uint32)i < (uint32)m_nAllocationCount;
 }
 
+//-----------------------------------------------------------------------------
+// Rounds an allocation up to the end of the allocator's size class it falls in:
+// 16 byte steps for small blocks, four classes per power of two above that and
+// whole pages for large blocks. The allocator hands out that much anyway.
+//-----------------------------------------------------------------------------
+inline int64 UtlMemory_RoundToSizeClass( int64 nBytes )
+{
+	if ( nBytes <= 256 )
+		return ( nBytes + 15 ) & ~15;
+
+	if ( nBytes >= 64 * 1024 )
+		return ( nBytes + 4095 ) & ~4095;
+
+	int64 nStep = 16;
+	while ( nStep * 16 < nBytes )
+	{
+		nStep *= 2;
+	}
+	return ( nBytes + nStep - 1 ) & ~( nStep - 1 );
+}
+
 //-----------------------------------------------------------------------------
 // Grows the memory
 //-----------------------------------------------------------------------------
@@ -677,7 +737,12 @@ inline int UtlMemory_CalcNewAllocationCount( int nAllocationCount, int nGrowSize
 		while (nAllocationCount < nNewSize)
 		{
 #ifndef _X360
-			nAllocationCount *= 2;
+			// double small blocks, but only grow by half once a block is large
+			// enough that the slack matters more than the number of reallocs
+			if ( (int64)nAllocationCount * nBytesItem < 64 * 1024 )
+				nAllocationCount *= 2;
+			else
+				nAllocationCount += MAX( 1, nAllocationCount / 2 );
 #else
 			int nNewAllocationCount = ( nAllocationCount * 9) / 8; // 12.5 %
 			if ( nNewAllocationCount > nAllocationCount )
@@ -686,6 +751,15 @@ inline int UtlMemory_CalcNewAllocationCount( int nAllocationCount, int nGrowSize
 				nAllocationCount *= 2;
 #endif
 		}
+
+#ifndef _X360
+		// use whatever the allocator would round the block up to
+		int64 nRoundedCount = UtlMemory_RoundToSizeClass( (int64)nAllocationCount * nBytesItem ) / nBytesItem;
+		if ( nRoundedCount > nAllocationCount && nRoundedCount <= 0x7fffffff )
+		{
+			nAllocationCount = (int)nRoundedCount;
+		}
+#endif
 	}
 
 	return nAllocationCount;
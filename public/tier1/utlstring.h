@@ -79,10 +79,14 @@ public:
 	// Move assignment operator:
 	CUtlString& operator=( CUtlString&& rhs )
 	{
-		// Move the string pointer from the source to this -- be sure to
+		// Free what we had, then take the source's string -- be sure to
 		// zero out the source to avoid double frees.
-		m_pString = rhs.m_pString;
-		rhs.m_pString = 0;
+		if ( this != &rhs )
+		{
+			Purge();
+			m_pString = rhs.m_pString;
+			rhs.m_pString = 0;
+		}
 		return *this;
 	}
 #endif
@@ -258,6 +262,98 @@ inline bool operator!=( const CUtlString &utlString, const char *pString )
 
 
 
+//-----------------------------------------------------------------------------
+// String for building names and paths: the first 23 characters are stored
+// inline, so short strings never touch the heap, and past that the buffer
+// grows geometrically, so appending is amortized constant time (CUtlString
+// reallocates on every append).
+// CUtlString itself stays a single pointer since the engine and the prebuilt
+// libraries share its layout, e.g. through ICommandCompletionCallback's
+// CUtlVector< CUtlString >.
+//-----------------------------------------------------------------------------
+class CUtlStringBuilder
+{
+public:
+	CUtlStringBuilder();
+	CUtlStringBuilder( const char *pString );
+	CUtlStringBuilder( const char *pString, int nChars );
+	CUtlStringBuilder( const CUtlStringBuilder &other );
+	~CUtlStringBuilder();
+
+#ifdef MOVE_CONSTRUCTOR_SUPPORT
+	CUtlStringBuilder( CUtlStringBuilder &&other );
+	CUtlStringBuilder &operator=( CUtlStringBuilder &&other );
+#endif
+
+	CUtlStringBuilder &operator=( const CUtlStringBuilder &other );
+	CUtlStringBuilder &operator=( const char *pString );
+
+	const char	*Get() const								{ return IsHeap() ? m_Heap.m_pString : m_szInline; }
+	const char	*String() const								{ return Get(); }
+	operator const char*() const							{ return Get(); }
+
+	int			Length() const								{ return IsHeap() ? m_Heap.m_nLength : INLINE_CAPACITY - (uint8)m_szInline[ INLINE_CAPACITY ]; }
+	bool		IsEmpty() const								{ return Length() == 0; }
+
+	// Number of characters that fit without reallocating, not counting the terminator
+	int			Capacity() const							{ return IsHeap() ? m_Heap.m_nCapacity : INLINE_CAPACITY; }
+	void		EnsureCapacity( int nChars );
+
+	void		Set( const char *pString );
+	// Copies at most nChars, stopping early at a terminator
+	void		SetDirect( const char *pString, int nChars );
+
+	void		Append( const char *pAddition );
+	// Appends at most nChars, stopping early at a terminator
+	void		Append( const char *pAddition, int nChars );
+	void		Append( char c );
+
+	CUtlStringBuilder &operator+=( const char *pAddition )	{ Append( pAddition ); return *this; }
+	CUtlStringBuilder &operator+=( char c )					{ Append( c ); return *this; }
+
+	// The arguments must not point into this string.
+	// Return the number of characters written.
+	int			Format( PRINTF_FORMAT_STRING const char *pFormat, ... ) FMTFUNCTION( 2, 3 );
+	int			FormatV( PRINTF_FORMAT_STRING const char *pFormat, va_list marker );
+	int			AppendFormat( PRINTF_FORMAT_STRING const char *pFormat, ... ) FMTFUNCTION( 2, 3 );
+	int			AppendFormatV( PRINTF_FORMAT_STRING const char *pFormat, va_list marker );
+
+	void		ToLower();
+	void		ToUpper();
+
+	// Clear() keeps the buffer for reuse, Purge() frees it
+	void		Clear();
+	void		Purge();
+
+private:
+	enum
+	{
+		INLINE_CAPACITY = 23,
+		HEAP_MARKER = 0xff,
+	};
+
+	bool		IsHeap() const								{ return (uint8)m_szInline[ INLINE_CAPACITY ] == HEAP_MARKER; }
+	char		*Base()										{ return IsHeap() ? m_Heap.m_pString : m_szInline; }
+	void		SetLengthInternal( int nLength );
+
+	struct HeapString_t
+	{
+		char	*m_pString;
+		int		m_nLength;
+		int		m_nCapacity;
+	};
+
+	union
+	{
+		HeapString_t	m_Heap;
+
+		// The last byte is INLINE_CAPACITY - Length() for an inline string, which makes
+		// it the terminator when the buffer is full, or HEAP_MARKER for a heap string.
+		char			m_szInline[ INLINE_CAPACITY + 1 ];
+	};
+};
+
+
 //-----------------------------------------------------------------------------
 // Inline methods
 //-----------------------------------------------------------------------------
@@ -319,6 +415,75 @@ inline CUtlString::operator const char*() const
 	return Get();
 }
 
+inline CUtlStringBuilder::CUtlStringBuilder()
+{
+	m_szInline[ 0 ] = 0;
+	m_szInline[ INLINE_CAPACITY ] = INLINE_CAPACITY;
+}
+
+inline CUtlStringBuilder::CUtlStringBuilder( const char *pString )
+{
+	m_szInline[ 0 ] = 0;
+	m_szInline[ INLINE_CAPACITY ] = INLINE_CAPACITY;
+	Set( pString );
+}
+
+inline CUtlStringBuilder::CUtlStringBuilder( const char *pString, int nChars )
+{
+	m_szInline[ 0 ] = 0;
+	m_szInline[ INLINE_CAPACITY ] = INLINE_CAPACITY;
+	SetDirect( pString, nChars );
+}
+
+inline CUtlStringBuilder::CUtlStringBuilder( const CUtlStringBuilder &other )
+{
+	m_szInline[ 0 ] = 0;
+	m_szInline[ INLINE_CAPACITY ] = INLINE_CAPACITY;
+	SetDirect( other.Get(), other.Length() );
+}
+
+inline CUtlStringBuilder::~CUtlStringBuilder()
+{
+	Purge();
+}
+
+#ifdef MOVE_CONSTRUCTOR_SUPPORT
+inline CUtlStringBuilder::CUtlStringBuilder( CUtlStringBuilder &&other )
+{
+	// Neither representation points into the object, so the bytes can just be taken
+	memcpy( m_szInline, other.m_szInline, sizeof( m_szInline ) );
+	other.m_szInline[ 0 ] = 0;
+	other.m_szInline[ INLINE_CAPACITY ] = INLINE_CAPACITY;
+}
+
+inline CUtlStringBuilder &CUtlStringBuilder::operator=( CUtlStringBuilder &&other )
+{
+	if ( this != &other )
+	{
+		Purge();
+		memcpy( m_szInline, other.m_szInline, sizeof( m_szInline ) );
+		other.m_szInline[ 0 ] = 0;
+		other.m_szInline[ INLINE_CAPACITY ] = INLINE_CAPACITY;
+	}
+	return *this;
+}
+#endif
+
+inline CUtlStringBuilder &CUtlStringBuilder::operator=( const CUtlStringBuilder &other )
+{
+	if ( this != &other )
+	{
+		SetDirect( other.Get(), other.Length() );
+	}
+	return *this;
+}
+
+inline CUtlStringBuilder &CUtlStringBuilder::operator=( const char *pString )
+{
+	Set( pString );
+	return *this;
+}
+
 
 
 //-----------------------------------------------------------------------------
@@ -55,6 +55,13 @@ public:
 	// Copy the array.
 	CUtlVector<T, A>& operator=( const CUtlVector<T, A> &other );
 
+#ifdef MOVE_CONSTRUCTOR_SUPPORT
+	// Take over the other vector's memory (or just its elements, when the
+	// allocator keeps them inline), leaving it empty.
+	CUtlVector( CUtlVector<T, A> &&other );
+	CUtlVector<T, A>& operator=( CUtlVector<T, A> &&other );
+#endif
+
 	// element access
 	T& operator[]( int i );
 	const T& operator[]( int i ) const;
@@ -105,6 +112,23 @@ public:
 	int InsertBefore( int elem, const T& src );
 	int InsertAfter( int elem, const T& src );
 
+	// Adds an element, uses the move constructor (the copy constructor if the
+	// compiler has no rvalue references). src is left in its moved-from state.
+	int AddToHeadMove( T& src );
+	int AddToTailMove( T& src );
+	int InsertBeforeMove( int elem, T& src );
+
+#ifdef MOVE_CONSTRUCTOR_SUPPORT
+	int AddToHead( T&& src )				{ return InsertBeforeMove( 0, src ); }
+	int AddToTail( T&& src )				{ return InsertBeforeMove( m_Size, src ); }
+	int InsertBefore( int elem, T&& src )	{ return InsertBeforeMove( elem, src ); }
+#endif
+
+	// Adds an element to the tail, constructed in place from the arguments
+	template < typename ARG1 > int EmplaceToTail( const ARG1 &a1 );
+	template < typename ARG1, typename ARG2 > int EmplaceToTail( const ARG1 &a1, const ARG2 &a2 );
+	template < typename ARG1, typename ARG2, typename ARG3 > int EmplaceToTail( const ARG1 &a1, const ARG2 &a2, const ARG3 &a3 );
+
 	// Adds multiple elements, uses default constructor
 	int AddMultipleToHead( int num );
 	int AddMultipleToTail( int num, const T *pToCopy=NULL );	   
@@ -176,6 +200,24 @@ protected:
 	void ShiftElementsRight( int elem, int num = 1 );
 	void ShiftElementsLeft( int elem, int num = 1 );
 
+	// Moves constructed elements into raw slots, and reallocates the memory.
+	// See CUtlIsTriviallyRelocatable; the false versions are only instantiated
+	// for the types that need them.
+	void RelocateElements( int dest, int src, int num, CUtlBoolConstant<true> );
+	void RelocateElements( int dest, int src, int num, CUtlBoolConstant<false> );
+	void GrowMemory( int num, CUtlBoolConstant<true> )		{ m_Memory.Grow( num ); }
+	void GrowMemory( int num, CUtlBoolConstant<false> );
+	void EnsureMemory( int num, CUtlBoolConstant<true> )	{ m_Memory.EnsureCapacity( num ); }
+	void EnsureMemory( int num, CUtlBoolConstant<false> );
+	void CompactMemory( CUtlBoolConstant<true> )			{ m_Memory.Purge( m_Size ); }
+	void CompactMemory( CUtlBoolConstant<false> );
+	T *MoveElementsOut();
+	void MoveElementsIn( T *pTemp );
+
+	// Takes the other vector's elements. See CUtlMemoryIsSwappable.
+	void MoveFrom( CUtlVector<T, A> &other, CUtlBoolConstant<true> )	{ Swap( other ); }
+	void MoveFrom( CUtlVector<T, A> &other, CUtlBoolConstant<false> );
+
 	CAllocator m_Memory;
 	int m_Size;
 
@@ -590,6 +632,39 @@ inline CUtlVector<T, A>& CUtlVector<T, A>::operator=( const CUtlVector<T, A> &ot
 	return *this;
 }
 
+#ifdef MOVE_CONSTRUCTOR_SUPPORT
+template< typename T, class A >
+inline CUtlVector<T, A>::CUtlVector( CUtlVector<T, A> &&other ) : m_Size(0)
+{
+	ResetDbgInfo();
+	MoveFrom( other, CUtlMemoryIsSwappable<A>() );
+}
+
+template< typename T, class A >
+inline CUtlVector<T, A>& CUtlVector<T, A>::operator=( CUtlVector<T, A> &&other )
+{
+	if ( this != &other )
+	{
+		Purge();
+		MoveFrom( other, CUtlMemoryIsSwappable<A>() );
+	}
+	return *this;
+}
+#endif
+
+template< typename T, class A >
+void CUtlVector<T, A>::MoveFrom( CUtlVector<T, A> &other, CUtlBoolConstant<false> )
+{
+	// the memory can't change hands, so move the elements one at a time
+	int nCount = other.Count();
+	EnsureCapacity( nCount );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		AddToTailMove( other[i] );
+	}
+	other.RemoveAll();
+}
+
 #ifdef STAGING_ONLY
 inline void StagingUtlVectorBoundsCheck( int i, int size )
 {
@@ -752,7 +827,7 @@ void CUtlVector<T, A>::GrowVector( int num )
 	if (m_Size + num > m_Memory.NumAllocated())
 	{
 		MEM_ALLOC_CREDIT_CLASS();
-		m_Memory.Grow( m_Size + num - m_Memory.NumAllocated() );
+		GrowMemory( m_Size + num - m_Memory.NumAllocated(), CUtlIsTriviallyRelocatable<T>() );
 	}
 
 	m_Size += num;
@@ -760,6 +835,95 @@ void CUtlVector<T, A>::GrowVector( int num )
 }
 
 
+//-----------------------------------------------------------------------------
+// Relocation of elements that can't be moved bytewise. They are moved out to a
+// temporary buffer while the memory is reallocated, then moved back.
+//-----------------------------------------------------------------------------
+template< typename T, class A >
+T *CUtlVector<T, A>::MoveElementsOut()
+{
+	if ( m_Size == 0 )
+		return NULL;
+
+	T *pTemp = (T*)malloc( m_Size * sizeof(T) );
+	for ( int i = 0; i < m_Size; ++i )
+	{
+		MoveConstruct( &pTemp[i], Element(i) );
+		Destruct( &Element(i) );
+	}
+	return pTemp;
+}
+
+template< typename T, class A >
+void CUtlVector<T, A>::MoveElementsIn( T *pTemp )
+{
+	if ( !pTemp )
+		return;
+
+	for ( int i = 0; i < m_Size; ++i )
+	{
+		MoveConstruct( &Element(i), pTemp[i] );
+		Destruct( &pTemp[i] );
+	}
+	free( pTemp );
+}
+
+template< typename T, class A >
+void CUtlVector<T, A>::GrowMemory( int num, CUtlBoolConstant<false> )
+{
+	T *pTemp = MoveElementsOut();
+	m_Memory.Grow( num );
+	MoveElementsIn( pTemp );
+}
+
+template< typename T, class A >
+void CUtlVector<T, A>::EnsureMemory( int num, CUtlBoolConstant<false> )
+{
+	if ( m_Memory.NumAllocated() >= num )
+		return;
+
+	T *pTemp = MoveElementsOut();
+	m_Memory.EnsureCapacity( num );
+	MoveElementsIn( pTemp );
+}
+
+template< typename T, class A >
+void CUtlVector<T, A>::CompactMemory( CUtlBoolConstant<false> )
+{
+	T *pTemp = MoveElementsOut();
+	m_Memory.Purge( m_Size );
+	MoveElementsIn( pTemp );
+}
+
+template< typename T, class A >
+inline void CUtlVector<T, A>::RelocateElements( int dest, int src, int num, CUtlBoolConstant<true> )
+{
+	Q_memmove( reinterpret_cast<void*>( &Element(dest) ), reinterpret_cast<void*>( &Element(src) ), num * sizeof(T) );
+}
+
+template< typename T, class A >
+void CUtlVector<T, A>::RelocateElements( int dest, int src, int num, CUtlBoolConstant<false> )
+{
+	// walk away from the destination so the slots written are always free
+	if ( dest > src )
+	{
+		for ( int i = num; --i >= 0; )
+		{
+			MoveConstruct( &Element(dest+i), Element(src+i) );
+			Destruct( &Element(src+i) );
+		}
+	}
+	else
+	{
+		for ( int i = 0; i < num; ++i )
+		{
+			MoveConstruct( &Element(dest+i), Element(src+i) );
+			Destruct( &Element(src+i) );
+		}
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Sorts the vector
 //-----------------------------------------------------------------------------
@@ -767,6 +931,8 @@ template< typename T, class A >
 void CUtlVector<T, A>::Sort( int (__cdecl *pfnCompare)(const T *, const T *) )
 {
 	typedef int (__cdecl *QSortCompareFunc_t)(const void *, const void *);
+	// qsort swaps the elements bytewise
+	COMPILE_TIME_ASSERT( CUtlIsTriviallyRelocatable<T>::value );
 	if ( Count() <= 1 )
 		return;
 
@@ -802,7 +968,7 @@ template< typename T, class A >
 void CUtlVector<T, A>::EnsureCapacity( int num )
 {
 	MEM_ALLOC_CREDIT_CLASS();
-	m_Memory.EnsureCapacity(num);
+	EnsureMemory( num, CUtlIsTriviallyRelocatable<T>() );
 	ResetDbgInfo();
 }
 
@@ -827,7 +993,7 @@ void CUtlVector<T, A>::ShiftElementsRight( int elem, int num )
 	Assert( IsValidIndex(elem) || ( m_Size == 0 ) || ( num == 0 ));
 	int numToMove = m_Size - elem - num;
 	if ((numToMove > 0) && (num > 0))
-		Q_memmove( &Element(elem+num), &Element(elem), numToMove * sizeof(T) );
+		RelocateElements( elem+num, elem, numToMove, CUtlIsTriviallyRelocatable<T>() );
 }
 
 template< typename T, class A >
@@ -837,7 +1003,7 @@ void CUtlVector<T, A>::ShiftElementsLeft( int elem, int num )
 	int numToMove = m_Size - elem - num;
 	if ((numToMove > 0) && (num > 0))
 	{
-		Q_memmove( &Element(elem), &Element(elem+num), numToMove * sizeof(T) );
+		RelocateElements( elem, elem+num, numToMove, CUtlIsTriviallyRelocatable<T>() );
 
 #ifdef _DEBUG
 		Q_memset( &Element(m_Size-num), 0xDD, num * sizeof(T) );
@@ -923,6 +1089,68 @@ int CUtlVector<T, A>::InsertBefore( int elem, const T& src )
 }
 
 
+//-----------------------------------------------------------------------------
+// Adds an element, uses move constructor
+//-----------------------------------------------------------------------------
+template< typename T, class A >
+inline int CUtlVector<T, A>::AddToHeadMove( T& src )
+{
+	return InsertBeforeMove( 0, src );
+}
+
+template< typename T, class A >
+inline int CUtlVector<T, A>::AddToTailMove( T& src )
+{
+	return InsertBeforeMove( m_Size, src );
+}
+
+template< typename T, class A >
+int CUtlVector<T, A>::InsertBeforeMove( int elem, T& src )
+{
+	// Can't insert something that's in the list... reallocation may hose us
+	Assert( (Base() == NULL) || (&src < Base()) || (&src >= (Base() + Count()) ) ); 
+
+	// Can insert at the end
+	Assert( (elem == Count()) || IsValidIndex(elem) );
+
+	GrowVector();
+	ShiftElementsRight(elem);
+	MoveConstruct( &Element(elem), src );
+	return elem;
+}
+
+
+//-----------------------------------------------------------------------------
+// Adds an element to the tail, constructed in place
+//-----------------------------------------------------------------------------
+template< typename T, class A >
+template < typename ARG1 >
+int CUtlVector<T, A>::EmplaceToTail( const ARG1 &a1 )
+{
+	GrowVector();
+	::new( &Element(m_Size-1) ) T( a1 );
+	return m_Size - 1;
+}
+
+template< typename T, class A >
+template < typename ARG1, typename ARG2 >
+int CUtlVector<T, A>::EmplaceToTail( const ARG1 &a1, const ARG2 &a2 )
+{
+	GrowVector();
+	::new( &Element(m_Size-1) ) T( a1, a2 );
+	return m_Size - 1;
+}
+
+template< typename T, class A >
+template < typename ARG1, typename ARG2, typename ARG3 >
+int CUtlVector<T, A>::EmplaceToTail( const ARG1 &a1, const ARG2 &a2, const ARG3 &a3 )
+{
+	GrowVector();
+	::new( &Element(m_Size-1) ) T( a1, a2, a3 );
+	return m_Size - 1;
+}
+
+
 //-----------------------------------------------------------------------------
 // Adds multiple elements, uses default constructor
 //-----------------------------------------------------------------------------
@@ -1074,7 +1302,7 @@ void CUtlVector<T, A>::FastRemove( int elem )
 	if (m_Size > 0)
 	{
 		if ( elem != m_Size -1 )
-			memcpy( reinterpret_cast<void*>( &Element(elem) ), reinterpret_cast<void*>( &Element(m_Size-1) ), sizeof(T) );
+			RelocateElements( elem, m_Size-1, 1, CUtlIsTriviallyRelocatable<T>() );
 		--m_Size;
 	}
 }
@@ -1185,7 +1413,8 @@ inline void CUtlVector<T, A>::PurgeAndDeleteElements()
 template< typename T, class A >
 inline void CUtlVector<T, A>::Compact()
 {
-	m_Memory.Purge(m_Size);
+	CompactMemory( CUtlIsTriviallyRelocatable<T>() );
+	ResetDbgInfo();
 }
 
 template< typename T, class A >
@@ -7,6 +7,20 @@
 #include "basetypes.h"
 #include "commonmacros.h"
 #include "checksum_crc.h"
+#include "processor_detect.h"
+#include "tier0/threadtools.h"
+
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) )
+#define CRC32_PCLMUL
+#define CRC32_PCLMUL_TARGET
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#elif ( defined( __i386__ ) || defined( __x86_64__ ) ) && ( defined( __clang__ ) || __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) )
+#define CRC32_PCLMUL
+#define CRC32_PCLMUL_TARGET __attribute__(( target( "sse2,pclmul" ) ))
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -98,7 +112,11 @@ CRC32_t	CRC32_GetTableEntry( unsigned int slot )
 	return pulCRCTable[(unsigned char)slot];
 }
 
-void CRC32_ProcessBuffer(CRC32_t *pulCRC, const void *pBuffer, int nBuffer)
+//-----------------------------------------------------------------------------
+// The original byte at a time table implementation, still used for the tail
+// of each buffer
+//-----------------------------------------------------------------------------
+void CRC32_ProcessBufferTable(CRC32_t *pulCRC, const void *pBuffer, int nBuffer)
 {
 	CRC32_t ulCrc = *pulCRC;
 	unsigned char *pb = (unsigned char *)pBuffer;
@@ -178,3 +196,176 @@ JustAfew:
     nBuffer &= 7;
     goto JustAfew;
 }
+
+//-----------------------------------------------------------------------------
+// Slicing-by-16: table k holds the CRC of a byte followed by k zero bytes, so
+// 16 bytes can be folded into the CRC with 16 independent lookups.
+//-----------------------------------------------------------------------------
+static CRC32_t s_pulCRCSliceTables[16][NUM_BYTES];
+static bool s_bCRCSliceTablesBuilt = false;
+
+static void CRC32_BuildSliceTables()
+{
+	for ( int i = 0; i < NUM_BYTES; i++ )
+	{
+		CRC32_t ulCrc = pulCRCTable[i];
+		s_pulCRCSliceTables[0][i] = ulCrc;
+		for ( int k = 1; k < 16; k++ )
+		{
+			ulCrc = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
+			s_pulCRCSliceTables[k][i] = ulCrc;
+		}
+	}
+
+	// The tables are identical whichever thread builds them, so only the flag needs to come last
+	ThreadMemoryBarrier();
+	s_bCRCSliceTablesBuilt = true;
+}
+
+static CRC32_t CRC32_ProcessSlices( CRC32_t ulCrc, const unsigned char *pb, int nSlices )
+{
+	const CRC32_t (*T)[NUM_BYTES] = s_pulCRCSliceTables;
+	while ( nSlices-- )
+	{
+		CRC32_t w0 = LittleLong( *(CRC32_t *)pb ) ^ ulCrc;
+		CRC32_t w1 = LittleLong( *(CRC32_t *)(pb + 4) );
+		CRC32_t w2 = LittleLong( *(CRC32_t *)(pb + 8) );
+		CRC32_t w3 = LittleLong( *(CRC32_t *)(pb + 12) );
+
+		ulCrc = T[15][w0 & 0xff] ^ T[14][(w0 >> 8) & 0xff] ^ T[13][(w0 >> 16) & 0xff] ^ T[12][w0 >> 24] ^
+				T[11][w1 & 0xff] ^ T[10][(w1 >> 8) & 0xff] ^ T[ 9][(w1 >> 16) & 0xff] ^ T[ 8][w1 >> 24] ^
+				T[ 7][w2 & 0xff] ^ T[ 6][(w2 >> 8) & 0xff] ^ T[ 5][(w2 >> 16) & 0xff] ^ T[ 4][w2 >> 24] ^
+				T[ 3][w3 & 0xff] ^ T[ 2][(w3 >> 8) & 0xff] ^ T[ 1][(w3 >> 16) & 0xff] ^ T[ 0][w3 >> 24];
+		pb += 16;
+	}
+	return ulCrc;
+}
+
+#ifdef CRC32_PCLMUL
+//-----------------------------------------------------------------------------
+// Carry-less multiply folding, from Intel's "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction". Folds four 128 bit lanes across the
+// buffer, then down to one lane, then Barrett reduces it to 32 bits.
+// nBuffer must be at least 64, and a multiple of 16.
+//-----------------------------------------------------------------------------
+CRC32_PCLMUL_TARGET static CRC32_t CRC32_ProcessPCLMUL( CRC32_t ulCrc, const unsigned char *pb, int nBuffer )
+{
+	static const uint64 k1k2[2] = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+	static const uint64 k3k4[2] = { 0x01751997d0ULL, 0x00ccaa009eULL };
+	static const uint64 k5k0[2] = { 0x0163cd6124ULL, 0x0000000000ULL };
+	static const uint64 poly[2] = { 0x01db710641ULL, 0x01f7011641ULL };
+
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	x1 = _mm_loadu_si128( (const __m128i *)(pb + 0x00) );
+	x2 = _mm_loadu_si128( (const __m128i *)(pb + 0x10) );
+	x3 = _mm_loadu_si128( (const __m128i *)(pb + 0x20) );
+	x4 = _mm_loadu_si128( (const __m128i *)(pb + 0x30) );
+	x1 = _mm_xor_si128( x1, _mm_cvtsi32_si128( ulCrc ) );
+	x0 = _mm_loadu_si128( (const __m128i *)k1k2 );
+	pb += 64;
+	nBuffer -= 64;
+
+	// Fold 64 bytes at a time
+	while ( nBuffer >= 64 )
+	{
+		x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+		x6 = _mm_clmulepi64_si128( x2, x0, 0x00 );
+		x7 = _mm_clmulepi64_si128( x3, x0, 0x00 );
+		x8 = _mm_clmulepi64_si128( x4, x0, 0x00 );
+		x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+		x2 = _mm_clmulepi64_si128( x2, x0, 0x11 );
+		x3 = _mm_clmulepi64_si128( x3, x0, 0x11 );
+		x4 = _mm_clmulepi64_si128( x4, x0, 0x11 );
+		y5 = _mm_loadu_si128( (const __m128i *)(pb + 0x00) );
+		y6 = _mm_loadu_si128( (const __m128i *)(pb + 0x10) );
+		y7 = _mm_loadu_si128( (const __m128i *)(pb + 0x20) );
+		y8 = _mm_loadu_si128( (const __m128i *)(pb + 0x30) );
+		x1 = _mm_xor_si128( _mm_xor_si128( x1, x5 ), y5 );
+		x2 = _mm_xor_si128( _mm_xor_si128( x2, x6 ), y6 );
+		x3 = _mm_xor_si128( _mm_xor_si128( x3, x7 ), y7 );
+		x4 = _mm_xor_si128( _mm_xor_si128( x4, x8 ), y8 );
+		pb += 64;
+		nBuffer -= 64;
+	}
+
+	// Fold the four lanes into one
+	x0 = _mm_loadu_si128( (const __m128i *)k3k4 );
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x2 ), x5 );
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x3 ), x5 );
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x4 ), x5 );
+
+	// Fold any remaining 16 byte blocks
+	while ( nBuffer >= 16 )
+	{
+		x2 = _mm_loadu_si128( (const __m128i *)pb );
+		x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+		x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+		x1 = _mm_xor_si128( _mm_xor_si128( x1, x2 ), x5 );
+		pb += 16;
+		nBuffer -= 16;
+	}
+
+	// Fold 128 bits down to 64
+	x2 = _mm_clmulepi64_si128( x1, x0, 0x10 );
+	x3 = _mm_setr_epi32( ~0, 0, ~0, 0 );
+	x1 = _mm_srli_si128( x1, 8 );
+	x1 = _mm_xor_si128( x1, x2 );
+	x0 = _mm_loadl_epi64( (const __m128i *)k5k0 );
+	x2 = _mm_srli_si128( x1, 4 );
+	x1 = _mm_and_si128( x1, x3 );
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+	x1 = _mm_xor_si128( x1, x2 );
+
+	// Barrett reduce to 32 bits
+	x0 = _mm_loadu_si128( (const __m128i *)poly );
+	x2 = _mm_and_si128( x1, x3 );
+	x2 = _mm_clmulepi64_si128( x2, x0, 0x10 );
+	x2 = _mm_and_si128( x2, x3 );
+	x2 = _mm_clmulepi64_si128( x2, x0, 0x00 );
+	x1 = _mm_xor_si128( x1, x2 );
+
+	return (CRC32_t)_mm_cvtsi128_si32( _mm_srli_si128( x1, 4 ) );
+}
+#endif // CRC32_PCLMUL
+
+//-----------------------------------------------------------------------------
+// Bulk of the buffer through PCLMULQDQ when the CPU has it, otherwise through
+// slicing-by-16, and what's left one byte at a time.
+//-----------------------------------------------------------------------------
+void CRC32_ProcessBuffer( CRC32_t *pulCRC, const void *pBuffer, int nBuffer )
+{
+	const unsigned char *pb = (const unsigned char *)pBuffer;
+
+#ifdef CRC32_PCLMUL
+	static bool s_bPCLMUL = CheckPCLMULTechnology();
+	if ( s_bPCLMUL && nBuffer >= 64 )
+	{
+		int nMain = nBuffer & ~15;
+		*pulCRC = CRC32_ProcessPCLMUL( *pulCRC, pb, nMain );
+		pb += nMain;
+		nBuffer -= nMain;
+	}
+#endif
+
+	if ( nBuffer >= 16 )
+	{
+		if ( !s_bCRCSliceTablesBuilt )
+		{
+			CRC32_BuildSliceTables();
+		}
+
+		int nSlices = nBuffer >> 4;
+		*pulCRC = CRC32_ProcessSlices( *pulCRC, pb, nSlices );
+		pb += nSlices << 4;
+		nBuffer &= 15;
+	}
+
+	CRC32_ProcessBufferTable( pulCRC, pb, nBuffer );
+}
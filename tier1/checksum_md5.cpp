@@ -11,6 +11,22 @@
 #include <stdio.h>
 #include "tier1/strtools.h"
 #include "tier0/dbg.h"
+#include "processor_detect.h"
+
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ ) )
+#define MD5_SIMD
+#include <emmintrin.h>
+#endif
+
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) ) && ( _MSC_VER >= 1700 )
+#define MD5_AVX2
+#define MD5_AVX2_TARGET
+#include <immintrin.h>
+#elif ( defined( __i386__ ) || defined( __x86_64__ ) ) && ( defined( __clang__ ) || __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) )
+#define MD5_AVX2
+#define MD5_AVX2_TARGET __attribute__(( target( "avx2" ) ))
+#include <immintrin.h>
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -303,3 +319,291 @@ void MD5_ProcessSingleBuffer( const void *p, int len, MD5Value_t &md5Result )
 	MD5Update( &ctx, (unsigned char const *)p, len );
 	MD5Final( md5Result.bits, &ctx );
 }
+
+#ifdef MD5_SIMD
+//-----------------------------------------------------------------------------
+// Four lane MD5, one independent message per SSE2 lane
+//-----------------------------------------------------------------------------
+#define ROL_4(x, s) _mm_or_si128( _mm_slli_epi32( x, s ), _mm_srli_epi32( x, 32 - (s) ) )
+#define F1_4(x, y, z) _mm_xor_si128( z, _mm_and_si128( x, _mm_xor_si128( y, z ) ) )
+#define F2_4(x, y, z) F1_4(z, x, y)
+#define F3_4(x, y, z) _mm_xor_si128( _mm_xor_si128( x, y ), z )
+#define F4_4(x, y, z) _mm_xor_si128( y, _mm_or_si128( x, _mm_xor_si128( z, allOnes ) ) )
+
+#define MD5STEP4(f, w, x, y, z, data, k, s) \
+        ( w = _mm_add_epi32( w, _mm_add_epi32( f(x, y, z), _mm_add_epi32( data, _mm_set1_epi32( (int)k ) ) ) ), \
+          w = ROL_4( w, s ), w = _mm_add_epi32( w, x ) )
+
+// The 64 steps of the transform, shared by the four and eight lane versions
+#define MD5_STEPS(STEP, F1, F2, F3, F4) \
+    STEP(F1, a, b, c, d, in[0], 0xd76aa478, 7); \
+    STEP(F1, d, a, b, c, in[1], 0xe8c7b756, 12); \
+    STEP(F1, c, d, a, b, in[2], 0x242070db, 17); \
+    STEP(F1, b, c, d, a, in[3], 0xc1bdceee, 22); \
+    STEP(F1, a, b, c, d, in[4], 0xf57c0faf, 7); \
+    STEP(F1, d, a, b, c, in[5], 0x4787c62a, 12); \
+    STEP(F1, c, d, a, b, in[6], 0xa8304613, 17); \
+    STEP(F1, b, c, d, a, in[7], 0xfd469501, 22); \
+    STEP(F1, a, b, c, d, in[8], 0x698098d8, 7); \
+    STEP(F1, d, a, b, c, in[9], 0x8b44f7af, 12); \
+    STEP(F1, c, d, a, b, in[10], 0xffff5bb1, 17); \
+    STEP(F1, b, c, d, a, in[11], 0x895cd7be, 22); \
+    STEP(F1, a, b, c, d, in[12], 0x6b901122, 7); \
+    STEP(F1, d, a, b, c, in[13], 0xfd987193, 12); \
+    STEP(F1, c, d, a, b, in[14], 0xa679438e, 17); \
+    STEP(F1, b, c, d, a, in[15], 0x49b40821, 22); \
+ \
+    STEP(F2, a, b, c, d, in[1], 0xf61e2562, 5); \
+    STEP(F2, d, a, b, c, in[6], 0xc040b340, 9); \
+    STEP(F2, c, d, a, b, in[11], 0x265e5a51, 14); \
+    STEP(F2, b, c, d, a, in[0], 0xe9b6c7aa, 20); \
+    STEP(F2, a, b, c, d, in[5], 0xd62f105d, 5); \
+    STEP(F2, d, a, b, c, in[10], 0x02441453, 9); \
+    STEP(F2, c, d, a, b, in[15], 0xd8a1e681, 14); \
+    STEP(F2, b, c, d, a, in[4], 0xe7d3fbc8, 20); \
+    STEP(F2, a, b, c, d, in[9], 0x21e1cde6, 5); \
+    STEP(F2, d, a, b, c, in[14], 0xc33707d6, 9); \
+    STEP(F2, c, d, a, b, in[3], 0xf4d50d87, 14); \
+    STEP(F2, b, c, d, a, in[8], 0x455a14ed, 20); \
+    STEP(F2, a, b, c, d, in[13], 0xa9e3e905, 5); \
+    STEP(F2, d, a, b, c, in[2], 0xfcefa3f8, 9); \
+    STEP(F2, c, d, a, b, in[7], 0x676f02d9, 14); \
+    STEP(F2, b, c, d, a, in[12], 0x8d2a4c8a, 20); \
+ \
+    STEP(F3, a, b, c, d, in[5], 0xfffa3942, 4); \
+    STEP(F3, d, a, b, c, in[8], 0x8771f681, 11); \
+    STEP(F3, c, d, a, b, in[11], 0x6d9d6122, 16); \
+    STEP(F3, b, c, d, a, in[14], 0xfde5380c, 23); \
+    STEP(F3, a, b, c, d, in[1], 0xa4beea44, 4); \
+    STEP(F3, d, a, b, c, in[4], 0x4bdecfa9, 11); \
+    STEP(F3, c, d, a, b, in[7], 0xf6bb4b60, 16); \
+    STEP(F3, b, c, d, a, in[10], 0xbebfbc70, 23); \
+    STEP(F3, a, b, c, d, in[13], 0x289b7ec6, 4); \
+    STEP(F3, d, a, b, c, in[0], 0xeaa127fa, 11); \
+    STEP(F3, c, d, a, b, in[3], 0xd4ef3085, 16); \
+    STEP(F3, b, c, d, a, in[6], 0x04881d05, 23); \
+    STEP(F3, a, b, c, d, in[9], 0xd9d4d039, 4); \
+    STEP(F3, d, a, b, c, in[12], 0xe6db99e5, 11); \
+    STEP(F3, c, d, a, b, in[15], 0x1fa27cf8, 16); \
+    STEP(F3, b, c, d, a, in[2], 0xc4ac5665, 23); \
+ \
+    STEP(F4, a, b, c, d, in[0], 0xf4292244, 6); \
+    STEP(F4, d, a, b, c, in[7], 0x432aff97, 10); \
+    STEP(F4, c, d, a, b, in[14], 0xab9423a7, 15); \
+    STEP(F4, b, c, d, a, in[5], 0xfc93a039, 21); \
+    STEP(F4, a, b, c, d, in[12], 0x655b59c3, 6); \
+    STEP(F4, d, a, b, c, in[3], 0x8f0ccc92, 10); \
+    STEP(F4, c, d, a, b, in[10], 0xffeff47d, 15); \
+    STEP(F4, b, c, d, a, in[1], 0x85845dd1, 21); \
+    STEP(F4, a, b, c, d, in[8], 0x6fa87e4f, 6); \
+    STEP(F4, d, a, b, c, in[15], 0xfe2ce6e0, 10); \
+    STEP(F4, c, d, a, b, in[6], 0xa3014314, 15); \
+    STEP(F4, b, c, d, a, in[13], 0x4e0811a1, 21); \
+    STEP(F4, a, b, c, d, in[4], 0xf7537e82, 6); \
+    STEP(F4, d, a, b, c, in[11], 0xbd3af235, 10); \
+    STEP(F4, c, d, a, b, in[2], 0x2ad7d2bb, 15); \
+    STEP(F4, b, c, d, a, in[9], 0xeb86d391, 21);
+
+// Runs nBlocks 64 byte blocks of each of the four messages through the transform
+static void MD5Transform4( __m128i buf[4], const unsigned char *pData[4], unsigned int nBlocks )
+{
+    const __m128i allOnes = _mm_set1_epi32( -1 );
+    const unsigned int *p0 = (const unsigned int *)pData[0];
+    const unsigned int *p1 = (const unsigned int *)pData[1];
+    const unsigned int *p2 = (const unsigned int *)pData[2];
+    const unsigned int *p3 = (const unsigned int *)pData[3];
+
+    while ( nBlocks-- )
+    {
+        __m128i in[16];
+        for ( int i = 0; i < 16; i++ )
+        {
+            in[i] = _mm_set_epi32( LittleLong( p3[i] ), LittleLong( p2[i] ), LittleLong( p1[i] ), LittleLong( p0[i] ) );
+        }
+
+        __m128i a = buf[0];
+        __m128i b = buf[1];
+        __m128i c = buf[2];
+        __m128i d = buf[3];
+
+        MD5_STEPS( MD5STEP4, F1_4, F2_4, F3_4, F4_4 );
+        buf[0] = _mm_add_epi32( buf[0], a );
+        buf[1] = _mm_add_epi32( buf[1], b );
+        buf[2] = _mm_add_epi32( buf[2], c );
+        buf[3] = _mm_add_epi32( buf[3], d );
+
+        p0 += 16;
+        p1 += 16;
+        p2 += 16;
+        p3 += 16;
+    }
+}
+#endif // MD5_SIMD
+
+#ifdef MD5_AVX2
+//-----------------------------------------------------------------------------
+// Eight lane MD5, one independent message per AVX2 lane. Only call this when
+// CheckAVX2Technology() is true.
+//-----------------------------------------------------------------------------
+#define ROL_8(x, s) _mm256_or_si256( _mm256_slli_epi32( x, s ), _mm256_srli_epi32( x, 32 - (s) ) )
+#define F1_8(x, y, z) _mm256_xor_si256( z, _mm256_and_si256( x, _mm256_xor_si256( y, z ) ) )
+#define F2_8(x, y, z) F1_8(z, x, y)
+#define F3_8(x, y, z) _mm256_xor_si256( _mm256_xor_si256( x, y ), z )
+#define F4_8(x, y, z) _mm256_xor_si256( y, _mm256_or_si256( x, _mm256_xor_si256( z, allOnes ) ) )
+
+#define MD5STEP8(f, w, x, y, z, data, k, s) \
+        ( w = _mm256_add_epi32( w, _mm256_add_epi32( f(x, y, z), _mm256_add_epi32( data, _mm256_set1_epi32( (int)k ) ) ) ), \
+          w = ROL_8( w, s ), w = _mm256_add_epi32( w, x ) )
+
+// Runs nBlocks 64 byte blocks of each of the eight messages through the transform.
+// state[j][i] is word j of lane i.
+static MD5_AVX2_TARGET void MD5Transform8( unsigned int state[4][8], const unsigned char *pData[8], unsigned int nBlocks )
+{
+    const __m256i allOnes = _mm256_set1_epi32( -1 );
+    const unsigned int *p[8];
+    for ( int i = 0; i < 8; i++ )
+    {
+        p[i] = (const unsigned int *)pData[i];
+    }
+
+    __m256i buf[4];
+    for ( int j = 0; j < 4; j++ )
+    {
+        buf[j] = _mm256_loadu_si256( (const __m256i *)state[j] );
+    }
+
+    while ( nBlocks-- )
+    {
+        __m256i in[16];
+        for ( int i = 0; i < 16; i++ )
+        {
+            in[i] = _mm256_set_epi32( LittleLong( p[7][i] ), LittleLong( p[6][i] ), LittleLong( p[5][i] ), LittleLong( p[4][i] ),
+                                      LittleLong( p[3][i] ), LittleLong( p[2][i] ), LittleLong( p[1][i] ), LittleLong( p[0][i] ) );
+        }
+
+        __m256i a = buf[0];
+        __m256i b = buf[1];
+        __m256i c = buf[2];
+        __m256i d = buf[3];
+
+        MD5_STEPS( MD5STEP8, F1_8, F2_8, F3_8, F4_8 );
+
+        buf[0] = _mm256_add_epi32( buf[0], a );
+        buf[1] = _mm256_add_epi32( buf[1], b );
+        buf[2] = _mm256_add_epi32( buf[2], c );
+        buf[3] = _mm256_add_epi32( buf[3], d );
+
+        for ( int i = 0; i < 8; i++ )
+        {
+            p[i] += 16;
+        }
+    }
+
+    for ( int j = 0; j < 4; j++ )
+    {
+        _mm256_storeu_si256( (__m256i *)state[j], buf[j] );
+    }
+}
+#endif // MD5_AVX2
+
+//-----------------------------------------------------------------------------
+// Purpose: MD5 of several independent buffers. With AVX2 they are hashed eight
+//  at a time, otherwise four at a time with SSE2, in lockstep over the full
+//  blocks the group has in common, so buffers of similar lengths should be
+//  passed together.
+//-----------------------------------------------------------------------------
+void MD5_ProcessMultipleBuffers( int nBuffers, const void * const *ppBuffers, const int *pnLengths, MD5Value_t *pResults )
+{
+#ifdef MD5_AVX2
+    static bool s_bAVX2 = CheckAVX2Technology();
+    int nGroup = s_bAVX2 ? 8 : 4;
+#else
+    int nGroup = 4;
+#endif
+
+    for ( int iFirst = 0; iFirst < nBuffers; iFirst += nGroup )
+    {
+        int nLanes = MIN( nBuffers - iFirst, nGroup );
+        MD5Context_t ctx[8];
+        unsigned int nDone = 0;
+
+        for ( int i = 0; i < nLanes; i++ )
+        {
+            Assert( pnLengths[iFirst + i] >= 0 );
+            MD5Init( &ctx[i] );
+        }
+
+#ifdef MD5_SIMD
+        static bool s_bSSE2 = CheckSSE2Technology();
+        unsigned int nBlocks = ~0u;
+        for ( int i = 0; i < nLanes; i++ )
+        {
+            nBlocks = MIN( nBlocks, (unsigned int)pnLengths[iFirst + i] / 64 );
+        }
+
+        unsigned int state[4][8];
+        bool bHashed = false;
+
+        // Missing lanes repeat the first buffer, and their results are dropped
+        const unsigned char *pData[8];
+        for ( int i = 0; i < 8; i++ )
+        {
+            pData[i] = (const unsigned char *)ppBuffers[iFirst + ( ( i < nLanes ) ? i : 0 )];
+        }
+
+#ifdef MD5_AVX2
+        if ( nLanes > 4 && nBlocks )
+        {
+            for ( int j = 0; j < 4; j++ )
+            {
+                for ( int i = 0; i < 8; i++ )
+                {
+                    state[j][i] = ctx[0].buf[j];
+                }
+            }
+
+            MD5Transform8( state, pData, nBlocks );
+            bHashed = true;
+        }
+#endif
+
+        if ( !bHashed && s_bSSE2 && nLanes > 1 && nBlocks )
+        {
+            __m128i buf[4];
+            for ( int j = 0; j < 4; j++ )
+            {
+                buf[j] = _mm_set1_epi32( (int)ctx[0].buf[j] );
+            }
+
+            MD5Transform4( buf, pData, nBlocks );
+
+            for ( int j = 0; j < 4; j++ )
+            {
+                _mm_storeu_si128( (__m128i *)state[j], buf[j] );
+            }
+            bHashed = true;
+        }
+
+        if ( bHashed )
+        {
+            nDone = nBlocks * 64;
+            for ( int i = 0; i < nLanes; i++ )
+            {
+                for ( int j = 0; j < 4; j++ )
+                {
+                    ctx[i].buf[j] = state[j][i];
+                }
+                ctx[i].bits[0] = nDone << 3;
+                ctx[i].bits[1] = nDone >> 29;
+            }
+        }
+#endif
+
+        for ( int i = 0; i < nLanes; i++ )
+        {
+            const unsigned char *pData = (const unsigned char *)ppBuffers[iFirst + i];
+            MD5Update( &ctx[i], pData + nDone, pnLengths[iFirst + i] - nDone );
+            MD5Final( pResults[iFirst + i].bits, &ctx[i] );
+        }
+    }
+}
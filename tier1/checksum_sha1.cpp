@@ -23,6 +23,22 @@
 
 #if !defined(_MINIMUM_BUILD_)
 #include "checksum_sha1.h"
+#include "processor_detect.h"
+
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ ) )
+#define SHA1_SIMD
+#include <emmintrin.h>
+#endif
+
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) ) && ( _MSC_VER >= 1700 )
+#define SHA1_AVX2
+#define SHA1_AVX2_TARGET
+#include <immintrin.h>
+#elif ( defined( __i386__ ) || defined( __x86_64__ ) ) && ( defined( __clang__ ) || __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) )
+#define SHA1_AVX2
+#define SHA1_AVX2_TARGET __attribute__(( target( "avx2" ) ))
+#include <immintrin.h>
+#endif
 #else
 //
 //	This path is build in the CEG/DRM projects where we require that no CRT references are made !
@@ -297,3 +313,267 @@ bool HashLessFunc( SHADigest_t const &lhs, SHADigest_t const &rhs )
 	return ( iRes < 0 );
 }
 #endif
+
+#ifndef	_MINIMUM_BUILD_
+#ifdef SHA1_SIMD
+//-----------------------------------------------------------------------------
+// Four lane SHA-1, one independent message per SSE2 lane
+//-----------------------------------------------------------------------------
+#define SHA1_ROL_4(x, s) _mm_or_si128( _mm_slli_epi32( x, s ), _mm_srli_epi32( x, 32 - (s) ) )
+
+#define SHA1_BLK0_4(i) (blk[i])
+#define SHA1_BLK_4(i) (blk[i&15] = SHA1_ROL_4( _mm_xor_si128( _mm_xor_si128( blk[(i+13)&15], blk[(i+8)&15] ), \
+	_mm_xor_si128( blk[(i+2)&15], blk[i&15] ) ), 1 ))
+
+#define SHA1_F0_4(w,x,y) _mm_xor_si128( _mm_and_si128( w, _mm_xor_si128( x, y ) ), y )
+#define SHA1_F2_4(w,x,y) _mm_xor_si128( _mm_xor_si128( w, x ), y )
+#define SHA1_F3_4(w,x,y) _mm_or_si128( _mm_and_si128( _mm_or_si128( w, x ), y ), _mm_and_si128( w, x ) )
+
+#define SHA1_STEP_4(f, blk, k, v, w, z) { z = _mm_add_epi32( z, _mm_add_epi32( _mm_add_epi32( f, blk ), \
+	_mm_add_epi32( _mm_set1_epi32( (int)k ), SHA1_ROL_4( v, 5 ) ) ) ); w = SHA1_ROL_4( w, 30 ); }
+
+#define SHA1_R4_0(v,w,x,y,z,i) SHA1_STEP_4( SHA1_F0_4(w,x,y), SHA1_BLK0_4(i), 0x5A827999, v, w, z )
+#define SHA1_R4_1(v,w,x,y,z,i) SHA1_STEP_4( SHA1_F0_4(w,x,y), SHA1_BLK_4(i), 0x5A827999, v, w, z )
+#define SHA1_R4_2(v,w,x,y,z,i) SHA1_STEP_4( SHA1_F2_4(w,x,y), SHA1_BLK_4(i), 0x6ED9EBA1, v, w, z )
+#define SHA1_R4_3(v,w,x,y,z,i) SHA1_STEP_4( SHA1_F3_4(w,x,y), SHA1_BLK_4(i), 0x8F1BBCDC, v, w, z )
+#define SHA1_R4_4(v,w,x,y,z,i) SHA1_STEP_4( SHA1_F2_4(w,x,y), SHA1_BLK_4(i), 0xCA62C1D6, v, w, z )
+
+// The 80 rounds of the transform, shared by the four and eight lane versions
+#define SHA1_ROUNDS(R0,R1,R2,R3,R4) { \
+	R0(a,b,c,d,e, 0); R0(e,a,b,c,d, 1); R0(d,e,a,b,c, 2); R0(c,d,e,a,b, 3); \
+	R0(b,c,d,e,a, 4); R0(a,b,c,d,e, 5); R0(e,a,b,c,d, 6); R0(d,e,a,b,c, 7); \
+	R0(c,d,e,a,b, 8); R0(b,c,d,e,a, 9); R0(a,b,c,d,e,10); R0(e,a,b,c,d,11); \
+	R0(d,e,a,b,c,12); R0(c,d,e,a,b,13); R0(b,c,d,e,a,14); R0(a,b,c,d,e,15); \
+	R1(e,a,b,c,d,16); R1(d,e,a,b,c,17); R1(c,d,e,a,b,18); R1(b,c,d,e,a,19); \
+	R2(a,b,c,d,e,20); R2(e,a,b,c,d,21); R2(d,e,a,b,c,22); R2(c,d,e,a,b,23); \
+	R2(b,c,d,e,a,24); R2(a,b,c,d,e,25); R2(e,a,b,c,d,26); R2(d,e,a,b,c,27); \
+	R2(c,d,e,a,b,28); R2(b,c,d,e,a,29); R2(a,b,c,d,e,30); R2(e,a,b,c,d,31); \
+	R2(d,e,a,b,c,32); R2(c,d,e,a,b,33); R2(b,c,d,e,a,34); R2(a,b,c,d,e,35); \
+	R2(e,a,b,c,d,36); R2(d,e,a,b,c,37); R2(c,d,e,a,b,38); R2(b,c,d,e,a,39); \
+	R3(a,b,c,d,e,40); R3(e,a,b,c,d,41); R3(d,e,a,b,c,42); R3(c,d,e,a,b,43); \
+	R3(b,c,d,e,a,44); R3(a,b,c,d,e,45); R3(e,a,b,c,d,46); R3(d,e,a,b,c,47); \
+	R3(c,d,e,a,b,48); R3(b,c,d,e,a,49); R3(a,b,c,d,e,50); R3(e,a,b,c,d,51); \
+	R3(d,e,a,b,c,52); R3(c,d,e,a,b,53); R3(b,c,d,e,a,54); R3(a,b,c,d,e,55); \
+	R3(e,a,b,c,d,56); R3(d,e,a,b,c,57); R3(c,d,e,a,b,58); R3(b,c,d,e,a,59); \
+	R4(a,b,c,d,e,60); R4(e,a,b,c,d,61); R4(d,e,a,b,c,62); R4(c,d,e,a,b,63); \
+	R4(b,c,d,e,a,64); R4(a,b,c,d,e,65); R4(e,a,b,c,d,66); R4(d,e,a,b,c,67); \
+	R4(c,d,e,a,b,68); R4(b,c,d,e,a,69); R4(a,b,c,d,e,70); R4(e,a,b,c,d,71); \
+	R4(d,e,a,b,c,72); R4(c,d,e,a,b,73); R4(b,c,d,e,a,74); R4(a,b,c,d,e,75); \
+	R4(e,a,b,c,d,76); R4(d,e,a,b,c,77); R4(c,d,e,a,b,78); R4(b,c,d,e,a,79); }
+
+static inline int SHA1_LoadBigEndian( const unsigned char *p )
+{
+	return (int)( ( (unsigned int)p[0] << 24 ) | ( (unsigned int)p[1] << 16 ) | ( (unsigned int)p[2] << 8 ) | p[3] );
+}
+
+// Runs nBlocks 64 byte blocks of each of the four messages through the transform
+static void SHA1Transform4( __m128i state[5], const unsigned char *pData[4], unsigned int nBlocks )
+{
+	const unsigned char *p0 = pData[0];
+	const unsigned char *p1 = pData[1];
+	const unsigned char *p2 = pData[2];
+	const unsigned char *p3 = pData[3];
+
+	while ( nBlocks-- )
+	{
+		__m128i blk[16];
+		for ( int i = 0; i < 16; i++ )
+		{
+			blk[i] = _mm_set_epi32( SHA1_LoadBigEndian( p3 + i*4 ), SHA1_LoadBigEndian( p2 + i*4 ),
+				SHA1_LoadBigEndian( p1 + i*4 ), SHA1_LoadBigEndian( p0 + i*4 ) );
+		}
+
+		__m128i a = state[0];
+		__m128i b = state[1];
+		__m128i c = state[2];
+		__m128i d = state[3];
+		__m128i e = state[4];
+
+		SHA1_ROUNDS( SHA1_R4_0, SHA1_R4_1, SHA1_R4_2, SHA1_R4_3, SHA1_R4_4 );
+		state[0] = _mm_add_epi32( state[0], a );
+		state[1] = _mm_add_epi32( state[1], b );
+		state[2] = _mm_add_epi32( state[2], c );
+		state[3] = _mm_add_epi32( state[3], d );
+		state[4] = _mm_add_epi32( state[4], e );
+
+		p0 += 64;
+		p1 += 64;
+		p2 += 64;
+		p3 += 64;
+	}
+}
+#endif // SHA1_SIMD
+
+#ifdef SHA1_AVX2
+//-----------------------------------------------------------------------------
+// Eight lane SHA-1, one independent message per AVX2 lane. Only call this when
+// CheckAVX2Technology() is true.
+//-----------------------------------------------------------------------------
+#define SHA1_ROL_8(x, s) _mm256_or_si256( _mm256_slli_epi32( x, s ), _mm256_srli_epi32( x, 32 - (s) ) )
+
+#define SHA1_BLK0_8(i) (blk[i])
+#define SHA1_BLK_8(i) (blk[i&15] = SHA1_ROL_8( _mm256_xor_si256( _mm256_xor_si256( blk[(i+13)&15], blk[(i+8)&15] ), \
+	_mm256_xor_si256( blk[(i+2)&15], blk[i&15] ) ), 1 ))
+
+#define SHA1_F0_8(w,x,y) _mm256_xor_si256( _mm256_and_si256( w, _mm256_xor_si256( x, y ) ), y )
+#define SHA1_F2_8(w,x,y) _mm256_xor_si256( _mm256_xor_si256( w, x ), y )
+#define SHA1_F3_8(w,x,y) _mm256_or_si256( _mm256_and_si256( _mm256_or_si256( w, x ), y ), _mm256_and_si256( w, x ) )
+
+#define SHA1_STEP_8(f, blk, k, v, w, z) { z = _mm256_add_epi32( z, _mm256_add_epi32( _mm256_add_epi32( f, blk ), \
+	_mm256_add_epi32( _mm256_set1_epi32( (int)k ), SHA1_ROL_8( v, 5 ) ) ) ); w = SHA1_ROL_8( w, 30 ); }
+
+#define SHA1_R8_0(v,w,x,y,z,i) SHA1_STEP_8( SHA1_F0_8(w,x,y), SHA1_BLK0_8(i), 0x5A827999, v, w, z )
+#define SHA1_R8_1(v,w,x,y,z,i) SHA1_STEP_8( SHA1_F0_8(w,x,y), SHA1_BLK_8(i), 0x5A827999, v, w, z )
+#define SHA1_R8_2(v,w,x,y,z,i) SHA1_STEP_8( SHA1_F2_8(w,x,y), SHA1_BLK_8(i), 0x6ED9EBA1, v, w, z )
+#define SHA1_R8_3(v,w,x,y,z,i) SHA1_STEP_8( SHA1_F3_8(w,x,y), SHA1_BLK_8(i), 0x8F1BBCDC, v, w, z )
+#define SHA1_R8_4(v,w,x,y,z,i) SHA1_STEP_8( SHA1_F2_8(w,x,y), SHA1_BLK_8(i), 0xCA62C1D6, v, w, z )
+
+// Runs nBlocks 64 byte blocks of each of the eight messages through the transform.
+// laneState[j][i] is word j of lane i.
+static SHA1_AVX2_TARGET void SHA1Transform8( unsigned int laneState[5][8], const unsigned char *pData[8], unsigned int nBlocks )
+{
+	const unsigned char *p[8];
+	for ( int i = 0; i < 8; i++ )
+	{
+		p[i] = pData[i];
+	}
+
+	__m256i state[5];
+	for ( int j = 0; j < 5; j++ )
+	{
+		state[j] = _mm256_loadu_si256( (const __m256i *)laneState[j] );
+	}
+
+	while ( nBlocks-- )
+	{
+		__m256i blk[16];
+		for ( int i = 0; i < 16; i++ )
+		{
+			blk[i] = _mm256_set_epi32( SHA1_LoadBigEndian( p[7] + i*4 ), SHA1_LoadBigEndian( p[6] + i*4 ),
+				SHA1_LoadBigEndian( p[5] + i*4 ), SHA1_LoadBigEndian( p[4] + i*4 ),
+				SHA1_LoadBigEndian( p[3] + i*4 ), SHA1_LoadBigEndian( p[2] + i*4 ),
+				SHA1_LoadBigEndian( p[1] + i*4 ), SHA1_LoadBigEndian( p[0] + i*4 ) );
+		}
+
+		__m256i a = state[0];
+		__m256i b = state[1];
+		__m256i c = state[2];
+		__m256i d = state[3];
+		__m256i e = state[4];
+
+		SHA1_ROUNDS( SHA1_R8_0, SHA1_R8_1, SHA1_R8_2, SHA1_R8_3, SHA1_R8_4 );
+		state[0] = _mm256_add_epi32( state[0], a );
+		state[1] = _mm256_add_epi32( state[1], b );
+		state[2] = _mm256_add_epi32( state[2], c );
+		state[3] = _mm256_add_epi32( state[3], d );
+		state[4] = _mm256_add_epi32( state[4], e );
+
+		for ( int i = 0; i < 8; i++ )
+		{
+			p[i] += 64;
+		}
+	}
+
+	for ( int j = 0; j < 5; j++ )
+	{
+		_mm256_storeu_si256( (__m256i *)laneState[j], state[j] );
+	}
+}
+#endif // SHA1_AVX2
+
+// SHA-1 of several independent buffers. With AVX2 they are hashed eight at a
+// time, otherwise four at a time with SSE2, in lockstep over the full blocks
+// the group has in common, so buffers of similar lengths should be passed
+// together.
+void SHA1_ProcessMultipleBuffers( int nBuffers, const void * const *ppBuffers, const int *pnLengths, SHADigest_t *pResults )
+{
+#ifdef SHA1_AVX2
+	static bool s_bAVX2 = CheckAVX2Technology();
+	int nGroup = s_bAVX2 ? 8 : 4;
+#else
+	int nGroup = 4;
+#endif
+
+	for ( int iFirst = 0; iFirst < nBuffers; iFirst += nGroup )
+	{
+		int nLanes = ( nBuffers - iFirst < nGroup ) ? nBuffers - iFirst : nGroup;
+		CSHA1 sha1[8];
+		unsigned int nDone = 0;
+
+#ifdef SHA1_SIMD
+		static bool s_bSSE2 = CheckSSE2Technology();
+		unsigned int nBlocks = ~0u;
+		for ( int i = 0; i < nLanes; i++ )
+		{
+			unsigned int nLaneBlocks = (unsigned int)pnLengths[iFirst + i] / 64;
+			nBlocks = ( nLaneBlocks < nBlocks ) ? nLaneBlocks : nBlocks;
+		}
+
+		unsigned int laneState[5][8];
+		bool bHashed = false;
+
+		// Missing lanes repeat the first buffer, and their results are dropped
+		const unsigned char *pData[8];
+		for ( int i = 0; i < 8; i++ )
+		{
+			pData[i] = (const unsigned char *)ppBuffers[iFirst + ( ( i < nLanes ) ? i : 0 )];
+		}
+
+#ifdef SHA1_AVX2
+		if ( nLanes > 4 && nBlocks )
+		{
+			for ( int j = 0; j < 5; j++ )
+			{
+				for ( int i = 0; i < 8; i++ )
+				{
+					laneState[j][i] = sha1[0].m_state[j];
+				}
+			}
+
+			SHA1Transform8( laneState, pData, nBlocks );
+			bHashed = true;
+		}
+#endif
+
+		if ( !bHashed && s_bSSE2 && nLanes > 1 && nBlocks )
+		{
+			__m128i state[5];
+			for ( int j = 0; j < 5; j++ )
+			{
+				state[j] = _mm_set1_epi32( (int)sha1[0].m_state[j] );
+			}
+
+			SHA1Transform4( state, pData, nBlocks );
+
+			for ( int j = 0; j < 5; j++ )
+			{
+				_mm_storeu_si128( (__m128i *)laneState[j], state[j] );
+			}
+			bHashed = true;
+		}
+
+		if ( bHashed )
+		{
+			nDone = nBlocks * 64;
+			for ( int i = 0; i < nLanes; i++ )
+			{
+				for ( int j = 0; j < 5; j++ )
+				{
+					sha1[i].m_state[j] = laneState[j][i];
+				}
+				sha1[i].m_count[0] = nDone << 3;
+				sha1[i].m_count[1] = nDone >> 29;
+			}
+		}
+#endif
+
+		for ( int i = 0; i < nLanes; i++ )
+		{
+			unsigned char *pData = (unsigned char *)ppBuffers[iFirst + i];
+			sha1[i].Update( pData + nDone, pnLengths[iFirst + i] - nDone );
+			sha1[i].Final();
+			sha1[i].GetHash( pResults[iFirst + i] );
+		}
+	}
+}
+#endif // _MINIMUM_BUILD_
@@ -8,9 +8,16 @@
 //===========================================================================//
 
 #include "tier1/CommandBuffer.h"
-#include "tier1/utlbuffer.h"
 #include "tier1/strtools.h"
 
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ ) )
+#define COMMANDBUFFER_SSE2
+#include <emmintrin.h>
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+#endif
+
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
@@ -69,22 +76,19 @@ void CCommandBuffer::LimitArgumentBufferSize( int nSize )
 
 	
 //-----------------------------------------------------------------------------
-// Parses argv0 out of the buffer
+// Parses argv0 out of the command
 //-----------------------------------------------------------------------------
-bool CCommandBuffer::ParseArgV0( CUtlBuffer &buf, char *pArgV0, int nMaxLen, const char **pArgS )
+bool CCommandBuffer::ParseArgV0( const char *pCommand, int nLen, char *pArgV0, int nMaxLen, const char **pArgS )
 {
 	pArgV0[0] = 0;
 	*pArgS = NULL;
 
-	if ( !buf.IsValid() )
-		return false;
-
-	int	nSize = buf.ParseToken( CCommand::DefaultBreakSet(), pArgV0, nMaxLen );
+	int nPos = 0;
+	int	nSize = CCommand::ParseToken( pCommand, nLen, nPos, pArgV0, nMaxLen, CCommand::DefaultBreakSet() );
 	if ( ( nSize <= 0 ) || ( nMaxLen == nSize ) )
 		return false;
 
-	int nArgSLen = buf.TellMaxPut() - buf.TellGet();
-	*pArgS = (nArgSLen > 0) ? (const char*)buf.PeekGet() : NULL;
+	*pArgS = ( nPos < nLen ) ? pCommand + nPos : NULL;
 	return true;
 }
 
@@ -157,6 +161,40 @@ bool CCommandBuffer::InsertCommand( const char *pArgS, int nCommandSize, int nTi
 }
 
 		
+#ifdef COMMANDBUFFER_SSE2
+static FORCEINLINE int LowestSetBit( unsigned int nMask )
+{
+#ifdef _WIN32
+	unsigned long nBit;
+	_BitScanForward( &nBit, nMask );
+	return (int)nBit;
+#else
+	return __builtin_ctz( nMask );
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Number of chars at pText before the first of " / ; or \n, looking at
+// whole blocks of 16 chars only
+//-----------------------------------------------------------------------------
+static FORCEINLINE int SkipPlainChars( const char *pText, int nMaxLen )
+{
+	int i = 0;
+	for ( ; i + 16 <= nMaxLen; i += 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)( pText + i ) );
+		__m128i special = _mm_or_si128( _mm_cmpeq_epi8( v, _mm_set1_epi8( '\"' ) ), _mm_cmpeq_epi8( v, _mm_set1_epi8( '/' ) ) );
+		special = _mm_or_si128( special, _mm_cmpeq_epi8( v, _mm_set1_epi8( ';' ) ) );
+		special = _mm_or_si128( special, _mm_cmpeq_epi8( v, _mm_set1_epi8( '\n' ) ) );
+		unsigned int nSpecial = _mm_movemask_epi8( special );
+		if ( nSpecial )
+			return i + LowestSetBit( nSpecial );
+	}
+	return i;
+}
+#endif
+
+
 //-----------------------------------------------------------------------------
 // Returns the length of the next command
 //-----------------------------------------------------------------------------
@@ -168,6 +206,14 @@ void CCommandBuffer::GetNextCommandLength( const char *pText, int nMaxLen, int *
 	bool bIsCommented = false;
 	for ( nNextCommandOffset=0; nNextCommandOffset < nMaxLen; ++nNextCommandOffset, nCommandLength += bIsCommented ? 0 : 1 )
 	{
+#ifdef COMMANDBUFFER_SSE2
+		// only " / ; and \n change anything, skip past the other chars 16 at a time
+		int nPlain = SkipPlainChars( pText + nNextCommandOffset, nMaxLen - nNextCommandOffset );
+		nNextCommandOffset += nPlain;
+		nCommandLength += bIsCommented ? 0 : nPlain;
+		if ( nNextCommandOffset >= nMaxLen )
+			break;
+#endif
 		char c = pText[nNextCommandOffset];
 		if ( !bIsCommented )
 		{
@@ -226,8 +272,7 @@ bool CCommandBuffer::AddText( const char *pText, int nTickDelay )
 
 		const char *pArgS;
 		char *pArgV0 = (char*)_alloca( nCommandLength+1 );
-		CUtlBuffer bufParse( pCurrentCommand, nCommandLength, CUtlBuffer::TEXT_BUFFER | CUtlBuffer::READ_ONLY ); 
-		ParseArgV0( bufParse, pArgV0, nCommandLength+1, &pArgS );
+		ParseArgV0( pCurrentCommand, nCommandLength, pArgV0, nCommandLength+1, &pArgS );
 		if ( pArgV0[0] == 0 )
 			continue;
 
@@ -294,38 +339,46 @@ void CCommandBuffer::BeginProcessingCommands( int nDeltaTicks )
 bool CCommandBuffer::DequeueNextCommand( )
 {
 	m_CurrentCommand.Reset();
+	return DequeueNextCommands( &m_CurrentCommand, 1 ) != 0;
+}
 
+
+//-----------------------------------------------------------------------------
+// Returns up to nMaxCommands of the next commands, and how many there were.
+// Commands inserted while processing them (by exec, for instance) are
+// inserted after all of them, not after the one being executed; use
+// DequeueNextCommand when the order of those matters
+//-----------------------------------------------------------------------------
+int CCommandBuffer::DequeueNextCommands( CCommand *pCommands, int nMaxCommands )
+{
 	Assert( m_bIsProcessingCommands );
-	if ( m_Commands.Count() == 0 )
-		return false;
 
-	int nHead = m_Commands.Head();
-	Command_t &command = m_Commands[ nHead ];
-	if ( command.m_nTick > m_nLastTickToProcess )
-		return false;
+	int nCount = 0;
+	while ( nCount < nMaxCommands && m_Commands.Count() != 0 )
+	{
+		int nHead = m_Commands.Head();
+		Command_t &command = m_Commands[ nHead ];
+		if ( command.m_nTick > m_nLastTickToProcess )
+			break;
 
-	m_nCurrentTick = command.m_nTick;
+		m_nCurrentTick = command.m_nTick;
 
-	// Copy the current command into a temp buffer
-	// NOTE: This is here to avoid the pointers returned by DequeueNextCommand
-	// to become invalid by calling AddText. Is there a way we can avoid the memcpy?
-	if ( command.m_nBufferSize > 0 )
-	{
-		m_CurrentCommand.Tokenize( &m_pArgSBuffer[command.m_nFirstArgS] );
-	}
+		// Copy the current command into a temp buffer
+		// NOTE: This is here to avoid the pointers returned by DequeueNextCommand
+		// to become invalid by calling AddText. Is there a way we can avoid the memcpy?
+		CCommand &current = pCommands[ nCount++ ];
+		current.Reset();
+		if ( command.m_nBufferSize > 0 )
+		{
+			current.Tokenize( &m_pArgSBuffer[command.m_nFirstArgS] );
+		}
 
-	m_Commands.Remove( nHead );
+		m_Commands.Remove( nHead );
+	}
 
 	// Necessary to insert commands while commands are being processed
 	m_hNextCommand = m_Commands.Head();
-
-//	Msg("Dequeue : ");
-//	for ( int i = 0; i < nArgc; ++i )
-//	{
-//		Msg("%s ", m_pCurrentArgv[i] ); 
-//	}
-//	Msg("\n");
-	return true;
+	return nCount;
 }
 
 
@@ -21,6 +21,12 @@
 #include "Color.h"
 #if defined( _X360 )
 #include "xbox/xbox_console.h"
+#elif defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+#define CONVAR_SSE2
+#include <emmintrin.h>
+#ifdef _WIN32
+#include <intrin.h>
+#endif
 #endif
 #include "tier0/memdbgon.h"
 
@@ -385,6 +391,157 @@ characterset_t* CCommand::DefaultBreakSet()
 	return &s_BreakSet;
 }
 
+#ifdef CONVAR_SSE2
+static FORCEINLINE int LowestSetBit( unsigned int nMask )
+{
+#ifdef _WIN32
+	unsigned long nBit;
+	_BitScanForward( &nBit, nMask );
+	return (int)nBit;
+#else
+	return __builtin_ctz( nMask );
+#endif
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Skips the rest of a word using the default break set: stops at a break,
+// a quote, or any char <= ' ' (signed, so non-ascii chars stop it too)
+//-----------------------------------------------------------------------------
+static FORCEINLINE const char *SkipDefaultWord( const char *p, const char *pEnd )
+{
+#ifdef CONVAR_SSE2
+	const __m128i vAboveSpace = _mm_set1_epi8( ' ' + 1 );
+	while ( pEnd - p >= 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)p );
+		__m128i stop = _mm_cmpgt_epi8( vAboveSpace, v );
+		stop = _mm_or_si128( stop, _mm_cmpeq_epi8( v, _mm_set1_epi8( '\"' ) ) );
+		stop = _mm_or_si128( stop, _mm_cmpeq_epi8( v, _mm_set1_epi8( '{' ) ) );
+		stop = _mm_or_si128( stop, _mm_cmpeq_epi8( v, _mm_set1_epi8( '}' ) ) );
+		stop = _mm_or_si128( stop, _mm_cmpeq_epi8( v, _mm_set1_epi8( '(' ) ) );
+		stop = _mm_or_si128( stop, _mm_cmpeq_epi8( v, _mm_set1_epi8( ')' ) ) );
+		stop = _mm_or_si128( stop, _mm_cmpeq_epi8( v, _mm_set1_epi8( '\'' ) ) );
+		stop = _mm_or_si128( stop, _mm_cmpeq_epi8( v, _mm_set1_epi8( ':' ) ) );
+		unsigned int nStop = _mm_movemask_epi8( stop );
+		if ( nStop )
+			return p + LowestSetBit( nStop );
+		p += 16;
+	}
+#endif
+	while ( p < pEnd && !IN_CHARACTERSET( s_BreakSet, *p ) && *p != '\"' && *p > ' ' )
+	{
+		++p;
+	}
+	return p;
+}
+
+int CCommand::ParseToken( const char *pCommand, int nLen, int &nPos, char *pTokenBuf, int nMaxLen, characterset_t *pBreakSet )
+{
+	Assert( nMaxLen >= 0 );
+	if ( nMaxLen > 0 )
+	{
+		pTokenBuf[0] = 0;
+	}
+
+	if ( !pBreakSet )
+	{
+		pBreakSet = &s_BreakSet;
+	}
+
+	const char *p = pCommand + nPos;
+	const char *pEnd = pCommand + nLen;
+
+	// skip whitespace + comments
+	while ( true )
+	{
+		while ( p < pEnd && isspace( *(const unsigned char *)p ) )
+		{
+			++p;
+		}
+		if ( pEnd - p < 2 || p[0] != '/' || p[1] != '/' )
+			break;
+
+		// comments run to the end of the line
+		p = (const char *)memchr( p + 2, '\n', pEnd - p - 2 );
+		if ( !p )
+		{
+			nPos = nLen;
+			return -1;
+		}
+		++p;
+	}
+
+	// End of buffer
+	if ( p == pEnd || *p == 0 )
+	{
+		nPos = ( p == pEnd ) ? nLen : p + 1 - pCommand;
+		return -1;
+	}
+
+	char c = *p++;
+	const char *pStart = p;
+	const char *pStop;
+	int nTokenLen;
+
+	// handle quoted strings specially
+	if ( c == '\"' )
+	{
+		// they end at the next quote, a nul, or the end of the text
+		pStop = (const char *)memchr( p, '\"', pEnd - p );
+		const char *pNul = (const char *)memchr( p, 0, ( pStop ? pStop : pEnd ) - p );
+		if ( pNul )
+		{
+			pStop = pNul;
+		}
+		nTokenLen = pStop ? pStop - p : pEnd - p;
+
+		// skip the end quote
+		pStop = pStop ? pStop + 1 : pEnd;
+	}
+	else if ( IN_CHARACTERSET( *pBreakSet, c ) )
+	{
+		// parse single characters
+		--pStart;
+		pStop = p;
+		nTokenLen = 1;
+	}
+	else
+	{
+		// parse a regular word
+		--pStart;
+		if ( pBreakSet == &s_BreakSet )
+		{
+			pStop = SkipDefaultWord( p, pEnd );
+		}
+		else
+		{
+			pStop = p;
+			while ( pStop < pEnd && !IN_CHARACTERSET( *pBreakSet, *pStop ) && *pStop != '\"' && *pStop > ' ' )
+			{
+				++pStop;
+			}
+		}
+		nTokenLen = pStop - pStart;
+	}
+
+	if ( nTokenLen >= nMaxLen )
+	{
+		if ( nMaxLen > 0 )
+		{
+			memcpy( pTokenBuf, pStart, nMaxLen - 1 );
+			pTokenBuf[nMaxLen - 1] = 0;
+		}
+		nPos = pStart + nMaxLen - pCommand;
+		return nMaxLen;
+	}
+
+	memcpy( pTokenBuf, pStart, nTokenLen );
+	pTokenBuf[nTokenLen] = 0;
+	nPos = pStop - pCommand;
+	return nTokenLen;
+}
+
 bool CCommand::Tokenize( const char *pCommand, characterset_t *pBreakSet )
 {
 	Reset();
@@ -410,14 +567,14 @@ bool CCommand::Tokenize( const char *pCommand, characterset_t *pBreakSet )
 	memcpy( m_pArgSBuffer, pCommand, nLen + 1 );
 
 	// Parse the current command into the current command buffer
-	CUtlBuffer bufParse( m_pArgSBuffer, nLen, CUtlBuffer::TEXT_BUFFER | CUtlBuffer::READ_ONLY ); 
+	int nPos = 0;
 	int nArgvBufferSize = 0;
-	while ( bufParse.IsValid() && ( m_nArgc < COMMAND_MAX_ARGC ) )
+	while ( m_nArgc < COMMAND_MAX_ARGC )
 	{
 		char *pArgvBuf = &m_pArgvBuffer[nArgvBufferSize];
 		int nMaxLen = COMMAND_MAX_LENGTH - nArgvBufferSize;
-		int nStartGet = bufParse.TellGet();
-		int	nSize = bufParse.ParseToken( pBreakSet, pArgvBuf, nMaxLen );
+		int nStartGet = nPos;
+		int	nSize = ParseToken( m_pArgSBuffer, nLen, nPos, pArgvBuf, nMaxLen, pBreakSet );
 		if ( nSize < 0 )
 			break;
 
@@ -431,7 +588,7 @@ bool CCommand::Tokenize( const char *pCommand, characterset_t *pBreakSet )
 		if ( m_nArgc == 1 )
 		{
 			// Deal with the case where the arguments were quoted
-			m_nArgv0Size = bufParse.TellGet();
+			m_nArgv0Size = nPos;
 			bool bFoundEndQuote = m_pArgSBuffer[m_nArgv0Size-1] == '\"';
 			if ( bFoundEndQuote )
 			{
@@ -13,50 +13,97 @@ DECLARE_POINTER_HANDLE( memhandle_t );
 
 #define AUTO_LOCK_DM() AUTO_LOCK_( CDataManagerBase, *this )
 
-CDataManagerBase::CDataManagerBase( unsigned int maxSize )
+CDataManagerBase *CDataManagerBase::s_pFirstManager = NULL;
+
+CDataManagerBase::CDataManagerBase( unsigned int maxSize, const char *pName )
 {
 	m_targetMemorySize = maxSize;
 	m_memUsed = 0;
+	m_protectedMemUsed = 0;
 	m_lruList = m_memoryLists.CreateList();
+	m_probationList = m_memoryLists.CreateList();
 	m_lockList = m_memoryLists.CreateList();
 	m_freeList = m_memoryLists.CreateList();
 	m_listsAreFreed = 0;
+	m_nShard = 0;
+	m_nShardBits = 0;
+	memset( &m_stats, 0, sizeof( m_stats ) );
+
+	m_pName = pName;
+	m_pNextManager = s_pFirstManager;
+	s_pFirstManager = this;
 }
 
 CDataManagerBase::~CDataManagerBase() 
 {
 	Assert( m_listsAreFreed );
+
+	for ( CDataManagerBase **ppManager = &s_pFirstManager; *ppManager; ppManager = &(*ppManager)->m_pNextManager )
+	{
+		if ( *ppManager == this )
+		{
+			*ppManager = m_pNextManager;
+			break;
+		}
+	}
+}
+
+void CDataManagerBase::SetHandleShard( int nShard, int nShardBits )
+{
+	Assert( m_memoryLists.Count( m_lruList ) + m_memoryLists.Count( m_probationList ) + m_memoryLists.Count( m_lockList ) == 0 );
+	Assert( nShard >= 0 && nShard < ( 1 << nShardBits ) );
+	m_nShard = nShard;
+	m_nShardBits = nShardBits;
 }
 
 void CDataManagerBase::NotifySizeChanged( memhandle_t handle, unsigned int oldSize, unsigned int newSize )
 {
 	Lock();
 	m_memUsed += (int)newSize - (int)oldSize;
+
+	unsigned short memoryIndex = FromHandle( handle );
+	if ( memoryIndex != m_memoryLists.InvalidIndex() )
+	{
+		resource_lru_element_t &mem = m_memoryLists[memoryIndex];
+		if ( mem.lockCount == 0 && mem.isProtected )
+		{
+			m_protectedMemUsed += (int)newSize - (int)mem.size;
+		}
+		mem.size = newSize;
+		TrimProtected();
+	}
 	Unlock();
 }
 
 void CDataManagerBase::SetTargetSize( unsigned int targetSize )
 {
+	Lock();
 	m_targetMemorySize = targetSize;
+	TrimProtected();
+	Unlock();
 }
 
 unsigned int CDataManagerBase::FlushAllUnlocked()
 {
 	Lock();
 
-	int nFlush = m_memoryLists.Count( m_lruList );
+	int nFlush = m_memoryLists.Count( m_lruList ) + m_memoryLists.Count( m_probationList );
 	void **pScratch = (void **)_alloca( nFlush * sizeof(void *) );
 	CUtlVector<void *> destroyList( pScratch, nFlush );
 
 	unsigned nBytesInitial = MemUsed_Inline();
 
-	int node = m_memoryLists.Head(m_lruList);
-	while ( node != m_memoryLists.InvalidIndex() )
+	unsigned short lists[2] = { m_probationList, m_lruList };
+	for ( int i = 0; i < 2; i++ )
 	{
-		int next = m_memoryLists.Next(node);
-		m_memoryLists.Unlink( m_lruList, node );
-		destroyList.AddToTail( GetForFreeByIndex( node ) );
-		node = next;
+		int node = m_memoryLists.Head(lists[i]);
+		while ( node != m_memoryLists.InvalidIndex() )
+		{
+			int next = m_memoryLists.Next(node);
+			UnlinkUnlocked( node );
+			destroyList.AddToTail( GetForFreeByIndex( node ) );
+			node = next;
+		}
 	}
 
 	Unlock();
@@ -81,7 +128,7 @@ unsigned int CDataManagerBase::FlushAll()
 {
 	Lock();
 
-	int nFlush = m_memoryLists.Count( m_lruList ) + m_memoryLists.Count( m_lockList );
+	int nFlush = m_memoryLists.Count( m_lruList ) + m_memoryLists.Count( m_probationList ) + m_memoryLists.Count( m_lockList );
 	void **pScratch = (void **)_alloca( nFlush * sizeof(void *) );
 	CUtlVector<void *> destroyList( pScratch, nFlush );
 
@@ -89,13 +136,17 @@ unsigned int CDataManagerBase::FlushAll()
 	int node;
 	int nextNode;
 
-	node = m_memoryLists.Head(m_lruList);
-	while ( node != m_memoryLists.InvalidIndex() )
+	unsigned short lists[2] = { m_probationList, m_lruList };
+	for ( int i = 0; i < 2; i++ )
 	{
-		nextNode = m_memoryLists.Next(node);
-		m_memoryLists.Unlink( m_lruList, node );
-		destroyList.AddToTail( GetForFreeByIndex( node ) );
-		node = nextNode;
+		node = m_memoryLists.Head(lists[i]);
+		while ( node != m_memoryLists.InvalidIndex() )
+		{
+			nextNode = m_memoryLists.Next(node);
+			UnlinkUnlocked( node );
+			destroyList.AddToTail( GetForFreeByIndex( node ) );
+			node = nextNode;
+		}
 	}
 
 	node = m_memoryLists.Head(m_lockList);
@@ -143,7 +194,7 @@ void CDataManagerBase::DestroyResource( memhandle_t handle )
 	Assert( m_memoryLists[index].lockCount == 0  );
 	if ( m_memoryLists[index].lockCount )
 		BreakLock( handle );
-	m_memoryLists.Unlink( m_lruList, index );
+	UnlinkUnlocked( index );
 	void *p = GetForFreeByIndex( index );
 	Unlock();
 
@@ -159,14 +210,18 @@ void *CDataManagerBase::LockResource( memhandle_t handle )
 	{
 		if ( m_memoryLists[memoryIndex].lockCount == 0 )
 		{
-			m_memoryLists.Unlink( m_lruList, memoryIndex );
+			// being used again, so it's protected once it's unlocked
+			UnlinkUnlocked( memoryIndex );
+			m_memoryLists[memoryIndex].isProtected = true;
 			m_memoryLists.LinkToTail( m_lockList, memoryIndex );
 		}
 		Assert(m_memoryLists[memoryIndex].lockCount != (unsigned short)-1);
 		m_memoryLists[memoryIndex].lockCount++;
+		m_stats.hits++;
 		return m_memoryLists[memoryIndex].pStore;
 	}
 
+	m_stats.misses++;
 	return NULL;
 }
 
@@ -183,7 +238,7 @@ int CDataManagerBase::UnlockResource( memhandle_t handle )
 			if ( m_memoryLists[memoryIndex].lockCount == 0 )
 			{
 				m_memoryLists.Unlink( m_lockList, memoryIndex );
-				m_memoryLists.LinkToTail( m_lruList, memoryIndex );
+				LinkUnlocked( memoryIndex );
 			}
 		}
 		return m_memoryLists[memoryIndex].lockCount;
@@ -211,8 +266,10 @@ void *CDataManagerBase::GetResource_NoLock( memhandle_t handle )
 	if ( memoryIndex != m_memoryLists.InvalidIndex() )
 	{
 		TouchByIndex( memoryIndex );
+		m_stats.hits++;
 		return m_memoryLists[memoryIndex].pStore;
 	}
+	m_stats.misses++;
 	return NULL;
 }
 
@@ -230,8 +287,9 @@ void CDataManagerBase::MarkAsStale( memhandle_t handle )
 	{
 		if ( m_memoryLists[memoryIndex].lockCount == 0 )
 		{
-			m_memoryLists.Unlink( m_lruList, memoryIndex );
-			m_memoryLists.LinkToHead( m_lruList, memoryIndex );
+			UnlinkUnlocked( memoryIndex );
+			m_memoryLists[memoryIndex].isProtected = false;
+			m_memoryLists.LinkToHead( m_probationList, memoryIndex );
 		}
 	}
 }
@@ -245,7 +303,7 @@ int CDataManagerBase::BreakLock( memhandle_t handle )
 		int nBroken = m_memoryLists[memoryIndex].lockCount;
 		m_memoryLists[memoryIndex].lockCount = 0;
 		m_memoryLists.Unlink( m_lockList, memoryIndex );
-		m_memoryLists.LinkToTail( m_lruList, memoryIndex );
+		LinkUnlocked( memoryIndex );
 
 		return nBroken;
 	}
@@ -266,7 +324,7 @@ int CDataManagerBase::BreakAllLocks()
 		nextNode = m_memoryLists.Next(node);
 		m_memoryLists[node].lockCount = 0;
 		m_memoryLists.Unlink( m_lockList, node );
-		m_memoryLists.LinkToTail( m_lruList, node );
+		LinkUnlocked( node );
 		node = nextNode;
 	}
 
@@ -278,7 +336,7 @@ unsigned short CDataManagerBase::CreateHandle( bool bCreateLocked )
 {
 	AUTO_LOCK_DM();
 	int memoryIndex = m_memoryLists.Head(m_freeList);
-	unsigned short list = ( bCreateLocked ) ? m_lockList : m_lruList;
+	unsigned short list = ( bCreateLocked ) ? m_lockList : m_probationList;
 	if ( memoryIndex != m_memoryLists.InvalidIndex() )
 	{
 		m_memoryLists.Unlink( m_freeList, memoryIndex );
@@ -288,6 +346,7 @@ unsigned short CDataManagerBase::CreateHandle( bool bCreateLocked )
 	{
 		memoryIndex = m_memoryLists.AddToTail( list );
 	}
+	Assert( memoryIndex < ( 0xFFFF >> m_nShardBits ) );
 
 	if ( bCreateLocked )
 	{
@@ -302,7 +361,9 @@ memhandle_t CDataManagerBase::StoreResourceInHandle( unsigned short memoryIndex,
 	AUTO_LOCK_DM();
 	resource_lru_element_t &mem = m_memoryLists[memoryIndex];
 	mem.pStore = pStore;
+	mem.size = realSize;
 	m_memUsed += realSize;
+	m_stats.creates++;
 	return ToHandle(memoryIndex);
 }
 
@@ -312,17 +373,61 @@ void CDataManagerBase::TouchByIndex( unsigned short memoryIndex )
 	{
 		if ( m_memoryLists[memoryIndex].lockCount == 0 )
 		{
-			m_memoryLists.Unlink( m_lruList, memoryIndex );
-			m_memoryLists.LinkToTail( m_lruList, memoryIndex );
+			UnlinkUnlocked( memoryIndex );
+			m_memoryLists[memoryIndex].isProtected = true;
+			LinkUnlocked( memoryIndex );
 		}
 	}
 }
 
+// put an unlocked resource at the tail of the list it belongs on
+void CDataManagerBase::LinkUnlocked( unsigned short memoryIndex )
+{
+	resource_lru_element_t &mem = m_memoryLists[memoryIndex];
+	if ( mem.isProtected )
+	{
+		m_memoryLists.LinkToTail( m_lruList, memoryIndex );
+		m_protectedMemUsed += mem.size;
+		TrimProtected();
+	}
+	else
+	{
+		m_memoryLists.LinkToTail( m_probationList, memoryIndex );
+	}
+}
+
+void CDataManagerBase::UnlinkUnlocked( unsigned short memoryIndex )
+{
+	resource_lru_element_t &mem = m_memoryLists[memoryIndex];
+	if ( mem.isProtected )
+	{
+		m_memoryLists.Unlink( m_lruList, memoryIndex );
+		m_protectedMemUsed -= mem.size;
+	}
+	else
+	{
+		m_memoryLists.Unlink( m_probationList, memoryIndex );
+	}
+}
+
+// demote the least recently used protected resources until they fit in 3/4 of the target
+void CDataManagerBase::TrimProtected()
+{
+	unsigned int nProtectedTarget = m_targetMemorySize - m_targetMemorySize / 4;
+	while ( m_protectedMemUsed > nProtectedTarget && m_memoryLists.Count( m_lruList ) > 1 )
+	{
+		unsigned short memoryIndex = m_memoryLists.Head( m_lruList );
+		UnlinkUnlocked( memoryIndex );
+		m_memoryLists[memoryIndex].isProtected = false;
+		m_memoryLists.LinkToTail( m_probationList, memoryIndex );
+	}
+}
+
 memhandle_t CDataManagerBase::ToHandle( unsigned short index )
 {
 	unsigned int hiword = m_memoryLists.Element(index).serial;
 	hiword <<= 16;
-	index++;
+	index = ( ( index << m_nShardBits ) | m_nShard ) + 1;
 	return (memhandle_t)( hiword|index );
 }
 
@@ -349,14 +454,21 @@ unsigned int CDataManagerBase::EnsureCapacity( unsigned int size )
 	while ( MemUsed_Inline() > MemTotal_Inline() || MemAvailable_Inline() < size )
 	{
 		Lock();
-		int lruIndex = m_memoryLists.Head( m_lruList );
+		int lruIndex = m_memoryLists.Head( m_probationList );
+		if ( lruIndex == m_memoryLists.InvalidIndex() )
+		{
+			lruIndex = m_memoryLists.Head( m_lruList );
+		}
 		if ( lruIndex == m_memoryLists.InvalidIndex() )
 		{
 			Unlock();
 			break;
 		}
-		m_memoryLists.Unlink( m_lruList, lruIndex );
+		UnlinkUnlocked( lruIndex );
+		unsigned int nUsed = MemUsed_Inline();
 		void *p = GetForFreeByIndex( lruIndex );
+		m_stats.evictions++;
+		m_stats.evictedBytes += nUsed - MemUsed_Inline();
 		Unlock();
 		DestroyResourceStorage( p );
 	}
@@ -381,13 +493,15 @@ void *CDataManagerBase::GetForFreeByIndex( unsigned short memoryIndex )
 		m_memUsed -= size;
 		p = mem.pStore;
 		mem.pStore = NULL;
+		mem.size = 0;
+		mem.isProtected = false;
 		mem.serial++;
 		m_memoryLists.LinkToTail( m_freeList, memoryIndex );
 	}
 	return p;
 }
 
-// get a list of everything in the LRU
+// get a list of everything unlocked, the last to be evicted first
 void CDataManagerBase::GetLRUHandleList( CUtlVector< memhandle_t >& list )
 {
 	for ( int node = m_memoryLists.Tail(m_lruList);
@@ -396,6 +510,13 @@ void CDataManagerBase::GetLRUHandleList( CUtlVector< memhandle_t >& list )
 	{
 		list.AddToTail( ToHandle( node ) );
 	}
+
+	for ( int node = m_memoryLists.Tail(m_probationList);
+			node != m_memoryLists.InvalidIndex();
+			node = m_memoryLists.Previous(node) )
+	{
+		list.AddToTail( ToHandle( node ) );
+	}
 }
 
 // get a list of everything locked
@@ -409,3 +530,19 @@ void CDataManagerBase::GetLockHandleList( CUtlVector< memhandle_t >& list )
 	}
 }
 
+void CDataManagerBase::GetStats( datamanagerstats_t &stats )
+{
+	AUTO_LOCK_DM();
+	stats = m_stats;
+	stats.usedBytes = MemUsed_Inline();
+	stats.targetBytes = MemTotal_Inline();
+	stats.probationCount = m_memoryLists.Count( m_probationList );
+	stats.protectedCount = m_memoryLists.Count( m_lruList );
+	stats.lockedCount = m_memoryLists.Count( m_lockList );
+}
+
+void CDataManagerBase::ResetStats()
+{
+	AUTO_LOCK_DM();
+	memset( &m_stats, 0, sizeof( m_stats ) );
+}
@@ -7,9 +7,19 @@
 
 #include "tier0/platform.h"
 #include "tier0/dbg.h"
+#include "tier0/threadtools.h"
 #include "tier1/diff.h"
+#include "tier1/utlvector.h"
 #include "mathlib/mathlib.h"
 
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ ) )
+#define DIFF_SSE2
+#include <emmintrin.h>
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+#endif
+
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
@@ -22,6 +32,7 @@
 // 100 N ofs(-32768..32767) copy next N, with larger delta offset
 // 00 NNNN(1..65535) ofs(-32768..32767) big copy from old
 // 80 00 NN NN NN big raw copy
+// 00 0000 OOOOOOOO NNNNNNNN far copy of N bytes from absolute offset O (FindDiffsChunked only)
 //
 // available codes (could be used for additonal compression ops)
 // long offset form whose offset could have fit in short offset
@@ -49,6 +60,78 @@ void Fail(char const *msg)
 	Assert(0);
 }
 
+//-----------------------------------------------------------------------------
+// Match length of two byte runs, 16 bytes at a time where SSE2 is available
+//-----------------------------------------------------------------------------
+#ifdef DIFF_SSE2
+static FORCEINLINE int LowestSetBit( unsigned int nMask )
+{
+#ifdef _WIN32
+	unsigned long nBit;
+	_BitScanForward( &nBit, nMask );
+	return (int)nBit;
+#else
+	return __builtin_ctz( nMask );
+#endif
+}
+
+static FORCEINLINE int HighestSetBit( unsigned int nMask )
+{
+#ifdef _WIN32
+	unsigned long nBit;
+	_BitScanReverse( &nBit, nMask );
+	return (int)nBit;
+#else
+	return 31 - __builtin_clz( nMask );
+#endif
+}
+
+// Bit set for every byte that differs
+static FORCEINLINE unsigned int DiffMask16( uint8 const *a, uint8 const *b )
+{
+	__m128i eq = _mm_cmpeq_epi8( _mm_loadu_si128( (__m128i const *)a ), _mm_loadu_si128( (__m128i const *)b ) );
+	return ~_mm_movemask_epi8( eq ) & 0xffff;
+}
+#endif
+
+// Number of equal bytes starting at a and b, at most nMax
+static FORCEINLINE int MatchLength( uint8 const *a, uint8 const *b, int nMax )
+{
+	int i = 0;
+#ifdef DIFF_SSE2
+	for ( ; i + 16 <= nMax; i += 16 )
+	{
+		unsigned int nDiff = DiffMask16( a + i, b + i );
+		if ( nDiff )
+			return i + LowestSetBit( nDiff );
+	}
+#endif
+	while ( i < nMax && a[i] == b[i] )
+	{
+		i++;
+	}
+	return i;
+}
+
+// Number of equal bytes just before a and b, at most nMax
+static FORCEINLINE int MatchLengthBackward( uint8 const *a, uint8 const *b, int nMax )
+{
+	int i = 0;
+#ifdef DIFF_SSE2
+	for ( ; i + 16 <= nMax; i += 16 )
+	{
+		unsigned int nDiff = DiffMask16( a - i - 16, b - i - 16 );
+		if ( nDiff )
+			return i + 15 - HighestSetBit( nDiff );
+	}
+#endif
+	while ( i < nMax && a[-1 - i] == b[-1 - i] )
+	{
+		i++;
+	}
+	return i;
+}
+
 void ApplyDiffs(uint8 const *OldBlock, uint8 const *DiffList,
                 int OldSize, int DiffListSize, int &ResultListSize,uint8 *Output,uint32 OutSize)
 {
@@ -62,6 +145,17 @@ void ApplyDiffs(uint8 const *OldBlock, uint8 const *DiffList,
     if (op==0)
     {
       uint16 copy_sz=DiffList[0]+256*DiffList[1];
+      if (copy_sz==0)
+      {
+        // far copy
+        int far_ofs=DiffList[2]+(DiffList[3]<<8)+(DiffList[4]<<16)+(DiffList[5]<<24);
+        int far_sz=DiffList[6]+(DiffList[7]<<8)+(DiffList[8]<<16)+(DiffList[9]<<24);
+        memcpy(Output,OldBlock+far_ofs,far_sz);
+        Output+=far_sz;
+        copy_src=OldBlock+far_ofs+far_sz;
+        DiffList+=10;
+        continue;
+      }
       int copy_ofs=DiffList[2]+DiffList[3]*256;
       if (copy_ofs>32767)
         copy_ofs|=0xffff0000;
@@ -130,6 +224,101 @@ void ApplyDiffs(uint8 const *OldBlock, uint8 const *DiffList,
   
 }
 
+static FORCEINLINE int ReadDiffInt16( uint8 const *p )
+{
+	int n = p[0] + ( p[1] << 8 );
+	return ( n > 32767 ) ? n - 65536 : n;
+}
+
+static FORCEINLINE int ReadDiffInt32( uint8 const *p )
+{
+	return (int)( p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (uint32)p[3] << 24 ) );
+}
+
+bool ApplyDiffsStreaming( uint8 const *OldBlock, uint8 const *DiffList,
+						  int OldSize, int DiffListSize, DiffWriteFunc_t pfnWrite, void *pContext )
+{
+	uint8 const *pEnd = DiffList + DiffListSize;
+	int nCopySrc = 0;		// end of the last copy in OldBlock, copy offsets are relative to it
+
+	while ( DiffList < pEnd )
+	{
+		int nLeft = pEnd - DiffList;
+		uint8 op = DiffList[0];
+		uint8 const *pData = NULL;
+		int nSize;
+		int nOfs = 0;
+
+		if ( op == 0 )
+		{
+			if ( nLeft < 5 )
+				return false;
+			nSize = DiffList[1] + ( DiffList[2] << 8 );
+			if ( nSize == 0 )
+			{
+				// far copy
+				if ( nLeft < 11 )
+					return false;
+				nOfs = ReadDiffInt32( DiffList + 3 );
+				nSize = ReadDiffInt32( DiffList + 7 );
+				DiffList += 11;
+			}
+			else
+			{
+				nOfs = nCopySrc + ReadDiffInt16( DiffList + 3 );
+				DiffList += 5;
+			}
+		}
+		else if ( !( op & 0x80 ) )
+		{
+			// raw bytes
+			nSize = op;
+			if ( nLeft < nSize + 1 )
+				return false;
+			pData = DiffList + 1;
+			DiffList += nSize + 1;
+		}
+		else if ( op != 0x80 )
+		{
+			if ( nLeft < 2 )
+				return false;
+			nSize = op & 0x7f;
+			nOfs = nCopySrc + (int)DiffList[1] - ( ( DiffList[1] & 0x80 ) ? 256 : 0 );
+			DiffList += 2;
+		}
+		else if ( nLeft >= 4 && DiffList[1] != 0 )
+		{
+			// copy with a long offset
+			nSize = DiffList[1];
+			nOfs = nCopySrc + ReadDiffInt16( DiffList + 2 );
+			DiffList += 4;
+		}
+		else
+		{
+			// big raw copy
+			if ( nLeft < 5 || DiffList[1] != 0 )
+				return false;
+			nSize = DiffList[2] + ( DiffList[3] << 8 ) + ( DiffList[4] << 16 );
+			if ( nLeft - 5 < nSize )
+				return false;
+			pData = DiffList + 5;
+			DiffList += nSize + 5;
+		}
+
+		if ( !pData )
+		{
+			if ( nSize < 0 || nOfs < 0 || nOfs > OldSize || nSize > OldSize - nOfs )
+				return false;
+			pData = OldBlock + nOfs;
+			nCopySrc = nOfs + nSize;
+		}
+
+		if ( nSize && !pfnWrite( pContext, pData, nSize ) )
+			return false;
+	}
+	return true;
+}
+
 static void CopyPending(int len, uint8 const *rawbytes,uint8 * &outbuf, uint8 const *limit)
 {
 //    printf("copy raw len=%d\n",len);
@@ -221,10 +410,7 @@ int FindDiffsForLargeFiles(uint8 const *NewBlock, uint8 const *OldBlock,
         {
           int max_mlength=V_min(65535,OldBlock+OldSize-b->dataptr);
           max_mlength=V_min(max_mlength,NewBlock+NewSize-walk);
-          int i;
-		  for(i=0;i<max_mlength;i++)
-            if (walk[i]!=b->dataptr[i])
-              break;
+          int i=MatchLength(walk,b->dataptr,max_mlength);
           if ((i>MIN_MATCH_LEN) && (i>longest))
           {
             longest=i;
@@ -357,10 +543,7 @@ int FindDiffs(uint8 const *NewBlock, uint8 const *OldBlock,
         {
           int max_mlength=V_min(65535,OldBlock+OldSize-b->dataptr);
           max_mlength=V_min(max_mlength,NewBlock+NewSize-walk);
-          int i;
-		  for(i=0;i<max_mlength;i++)
-            if (walk[i]!=b->dataptr[i])
-              break;
+          int i=MatchLength(walk,b->dataptr,max_mlength);
           if ((i>MIN_MATCH_LEN) && (i>longest))
           {
             longest=i;
@@ -465,13 +648,13 @@ int FindDiffsLowMemory(uint8 const *NewBlock, uint8 const *OldBlock,
     {
       // check for a match
       uint16 hash1=(walk[0]+walk[1]+walk[2]+walk[3]) & (NELEMS(old_data_hash)-1);
-      if (old_data_hash[hash1])
+      // the match has to fit the copy encodings, like in FindDiffs
+      int match_of=old_data_hash[hash1]-lastmatchend;
+      if (old_data_hash[hash1] && (match_of>-32768) && (match_of<32767))
       {
         int max_bytes_to_compare=V_min(NewBlock+NewSize-walk,OldBlock+OldSize-old_data_hash[hash1]);
-        int nmatches;
-		for(nmatches=0;nmatches<max_bytes_to_compare;nmatches++)
-          if (walk[nmatches]!=old_data_hash[hash1][nmatches])
-            break;
+        max_bytes_to_compare=V_min(max_bytes_to_compare,65535);
+        int nmatches=MatchLength(walk,old_data_hash[hash1],max_bytes_to_compare);
         if (nmatches>MIN_MATCH_LEN)
         {
           longest_block=old_data_hash[hash1];
@@ -545,3 +728,392 @@ int FindDiffsLowMemory(uint8 const *NewBlock, uint8 const *OldBlock,
 }
 
 
+//-----------------------------------------------------------------------------
+// FindDiffsChunked
+//
+// A rolling hash of the last 32 bytes picks anchor positions from the data
+// itself, so an edit only moves the anchors around it and the rest of the
+// anchors in the new block line up with the ones in the old block. Only the
+// anchors of the old block are indexed. Each anchor of the new block is looked
+// up in that index, and a hit is extended both ways. Between anchors, the
+// offset of the last match is tried first, which finds most small edits
+// without waiting for the next anchor.
+//
+// The old block is indexed and the new block is scanned in segments on
+// several threads. Each segment yields its own match list. The lists are
+// merged in order, trimming matches that run into the next segment.
+//-----------------------------------------------------------------------------
+#define DIFF_ANCHOR_MASK			0xfc000000		// top 6 bits of the hash clear, one anchor every 64 bytes
+#define DIFF_CHUNK_MIN_MATCH		16
+#define DIFF_MIN_BYTES_PER_THREAD	( 1024 * 1024 )
+#define DIFF_MAX_THREADS			32
+
+struct DiffAnchor_t
+{
+	uint32 m_nHash;
+	int m_nPos;
+};
+
+struct DiffMatch_t
+{
+	int m_nNewPos;
+	int m_nOldPos;
+	int m_nLength;
+};
+
+struct DiffChunkContext_t
+{
+	uint8 const *m_pNew;
+	uint8 const *m_pOld;
+	int m_nNewSize;
+	int m_nOldSize;
+	int *m_pAnchorTable;		// old block position + 1 of an anchor in each slot, 0 if empty
+	int m_nAnchorTableBits;
+	uint32 m_Gear[256];
+};
+
+struct DiffChunkJob_t
+{
+	const DiffChunkContext_t *m_pContext;
+	int m_nStart;
+	int m_nEnd;
+	CUtlVector< DiffAnchor_t > m_Anchors;
+	CUtlVector< DiffMatch_t > m_Matches;
+};
+
+static FORCEINLINE int DiffAnchorSlot( const DiffChunkContext_t *pContext, uint32 nHash )
+{
+	return ( nHash * 0x9E3779B1 ) >> ( 32 - pContext->m_nAnchorTableBits );
+}
+
+// Hash of the bytes before nPos. Only the last 32 of them affect it
+static uint32 DiffRollingHash( const DiffChunkContext_t *pContext, uint8 const *pData, int nPos )
+{
+	uint32 nHash = 0;
+	for ( int i = V_max( nPos - 32, 0 ); i < nPos; i++ )
+	{
+		nHash = ( nHash << 1 ) + pContext->m_Gear[ pData[i] ];
+	}
+	return nHash;
+}
+
+static unsigned FindOldAnchorsThread( void *pParam )
+{
+	DiffChunkJob_t *pJob = (DiffChunkJob_t *)pParam;
+	const DiffChunkContext_t *pContext = pJob->m_pContext;
+	uint8 const *pOld = pContext->m_pOld;
+
+	pJob->m_Anchors.EnsureCapacity( ( pJob->m_nEnd - pJob->m_nStart ) / 48 );
+
+	uint32 nHash = DiffRollingHash( pContext, pOld, pJob->m_nStart );
+	for ( int i = pJob->m_nStart; i < pJob->m_nEnd; i++ )
+	{
+		nHash = ( nHash << 1 ) + pContext->m_Gear[ pOld[i] ];
+		if ( !( nHash & DIFF_ANCHOR_MASK ) )
+		{
+			DiffAnchor_t &anchor = pJob->m_Anchors[ pJob->m_Anchors.AddToTail() ];
+			anchor.m_nHash = nHash;
+			anchor.m_nPos = i;
+		}
+	}
+	return 0;
+}
+
+static unsigned FindNewMatchesThread( void *pParam )
+{
+	DiffChunkJob_t *pJob = (DiffChunkJob_t *)pParam;
+	const DiffChunkContext_t *pContext = pJob->m_pContext;
+	uint8 const *pNew = pContext->m_pNew;
+	uint8 const *pOld = pContext->m_pOld;
+	int nNewSize = pContext->m_nNewSize;
+	int nOldSize = pContext->m_nOldSize;
+
+	int nCovered = pJob->m_nStart;		// matches may not extend backwards past this
+	bool bHaveRepeat = false;
+	int nRepeatDelta = 0;				// old - new position of the last match
+
+	uint32 nHash = DiffRollingHash( pContext, pNew, pJob->m_nStart );
+	int i = pJob->m_nStart;
+	while ( i < pJob->m_nEnd )
+	{
+		int nOldPos = 0;
+		int nBack = 0;
+		int nLength = 0;
+
+		int nRepeatPos = i + nRepeatDelta;
+		if ( bHaveRepeat && nRepeatPos >= 0 && nRepeatPos <= nOldSize - 4 && i <= nNewSize - 4 &&
+			 *(uint32 const *)( pNew + i ) == *(uint32 const *)( pOld + nRepeatPos ) )
+		{
+			nOldPos = nRepeatPos;
+			nLength = MatchLength( pNew + i, pOld + nRepeatPos, V_min( nNewSize - i, nOldSize - nRepeatPos ) );
+		}
+
+		if ( nLength < DIFF_CHUNK_MIN_MATCH )
+		{
+			nLength = 0;
+			nHash = ( nHash << 1 ) + pContext->m_Gear[ pNew[i] ];
+			if ( !( nHash & DIFF_ANCHOR_MASK ) )
+			{
+				int nCandidate = pContext->m_pAnchorTable[ DiffAnchorSlot( pContext, nHash ) ] - 1;
+				if ( nCandidate >= 0 )
+				{
+					nBack = MatchLengthBackward( pNew + i, pOld + nCandidate, V_min( i - nCovered, nCandidate ) );
+					nLength = nBack + MatchLength( pNew + i, pOld + nCandidate, V_min( nNewSize - i, nOldSize - nCandidate ) );
+					nOldPos = nCandidate - nBack;
+				}
+			}
+
+			if ( nLength < DIFF_CHUNK_MIN_MATCH )
+			{
+				i++;
+				continue;
+			}
+		}
+
+		DiffMatch_t &match = pJob->m_Matches[ pJob->m_Matches.AddToTail() ];
+		match.m_nNewPos = i - nBack;
+		match.m_nOldPos = nOldPos;
+		match.m_nLength = nLength;
+
+		bHaveRepeat = true;
+		nRepeatDelta = nOldPos - match.m_nNewPos;
+		i = nCovered = match.m_nNewPos + nLength;
+		nHash = DiffRollingHash( pContext, pNew, i );
+	}
+	return 0;
+}
+
+// Runs a job per segment, the first one on this thread
+static void RunDiffJobs( ThreadFunc_t pfnJob, DiffChunkJob_t *pJobs, int nJobs )
+{
+	ThreadHandle_t hThreads[ DIFF_MAX_THREADS ];
+	for ( int i = 1; i < nJobs; i++ )
+	{
+		hThreads[i] = CreateSimpleThread( pfnJob, &pJobs[i] );
+		if ( !hThreads[i] )
+		{
+			pfnJob( &pJobs[i] );
+		}
+	}
+
+	pfnJob( &pJobs[0] );
+
+	for ( int i = 1; i < nJobs; i++ )
+	{
+		if ( hThreads[i] )
+		{
+			ThreadJoin( hThreads[i] );
+			ReleaseThreadHandle( hThreads[i] );
+		}
+	}
+}
+
+static bool WriteRawBytes( uint8 const *pData, int nLength, uint8 *&pOut, uint8 const *pLimit )
+{
+	while ( nLength > 0 )
+	{
+		int nPiece = V_min( nLength, 0xffffff );
+		if ( nPiece < 128 )
+		{
+			if ( pLimit - pOut < nPiece + 1 )
+				return false;
+			*(pOut++) = nPiece;
+		}
+		else
+		{
+			if ( pLimit - pOut < nPiece + 5 )
+				return false;
+			*(pOut++) = 0x80;
+			*(pOut++) = 0x00;
+			*(pOut++) = ( nPiece & 255 );
+			*(pOut++) = ( ( nPiece >> 8 ) & 255 );
+			*(pOut++) = ( ( nPiece >> 16 ) & 255 );
+		}
+		memcpy( pOut, pData, nPiece );
+		pOut += nPiece;
+		pData += nPiece;
+		nLength -= nPiece;
+	}
+	return true;
+}
+
+static bool WriteCopy( int nOfs, int nOldPos, int nLength, uint8 *&pOut, uint8 const *pLimit )
+{
+	if ( nOfs <= -32768 || nOfs >= 32767 )
+	{
+		// far copy, with the absolute position and length
+		if ( pLimit - pOut < 11 )
+			return false;
+		*(pOut++) = 0x00;
+		*(pOut++) = 0x00;
+		*(pOut++) = 0x00;
+		for ( int i = 0; i < 4; i++ )
+		{
+			*(pOut++) = ( ( nOldPos >> ( i * 8 ) ) & 255 );
+		}
+		for ( int i = 0; i < 4; i++ )
+		{
+			*(pOut++) = ( ( nLength >> ( i * 8 ) ) & 255 );
+		}
+		return true;
+	}
+
+	while ( nLength > 0 )
+	{
+		int nPiece = V_min( nLength, 65535 );
+		if ( nPiece > 127 )
+		{
+			if ( pLimit - pOut < 5 )
+				return false;
+			*(pOut++) = 0x00;
+			*(pOut++) = ( nPiece & 255 );
+			*(pOut++) = ( ( nPiece >> 8 ) & 255 );
+			*(pOut++) = ( nOfs & 255 );
+			*(pOut++) = ( ( nOfs >> 8 ) & 255 );
+		}
+		else if ( nOfs >= -128 && nOfs < 128 )
+		{
+			if ( pLimit - pOut < 2 )
+				return false;
+			*(pOut++) = 128 + nPiece;
+			*(pOut++) = ( nOfs & 255 );
+		}
+		else
+		{
+			if ( pLimit - pOut < 4 )
+				return false;
+			*(pOut++) = 0x80;
+			*(pOut++) = nPiece;
+			*(pOut++) = ( nOfs & 255 );
+			*(pOut++) = ( ( nOfs >> 8 ) & 255 );
+		}
+		// the rest continues right where this piece ends
+		nLength -= nPiece;
+		nOfs = 0;
+	}
+	return true;
+}
+
+int FindDiffsChunked( uint8 const *NewBlock, uint8 const *OldBlock,
+					  int NewSize, int OldSize, int &DiffListSize, uint8 *Output, uint32 OutSize,
+					  int nThreads )
+{
+	DiffChunkContext_t context;
+	context.m_pNew = NewBlock;
+	context.m_pOld = OldBlock;
+	context.m_nNewSize = NewSize;
+	context.m_nOldSize = OldBlock ? OldSize : 0;
+
+	uint32 nSeed = 0x2545F491;
+	for ( int i = 0; i < 256; i++ )
+	{
+		nSeed = nSeed * 1664525 + 1013904223;
+		// a run of byte i settles on a hash of -m_Gear[i], keep that from being an anchor at every byte
+		context.m_Gear[i] = ( ( 0 - nSeed ) & DIFF_ANCHOR_MASK ) ? nSeed : ( nSeed ^ 0x80000000 );
+	}
+
+	if ( nThreads <= 0 )
+	{
+		nThreads = GetCPUInformation()->m_nLogicalProcessors;
+	}
+	nThreads = clamp( nThreads, 1, DIFF_MAX_THREADS );
+	nThreads = V_min( nThreads, V_max( V_max( NewSize, context.m_nOldSize ) / DIFF_MIN_BYTES_PER_THREAD, 1 ) );
+
+	DiffChunkJob_t jobs[ DIFF_MAX_THREADS ];
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		jobs[i].m_pContext = &context;
+		jobs[i].m_nStart = (int)( (int64)context.m_nOldSize * i / nThreads );
+		jobs[i].m_nEnd = (int)( (int64)context.m_nOldSize * ( i + 1 ) / nThreads );
+	}
+	RunDiffJobs( FindOldAnchorsThread, jobs, nThreads );
+
+	// index the anchors, later ones replace earlier ones in the same slot
+	int nAnchors = 0;
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		nAnchors += jobs[i].m_Anchors.Count();
+	}
+	context.m_nAnchorTableBits = 12;
+	while ( context.m_nAnchorTableBits < 30 && ( 1 << context.m_nAnchorTableBits ) < 2 * nAnchors )
+	{
+		context.m_nAnchorTableBits++;
+	}
+	context.m_pAnchorTable = new int[ 1 << context.m_nAnchorTableBits ];
+	memset( context.m_pAnchorTable, 0, sizeof( int ) << context.m_nAnchorTableBits );
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		FOR_EACH_VEC( jobs[i].m_Anchors, j )
+		{
+			const DiffAnchor_t &anchor = jobs[i].m_Anchors[j];
+			context.m_pAnchorTable[ DiffAnchorSlot( &context, anchor.m_nHash ) ] = anchor.m_nPos + 1;
+		}
+		jobs[i].m_Anchors.Purge();
+	}
+
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		jobs[i].m_nStart = (int)( (int64)NewSize * i / nThreads );
+		jobs[i].m_nEnd = (int)( (int64)NewSize * ( i + 1 ) / nThreads );
+	}
+	RunDiffJobs( FindNewMatchesThread, jobs, nThreads );
+
+	delete[] context.m_pAnchorTable;
+
+	// merge the matches of all segments and write them out
+	int ret = ( OldSize != NewSize ) ? 1 : 0;
+	uint8 *outbuf = Output;
+	uint8 const *limit = Output + OutSize;
+	int nDone = 0;			// new block bytes written so far
+	int nLastMatchEnd = 0;
+	bool bFits = true;
+	for ( int i = 0; i < nThreads && bFits; i++ )
+	{
+		FOR_EACH_VEC( jobs[i].m_Matches, j )
+		{
+			DiffMatch_t match = jobs[i].m_Matches[j];
+			if ( match.m_nNewPos < nDone )
+			{
+				// overlaps the last match of the previous segment
+				int nTrim = nDone - match.m_nNewPos;
+				match.m_nNewPos += nTrim;
+				match.m_nOldPos += nTrim;
+				match.m_nLength -= nTrim;
+				if ( match.m_nLength < DIFF_CHUNK_MIN_MATCH )
+					continue;
+			}
+
+			if ( match.m_nNewPos > nDone )
+			{
+				ret = 1;
+				bFits = WriteRawBytes( NewBlock + nDone, match.m_nNewPos - nDone, outbuf, limit );
+			}
+
+			int match_of = match.m_nOldPos - nLastMatchEnd;
+			if ( match_of )
+				ret = 1;
+			if ( !bFits || !WriteCopy( match_of, match.m_nOldPos, match.m_nLength, outbuf, limit ) )
+			{
+				bFits = false;
+				break;
+			}
+
+			nDone = match.m_nNewPos + match.m_nLength;
+			nLastMatchEnd = match.m_nOldPos + match.m_nLength;
+		}
+	}
+
+	if ( bFits && nDone < NewSize )
+	{
+		ret = 1;
+		bFits = WriteRawBytes( NewBlock + nDone, NewSize - nDone, outbuf, limit );
+	}
+
+	if ( !bFits )
+	{
+		DiffListSize = 0;
+		return -1;
+	}
+	DiffListSize = outbuf - Output;
+	return ret;
+}
@@ -10,8 +10,18 @@
 #include "tier0/platform.h"
 #include "generichash.h"
 #include <ctype.h>
+#include <string.h>
 #include "tier0/dbg.h"
 
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ ) )
+#define FASTHASH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined( _WIN32 ) && !defined( _X360 )
+#include <intrin.h>
+#endif
+
 // NOTE: This has to be the last file included!
 #include "tier0/memdbgon.h"
 
@@ -435,3 +445,180 @@ uint64 MurmurHash64( const void * key, int len, uint32 seed )
 	return h;
 }
 
+
+//-----------------------------------------------------------------------------
+// Fast 64 bit hash
+//-----------------------------------------------------------------------------
+static const uint64 g_FastHashSecret[4] =
+{
+	0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+// multiply to 128 bits and fold the halves together
+static FORCEINLINE uint64 FastHashMix( uint64 a, uint64 b )
+{
+#if defined( __GNUC__ ) && defined( __x86_64__ )
+	unsigned __int128 r = (unsigned __int128)a * b;
+	return (uint64)r ^ (uint64)( r >> 64 );
+#elif defined( _M_X64 )
+	unsigned __int64 hi;
+	uint64 lo = _umul128( a, b, &hi );
+	return lo ^ hi;
+#else
+	uint64 ha = a >> 32, hb = b >> 32, la = (uint32)a, lb = (uint32)b;
+	uint64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64 t = rl + ( rm0 << 32 );
+	uint64 c = t < rl;
+	uint64 lo = t + ( rm1 << 32 );
+	c += lo < t;
+	uint64 hi = rh + ( rm0 >> 32 ) + ( rm1 >> 32 ) + c;
+	return lo ^ hi;
+#endif
+}
+
+static FORCEINLINE uint64 FastHashRead64( const uint8 *p )
+{
+	uint64 v;
+	memcpy( &v, p, sizeof( v ) );
+	return LittleQWord( v );
+}
+
+static FORCEINLINE uint64 FastHashStart( uint64 nSeed )
+{
+	return nSeed ^ FastHashMix( nSeed ^ g_FastHashSecret[0], g_FastHashSecret[1] );
+}
+
+static FORCEINLINE uint64 FastHashBlock( uint64 nSeed, const uint8 *pBlock )
+{
+	return FastHashMix( FastHashRead64( pBlock ) ^ g_FastHashSecret[1], FastHashRead64( pBlock + 8 ) ^ nSeed );
+}
+
+// pLast is the final 1-16 bytes of the key, zero padded to 16
+static FORCEINLINE uint64 FastHashFinish( uint64 nSeed, const uint8 *pLast, int nLength )
+{
+	uint64 h = FastHashBlock( nSeed, pLast );
+	return FastHashMix( h ^ g_FastHashSecret[2], (uint64)nLength ^ g_FastHashSecret[3] );
+}
+
+uint64 FastHash64( const void *pKey, int nLength, uint64 nSeed )
+{
+	const uint8 *p = (const uint8 *)pKey;
+	uint64 h = FastHashStart( nSeed );
+
+	int nLeft = nLength;
+	while ( nLeft > 16 )
+	{
+		h = FastHashBlock( h, p );
+		p += 16;
+		nLeft -= 16;
+	}
+
+	uint8 last[16] = { 0 };
+	if ( nLeft > 0 )
+	{
+		memcpy( last, p, nLeft );
+	}
+	return FastHashFinish( h, last, nLength );
+}
+
+//-----------------------------------------------------------------------------
+// Copy the next up to 16 characters of a string into pChunk, zero padded past
+// the terminator, and return how many there were. Lowercases A-Z if bCaseless.
+//-----------------------------------------------------------------------------
+template < bool bCaseless >
+static FORCEINLINE int FastHashLoadChunk( const char *psz, uint8 *pChunk )
+{
+#ifdef FASTHASH_SSE2
+	// only read the full 16 bytes when they can't cross into the next page
+	if ( ( (uintp)psz & 4095 ) <= 4096 - 16 )
+	{
+		__m128i v = _mm_loadu_si128( (const __m128i *)psz );
+		int nZeroMask = _mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_setzero_si128() ) );
+		int n = 16;
+		if ( nZeroMask )
+		{
+#ifdef _WIN32
+			unsigned long nBit;
+			_BitScanForward( &nBit, nZeroMask );
+			n = (int)nBit;
+#else
+			n = __builtin_ctz( nZeroMask );
+#endif
+			const __m128i index = _mm_setr_epi8( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 );
+			v = _mm_and_si128( v, _mm_cmpgt_epi8( _mm_set1_epi8( (char)n ), index ) );
+		}
+
+		if ( bCaseless )
+		{
+			// signed compares are fine, everything >= 0x80 is outside 'A'-'Z' either way
+			__m128i upper = _mm_and_si128( _mm_cmpgt_epi8( v, _mm_set1_epi8( 'A' - 1 ) ), _mm_cmpgt_epi8( _mm_set1_epi8( 'Z' + 1 ), v ) );
+			v = _mm_or_si128( v, _mm_and_si128( upper, _mm_set1_epi8( 0x20 ) ) );
+		}
+
+		_mm_storeu_si128( (__m128i *)pChunk, v );
+		return n;
+	}
+#endif
+
+	int n = 0;
+	for ( ; n < 16 && psz[n]; n++ )
+	{
+		uint8 c = (uint8)psz[n];
+		if ( bCaseless && c >= 'A' && c <= 'Z' )
+		{
+			c |= 0x20;
+		}
+		pChunk[n] = c;
+	}
+	memset( pChunk + n, 0, 16 - n );
+	return n;
+}
+
+// Same as FastHash64() over the string's bytes, but without a strlen pass first.
+// A full chunk is only hashed once the next one shows it isn't the last.
+template < bool bCaseless >
+static uint64 FastHashStringImpl( const char *pszKey, uint64 nSeed )
+{
+	uint64 h = FastHashStart( nSeed );
+
+	uint8 chunks[2][16];
+	uint8 *pPending = chunks[0];
+	uint8 *pNext = chunks[1];
+	memset( pPending, 0, 16 );
+
+	int nLength = 0;
+	bool bHavePending = false;
+	for ( ;; )
+	{
+		int n = FastHashLoadChunk< bCaseless >( pszKey, pNext );
+		if ( n == 0 )
+			break;
+
+		if ( bHavePending )
+		{
+			h = FastHashBlock( h, pPending );
+		}
+
+		uint8 *pTemp = pPending;
+		pPending = pNext;
+		pNext = pTemp;
+		bHavePending = true;
+		nLength += n;
+		pszKey += n;
+
+		if ( n < 16 )
+			break;
+	}
+
+	return FastHashFinish( h, pPending, nLength );
+}
+
+uint64 FastHashString64( const char *pszKey, uint64 nSeed )
+{
+	return FastHashStringImpl< false >( pszKey, nSeed );
+}
+
+uint64 FastHashStringCaseless64( const char *pszKey, uint64 nSeed )
+{
+	return FastHashStringImpl< true >( pszKey, nSeed );
+}
@@ -55,7 +55,11 @@
 #include <utime.h>
 #include <map>
 #include <string>
+#include <vector>
 #include <time.h>
+#ifdef MAIN_TEST
+#include <pthread.h>
+#endif
 
 // Enable to do pathmatch caching. Beware: this code isn't threadsafe.
 // #define DO_PATHMATCH_CACHE
@@ -371,6 +375,328 @@ private:
     char m_c;
 };
 
+// Directory listing cache used by Descend(). Each directory that has to be
+// searched is read once, and its entries are kept along with a hash of their
+// case-folded names, so later lookups only compare the names that can match.
+// A listing is reused for as long as the directory's device, inode and mtime
+// are unchanged. Listings built within a second of the directory's mtime (or
+// before it, when the mtime is in the future) may have missed a change made in
+// the same timestamp tick, so they aren't published: the lookup that built one
+// uses it and frees it.
+//
+// Readers don't take locks: directory entries are only ever pushed onto the
+// front of their bucket, and a listing is never modified once published.
+// Replaced listings are retired, since another thread may still be reading
+// them, and freed the next time no lookup is running.
+// Set PATHMATCH_NO_DIRCACHE to search the directories every time instead.
+
+struct DirCacheName_t
+{
+	uint32_t	nFoldedHash;
+	uint32_t	nNameOffset;	// into CDirListing::m_Names
+};
+
+class CDirListing
+{
+public:
+	dev_t		m_Dev;
+	ino_t		m_Ino;
+	struct timespec m_MTime;
+	std::vector<DirCacheName_t> m_Entries;	// in readdir order
+	std::vector<char> m_Names;
+
+	const char *GetName( size_t i ) const { return &m_Names[ m_Entries[i].nNameOffset ]; }
+
+	CDirListing *m_pNextRetired;
+};
+
+struct DirCacheEntry_t
+{
+	DirCacheEntry_t *m_pNext;
+	uint32_t	m_nPathHash;
+	std::string	m_Path;
+	CDirListing * volatile m_pListing;
+};
+
+static const int k_nDirCacheBuckets = 4096;
+static DirCacheEntry_t * volatile s_DirCacheBuckets[ k_nDirCacheBuckets ];
+static CDirListing * volatile s_pRetiredDirListings;
+static volatile int s_nDirListingReaders;	// lookups that may hold a published listing
+static bool s_bDirCache = ( getenv( "PATHMATCH_NO_DIRCACHE" ) == NULL );
+
+// Loads a pointer published by another thread. x86 doesn't reorder loads with
+// other loads, so only the compiler has to be kept from doing it.
+template < typename T >
+inline __attribute__ ((always_inline)) static T *LoadPublished( T * const volatile *ppValue )
+{
+	T *pValue = *ppValue;
+	__asm__ __volatile__ ( "" ::: "memory" );
+	return pValue;
+}
+
+inline __attribute__ ((always_inline)) static uint32_t HashPathString( const char *str )
+{
+	// FNV-1a
+	uint32_t nHash = 2166136261u;
+	while ( *str )
+	{
+		nHash ^= (uint8_t)*str++;
+		nHash *= 16777619u;
+	}
+	return nHash;
+}
+
+// Hash of a name after case folding, equal for any two names that strcasecmp
+// (ASCII or UTF-8) considers equal.
+inline __attribute__ ((always_inline)) static uint32_t HashFoldedName( const char *str )
+{
+	uint32_t nHash = 2166136261u;
+	while ( *str )
+	{
+		uint32_t fold[3];
+		if ( *str & 0x80 )
+		{
+			locate_case_fold_mapping( utf8codepoint( &str ), fold );
+		}
+		else
+		{
+			const char ch = *str++;
+			fold[0] = (uint32_t) (((ch >= 'A') && (ch <= 'Z')) ? ch + 32 : ch);
+			fold[1] = 0;
+		}
+
+		for ( int i = 0; i < 3 && fold[i]; i++ )
+		{
+			nHash ^= fold[i];
+			nHash *= 16777619u;
+		}
+	}
+	return nHash;
+}
+
+static CDirListing *BuildDirListing( const char *pszDir, const struct stat &dirStat, bool *pbRacy )
+{
+	CDirPtr spDir( __real_opendir( pszDir ) );
+	if ( !spDir )
+		return NULL;
+
+	CDirListing *pListing = new CDirListing;
+	pListing->m_Dev = dirStat.st_dev;
+	pListing->m_Ino = dirStat.st_ino;
+	pListing->m_MTime = dirStat.st_mtim;
+	pListing->m_pNextRetired = NULL;
+
+	struct timespec now;
+	clock_gettime( CLOCK_REALTIME, &now );
+	*pbRacy = ( now.tv_sec - dirStat.st_mtim.tv_sec ) <= 1;
+
+	struct dirent *pEntry;
+	while ( ( pEntry = readdir( spDir ) ) != NULL )
+	{
+		DirCacheName_t name;
+		name.nFoldedHash = HashFoldedName( pEntry->d_name );
+		name.nNameOffset = pListing->m_Names.size();
+		pListing->m_Entries.push_back( name );
+		pListing->m_Names.insert( pListing->m_Names.end(), pEntry->d_name, pEntry->d_name + strlen( pEntry->d_name ) + 1 );
+	}
+
+	return pListing;
+}
+
+// Pushes a chain of listings linked by m_pNextRetired onto the retired list.
+static void RetireDirListings( CDirListing *pFirst )
+{
+	CDirListing *pLast = pFirst;
+	while ( pLast->m_pNextRetired )
+	{
+		pLast = pLast->m_pNextRetired;
+	}
+
+	CDirListing *pRetired;
+	do
+	{
+		pRetired = s_pRetiredDirListings;
+		pLast->m_pNextRetired = pRetired;
+	} while ( !__sync_bool_compare_and_swap( &s_pRetiredDirListings, pRetired, pFirst ) );
+}
+
+// Ends a lookup, and frees the retired listings if no other lookup is running.
+// A listing is retired after it's unpublished, so only lookups that were
+// already running when it was retired can still be reading it.
+static void ReleaseDirListingReader()
+{
+	if ( __sync_sub_and_fetch( &s_nDirListingReaders, 1 ) != 0 || !LoadPublished( &s_pRetiredDirListings ) )
+		return;
+
+	CDirListing *pRetired;
+	do
+	{
+		pRetired = s_pRetiredDirListings;
+	} while ( !__sync_bool_compare_and_swap( &s_pRetiredDirListings, pRetired, (CDirListing *)NULL ) );
+
+	if ( !pRetired )
+		return;
+
+	// Another lookup started in the meantime, it may hold one of them
+	if ( __sync_fetch_and_add( &s_nDirListingReaders, 0 ) != 0 )
+	{
+		RetireDirListings( pRetired );
+		return;
+	}
+
+	while ( pRetired )
+	{
+		CDirListing *pNext = pRetired->m_pNextRetired;
+		delete pRetired;
+		pRetired = pNext;
+	}
+}
+
+// Returns the current listing of the directory, or NULL if it can't be read.
+// *pbOwned is set if the listing isn't in the cache and has to be freed by the
+// caller. The caller has to be counted in s_nDirListingReaders.
+static const CDirListing *GetDirListing( const char *pszDir, bool *pbOwned )
+{
+	*pbOwned = false;
+
+	struct stat dirStat;
+	if ( fstatat( AT_FDCWD, pszDir, &dirStat, 0 ) != 0 || !S_ISDIR( dirStat.st_mode ) )
+		return NULL;
+
+	uint32_t nPathHash = HashPathString( pszDir );
+	DirCacheEntry_t * volatile *ppBucket = &s_DirCacheBuckets[ nPathHash % k_nDirCacheBuckets ];
+
+	DirCacheEntry_t *pFirst = LoadPublished( ppBucket );
+	DirCacheEntry_t *pEntry = pFirst;
+	while ( pEntry && ( pEntry->m_nPathHash != nPathHash || pEntry->m_Path != pszDir ) )
+	{
+		pEntry = pEntry->m_pNext;
+	}
+
+	if ( !pEntry )
+	{
+		DirCacheEntry_t *pNewEntry = new DirCacheEntry_t;
+		pNewEntry->m_nPathHash = nPathHash;
+		pNewEntry->m_Path = pszDir;
+		pNewEntry->m_pListing = NULL;
+
+		// Push onto the bucket, unless another thread adds the same directory first
+		while ( !pEntry )
+		{
+			pNewEntry->m_pNext = pFirst;
+			if ( __sync_bool_compare_and_swap( ppBucket, pFirst, pNewEntry ) )
+			{
+				pEntry = pNewEntry;
+				break;
+			}
+
+			DirCacheEntry_t *pLastFirst = pFirst;
+			pFirst = LoadPublished( ppBucket );
+			for ( DirCacheEntry_t *pTest = pFirst; pTest != pLastFirst; pTest = pTest->m_pNext )
+			{
+				if ( pTest->m_nPathHash == nPathHash && pTest->m_Path == pszDir )
+				{
+					pEntry = pTest;
+					delete pNewEntry;
+					break;
+				}
+			}
+		}
+	}
+
+	CDirListing *pListing = LoadPublished( &pEntry->m_pListing );
+	if ( pListing &&
+		 pListing->m_Dev == dirStat.st_dev && pListing->m_Ino == dirStat.st_ino &&
+		 pListing->m_MTime.tv_sec == dirStat.st_mtim.tv_sec && pListing->m_MTime.tv_nsec == dirStat.st_mtim.tv_nsec )
+	{
+		return pListing;
+	}
+
+	bool bRacy;
+	CDirListing *pNewListing = BuildDirListing( pszDir, dirStat, &bRacy );
+	if ( !pNewListing )
+		return NULL;
+
+	if ( bRacy )
+	{
+		*pbOwned = true;
+		return pNewListing;
+	}
+
+	// If another thread has just replaced the listing too, theirs is as good as ours
+	if ( !__sync_bool_compare_and_swap( &pEntry->m_pListing, pListing, pNewListing ) )
+	{
+		delete pNewListing;
+		return LoadPublished( &pEntry->m_pListing );
+	}
+
+	if ( pListing )
+	{
+		RetireDirListings( pListing );
+	}
+
+	return pNewListing;
+}
+
+// Enumerates the names in a directory that may case-insensitively match a
+// given name, from the listing cache or straight from readdir().
+class CDirEnum
+{
+public:
+	CDirEnum( const char *pszDir, const char *pszName )
+		: m_pListing( NULL ), m_bOwnsListing( false ), m_bCached( s_bDirCache ), m_iEntry( 0 ), m_nFoldedHash( 0 )
+	{
+		if ( m_bCached )
+		{
+			__sync_fetch_and_add( &s_nDirListingReaders, 1 );
+			m_pListing = GetDirListing( pszDir, &m_bOwnsListing );
+			m_nFoldedHash = HashFoldedName( pszName );
+		}
+		else
+		{
+			m_spDir = __real_opendir( pszDir );
+		}
+	}
+
+	~CDirEnum()
+	{
+		if ( m_bOwnsListing )
+		{
+			delete m_pListing;
+		}
+		if ( m_bCached )
+		{
+			ReleaseDirListingReader();
+		}
+	}
+
+	const char *Next()
+	{
+		if ( m_pListing )
+		{
+			while ( m_iEntry < m_pListing->m_Entries.size() )
+			{
+				size_t i = m_iEntry++;
+				if ( m_pListing->m_Entries[i].nFoldedHash == m_nFoldedHash )
+					return m_pListing->GetName( i );
+			}
+			return NULL;
+		}
+
+		struct dirent *pEntry = m_spDir ? readdir( m_spDir ) : NULL;
+		return pEntry ? pEntry->d_name : NULL;
+	}
+
+private:
+	const CDirListing *m_pListing;
+	bool m_bOwnsListing;
+	bool m_bCached;
+	size_t m_iEntry;
+	uint32_t m_nFoldedHash;
+	CDirPtr m_spDir;
+};
+
+
 
 enum PathMod_t
 {
@@ -414,41 +740,42 @@ static bool Descend( char *pPath, size_t nStartIdx, bool bAllowBasenameMismatch,
 	}
 
 	// Start enumerating dirents
-	CDirPtr spDir;
+	size_t nDirIdx = nStartIdx;
+	const char *pDir;
 	if ( nStartIdx )
 	{
 		// we have a path
-		spDir = __real_opendir( CDirTrimmer( pPath, nStartIdx ) );
+		pDir = pPath;
 		nStartIdx++;
 	}
 	else
 	{
 		// we either start at root or cwd
-		const char *pRoot = ".";
+		pDir = ".";
 		if ( *pPath == '/' )
 		{
-		    pRoot = "/";
+		    pDir = "/";
 		    nStartIdx++;
 		}
-		spDir = __real_opendir( pRoot );
 	}
 
     errno = 0;
-    struct dirent *pEntry = spDir ? readdir( spDir ) : NULL;
     char *pszComponent = pPath + nStartIdx;
     size_t cbComponent = nNextSlash - nStartIdx;
-    while ( pEntry )
+    CDirEnum dirEnum( ( pDir == pPath ) ? (const char *)CDirTrimmer( pPath, nDirIdx ) : pDir, CDirTrimmer( pszComponent, cbComponent ) );
+    const char *pszEntry = dirEnum.Next();
+    while ( pszEntry )
     {
-        DEBUG_MSG( "\t(%zu) comparing %s with %s\n", nLevel, pEntry->d_name, (const char *)CDirTrimmer(pszComponent, cbComponent) );
+        DEBUG_MSG( "\t(%zu) comparing %s with %s\n", nLevel, pszEntry, (const char *)CDirTrimmer(pszComponent, cbComponent) );
 
         // the candidate must match the target, but not be a case-identical match (we would
         // have looked there in the short-circuit code above, so don't look again)
-        bool bMatches = ( strcasecmp( CDirTrimmer(pszComponent, cbComponent), pEntry->d_name ) == 0 &&
-                          strcmp( CDirTrimmer(pszComponent, cbComponent), pEntry->d_name ) != 0 );
+        bool bMatches = ( strcasecmp( CDirTrimmer(pszComponent, cbComponent), pszEntry ) == 0 &&
+                          strcmp( CDirTrimmer(pszComponent, cbComponent), pszEntry ) != 0 );
 
         if ( bMatches )
         {
-            char *pSrc = pEntry->d_name;
+            const char *pSrc = pszEntry;
             char *pDst = &pPath[nStartIdx];
             // found a match; copy it in.
             while ( *pSrc && (*pSrc != '/') )
@@ -464,7 +791,7 @@ static bool Descend( char *pPath, size_t nStartIdx, bool bAllowBasenameMismatch,
 
             // If descend fails, try more directories
         }
-        pEntry = readdir( spDir );
+        pszEntry = dirEnum.Next();
     }
 
     if ( bIsDir )
@@ -680,6 +1007,7 @@ private:
 void usage()
 {
     puts("pathmatch [options] <path>");
+    puts("pathmatch -b <trace> [iterations] [threads]");
     //puts("options:");
     //puts("\t");
 
@@ -713,13 +1041,118 @@ void test( const char *pszFile, bool bAllowBasenameMismatch )
     printf(" Path In: %s\n", pszFile );
     printf("Path Out: %s\n",  nStat == kPathUnchanged ? pszFile : pNewPath );
 
-    if ( pNewPath )
+    if ( pNewPath && pNewPath != NewPathBuf )
         free( pNewPath );
 }
 
+// Replays a file access trace (one path per line, for example the paths
+// opened during a map load) through pathmatch(), with and without the
+// directory listing cache.
+struct BenchmarkThread_t
+{
+    const std::vector<std::string> *pTrace;
+    int nIterations;
+    int nChanged;
+    int nFailed;
+};
+
+static void *BenchmarkThread( void *pArg )
+{
+    BenchmarkThread_t *pThread = (BenchmarkThread_t *)pArg;
+    pThread->nChanged = 0;
+    pThread->nFailed = 0;
+
+    for ( int i = 0; i < pThread->nIterations; i++ )
+    {
+        for ( size_t j = 0; j < pThread->pTrace->size(); j++ )
+        {
+            char *pNewPath = NULL;
+            char NewPathBuf[ 512 ];
+            PathMod_t nStat = pathmatch( (*pThread->pTrace)[j].c_str(), &pNewPath, false, NewPathBuf, sizeof( NewPathBuf ) );
+            if ( nStat == kPathChanged )
+                pThread->nChanged++;
+            else if ( nStat == kPathFailed )
+                pThread->nFailed++;
+
+            if ( pNewPath && pNewPath != NewPathBuf )
+                free( pNewPath );
+        }
+    }
+    return NULL;
+}
+
+static double RunBenchmark( const std::vector<std::string> &trace, int nIterations, int nThreads, int *pnChanged, int *pnFailed )
+{
+    std::vector<BenchmarkThread_t> threads( nThreads );
+    std::vector<pthread_t> threadIds( nThreads );
+
+    struct timespec start, end;
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    for ( int i = 0; i < nThreads; i++ )
+    {
+        threads[i].pTrace = &trace;
+        threads[i].nIterations = nIterations;
+        pthread_create( &threadIds[i], NULL, BenchmarkThread, &threads[i] );
+    }
+
+    *pnChanged = *pnFailed = 0;
+    for ( int i = 0; i < nThreads; i++ )
+    {
+        pthread_join( threadIds[i], NULL );
+        *pnChanged += threads[i].nChanged;
+        *pnFailed += threads[i].nFailed;
+    }
+    clock_gettime( CLOCK_MONOTONIC, &end );
+
+    return ( end.tv_sec - start.tv_sec ) * 1000.0 + ( end.tv_nsec - start.tv_nsec ) / 1000000.0;
+}
+
+void benchmark( const char *pszTrace, int nIterations, int nThreads )
+{
+    FILE *fp = fopen( pszTrace, "r" );
+    if ( !fp )
+    {
+        printf( "Couldn't open trace %s\n", pszTrace );
+        exit( -1 );
+    }
+
+    std::vector<std::string> trace;
+    char line[ 1024 ];
+    while ( fgets( line, sizeof( line ), fp ) )
+    {
+        line[ strcspn( line, "\r\n" ) ] = '\0';
+        if ( line[0] )
+            trace.push_back( line );
+    }
+    fclose( fp );
+
+    int nChanged, nFailed;
+    double nLookups = (double)trace.size() * nIterations * nThreads;
+
+    // warm up the kernel's dentry cache, so both runs see the same filesystem state
+    s_bDirCache = false;
+    RunBenchmark( trace, 1, 1, &nChanged, &nFailed );
+
+    for ( int nPass = 0; nPass < 2; nPass++ )
+    {
+        s_bDirCache = ( nPass == 1 );
+        double flMilliseconds = RunBenchmark( trace, nIterations, nThreads, &nChanged, &nFailed );
+        printf( "%-12s %10.3f ms %8.3f us/lookup, %d changed, %d failed\n",
+            s_bDirCache ? "dir cache:" : "readdir:", flMilliseconds, flMilliseconds * 1000.0 / nLookups, nChanged, nFailed );
+    }
+}
+
 int
 main(int argc, char **argv)
 {
+    setenv( "ENABLE_PATHMATCH", "1", 0 );
+
+    if ( argc >= 3 && argc <= 5 && !strcmp( argv[1], "-b" ) )
+    {
+        benchmark( argv[2], ( argc > 3 ) ? atoi( argv[3] ) : 10, ( argc > 4 ) ? atoi( argv[4] ) : 1 );
+        return 0;
+    }
+
     if ( argc <= 1 || argc > 2 )
         usage();
 
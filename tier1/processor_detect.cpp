@@ -12,6 +12,8 @@ bool CheckMMXTechnology(void) { return false; }
 bool CheckSSETechnology(void) { return false; }
 bool CheckSSE2Technology(void) { return false; }
 bool Check3DNowTechnology(void) { return false; }
+bool CheckPCLMULTechnology(void) { return false; }
+bool CheckAVX2Technology(void) { return false; }
 
 #elif defined( _WIN32 ) && !defined( _X360 )
 
@@ -269,6 +271,94 @@ bool Check3DNowTechnology(void)
     return retval;
 }
 
+bool CheckPCLMULTechnology(void)
+{
+    int retval = true;
+    unsigned int RegECX = 0;
+
+#ifdef CPUID
+	_asm pushad;
+#endif
+
+    __try
+	{
+        _asm
+		{
+#ifdef CPUID
+			xor ecx, ecx	// Clue the compiler that ECX is about to be used.
+#endif
+            mov eax, 1      // set up CPUID to return processor version and features
+            CPUID           // code bytes = 0fh,  0a2h
+            mov RegECX, ecx // extended features returned in ecx
+		}
+    } 
+	__except(EXCEPTION_EXECUTE_HANDLER) 
+	{ 
+		retval = false; 
+	}
+
+#ifdef CPUID
+	_asm popad;
+#endif
+
+	// bit 1 is set for PCLMULQDQ
+	return retval && ( RegECX & 0x2 );
+}
+
+bool CheckAVX2Technology(void)
+{
+    int retval = true;
+    unsigned int RegMaxLeaf = 0;
+    unsigned int RegECX = 0;
+    unsigned int RegXCR0 = 0;
+    unsigned int RegEBX7 = 0;
+
+#ifdef CPUID
+	_asm pushad;
+#endif
+
+    __try
+	{
+        _asm
+		{
+            xor eax, eax    // highest standard function supported
+            CPUID
+            mov RegMaxLeaf, eax
+            mov eax, 1      // set up CPUID to return processor version and features
+            CPUID
+            mov RegECX, ecx // extended features returned in ecx
+		}
+    } 
+	__except(EXCEPTION_EXECUTE_HANDLER) 
+	{ 
+		retval = false; 
+	}
+
+	// bit 27 is set for OSXSAVE and bit 28 for AVX. Without OSXSAVE, XGETBV faults.
+	if ( retval && RegMaxLeaf >= 7 && ( RegECX & 0x18000000 ) == 0x18000000 )
+	{
+        _asm
+		{
+            xor ecx, ecx
+            _emit 0x0f      // XGETBV
+            _emit 0x01
+            _emit 0xd0
+            mov RegXCR0, eax
+            mov eax, 7      // structured extended features
+            xor ecx, ecx
+            CPUID
+            mov RegEBX7, ebx
+		}
+	}
+
+#ifdef CPUID
+	_asm popad;
+#endif
+
+	// the OS has to save the XMM and YMM state, and bit 5 of leaf 7 is set for AVX2
+	return retval && ( RegXCR0 & 0x6 ) == 0x6 && ( RegEBX7 & 0x20 );
+}
+
 #pragma optimize( "", on )
 
 #endif // _WIN32
@@ -45,3 +45,36 @@ bool Check3DNowTechnology(void)
     }
     return false;
 }
+
+bool CheckPCLMULTechnology(void)
+{
+    unsigned long eax,ebx,ecx,unused;
+    cpuid(1,eax,ebx,ecx,unused);
+
+    return ecx & 0x2;	// bit 1 is set for PCLMULQDQ
+}
+
+#define cpuid_count(in,sub,a,b,c,d)										\
+	asm("pushl %%ebx\n\t" "cpuid\n\t" "movl %%ebx,%%esi\n\t" "pop %%ebx": "=a" (a), "=S" (b), "=c" (c), "=d" (d) : "a" (in), "c" (sub));
+
+bool CheckAVX2Technology(void)
+{
+    unsigned long eax,ebx,ecx,unused;
+    cpuid(0,eax,unused,unused,unused);
+    if ( eax < 7 )
+        return false;
+
+    // bit 27 is set for OSXSAVE and bit 28 for AVX. Without OSXSAVE, xgetbv faults.
+    cpuid(1,eax,ebx,ecx,unused);
+    if ( ( ecx & 0x18000000 ) != 0x18000000 )
+        return false;
+
+    // the OS has to save the XMM and YMM state
+    unsigned int xcr0, xcr0hi;
+    asm(".byte 0x0f, 0x01, 0xd0" : "=a" (xcr0), "=d" (xcr0hi) : "c" (0));
+    if ( ( xcr0 & 0x6 ) != 0x6 )
+        return false;
+
+    cpuid_count(7,0,eax,ebx,ecx,unused);
+    return ebx & 0x20;	// bit 5 is set for AVX2
+}
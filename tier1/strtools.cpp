@@ -75,6 +75,15 @@
 #if defined( _X360 )
 #include "xbox/xbox_win32stubs.h"
 #endif
+
+#if !defined( _X360 ) && ( defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ ) )
+#define STRTOOLS_SSE2
+#include <emmintrin.h>
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+#endif
+
 #include "tier0/memdbgon.h"
 
 static int FastToLower( char c )
@@ -92,6 +101,132 @@ static int FastToLower( char c )
 	return i;
 }
 
+#ifdef STRTOOLS_SSE2
+//-----------------------------------------------------------------------------
+// SSE2 helpers for the string functions below. Unaligned loads are only done
+// when all 16 bytes are on the same page, so they can never fault past the end
+// of a string; otherwise the string is copied up to its terminator instead.
+//-----------------------------------------------------------------------------
+static FORCEINLINE int LowestSetBit( unsigned int nMask )
+{
+#ifdef _WIN32
+	unsigned long nBit;
+	_BitScanForward( &nBit, nMask );
+	return (int)nBit;
+#else
+	return __builtin_ctz( nMask );
+#endif
+}
+
+static FORCEINLINE int HighestSetBit( unsigned int nMask )
+{
+#ifdef _WIN32
+	unsigned long nBit;
+	_BitScanReverse( &nBit, nMask );
+	return (int)nBit;
+#else
+	return 31 - __builtin_clz( nMask );
+#endif
+}
+
+// Next 16 characters of a string, zero filled after the terminator
+static FORCEINLINE __m128i LoadString16( const unsigned char *p )
+{
+	if ( ( (uintp)p & 4095 ) <= 4096 - 16 )
+		return _mm_loadu_si128( (const __m128i *)p );
+
+	unsigned char buf[16];
+	int i = 0;
+	for ( ; i < 16 && p[i]; i++ )
+	{
+		buf[i] = p[i];
+	}
+	for ( ; i < 16; i++ )
+	{
+		buf[i] = 0;
+	}
+	return _mm_loadu_si128( (const __m128i *)buf );
+}
+
+// ASCII tolower of 16 characters. Bytes >= 0x80 compare as negative so they're left alone.
+static FORCEINLINE __m128i ToLower16( __m128i v )
+{
+	__m128i upper = _mm_and_si128( _mm_cmpgt_epi8( v, _mm_set1_epi8( 'A' - 1 ) ), _mm_cmpgt_epi8( _mm_set1_epi8( 'Z' + 1 ), v ) );
+	return _mm_or_si128( v, _mm_and_si128( upper, _mm_set1_epi8( 0x20 ) ) );
+}
+
+// How many of the next 16 characters are equal ignoring ASCII case, stopping at a terminator
+static FORCEINLINE int StrPrefixCaseless16( const unsigned char *s1, const unsigned char *s2 )
+{
+	__m128i a = LoadString16( s1 );
+	__m128i b = LoadString16( s2 );
+	int nEqual = _mm_movemask_epi8( _mm_cmpeq_epi8( ToLower16( a ), ToLower16( b ) ) );
+	int nZero = _mm_movemask_epi8( _mm_cmpeq_epi8( a, _mm_setzero_si128() ) );
+	int nStop = ( ~nEqual | nZero ) & 0xffff;
+	return nStop ? LowestSetBit( nStop ) : 16;
+}
+
+// First position whose character is c0 and, unless c1 is 0, is followed by c1, ignoring ASCII case.
+// c0 and c1 must be lowercase ASCII. Returns the terminator if there is no such position.
+static const char *FindCaselessPair( const char *pStr, unsigned char c0, unsigned char c1 )
+{
+	const unsigned char *p = (const unsigned char *)pStr;
+	__m128i first = _mm_set1_epi8( (char)c0 );
+	__m128i second = _mm_set1_epi8( (char)c1 );
+	for ( ;; )
+	{
+		__m128i a = LoadString16( p );
+		int nZero = _mm_movemask_epi8( _mm_cmpeq_epi8( a, _mm_setzero_si128() ) );
+		__m128i match = _mm_cmpeq_epi8( ToLower16( a ), first );
+		if ( c1 )
+		{
+			// p + 1 may be past the terminator, but then a already has it and LoadString16 stops there
+			__m128i b = nZero ? _mm_srli_si128( a, 1 ) : LoadString16( p + 1 );
+			match = _mm_and_si128( match, _mm_cmpeq_epi8( ToLower16( b ), second ) );
+		}
+
+		int nStop = _mm_movemask_epi8( match ) | nZero;
+		if ( nStop )
+			return (const char *)p + LowestSetBit( nStop );
+
+		p += 16;
+	}
+}
+
+// Index of the last '.', '/' or '\' in pStr[0..nLast], or -1. Aligned loads never cross a page.
+static int FindLastDotOrSeparator( const char *pStr, int nLast )
+{
+	if ( nLast < 0 )
+		return -1;
+
+	const __m128i dot = _mm_set1_epi8( '.' );
+	const __m128i slash = _mm_set1_epi8( '/' );
+	const __m128i backslash = _mm_set1_epi8( '\\' );
+
+	const char *pBlock = (const char *)( (uintp)( pStr + nLast ) & ~(uintp)15 );
+	unsigned int nKeep = 0xffff >> ( 15 - ( pStr + nLast - pBlock ) );
+	for ( ;; )
+	{
+		if ( pBlock < pStr )
+		{
+			nKeep &= 0xffff << ( pStr - pBlock );
+		}
+
+		__m128i v = _mm_load_si128( (const __m128i *)pBlock );
+		__m128i hit = _mm_or_si128( _mm_cmpeq_epi8( v, dot ), _mm_or_si128( _mm_cmpeq_epi8( v, slash ), _mm_cmpeq_epi8( v, backslash ) ) );
+		unsigned int nHit = _mm_movemask_epi8( hit ) & nKeep;
+		if ( nHit )
+			return (int)( pBlock - pStr ) + HighestSetBit( nHit );
+
+		if ( pBlock <= pStr )
+			return -1;
+
+		pBlock -= 16;
+		nKeep = 0xffff;
+	}
+}
+#endif // STRTOOLS_SSE2
+
 void _V_memset (const char* file, int line, void *dest, int fill, int count)
 {
 	Assert( count >= 0 );
@@ -269,6 +404,18 @@ int V_stricmp( const char *str1, const char *str2 )
 	}
 	const unsigned char *s1 = (const unsigned char*)str1;
 	const unsigned char *s2 = (const unsigned char*)str2;
+#ifdef STRTOOLS_SSE2
+	// skip the part that's equal 16 characters at a time; the loop below
+	// then starts on the terminator or the first difference
+	for ( ;; )
+	{
+		int nSame = StrPrefixCaseless16( s1, s2 );
+		s1 += nSame;
+		s2 += nSame;
+		if ( nSame < 16 )
+			break;
+	}
+#endif
 	for ( ; *s1; ++s1, ++s2 )
 	{
 		if ( *s1 != *s2 )
@@ -294,6 +441,17 @@ int V_strnicmp( const char *str1, const char *str2, int n )
 {
 	const unsigned char *s1 = (const unsigned char*)str1;
 	const unsigned char *s2 = (const unsigned char*)str2;
+#ifdef STRTOOLS_SSE2
+	while ( n >= 16 )
+	{
+		int nSame = StrPrefixCaseless16( s1, s2 );
+		s1 += nSame;
+		s2 += nSame;
+		n -= nSame;
+		if ( nSame < 16 )
+			break;
+	}
+#endif
 	for ( ; n > 0 && *s1; --n, ++s1, ++s2 )
 	{
 		if ( *s1 != *s2 )
@@ -624,9 +782,26 @@ char const* V_stristr( char const* pStr, char const* pSearch )
 
 	char const* pLetter = pStr;
 
+#ifdef STRTOOLS_SSE2
+	// Skip ahead to the first two characters of the search string. Only when they're
+	// ASCII, since FastToLower() may fold other characters by locale.
+	unsigned char c0 = (unsigned char)pSearch[0];
+	unsigned char c1 = c0 ? (unsigned char)pSearch[1] : 0;
+	bool bSkip = c0 && ( ( c0 | c1 ) < 0x80 );
+#endif
+
 	// Check the entire string
 	while (*pLetter != 0)
 	{
+#ifdef STRTOOLS_SSE2
+		if ( bSkip )
+		{
+			pLetter = FindCaselessPair( pLetter, FastToLower( c0 ), FastToLower( c1 ) );
+			if ( *pLetter == 0 )
+				break;
+		}
+#endif
+
 		// Skip over non-matches
 		if (FastToLower((unsigned char)*pLetter) == FastToLower((unsigned char)*pSearch))
 		{
@@ -679,9 +854,27 @@ char const* V_strnistr( char const* pStr, char const* pSearch, int n )
 
 	char const* pLetter = pStr;
 
+#ifdef STRTOOLS_SSE2
+	// Skip ahead to the first two characters of the search string, as in V_stristr
+	unsigned char c0 = (unsigned char)pSearch[0];
+	unsigned char c1 = c0 ? (unsigned char)pSearch[1] : 0;
+	bool bSkip = c0 && ( ( c0 | c1 ) < 0x80 );
+#endif
+
 	// Check the entire string
 	while (*pLetter != 0)
 	{
+#ifdef STRTOOLS_SSE2
+		if ( bSkip && n > 0 )
+		{
+			char const* pNext = FindCaselessPair( pLetter, FastToLower( c0 ), FastToLower( c1 ) );
+			n -= (int)( pNext - pLetter );
+			pLetter = pNext;
+			if ( *pLetter == 0 )
+				break;
+		}
+#endif
+
 		if ( n <= 0 )
 			return 0;
 
@@ -1677,10 +1870,14 @@ void V_FileBase( const char *in, char *out, int maxlen )
 	
 	// scan backward for '.'
 	end = len - 1;
+#ifdef STRTOOLS_SSE2
+	end = MAX( FindLastDotOrSeparator( in, end ), 0 );
+#else
 	while ( end&& in[end] != '.' && !PATHSEPARATOR( in[end] ) )
 	{
 		end--;
 	}
+#endif
 	
 	if ( in[end] != '.' )		// no '.', copy to end
 	{
@@ -1747,10 +1944,17 @@ void V_StripExtension( const char *in, char *out, int outSize )
 
 	// scan backward for '.'
 	int end = V_strlen( in ) - 1;
+#ifdef STRTOOLS_SSE2
+	if ( end > 0 )
+	{
+		end = MAX( FindLastDotOrSeparator( in, end ), 0 );
+	}
+#else
 	while ( end > 0 && in[end] != '.' && !PATHSEPARATOR( in[end] ) )
 	{
 		--end;
 	}
+#endif
 
 	if (end > 0 && !PATHSEPARATOR( in[end] ) && end < outSize)
 	{
@@ -1864,6 +2068,38 @@ void  V_StripFilename (char *path)
 //-----------------------------------------------------------------------------
 void V_FixSlashes( char *pname, char separator /* = CORRECT_PATH_SEPARATOR */ )
 {
+#ifdef STRTOOLS_SSE2
+	// once aligned, do 16 characters at a time until the block with the terminator
+	while ( ( (uintp)pname & 15 ) && *pname )
+	{
+		if ( *pname == INCORRECT_PATH_SEPARATOR || *pname == CORRECT_PATH_SEPARATOR )
+		{
+			*pname = separator;
+		}
+		pname++;
+	}
+
+	if ( *pname )
+	{
+		const __m128i slash = _mm_set1_epi8( '/' );
+		const __m128i backslash = _mm_set1_epi8( '\\' );
+		const __m128i replacement = _mm_set1_epi8( separator );
+		for ( ;; )
+		{
+			__m128i v = _mm_load_si128( (const __m128i *)pname );
+			if ( _mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_setzero_si128() ) ) )
+				break;
+
+			__m128i hit = _mm_or_si128( _mm_cmpeq_epi8( v, slash ), _mm_cmpeq_epi8( v, backslash ) );
+			if ( _mm_movemask_epi8( hit ) )
+			{
+				_mm_store_si128( (__m128i *)pname, _mm_or_si128( _mm_andnot_si128( hit, v ), _mm_and_si128( hit, replacement ) ) );
+			}
+			pname += 16;
+		}
+	}
+#endif
+
 	while ( *pname )
 	{
 		if ( *pname == INCORRECT_PATH_SEPARATOR || *pname == CORRECT_PATH_SEPARATOR )
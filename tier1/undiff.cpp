@@ -25,6 +25,17 @@ void ApplyDiffs(uint8 const *OldBlock, uint8 const *DiffList,
     if (op==0)
     {
       uint16 copy_sz=DiffList[0]+256*DiffList[1];
+      if (copy_sz==0)
+      {
+        // far copy
+        int far_ofs=DiffList[2]+(DiffList[3]<<8)+(DiffList[4]<<16)+(DiffList[5]<<24);
+        int far_sz=DiffList[6]+(DiffList[7]<<8)+(DiffList[8]<<16)+(DiffList[9]<<24);
+        memcpy(Output,OldBlock+far_ofs,far_sz);
+        Output+=far_sz;
+        copy_src=OldBlock+far_ofs+far_sz;
+        DiffList+=10;
+        continue;
+      }
       int copy_ofs=DiffList[2]+DiffList[3]*256;
       if (copy_ofs>32767)
         copy_ofs|=0xffff0000;
@@ -716,16 +716,23 @@ CUtlString CUtlString::PathJoin( const char *pStr1, const char *pStr2 )
 
 CUtlString CUtlString::operator+( const char *pOther ) const
 {
-	CUtlString s = *this;
-	s += pOther;
+	// allocate the result once rather than copying and then growing it
+	const int lhsLength( Length() );
+	const int rhsLength( pOther ? V_strlen( pOther ) : 0 );
+
+	CUtlString s;
+	if ( lhsLength + rhsLength )
+	{
+		s.AllocMemory( lhsLength + rhsLength );
+		Q_memcpy( s.m_pString, Get(), lhsLength );
+		Q_memcpy( s.m_pString + lhsLength, pOther, rhsLength );
+	}
 	return s;
 }
 
 CUtlString CUtlString::operator+( const CUtlString &other ) const
 {
-	CUtlString s = *this;
-	s += other;
-	return s;
+	return operator+( other.Get() );
 }
 
 CUtlString CUtlString::operator+( int rhs ) const
@@ -765,3 +772,204 @@ const CUtlString &CUtlString::GetEmptyString()
 
 	return s_emptyString;
 }
+
+//-----------------------------------------------------------------------------
+// CUtlStringBuilder
+//-----------------------------------------------------------------------------
+
+#if !defined( va_copy )
+// va_list is a plain pointer on the compilers without va_copy
+#define va_copy( dest, src ) ( ( dest ) = ( src ) )
+#endif
+
+void CUtlStringBuilder::SetLengthInternal( int nLength )
+{
+	Assert( nLength >= 0 && nLength <= Capacity() );
+	if ( IsHeap() )
+	{
+		m_Heap.m_nLength = nLength;
+		m_Heap.m_pString[ nLength ] = 0;
+	}
+	else
+	{
+		m_szInline[ nLength ] = 0;
+		m_szInline[ INLINE_CAPACITY ] = (char)( INLINE_CAPACITY - nLength );
+	}
+}
+
+void CUtlStringBuilder::EnsureCapacity( int nChars )
+{
+	int nCapacity = Capacity();
+	if ( nChars <= nCapacity )
+		return;
+
+	// grow geometrically so repeated appends stay linear
+	int nNewCapacity = MAX( nChars, nCapacity * 2 );
+	if ( IsHeap() )
+	{
+		m_Heap.m_pString = (char *)realloc( m_Heap.m_pString, nNewCapacity + 1 );
+		m_Heap.m_nCapacity = nNewCapacity;
+	}
+	else
+	{
+		int nLength = Length();
+		char *pString = (char *)malloc( nNewCapacity + 1 );
+		memcpy( pString, m_szInline, nLength + 1 );
+
+		m_Heap.m_pString = pString;
+		m_Heap.m_nLength = nLength;
+		m_Heap.m_nCapacity = nNewCapacity;
+		m_szInline[ INLINE_CAPACITY ] = (char)HEAP_MARKER;
+	}
+}
+
+void CUtlStringBuilder::Set( const char *pString )
+{
+	SetDirect( pString, pString ? V_strlen( pString ) : 0 );
+}
+
+void CUtlStringBuilder::SetDirect( const char *pString, int nChars )
+{
+	const char *pBase = Get();
+	int nLength = Length();
+	if ( pString && pString >= pBase && pString <= pBase + nLength )
+	{
+		// setting to part of ourselves
+		int nOffset = (int)( pString - pBase );
+		int nNewLength = Min( nChars, nLength - nOffset );
+		memmove( Base(), pString, nNewLength );
+		SetLengthInternal( nNewLength );
+		return;
+	}
+
+	SetLengthInternal( 0 );
+	Append( pString, nChars );
+}
+
+void CUtlStringBuilder::Append( const char *pAddition )
+{
+	Append( pAddition, INT_MAX );
+}
+
+void CUtlStringBuilder::Append( const char *pAddition, int nChars )
+{
+	if ( !pAddition )
+		return;
+
+	int nAddition = 0;
+	while ( nAddition < nChars && pAddition[ nAddition ] )
+	{
+		nAddition++;
+	}
+	if ( !nAddition )
+		return;
+
+	// the addition may be part of this string, which growing can move
+	int nLength = Length();
+	const char *pBase = Get();
+	int nSelfOffset = ( pAddition >= pBase && pAddition <= pBase + nLength ) ? (int)( pAddition - pBase ) : -1;
+
+	EnsureCapacity( nLength + nAddition );
+	if ( nSelfOffset >= 0 )
+	{
+		pAddition = Get() + nSelfOffset;
+	}
+
+	memmove( Base() + nLength, pAddition, nAddition );
+	SetLengthInternal( nLength + nAddition );
+}
+
+void CUtlStringBuilder::Append( char c )
+{
+	if ( !c )
+		return;
+
+	int nLength = Length();
+	EnsureCapacity( nLength + 1 );
+	Base()[ nLength ] = c;
+	SetLengthInternal( nLength + 1 );
+}
+
+int CUtlStringBuilder::Format( const char *pFormat, ... )
+{
+	va_list marker;
+
+	va_start( marker, pFormat );
+	int len = FormatV( pFormat, marker );
+	va_end( marker );
+
+	return len;
+}
+
+int CUtlStringBuilder::FormatV( const char *pFormat, va_list marker )
+{
+	SetLengthInternal( 0 );
+	return AppendFormatV( pFormat, marker );
+}
+
+int CUtlStringBuilder::AppendFormat( const char *pFormat, ... )
+{
+	va_list marker;
+
+	va_start( marker, pFormat );
+	int len = AppendFormatV( pFormat, marker );
+	va_end( marker );
+
+	return len;
+}
+
+int CUtlStringBuilder::AppendFormatV( const char *pFormat, va_list marker )
+{
+	int nLength = Length();
+	for ( ;; )
+	{
+		// format into whatever space is left, and grow and retry if that wasn't enough
+		int nSpace = Capacity() - nLength + 1;
+		bool bTruncated = false;
+
+		va_list args;
+		va_copy( args, marker );
+		int len = V_vsnprintfRet( Base() + nLength, nSpace, pFormat, args, &bTruncated );
+		va_end( args );
+
+		if ( !bTruncated )
+		{
+			SetLengthInternal( nLength + len );
+			return len;
+		}
+
+		if ( Capacity() >= 64 * 1024 * 1024 )
+		{
+			AssertMsg( false, "CUtlStringBuilder::AppendFormatV: formatted string is too long" );
+			SetLengthInternal( Capacity() );
+			return Capacity() - nLength;
+		}
+
+		EnsureCapacity( Capacity() * 2 );
+	}
+}
+
+void CUtlStringBuilder::ToLower()
+{
+	V_strlower( Base() );
+}
+
+void CUtlStringBuilder::ToUpper()
+{
+	V_strupr( Base() );
+}
+
+void CUtlStringBuilder::Clear()
+{
+	SetLengthInternal( 0 );
+}
+
+void CUtlStringBuilder::Purge()
+{
+	if ( IsHeap() )
+	{
+		free( m_Heap.m_pString );
+	}
+	m_szInline[ 0 ] = 0;
+	m_szInline[ INLINE_CAPACITY ] = INLINE_CAPACITY;
+}